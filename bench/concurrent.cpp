@@ -0,0 +1,175 @@
+// Measures how reads of one table in concurrent mode scale with threads,
+// with and without a thread writing at the same time.
+//
+// USAGE: concurrent <table file> [seconds per run] [max readers]
+// Table is read from file and never written back. Generate one with
+// scripts/make_db.py.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "toiletdb.hpp"
+
+using namespace toiletdb;
+
+struct Run
+{
+    double reads;
+    double writes;
+};
+
+// Looks rows up by ID and reads them through RowView, with a range search
+// every so often. Returns reads done until 'stop' is set.
+static size_t read_rows(const InMemoryTable &table, const std::vector<size_t> &ids,
+                        unsigned seed, const std::atomic<bool> &stop)
+{
+    std::minstd_rand random(seed);
+    size_t reads = 0;
+    size_t sum   = 0;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        size_t id = ids[random() % ids.size()];
+
+        if (reads % 64 == 0) {
+            sum += table.count_range(id, id + 1000);
+        }
+        else {
+            size_t pos = table.search(id);
+
+            // Row could have been erased since the search.
+            try {
+                RowView row = table.get_row_view(pos);
+
+                sum += row.get<size_t>(4) + row.get<std::string_view>(1).size();
+            }
+            catch (const std::logic_error &) {
+            }
+        }
+
+        ++reads;
+    }
+
+    // Keeps reads from being optimized away.
+    if (sum == 1) {
+        std::puts("");
+    }
+
+    return reads;
+}
+
+// Adds a row, edits one and erases the added one, until 'stop' is set.
+// Returns rounds done.
+static size_t write_rows(InMemoryTable &table, const std::atomic<bool> &stop)
+{
+    std::minstd_rand random(1);
+    size_t rounds = 0;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        table.emplace_row("Bench", "Mark", "Writers", static_cast<size_t>(rounds));
+        table.get_row_ref(random() % table.get_row_count()).set(4, static_cast<size_t>(rounds));
+        table.erase(table.get_row_count() - 1);
+
+        ++rounds;
+    }
+
+    return rounds;
+}
+
+static Run run(InMemoryTable &table, const std::vector<size_t> &ids, size_t readers,
+               bool writer, double seconds)
+{
+    std::atomic<bool> stop(false);
+    std::vector<size_t> reads(readers, 0);
+    std::vector<std::thread> threads;
+    size_t writes = 0;
+
+    for (size_t i = 0; i < readers; ++i) {
+        threads.emplace_back([&, i]() { reads[i] = read_rows(table, ids, i + 1, stop); });
+    }
+
+    if (writer) {
+        threads.emplace_back([&]() { writes = write_rows(table, stop); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    size_t total = 0;
+
+    for (size_t count : reads) {
+        total += count;
+    }
+
+    return {total / seconds, writes / seconds};
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "USAGE: %s <table file> [seconds per run] [max readers]\n", argv[0]);
+        return 1;
+    }
+
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+    size_t cores   = std::thread::hardware_concurrency();
+    size_t max     = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : (cores ? cores : 4);
+
+    try {
+        InMemoryTable table(argv[1]);
+
+        table.set_concurrent(true);
+        // Scans stay on the calling thread, so threads measured are the
+        // only ones reading.
+        table.set_thread_count(1);
+
+        if (table.get_row_count() == 0) {
+            std::fprintf(stderr, "Table '%s' has no rows\n", argv[1]);
+            return 1;
+        }
+
+        std::vector<size_t> ids;
+
+        for (size_t pos = 0; pos < table.get_row_count(); ++pos) {
+            ids.push_back(table.get_row_view(pos).get<size_t>(0));
+        }
+
+        std::printf("%zu rows, %zu cores, %.1f s per run\n\n", table.get_row_count(), cores,
+                    seconds);
+        std::printf("%8s %16s %9s %16s %9s %10s\n", "readers", "reads/s", "scaling",
+                    "reads/s +writer", "scaling", "writes/s");
+
+        double first      = 0;
+        double first_busy = 0;
+
+        for (size_t readers = 1; readers <= max; readers *= 2) {
+            Run idle = run(table, ids, readers, false, seconds);
+            Run busy = run(table, ids, readers, true, seconds);
+
+            if (readers == 1) {
+                first      = idle.reads;
+                first_busy = busy.reads;
+            }
+
+            std::printf("%8zu %16.0f %8.2fx %16.0f %8.2fx %10.0f\n", readers, idle.reads,
+                        idle.reads / first, busy.reads, busy.reads / first_busy, busy.writes);
+        }
+    }
+    catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
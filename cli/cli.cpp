@@ -8,6 +8,9 @@ using namespace toiletdb;
 
 #define CLI_MARGIN 4
 
+// Output of rows is written to stdout once this many bytes are gathered.
+#define CLI_OUTPUT_BUFFER (1 << 20)
+
 enum CLI_COMMAND_KIND
 {
     UNKNOWN = 0,
@@ -19,6 +22,11 @@ enum CLI_COMMAND_KIND
     LIST,
     LIST_TYPES,
     DBSIZE,
+    AGGREGATE,
+    GROUP,
+    SELECT,
+    EXPLAIN,
+    JOIN,
     ADD,
     REMOVE,
     EDIT,
@@ -26,6 +34,9 @@ enum CLI_COMMAND_KIND
     COMMITAS,
     COMMIT,
     REVERT,
+    BEGIN,
+    ROLLBACK,
+    AUTOSAVE,
 };
 
 // Extracts filename from file path.
@@ -52,6 +63,107 @@ static std::string cli_concat_args(std::vector<std::string> &args, size_t pos)
     return result;
 }
 
+// Parses comparison operator for 'search' and 'agg ... where'.
+static bool cli_parse_compare(const std::string &s, ToiletCompare &op)
+{
+    if (s == "=" || s == "==") {
+        op = TC_EQ;
+    }
+    else if (s == "!=") {
+        op = TC_NE;
+    }
+    else if (s == "<") {
+        op = TC_LT;
+    }
+    else if (s == "<=") {
+        op = TC_LE;
+    }
+    else if (s == ">") {
+        op = TC_GT;
+    }
+    else if (s == ">=") {
+        op = TC_GE;
+    }
+    else if (s == "between") {
+        op = TC_BETWEEN;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+// Selects rows of column with filter(). Values are parsed according to the
+// column type, and 'str' values are compared as they are, the way queries
+// compare them. Returns false if numbers can't be parsed.
+static bool cli_filter(InMemoryTable &model, size_t column_pos, ToiletCompare op,
+                       const std::string &a, const std::string &b,
+                       Selection &result)
+{
+    const std::string &name = model.get_column_name(column_pos);
+    int type                = TDB_TYPE(model.get_column_type(column_pos));
+
+    if (type == TT_STR) {
+        result = model.filter(name, op, std::string_view(a), std::string_view(b));
+    }
+    else if (type == TT_INT) {
+        int x = parse_int(a);
+        int y = op == TC_BETWEEN ? parse_int(b) : 0;
+
+        if (x == TDB_INVALID_I || y == TDB_INVALID_I) {
+            return false;
+        }
+
+        result = model.filter(name, op, x, y);
+    }
+    else {
+        size_t x = parse_long_long(a);
+        size_t y = op == TC_BETWEEN ? parse_long_long(b) : 0;
+
+        if (x == TDB_INVALID_ULL || y == TDB_INVALID_ULL) {
+            return false;
+        }
+
+        result = model.filter(name, op, x, y);
+    }
+
+    return true;
+}
+
+// Selects rows of column by '[op] <value>' or 'between <min> <max>' found
+// at args[pos]. Prints an error and returns false if they are invalid.
+static bool cli_select(InMemoryTable &model, size_t column_pos,
+                       std::vector<std::string> &args, size_t pos,
+                       Selection &result)
+{
+    ToiletCompare op = TC_EQ;
+
+    if (args.size() > pos + 1 && cli_parse_compare(args[pos], op)) {
+        ++pos;
+    }
+
+    size_t expected = pos + (op == TC_BETWEEN ? 2 : 1);
+
+    if (args.size() != expected) {
+        std::cout << "ERROR: Expected "
+                  << (op == TC_BETWEEN ? "two values" : "one value")
+                  << " for field '" << model.get_column_name(column_pos) << "'."
+                  << std::endl;
+        return false;
+    }
+
+    if (!cli_filter(model, column_pos, op, args[pos],
+                    op == TC_BETWEEN ? args[pos + 1] : "", result)) {
+        std::cout << "ERROR: Value is not a valid '"
+                  << (TDB_TYPE(model.get_column_type(column_pos)) == TT_INT ? "int" : "uint")
+                  << "'." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 // Splits strings by spaces, treats "quoted sentences" as a single argument.
 // Supports escaping, i. e. "Gorlock \"The Destroyer\""
 static std::vector<std::string> cli_split_args(const std::string &s)
@@ -163,271 +275,304 @@ static char cli_forbiddenchar(std::string &arg)
     return 0;
 }
 
-// Puts modifiers first, then names of columns.
-static void cli_put_table_header(InMemoryTable &model)
+// Positions of every column of the table.
+static std::vector<size_t> cli_all_columns(const InMemoryTable &model)
 {
-    std::vector<std::string> names = model.get_column_names();
-    std::vector<int> types         = model.get_types();
-
-    size_t len = names.size();
-
-    std::stringstream modifier;
-    std::stringstream type;
-    std::stringstream name;
-
-    size_t padding = 0;
-
-    for (size_t i = 0; i < len; ++i) {
-        if (types[i] & TT_INT) {
-            padding = CLI_INTW;
-            name << std::left << std::setw(CLI_INTW) << names[i];
-        }
-
-        else if (types[i] & TT_UINT) {
-            padding = CLI_B_INTW;
-            name << std::left << std::setw(CLI_B_INTW) << names[i];
-        }
-
-        else if (types[i] & TT_STR) {
-            padding = CLI_STRW;
-            name << std::left << std::setw(CLI_STRW) << names[i];
-        }
-
-        // Output modifiers
+    std::vector<size_t> columns(model.get_column_count());
+    std::iota(columns.begin(), columns.end(), 0);
 
-        std::string temp;
+    return columns;
+}
 
-        if (types[i] & TT_ID) {
-            temp += "[id]";
-        }
+// Amount of characters in UTF-8 string, which is how wide it is on screen.
+static size_t cli_display_width(std::string_view s)
+{
+    size_t continuation = 0;
 
-        if (types[i] & TT_CONST) {
-            temp += "[const]";
-        }
+    for (char c : s) {
+        continuation += (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
 
-        modifier << std::left << std::setw(padding)
-                 << (temp.empty() ? " " : temp);
+    return s.size() - continuation;
+}
 
-        temp.clear();
+// Length in bytes of first 'chars' characters of UTF-8 string.
+static size_t cli_utf8_prefix(std::string_view s, size_t chars)
+{
+    size_t pos = 0;
 
-        // Output types
+    while (pos < s.size() && chars > 0) {
+        ++pos;
 
-        if (types[i] & TT_INT) {
-            temp = "[int]";
+        while (pos < s.size() && (static_cast<unsigned char>(s[pos]) & 0xC0) == 0x80) {
+            ++pos;
         }
 
-        else if (types[i] & TT_UINT) {
-            temp = "[uint]";
-        }
+        --chars;
+    }
 
-        else if (types[i] & TT_STR) {
-            temp = "[str]";
-        }
+    return pos;
+}
 
-        type << std::left << std::setw(padding) << temp;
+// Width of cells of column of this type.
+static size_t cli_cell_width(int type)
+{
+    switch (TDB_TYPE(type)) {
+        case TT_INT:
+            return CLI_INTW;
+        case TT_UINT:
+            return CLI_B_INTW;
+        default:
+            return CLI_STRW;
     }
-
-    std::cout << modifier.str() << "\n";
-    std::cout << type.str() << "\n";
-    std::cout << name.str() << "\n";
 }
 
-// Prints out a row.
-// Wraps words by breaking them to the next line
-// if they exceed column width.
-static void cli_put_row(InMemoryTable &model, const size_t &pos)
+// Text is gathered here and written to stdout in large pieces, when buffer
+// fills up and when output is done.
+class CliOutput
 {
-    std::stringstream wrap_buf;
+private:
+    std::string buffer;
 
-    bool should_wrap = false;
+public:
+    CliOutput()
+    {
+        this->buffer.reserve(CLI_OUTPUT_BUFFER + CLI_OUTPUT_BUFFER / 4);
+    }
 
-    size_t line = 1;
+    ~CliOutput()
+    {
+        this->flush();
+        std::fflush(stdout);
+    }
 
-    std::vector<int> types  = model.get_types();
-    std::vector<void *> row = model.unsafe_get_mut_row(pos);
+    void put(std::string_view text)
+    {
+        this->buffer.append(text);
+    }
 
-    size_t len = types.size();
+    void put(char c)
+    {
+        this->buffer.push_back(c);
+    }
 
-    for (size_t i = 0; i < len; ++i) {
-        switch (TDB_TYPE(types[i])) {
-            case TT_INT: {
-                // Int should always fit.
-                continue;
-            } break;
-
-            case TT_UINT: {
-                if (TDB_CAST(size_t, row[i]) >= 100000000000) {
-                    should_wrap = true;
-                    break;
-                }
-            } break;
+    // Puts text that is 'width' characters wide, and pads it with spaces to
+    // 'cell' characters. Text wider than that is not cut.
+    void put_cell(std::string_view text, size_t width, size_t cell)
+    {
+        this->buffer.append(text);
 
-            case TT_STR: {
-                if (tl_utf8_strlen(TDB_CAST(std::string, row[i]).c_str()) > CLI_STRW - CLI_MARGIN) {
-                    should_wrap = true;
-                    break;
-                }
-            } break;
+        if (width < cell) {
+            this->buffer.append(cell - width, ' ');
+        }
+    }
 
-            default:
-                std::logic_error("Unreachable");
+    // Should be called after every line, so buffer is written once it's full.
+    void line_done()
+    {
+        if (this->buffer.size() >= CLI_OUTPUT_BUFFER) {
+            this->flush();
         }
     }
 
-    if (!should_wrap) {
-        for (size_t i = 0; i < len; ++i) {
-            switch (types[i] & TDB_TMASK) {
+    void flush()
+    {
+        std::fwrite(this->buffer.data(), 1, this->buffer.size(), stdout);
+        this->buffer.clear();
+    }
+};
+
+// Formats rows of a table straight from its columns. Values are read through
+// RowView, and numbers are formatted with std::to_chars(), so nothing is
+// allocated per row.
+class CliRenderer
+{
+private:
+    CliOutput &out;
+    const InMemoryTable &model;
+    std::vector<size_t> columns;
+    std::vector<int> types;
+    // Width of cells of every column.
+    std::vector<size_t> cells;
+    // Text of every value of the row being put, and how wide it is. Numbers
+    // are formatted into 'digits'.
+    std::vector<std::string_view> texts;
+    std::vector<size_t> widths;
+    std::vector<std::array<char, 24>> digits;
+
+    // Reads values of the row, and returns whether some of them should be
+    // wrapped.
+    bool read_row(size_t pos)
+    {
+        RowView row = this->model.get_row_view(pos);
+        bool wrap   = false;
+
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            switch (TDB_TYPE(this->types[i])) {
                 case TT_INT: {
-                    std::cout << std::left << std::setw(CLI_INTW)
-                              << TDB_CAST(int, row[i]);
+                    char *begin = this->digits[i].data();
+                    char *end   = std::to_chars(begin, begin + this->digits[i].size(),
+                                                row.get<int>(this->columns[i]))
+                                    .ptr;
+
+                    this->texts[i]  = std::string_view(begin, end - begin);
+                    this->widths[i] = end - begin;
+
+                    // Int should always fit.
                 } break;
 
                 case TT_UINT: {
-                    std::cout << std::left << std::setw(CLI_B_INTW)
-                              << TDB_CAST(size_t, row[i]);
+                    char *begin = this->digits[i].data();
+                    char *end   = std::to_chars(begin, begin + this->digits[i].size(),
+                                                row.get<size_t>(this->columns[i]))
+                                    .ptr;
+
+                    this->texts[i]  = std::string_view(begin, end - begin);
+                    this->widths[i] = end - begin;
+
+                    wrap = wrap || this->widths[i] > CLI_B_INTW - CLI_MARGIN;
                 } break;
 
                 case TT_STR: {
-                    std::cout << std::left << std::setw(CLI_STRW)
-                              << TDB_CAST(std::string, row[i]);
+                    this->texts[i]  = row.get<std::string_view>(this->columns[i]);
+                    this->widths[i] = cli_display_width(this->texts[i]);
+
+                    wrap = wrap || this->widths[i] > CLI_STRW - CLI_MARGIN;
                 } break;
 
                 default:
-                    std::logic_error("Unreachable");
+                    throw std::logic_error("Unreachable");
             }
         }
-        std::cout << '\n';
-    }
-    else {
-        std::vector<int> lengths;
-        std::vector<std::string> cols;
-
-        if (line > 1) {
-            wrap_buf << '\n';
-        }
 
-        for (size_t i = 0; i < len; ++i) {
-            switch (types[i] & TDB_TMASK) {
-                case TT_INT: {
-                    // Int always should fit
-                    int n         = TDB_CAST(int, row[i]);
-                    std::string s = std::to_string(n);
+        return wrap;
+    }
 
-                    cols.push_back(std::to_string(n));
-                    lengths.push_back(s.size());
-                } break;
+public:
+    CliRenderer(CliOutput &out, const InMemoryTable &model,
+                const std::vector<size_t> &columns) :
+        out(out), model(model), columns(columns)
+    {
+        size_t len = columns.size();
 
-                case TT_UINT: {
-                    size_t n = TDB_CAST(size_t, row[i]);
-
-                    std::string s = std::to_string(n);
+        for (size_t column : columns) {
+            this->types.push_back(model.get_column_type(column));
+            this->cells.push_back(cli_cell_width(this->types.back()));
+        }
 
-                    cols.push_back(std::to_string(n));
-                    lengths.push_back(s.size());
-                } break;
+        this->texts.resize(len);
+        this->widths.resize(len);
+        this->digits.resize(len);
+    }
 
-                case TT_STR: {
-                    std::string s = TDB_CAST(std::string, row[i]);
+    // All columns of the table.
+    CliRenderer(CliOutput &out, const InMemoryTable &model) :
+        CliRenderer(out, model, cli_all_columns(model))
+    {}
 
-                    cols.push_back(s);
-                    lengths.push_back(tl_utf8_strlen(s.c_str()));
-                } break;
+    // Puts modifiers first, then types, then names of columns.
+    void put_header()
+    {
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            std::string modifier;
 
-                default:
-                    std::logic_error("Unreachable");
+            if (this->types[i] & TT_ID) {
+                modifier += "[id]";
             }
-        }
 
-        TDB_DEBUGV(lengths, "lengths");
+            if (this->types[i] & TT_CONST) {
+                modifier += "[const]";
+            }
 
-        while (should_wrap) {
-            if (line > 1) {
-                wrap_buf << "\n";
+            if (modifier.empty()) {
+                modifier = " ";
             }
 
-            // Slice very long string into lines.
-            // Can be several lines long.
+            this->out.put_cell(modifier, modifier.size(), this->cells[i]);
+        }
 
-            for (size_t i = 0; i < len; ++i) {
-                switch (types[i] & TDB_TMASK) {
-                    case TT_INT: {
-                        wrap_buf << std::left << std::setw(CLI_INTW) << ' ';
-                    } break;
+        this->out.put('\n');
 
-                    case TT_UINT: {
-                        wrap_buf << std::left << std::setw(CLI_B_INTW)
-                                 << (lengths[i] > (CLI_B_INTW - CLI_MARGIN)
-                                         ? cols[i].substr(
-                                               (CLI_B_INTW - CLI_MARGIN) * line,
-                                               CLI_B_INTW - CLI_MARGIN)
-                                         : " ");
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            std::string_view type = TDB_TYPE(this->types[i]) == TT_INT    ? "[int]"
+                                    : TDB_TYPE(this->types[i]) == TT_UINT ? "[uint]"
+                                                                          : "[str]";
 
-                        lengths[i] -= CLI_B_INTW;
-                    } break;
+            this->out.put_cell(type, type.size(), this->cells[i]);
+        }
 
-                    case TT_STR: {
-                        wrap_buf << std::left << std::setw(CLI_STRW)
-                                 << (lengths[i] > (CLI_STRW - CLI_MARGIN)
-                                         ? cols[i].substr(
-                                               (CLI_STRW - CLI_MARGIN) * line,
-                                               CLI_STRW - CLI_MARGIN)
-                                         : " ");
+        this->out.put('\n');
+        this->put_names();
+        this->out.put('\n');
+        this->out.line_done();
+    }
 
-                        lengths[i] -= CLI_STRW;
-                    } break;
-                }
-            }
+    // Puts names of columns on one line, without ending it, so that names of
+    // several tables can be put side by side.
+    void put_names()
+    {
+        const std::vector<std::string> &names = this->model.get_column_names();
 
-            // Recheck if any column still exceeds width.
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            const std::string &name = names[this->columns[i]];
+            this->out.put_cell(name, cli_display_width(name), this->cells[i]);
+        }
+    }
 
-            should_wrap = false;
+    // Same as above, for values of a row. Values are not wrapped.
+    void put_values(size_t pos)
+    {
+        this->read_row(pos);
 
-            for (size_t i = 0; i < len; ++i) {
-                switch (types[i] & TDB_TMASK) {
-                    case TT_INT: {
-                        continue;
-                    } break;
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            this->out.put_cell(this->texts[i], this->widths[i], this->cells[i]);
+        }
+    }
 
-                    case TT_UINT: {
-                        should_wrap =
-                            should_wrap || lengths[i] > CLI_B_INTW - CLI_MARGIN;
-                    } break;
+    // Puts values of a row on one line. Values wider than their cells are
+    // wrapped by breaking them to the next lines.
+    void put_row(size_t pos)
+    {
+        bool wrap = this->read_row(pos);
 
-                    case TT_STR: {
-                        should_wrap =
-                            should_wrap || lengths[i] > CLI_STRW - CLI_MARGIN;
-                    } break;
-                }
+        if (!wrap) {
+            for (size_t i = 0; i < this->columns.size(); ++i) {
+                this->out.put_cell(this->texts[i], this->widths[i], this->cells[i]);
             }
 
-            ++line;
+            this->out.put('\n');
+            this->out.line_done();
+
+            return;
         }
 
-        for (size_t i = 0; i < len; ++i) {
-            switch (TDB_TYPE(types[i])) {
-                case TT_INT: {
-                    std::cout << std::left << std::setw(CLI_INTW) << cols[i];
-                } break;
+        // Every line takes next few characters of values that are left.
+        while (wrap) {
+            wrap = false;
 
-                case TT_UINT: {
-                    std::cout << std::left << std::setw(CLI_B_INTW)
-                              << cols[i].substr(0, CLI_B_INTW - CLI_MARGIN);
-                } break;
+            for (size_t i = 0; i < this->columns.size(); ++i) {
+                std::string_view &text = this->texts[i];
 
-                case TT_STR: {
-                    std::cout << std::left << std::setw(CLI_STRW)
-                              << cols[i].substr(0, CLI_STRW - CLI_MARGIN);
-                } break;
+                size_t fits = TDB_TYPE(this->types[i]) == TT_INT
+                                  ? this->widths[i]
+                                  : this->cells[i] - CLI_MARGIN;
+                size_t width = std::min(this->widths[i], fits);
+                size_t bytes = cli_utf8_prefix(text, width);
 
-                default:
-                    std::logic_error("Unreachable");
+                this->out.put_cell(text.substr(0, bytes), width, this->cells[i]);
+
+                text.remove_prefix(bytes);
+                this->widths[i] -= width;
+
+                wrap = wrap || this->widths[i] > 0;
             }
+
+            this->out.put('\n');
         }
 
-        std::cout << '\n'
-                  << wrap_buf.str() << '\n';
+        this->out.line_done();
     }
-}
+};
 
 static CLI_COMMAND_KIND cli_get_command(std::string &s)
 {
@@ -447,6 +592,16 @@ static CLI_COMMAND_KIND cli_get_command(std::string &s)
         return LIST_TYPES;
     if (s == "size")
         return DBSIZE;
+    if (s == "agg")
+        return AGGREGATE;
+    if (s == "group")
+        return GROUP;
+    if (s == "select" || s == "SELECT")
+        return SELECT;
+    if (s == "explain" || s == "EXPLAIN")
+        return EXPLAIN;
+    if (s == "join")
+        return JOIN;
     if (s == "add")
         return ADD;
     if (s == "remove" || s == "rm")
@@ -461,11 +616,20 @@ static CLI_COMMAND_KIND cli_get_command(std::string &s)
         return COMMIT;
     if (s == "revert" || s == "reset")
         return REVERT;
+    if (s == "begin")
+        return BEGIN;
+    if (s == "rollback" || s == "undo")
+        return ROLLBACK;
+    if (s == "autosave")
+        return AUTOSAVE;
 
     return UNKNOWN;
 }
 
-static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
+// Line is passed as is for queries, since splitting it into args loses
+// quotes.
+static int cli_exec(InMemoryTable &model, const std::string &line,
+                    std::vector<std::string> &args)
 {
     CLI_COMMAND_KIND c;
 
@@ -488,16 +652,24 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                          "    version, ver        Display version.\n"
                          "    exit, quit, q       Save and quit. Append '!' to the end to skip saving.\n"
                          "    search, s           Search the database.\n"
-                         "    list, ls            Show all rows.\n"
+                         "    list, ls            Show all rows, or first rows sorted by a column.\n"
                          "    types, lst          Show only a table header.\n"
                          "    size                See total amount of rows in database.\n"
+                         "    agg                 Count, sum, min, max and average of a numeric column.\n"
+                         "    group               Count rows and aggregate columns per group.\n"
+                         "    select              Run a query, see 'select help'.\n"
+                         "    explain             Show how a query would be run.\n"
+                         "    join                Pair rows with rows of another file by a key.\n"
                          "    add                 Add a row to database.\n"
                          "    remove, rm          Remove a row from database.\n"
                          "    edit, e             Edit a row.\n"
                          "    clear               Clear the database.\n"
                          "    commitas, saveas    Save changes to the file specified.\n"
-                         "    commit, save        Save changes.\n"
-                         "    revert, reset       Revert uncommited changes."
+                         "    commit, save        Save changes, ending a transaction.\n"
+                         "    revert, reset       Revert uncommited changes.\n"
+                         "    begin               Start a transaction.\n"
+                         "    rollback, undo      Undo changes made since 'begin'.\n"
+                         "    autosave            Save changes in background, see 'autosave help'."
                       << std::endl;
         } break;
 
@@ -509,7 +681,10 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
 
         case EXIT: {
             std::cout << "Saving..." << std::endl;
-            model.write_file();
+            if (model.get_flush_stats().background)
+                model.flush();
+            else
+                model.write_file();
             std::cout << "Exiting..." << std::endl;
 
             return 1;
@@ -522,12 +697,67 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
         } break;
 
         case LIST: {
-            size_t len = model.get_row_count();
+            std::vector<SortKey> keys;
+            size_t limit = TDB_NO_LIMIT;
+
+            for (size_t i = 1; i < args.size(); i += 2) {
+                if (i + 1 >= args.size() ||
+                    (args[i] != "--sort" && args[i] != "--limit")) {
+                    std::cout << "ERROR: Invalid arguments.\n"
+                                 "Usage: list [--sort <field>[:desc][,<field>[:desc]...]] "
+                                 "[--limit <count>]"
+                              << std::endl;
+                    return 0;
+                }
+
+                if (args[i] == "--limit") {
+                    limit = parse_long_long(args[i + 1]);
+
+                    if (limit == TDB_INVALID_ULL) {
+                        std::cout << "ERROR: Limit is not a number." << std::endl;
+                        return 0;
+                    }
+
+                    continue;
+                }
+
+                const std::string &fields = args[i + 1];
+
+                for (size_t begin = 0, end; begin <= fields.size(); begin = end + 1) {
+                    end = std::min(fields.find(',', begin), fields.size());
+
+                    SortKey key = {fields.substr(begin, end - begin), TO_ASC};
+                    size_t colon = key.name.find(':');
+
+                    if (colon != std::string::npos) {
+                        std::string order = key.name.substr(colon + 1);
+                        key.name.resize(colon);
+
+                        if (order == "desc") {
+                            key.order = TO_DESC;
+                        }
+                        else if (order != "asc") {
+                            std::cout << "ERROR: Unknown order '" << order
+                                      << "', expected 'asc' or 'desc'." << std::endl;
+                            return 0;
+                        }
+                    }
+
+                    if (model.search_column_index(key.name) == TDB_NOT_FOUND) {
+                        std::cout << "ERROR: Unknown column '" << key.name << "'."
+                                  << std::endl;
+                        return 0;
+                    }
+
+                    keys.push_back(std::move(key));
+                }
+            }
+
+            size_t len = std::min(model.get_row_count(), limit);
 
             if (len > 1000) {
                 std::cout << "Database has over 1 000 entries "
                              "(" << len << ").\n"
-                             "This can take a long time.\n"
                              "Do you really want to list them all?"
                           << std::endl;
 
@@ -536,20 +766,57 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                 }
             }
 
-            cli_put_table_header(model);
+            CliOutput out;
+            CliRenderer rows(out, model);
 
-            for (size_t i = 0; i < len; ++i) {
-                cli_put_row(model, i);
+            if (keys.empty()) {
+                rows.put_header();
+
+                for (size_t i = 0; i < len; ++i) {
+                    rows.put_row(i);
+                }
             }
+            else {
+                std::vector<size_t> positions = model.sort_positions(keys, limit);
 
-            std::fflush(stdout);
+                rows.put_header();
+
+                for (const size_t &pos : positions) {
+                    rows.put_row(pos);
+                }
+            }
         } break;
 
         case LIST_TYPES: {
-            cli_put_table_header(model);
+            CliOutput out;
+            CliRenderer(out, model).put_header();
         } break;
 
         case QUERY: {
+            // Flags go right after the command.
+            int flags    = TS_PREFIX;
+            size_t limit = TDB_NO_LIMIT;
+
+            while (args.size() > 1) {
+                if (args[1] == "-i" || args[1] == "-e") {
+                    flags |= args[1] == "-i" ? TS_NOCASE : TS_EXACT;
+                    args.erase(args.begin() + 1);
+                }
+                else if (args[1] == "-n" && args.size() > 2) {
+                    limit = parse_long_long(args[2]);
+
+                    if (limit == TDB_INVALID_ULL) {
+                        std::cout << "ERROR: Count is not a number." << std::endl;
+                        return 0;
+                    }
+
+                    args.erase(args.begin() + 1, args.begin() + 3);
+                }
+                else {
+                    break;
+                }
+            }
+
             if (args.size() < 3) {
                 size_t len                     = model.get_column_count();
                 std::vector<std::string> names = model.get_column_names();
@@ -563,7 +830,18 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
 
                 std::cout
                     << "ERROR: Not enough arguments.\n"
-                       "Usage: search <field> <value>\n"
+                       "Usage: search [-i] [-e] [-n <count>] <field> <value>\n"
+                       "       search <field> <op> <value>\n"
+                       "       search <field> between <min> <max>\n"
+                       "       search [-i] [-n <count>] <field> like <pattern>\n"
+                       "Text fields match values starting with <value>, '-e' "
+                       "matches whole values only\n"
+                       "and '-i' ignores case. '-n' shows at most <count> "
+                       "matches.\n"
+                       "Operators =, !=, <, <=, >, >= and 'between' can be used "
+                       "with numeric fields.\n"
+                       "In patterns, '%' matches any text and '_' matches one "
+                       "character.\n"
                        "Available fields: "
                     << fields
                     << "\n"
@@ -582,8 +860,40 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                 return 0;
             }
 
+            // Patterns work with any column, numbers are matched as text.
+            if (args.size() > 3 && to_lower_string(args[2]) == "like") {
+                Pattern pattern(cli_concat_args(args, 3), flags & TS_NOCASE);
+
+                std::vector<size_t> positions = model.search(args[1], pattern);
+
+                if (positions.size() > limit) {
+                    positions.resize(limit);
+                }
+
+                CliOutput out;
+                CliRenderer rows(out, model);
+
+                rows.put_header();
+
+                for (const size_t &pos : positions) {
+                    rows.put_row(pos);
+                }
+
+                return 0;
+            }
+
+            int type         = model.get_column_type(column_pos);
+            ToiletCompare op = TC_EQ;
+
+            bool has_op = TDB_TYPE(type) != TT_STR && args.size() > 3 &&
+                          cli_parse_compare(args[2], op);
+
             // If column specified has modifier 'id', use binary search.
-            if (model.get_column_type(column_pos) & TT_ID) {
+            if ((type & TT_ID) && op == TC_EQ) {
+                if (has_op) {
+                    query = cli_concat_args(args, 3);
+                }
+
                 size_t value = parse_long_long(query);
 
                 if (value == TDB_INVALID_ULL) {
@@ -593,33 +903,358 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
 
                 size_t pos = model.search(value);
 
-                cli_put_table_header(model);
+                CliOutput out;
+                CliRenderer rows(out, model);
+
+                rows.put_header();
 
                 if (pos != TDB_NOT_FOUND) {
-                    cli_put_row(model, model.search(value));
+                    rows.put_row(pos);
                 }
 
-                std::fflush(stdout);
-
                 return 0;
             };
 
-            std::vector<size_t> positions = model.search(args[1], query);
+            // Numeric columns are compared as numbers.
+            if (TDB_TYPE(type) != TT_STR) {
+                Selection selection;
+
+                if (!cli_select(model, column_pos, args, 2, selection)) {
+                    return 0;
+                }
+
+                std::vector<size_t> positions = selection.positions();
+
+                if (positions.size() > limit) {
+                    positions.resize(limit);
+                }
+
+                CliOutput out;
+                CliRenderer rows(out, model);
+
+                rows.put_header();
+
+                for (const size_t &pos : positions) {
+                    rows.put_row(pos);
+                }
+
+                return 0;
+            }
+
+            // Text matches are printed as they are found.
+            SearchCursor cursor(model, args[1], query, flags);
+            cursor.limit(limit);
+
+            CliOutput out;
+            CliRenderer rows(out, model);
+
+            rows.put_header();
+
+            for (size_t pos = cursor.next(); pos != TDB_NOT_FOUND; pos = cursor.next()) {
+                rows.put_row(pos);
+            }
+        } break;
+
+        case SELECT: {
+            if (args.size() == 1 || (args.size() == 2 && args[1] == "help")) {
+                std::cout << "Usage: select * | <field>[, <field>...]\n"
+                             "              [where <predicate>]\n"
+                             "              [order by <field> [asc | desc][, ...]]\n"
+                             "              [limit <count>]\n"
+                             "Predicate is '<field> <op> <value>', where op is one of\n"
+                             "=, !=, <, <=, > and >=, or '<field> between <min> and <max>'.\n"
+                             "Predicates can be joined with 'and', 'or' and parentheses.\n"
+                             "Strings should be quoted."
+                          << std::endl;
+                return 0;
+            }
+
+            QueryResult result = Query(line).run(model);
+
+            if (result.rows.size() > 1000) {
+                std::cout << "Query returned over 1 000 entries "
+                             "(" << result.rows.size() << ").\n"
+                             "Do you really want to list them all?"
+                          << std::endl;
+
+                if (!cli_y_or_n()) {
+                    return 0;
+                }
+            }
+
+            CliOutput out;
+            CliRenderer rows(out, model, result.columns);
+
+            rows.put_header();
 
-            cli_put_table_header(model);
+            for (const size_t &pos : result.rows) {
+                rows.put_row(pos);
+            }
+        } break;
 
-            for (const size_t &pos : positions) {
-                cli_put_row(model, pos);
+        case EXPLAIN: {
+            if (args.size() < 2) {
+                std::cout << "ERROR: Not enough arguments.\n"
+                             "Usage: explain select ..."
+                          << std::endl;
+                return 0;
             }
 
+            // Query starts after the command.
+            Query query(line.substr(line.find(args[0]) + args[0].size()));
+
+            std::cout << query.explain(model);
             std::fflush(stdout);
         } break;
 
+        case JOIN: {
+            if (args.size() != 3 && args.size() != 4) {
+                std::cout << "ERROR: Invalid arguments.\n"
+                             "Usage: join <file> <field> [<field in file>]"
+                          << std::endl;
+                return 0;
+            }
+
+            const std::string &other_name = args.size() == 4 ? args[3] : args[2];
+
+            std::unique_ptr<InMemoryTable> other;
+
+            try {
+                other = std::make_unique<InMemoryTable>(args[1]);
+            }
+            catch (std::ios::failure &e) {
+                std::cout << "ERROR: " << args[1] << ": Could not open file: "
+                          << strerror(errno) << std::endl;
+                return 0;
+            }
+            catch (ParsingError &e) {
+                std::cout << "ERROR: " << args[1] << ": " << e.what() << std::endl;
+                return 0;
+            }
+            catch (std::runtime_error &e) {
+                std::cout << "ERROR: " << args[1] << ": " << strerror(errno)
+                          << std::endl;
+                return 0;
+            }
+
+            Joined joined = model.join(args[2], *other, other_name);
+
+            size_t len = joined.rows.size();
+
+            if (len > 1000) {
+                std::cout << "Join has over 1 000 entries "
+                             "(" << len << ").\n"
+                             "Do you really want to list them all?"
+                          << std::endl;
+
+                if (!cli_y_or_n()) {
+                    return 0;
+                }
+            }
+
+            CliOutput out;
+            CliRenderer rows(out, model);
+            CliRenderer other_rows(out, *other);
+
+            rows.put_names();
+            other_rows.put_names();
+            out.put('\n');
+
+            for (size_t i = 0; i < len; ++i) {
+                rows.put_values(joined.rows[i]);
+                other_rows.put_values(joined.other_rows[i]);
+                out.put('\n');
+                out.line_done();
+            }
+        } break;
+
         case DBSIZE: {
             std::cout << "There are " << model.get_row_count()
                       << " rows in database." << std::endl;
         } break;
 
+        case AGGREGATE: {
+            if (args.size() != 2 && (args.size() < 5 || args[2] != "where")) {
+                std::cout << "ERROR: Invalid arguments.\n"
+                             "Usage: agg <field>\n"
+                             "       agg <field> where <field> [op] <value>\n"
+                             "       agg <field> where <field> between <min> <max>"
+                          << std::endl;
+                return 0;
+            }
+
+            size_t column_pos = model.search_column_index(args[1]);
+
+            if (column_pos == TDB_NOT_FOUND) {
+                std::cout << "ERROR: Unknown column '" << args[1] << "'."
+                          << std::endl;
+                return 0;
+            }
+
+            int type = TDB_TYPE(model.get_column_type(column_pos));
+
+            if (type == TT_STR) {
+                std::cout << "ERROR: Column '" << args[1] << "' is not numeric."
+                          << std::endl;
+                return 0;
+            }
+
+            Selection selection;
+            bool filtered = args.size() > 2;
+
+            if (filtered) {
+                size_t where_pos = model.search_column_index(args[3]);
+
+                if (where_pos == TDB_NOT_FOUND) {
+                    std::cout << "ERROR: Unknown column '" << args[3] << "'."
+                              << std::endl;
+                    return 0;
+                }
+
+                if (!cli_select(model, where_pos, args, 4, selection)) {
+                    return 0;
+                }
+            }
+
+            const Selection *rows = filtered ? &selection : nullptr;
+
+            if (type == TT_INT) {
+                Aggregate<int> result = model.aggregate<int>(args[1], rows);
+
+                std::cout << "count: " << result.count << "\n"
+                          << "sum:   " << result.sum << "\n"
+                          << "min:   " << result.min << "\n"
+                          << "max:   " << result.max << "\n"
+                          << "avg:   " << std::fixed << std::setprecision(2)
+                          << result.avg << std::defaultfloat << std::endl;
+            }
+            else {
+                Aggregate<size_t> result = model.aggregate<size_t>(args[1], rows);
+
+                std::cout << "count: " << result.count << "\n"
+                          << "sum:   " << result.sum
+                          << (result.overflow ? " (overflowed)" : "") << "\n"
+                          << "min:   " << result.min << "\n"
+                          << "max:   " << result.max << "\n"
+                          << "avg:   " << std::fixed << std::setprecision(2)
+                          << result.avg << std::defaultfloat << std::endl;
+            }
+        } break;
+
+        case GROUP: {
+            if (args.size() < 2) {
+                std::cout << "ERROR: Not enough arguments.\n"
+                             "Usage: group <field>[,<field>...] [<numeric field>...]"
+                          << std::endl;
+                return 0;
+            }
+
+            std::vector<std::string> keys;
+            std::vector<size_t> key_pos;
+
+            for (size_t begin = 0, end; begin <= args[1].size(); begin = end + 1) {
+                end = std::min(args[1].find(',', begin), args[1].size());
+                keys.push_back(args[1].substr(begin, end - begin));
+                key_pos.push_back(model.search_column_index(keys.back()));
+
+                if (key_pos.back() == TDB_NOT_FOUND) {
+                    std::cout << "ERROR: Unknown column '" << keys.back() << "'."
+                              << std::endl;
+                    return 0;
+                }
+            }
+
+            std::vector<std::string> columns(args.begin() + 2, args.end());
+
+            for (const std::string &name : columns) {
+                size_t pos = model.search_column_index(name);
+
+                if (pos == TDB_NOT_FOUND) {
+                    std::cout << "ERROR: Unknown column '" << name << "'."
+                              << std::endl;
+                    return 0;
+                }
+
+                if (TDB_TYPE(model.get_column_type(pos)) == TT_STR) {
+                    std::cout << "ERROR: Column '" << name << "' is not numeric."
+                              << std::endl;
+                    return 0;
+                }
+            }
+
+            Groups groups = model.group_by(keys, columns);
+
+            std::stringstream header;
+
+            for (size_t k = 0; k < keys.size(); ++k) {
+                header << std::left
+                       << std::setw(TDB_TYPE(model.get_column_type(key_pos[k])) == TT_STR
+                                        ? CLI_STRW
+                                        : CLI_B_INTW)
+                       << keys[k];
+            }
+
+            header << std::setw(CLI_B_INTW) << "count";
+
+            for (const std::string &name : columns) {
+                for (const char *agg : {"sum", "min", "max", "avg"}) {
+                    header << std::setw(CLI_B_INTW)
+                           << std::string(agg) + "(" + name + ")";
+                }
+            }
+
+            std::cout << header.str() << "\n";
+
+            for (size_t g = 0; g < groups.rows.size(); ++g) {
+                RowView row = model.get_row_view(groups.rows[g]);
+
+                for (size_t k = 0; k < keys.size(); ++k) {
+                    switch (TDB_TYPE(model.get_column_type(key_pos[k]))) {
+                        case TT_INT: {
+                            std::cout << std::left << std::setw(CLI_B_INTW)
+                                      << row.get<int>(key_pos[k]);
+                        } break;
+
+                        case TT_UINT: {
+                            std::cout << std::left << std::setw(CLI_B_INTW)
+                                      << row.get<size_t>(key_pos[k]);
+                        } break;
+
+                        case TT_STR: {
+                            std::string_view value = row.get<std::string_view>(key_pos[k]);
+                            std::cout << std::left << std::setw(CLI_STRW)
+                                      << value.substr(0, CLI_STRW - CLI_MARGIN);
+                        } break;
+                    }
+                }
+
+                std::cout << std::left << std::setw(CLI_B_INTW) << groups.counts[g];
+
+                for (const Groups::Values &values : groups.values) {
+                    if (!values.ints.empty()) {
+                        const Aggregate<int> &a = values.ints[g];
+                        std::cout << std::setw(CLI_B_INTW) << a.sum
+                                  << std::setw(CLI_B_INTW) << a.min
+                                  << std::setw(CLI_B_INTW) << a.max
+                                  << std::setw(CLI_B_INTW) << std::fixed
+                                  << std::setprecision(2) << a.avg << std::defaultfloat;
+                    }
+                    else {
+                        const Aggregate<size_t> &a = values.uints[g];
+                        std::cout << std::setw(CLI_B_INTW) << a.sum
+                                  << std::setw(CLI_B_INTW) << a.min
+                                  << std::setw(CLI_B_INTW) << a.max
+                                  << std::setw(CLI_B_INTW) << std::fixed
+                                  << std::setprecision(2) << a.avg << std::defaultfloat;
+                    }
+                }
+
+                std::cout << "\n";
+            }
+
+            std::cout << "There are " << groups.rows.size() << " groups." << std::endl;
+        } break;
+
         case ADD: {
             size_t len             = model.get_column_count();
             std::vector<int> types = model.get_types();
@@ -665,8 +1300,11 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
             int err = model.add_row(args);
 
             if (!err) {
-                cli_put_table_header(model);
-                cli_put_row(model, model.get_row_count() - 1);
+                CliOutput out;
+                CliRenderer rows(out, model);
+
+                rows.put_header();
+                rows.put_row(model.get_row_count() - 1);
             }
             else {
                 std::cout << "ERROR: ";
@@ -704,8 +1342,11 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                 return 0;
             }
 
-            cli_put_table_header(model);
-            cli_put_row(model, pos);
+            CliOutput out;
+            CliRenderer rows(out, model);
+
+            rows.put_header();
+            rows.put_row(pos);
 
             model.erase(pos);
         } break;
@@ -769,8 +1410,6 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                 return 0;
             }
 
-            void *data = (model.unsafe_get_mut_row(pos))[column_index];
-
             if (TDB_IS(types[column_index], TT_CONST)) {
                 std::cout << "ERROR: Can not edit value with 'const' modifier."
                           << std::endl;
@@ -781,34 +1420,37 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
                 case TT_INT: {
                     int number = parse_int(value);
 
-                    if (n == TDB_INVALID_I) {
+                    if (number == TDB_INVALID_I) {
                         std::cout << "ERROR: Value is not a number."
                                   << std::endl;
                         return 0;
                     }
 
-                    TDB_CAST(int, data) = number;
+                    model.get_row_ref(pos).set(column_index, number);
                 } break;
 
                 case TT_UINT: {
                     size_t number = parse_long_long(value);
 
-                    if (n == TDB_INVALID_ULL) {
+                    if (number == TDB_INVALID_ULL) {
                         std::cout << "ERROR: Value is not a number."
                                   << std::endl;
                         return 0;
                     }
 
-                    TDB_CAST(size_t, data) = number;
+                    model.get_row_ref(pos).set(column_index, number);
                 } break;
 
                 case TT_STR: {
-                    TDB_CAST(std::string, data) = value;
+                    model.get_row_ref(pos).set(column_index, std::move(value));
                 } break;
             }
 
-            cli_put_table_header(model);
-            cli_put_row(model, pos);
+            CliOutput out;
+            CliRenderer rows(out, model);
+
+            rows.put_header();
+            rows.put_row(pos);
         }
 
         break;
@@ -823,8 +1465,20 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
         } break;
 
         case COMMIT: {
-            std::cout << "Saving..." << std::endl;
-            model.write_file();
+            if (model.in_transaction()) {
+                model.commit();
+            }
+
+            // Background thread writes from a snapshot, so there's no need
+            // to wait for it.
+            if (model.get_flush_stats().background) {
+                std::cout << "Saving in background..." << std::endl;
+                model.flush(false);
+            }
+            else {
+                std::cout << "Saving..." << std::endl;
+                model.write_file();
+            }
         } break;
 
         case COMMITAS: {
@@ -848,6 +1502,66 @@ static int cli_exec(InMemoryTable &model, std::vector<std::string> &args)
             std::cout << "Reverting changes..." << std::endl;
             model.reread_file();
         } break;
+
+        case BEGIN: {
+            if (model.in_transaction()) {
+                std::cout << "ERROR: Transaction is already started." << std::endl;
+                return 0;
+            }
+
+            model.begin();
+        } break;
+
+        case ROLLBACK: {
+            if (!model.in_transaction()) {
+                std::cout << "ERROR: No transaction was started." << std::endl;
+                return 0;
+            }
+
+            std::cout << "Rolling back changes..." << std::endl;
+            model.rollback();
+        } break;
+
+        case AUTOSAVE: {
+            if (args.size() == 1) {
+                FlushStats stats = model.get_flush_stats();
+
+                std::cout << "Autosave is " << (stats.background ? "on" : "off") << ".\n"
+                          << "Unsaved changes: " << stats.pending << ", oldest is "
+                          << stats.lag_ms << " ms old.\n"
+                          << "Writes: " << stats.flushes << ", failed: " << stats.failures
+                          << ", last took " << stats.last_write_ms << " ms.\n"
+                          << "Longest wait for a write: " << stats.max_lag_ms << " ms."
+                          << std::endl;
+
+                if (stats.failures) {
+                    std::cout << "Last error: " << stats.last_error << std::endl;
+                }
+
+                return 0;
+            }
+
+            if (args.size() == 2 && args[1] == "off") {
+                model.set_auto_flush(0, 0);
+                return 0;
+            }
+
+            size_t delay   = parse_long_long(args[1]);
+            size_t changes = args.size() == 3 ? parse_long_long(args[2]) : 0;
+
+            if (args[1] == "help" || args.size() > 3 || delay == TDB_INVALID_ULL ||
+                changes == TDB_INVALID_ULL) {
+                std::cout << "Usage: autosave                          Show state of autosave.\n"
+                             "       autosave <delay ms> [<changes>]   Save changes in background\n"
+                             "                                         after a delay, or once\n"
+                             "                                         enough changes pile up.\n"
+                             "       autosave off                      Save what is left and stop."
+                          << std::endl;
+                return 0;
+            }
+
+            model.set_auto_flush(delay, changes);
+        } break;
     }
 
     return 0;
@@ -933,7 +1647,7 @@ int cli_loop(const std::string &filepath)
         std::vector<std::string> args = cli_split_args(line);
 
         try {
-            if (cli_exec(*model, args))
+            if (cli_exec(*model, line, args))
                 break;
         }
         // Logic exceptions at execution should be recoverable errors.
@@ -1,12 +1,16 @@
 #ifndef TOILETDB_CLI_H_
 #define TOILETDB_CLI_H_
 
+#include <array>
 #include <cctype>
+#include <charconv>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 #include <vector>
 
 #include "toiletdb.hpp"
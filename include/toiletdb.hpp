@@ -27,13 +27,17 @@
 #include <cctype>
 #include <climits>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <numeric>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 #define TOILETDB_VERSION "1.3.4"
@@ -41,7 +45,11 @@
 
 #define TDB_INVALID_ULL (size_t)(-1)
 #define TDB_NOT_FOUND (size_t)(-1)
+/// @brief Limit that does not limit anything.
+#define TDB_NO_LIMIT (size_t)(-1)
 #define TDB_INVALID_I 2147483647
+/// @brief Extension of table files a Database opens.
+#define TDB_TABLE_EXTENSION ".tdb"
 /**
  *  @brief Type mask for ToiletType
  */
@@ -100,16 +108,25 @@ void toilet_debug_puts(const T &s, const char *name)
  *  @brief Parse size_t.
  *  @return TDB_INVALID_ULL if string cannot be parsed.i
  */
-size_t parse_long_long(const std::string &str);
+size_t parse_long_long(std::string_view str);
 /**
  *  @brief Parse signed int.
  *  return TDB_INVALID_I if string cannot be parsed.
  */
-int parse_int(const std::string &str);
+int parse_int(std::string_view str);
 /**
  *  @brief Returns copy of a string with all characters lowercased.
  */
 std::string to_lower_string(const std::string &str);
+/**
+ *  @brief Returns copy of a UTF-8 string with simple case folding applied,
+ *         so strings that differ only in case fold to the same string.
+ *         Covers Latin, Greek, Cyrillic and Armenian letters of the Basic
+ *         Multilingual Plane, folded as Unicode CaseFolding.txt (status C
+ *         and S) folds them. Other characters are left as they are.
+ *         Bytes that are not valid UTF-8 are copied as is.
+ */
+std::string fold_case(std::string_view str);
 
 /**
  * @brief One bit in 32 bit integer that means either a type or a modifier.
@@ -141,6 +158,21 @@ public:
     ParsingError(std::string const &msg);
 };
 
+/**
+ * @class PartialCommit
+ * @brief Is thrown by Database.commit() when a table file could not be
+ *        replaced after files of other tables already were.
+ */
+class PartialCommit : public std::runtime_error
+{
+public:
+    /// @brief Tables whose files have the new rows. Files of the rest are
+    ///        left as they were.
+    std::vector<std::string> committed;
+
+    PartialCommit(std::string const &msg, std::vector<std::string> committed);
+};
+
 /**
  * @brief Base class for columns in InMemoryTable table.
  *        This should be casted to appropriate column type.
@@ -155,6 +187,316 @@ public:
     virtual size_t size() const                 = 0;
     virtual void clear()                        = 0;
     virtual void erase(size_t pos)              = 0;
+    /// @brief Memory taken by values of the column.
+    virtual size_t bytes() const                = 0;
+    /// @brief Copy of the column, allocated from the same memory resource.
+    virtual std::shared_ptr<ColumnBase> clone() const = 0;
+    /// @brief Column with values there are now, that shares them with this
+    ///        one instead of copying them. Values added to this column
+    ///        later don't show up in it.
+    virtual std::shared_ptr<ColumnBase> share() const = 0;
+};
+
+/**
+ * @brief Comparison used by predicates on numeric columns.
+ *        TC_BETWEEN is inclusive on both ends.
+ */
+enum ToiletCompare
+{
+    TC_EQ,
+    TC_NE,
+    TC_LT,
+    TC_LE,
+    TC_GT,
+    TC_GE,
+    TC_BETWEEN,
+};
+
+/**
+ * @class Selection
+ * @brief Set of rows of one table, stored as a bitmap with one bit per row.
+ *        Selections of the same table can be combined with &, | and ~.
+ * @see InMemoryTable.filter()
+ */
+class Selection
+{
+private:
+    std::vector<uint64_t> words;
+    size_t rows;
+
+    void clear_tail();
+    void check_rows(const Selection &other) const;
+
+public:
+    /// @brief Selection of 'rows' rows. All of them are selected if 'value'
+    ///        is true.
+    Selection(size_t rows = 0, bool value = false);
+    /// @brief Amount of rows selection covers, selected or not.
+    size_t get_row_count() const;
+    bool contains(size_t pos) const;
+    void set(size_t pos, bool value = true);
+    /// @brief Amount of rows selected.
+    size_t count() const;
+    /// @brief Positions of selected rows, in ascending order.
+    std::vector<size_t> positions() const;
+    /// @brief Raw bitmap, bit (pos % 64) of word (pos / 64) is row pos.
+    uint64_t *data();
+    const uint64_t *data() const;
+    /// @throws std::logic_error when row counts don't match.
+    Selection &operator&=(const Selection &other);
+    /// @throws std::logic_error when row counts don't match.
+    Selection &operator|=(const Selection &other);
+    Selection operator&(const Selection &other) const;
+    Selection operator|(const Selection &other) const;
+    Selection operator~() const;
+};
+
+/**
+ * @brief Sets amount of threads scans are split between, for tables that
+ *        don't set their own. 0 means one per hardware thread, which is the
+ *        default.
+ * @see InMemoryTable.set_thread_count()
+ */
+void set_default_thread_count(size_t threads);
+
+/**
+ * @brief Amount of threads scans are split between by default, with 0
+ *        resolved to amount of hardware threads.
+ */
+size_t get_default_thread_count();
+
+/**
+ * @brief Calls call(context) on a thread of the same pool scans use, without
+ *        waiting for it, for work started by async API. Pool is grown to
+ *        get_default_thread_count() threads, and calls that find all of
+ *        them busy wait in order they were made.
+ * @warning call should not throw.
+ * @see offload()
+ */
+void post_task(void (*call)(void *), void *context);
+
+/**
+ * @brief How table files are read and written.
+ * @see set_io_backend()
+ */
+enum ToiletIo
+{
+    /// @brief io_uring where kernel supports it, plain reads and writes
+    ///        otherwise. This is the default.
+    TI_AUTO,
+    /// @brief Plain blocking reads and writes, one block at a time.
+    TI_SYNC,
+    /// @brief Several blocks are queued to the kernel through io_uring, so
+    ///        reading and writing overlaps parsing and formatting. Falls back
+    ///        to TI_SYNC where io_uring is not available.
+    TI_URING,
+};
+
+/**
+ * @brief Sets how table files are read and written, for files opened after
+ *        the call.
+ */
+void set_io_backend(ToiletIo backend);
+
+/**
+ * @brief Backend files are read and written with, TI_AUTO resolved to
+ *        TI_SYNC or TI_URING.
+ */
+ToiletIo get_io_backend();
+
+class RowBuilder;
+class RowView;
+class RowRef;
+class SearchCursor;
+
+/**
+ * @brief Memory taken by a table, in bytes.
+ * @see InMemoryTable.memory_usage()
+ */
+struct MemoryUsage
+{
+    struct Entry
+    {
+        std::string name;
+        size_t bytes;
+    };
+
+    /// @brief One entry per column, in the same order as columns.
+    std::vector<Entry> columns;
+    /// @brief One entry per index, named after the column it indexes.
+    std::vector<Entry> indexes;
+    /// @brief Sum of everything above.
+    size_t total;
+    /// @brief Bytes currently allocated through table's memory resource.
+    size_t allocated;
+};
+
+/**
+ * @brief State of writing a table to its file.
+ * @see InMemoryTable.set_auto_flush()
+ */
+struct FlushStats
+{
+    /// @brief Whether background thread is running.
+    bool background;
+    /// @brief Changes made since rows were last written.
+    size_t pending;
+    /// @brief Milliseconds since oldest change that is not written yet, 0
+    ///        when there is none.
+    double lag_ms;
+    /// @brief Longest time a change waited to be written by flush().
+    double max_lag_ms;
+    /// @brief Milliseconds last write by flush() took.
+    double last_write_ms;
+    /// @brief Writes by flush() that were done and that failed.
+    size_t flushes;
+    size_t failures;
+    /// @brief Error of last write that failed.
+    std::string last_error;
+};
+
+/**
+ * @brief Count, sum, minimum, maximum and average of values of a numeric
+ *        column. T is int for 'int' columns and size_t for 'uint'.
+ * @see InMemoryTable.aggregate()
+ */
+template <typename T>
+struct Aggregate
+{
+    /// @brief Amount of values aggregated.
+    size_t count;
+    /// @brief Sum of values, long long for 'int' columns.
+    std::conditional_t<std::is_signed_v<T>, long long, size_t> sum;
+    /// @brief Set when sum did not fit into its type and wrapped around.
+    ///        Average is correct either way.
+    bool overflow;
+    /// @brief 0 when nothing was aggregated.
+    T min;
+    /// @brief 0 when nothing was aggregated.
+    T max;
+    /// @brief 0 when nothing was aggregated.
+    double avg;
+};
+
+/// @brief Aggregate of values of 'a' and 'b' together, e.g. of two tables.
+///        Sets overflow when sum of both doesn't fit into its type.
+Aggregate<int> merge_aggregates(const Aggregate<int> &a, const Aggregate<int> &b);
+Aggregate<size_t> merge_aggregates(const Aggregate<size_t> &a, const Aggregate<size_t> &b);
+
+/**
+ * @brief Result of InMemoryTable.group_by(). Groups are ordered by their
+ *        first row.
+ */
+struct Groups
+{
+    struct Values
+    {
+        /// @brief Name of column aggregated.
+        std::string name;
+        /// @brief One entry per group, set for 'int' columns.
+        std::vector<Aggregate<int>> ints;
+        /// @brief One entry per group, set for 'uint' columns.
+        std::vector<Aggregate<size_t>> uints;
+    };
+
+    /// @brief First row of each group. Values of key columns can be read
+    ///        from it.
+    std::vector<size_t> rows;
+    /// @brief Amount of rows in each group.
+    std::vector<size_t> counts;
+    /// @brief One entry per column aggregated, in the order they were passed.
+    std::vector<Values> values;
+};
+
+/**
+ * @brief How InMemoryTable.search() matches values against query. Bits can
+ *        be combined.
+ */
+enum ToiletSearch
+{
+    /// @brief Values starting with query match, which is the default.
+    TS_PREFIX = 0,
+    /// @brief Only values equal to query match.
+    TS_EXACT  = 1 << 0,
+    /// @brief Values of 'str' columns are compared after fold_case().
+    TS_NOCASE = 1 << 1,
+};
+
+/**
+ * @brief Direction of sorting.
+ */
+enum ToiletOrder
+{
+    TO_ASC,
+    TO_DESC,
+};
+
+/**
+ * @brief One column to sort by.
+ * @see InMemoryTable.sort_positions()
+ */
+struct SortKey
+{
+    std::string name;
+    ToiletOrder order;
+};
+
+/**
+ * @brief Counters and size of a table's search cache.
+ * @see InMemoryTable.set_search_cache()
+ */
+struct CacheStats
+{
+    size_t hits;
+    size_t misses;
+    /// @brief Entries dropped to stay under the cap.
+    size_t evictions;
+    size_t entries;
+    /// @brief Bytes taken by cached keys and positions.
+    size_t bytes;
+    /// @brief Cap on bytes, 0 when cache is disabled.
+    size_t capacity;
+};
+
+/**
+ * @brief Pairs of rows with equal keys, result of InMemoryTable.join().
+ *        Pairs are ordered by 'rows', then by 'other_rows'.
+ */
+struct Joined
+{
+    /// @brief Positions of rows in the table join() was called on.
+    std::vector<size_t> rows;
+    /// @brief Positions of rows in the other table. Pair i is rows[i] and
+    ///        other_rows[i].
+    std::vector<size_t> other_rows;
+};
+
+/**
+ * @class Pattern
+ * @brief SQL LIKE pattern, compiled once and matched against any amount of
+ *        values. '%' matches any amount of characters, '_' matches one
+ *        character, and '\' makes the next '%', '_' or '\' literal.
+ *        Characters are UTF-8 code points.
+ *        Patterns of form 'abc', 'abc%', '%abc' and '%abc%' are compared
+ *        directly, others are matched segment by segment, looking for the
+ *        literal start of each segment with memchr().
+ */
+class Pattern
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief With 'nocase', pattern is folded with fold_case(), and values
+    ///        passed to matches() should be folded the same way.
+    /// @throws ParsingError when pattern ends with an unpaired '\'.
+    Pattern(std::string_view text, bool nocase = false);
+    Pattern(Pattern &&other);
+    Pattern &operator=(Pattern &&other);
+    ~Pattern();
+    bool matches(std::string_view value) const;
+    bool is_nocase() const;
 };
 
 /**
@@ -166,6 +508,15 @@ class InMemoryTable
 {
 private:
     struct Private;
+    std::unique_ptr<Private> internal;
+
+    friend class RowBuilder;
+    friend class RowView;
+    friend class RowRef;
+    friend class SearchCursor;
+
+    // Makes a snapshot.
+    InMemoryTable(std::unique_ptr<Private> internal);
 
 public:
     /// @brief Opens up a file and loads it up into memory.
@@ -174,9 +525,12 @@ public:
     /// @throws std::runtime_error when file does not exist.
     /// @throws ParsingError when parsing error is encountered.
     InMemoryTable(const std::string &filename);
+    /// @brief Same as above, but memory for values and index is taken from
+    ///        resource. Resource should outlive the table.
+    InMemoryTable(const std::string &filename, std::pmr::memory_resource *resource);
     ~InMemoryTable();
     /// @brief Discards all changes made to in-memory vector, and reads file
-    /// again.
+    /// again. Ends a transaction, if one was started.
     /// @throws std::runtime_error when table file was deleted or moved.
     void reread_file();
     /// @brief Writes data stored in memory back to the file.
@@ -184,6 +538,9 @@ public:
     void write_file() const;
     /// @brief Writes data stored in memory back to the file specified.
     void write_file(const std::string &filepath) const;
+    /// @brief Same as above, but only rows selected are written.
+    /// @throws std::logic_error when selection is of different row count.
+    void write_file(const std::string &filepath, const Selection &selection) const;
     /// @brief Search in-memory vector by ID.
     /// O(log n)
     /// @return TDB_NOT_FOUND if element is not found.
@@ -191,17 +548,117 @@ public:
     /// @brief Search in-memory vector by comparing values as std::string.
     /// O(n)
     /// @return TDB_NOT_FOUND if element is not found.
+    /// @see set_search_cache(), SearchCursor
     std::vector<size_t> search(const std::string &name,
                                std::string &query) const;
+    /// @brief Same as above, with matching set by 'flags'.
+    ///        With TS_NOCASE, a case-folded copy of the column is made on
+    ///        first use and kept in sync with edits afterwards.
+    /// @see ToiletSearch
+    std::vector<size_t> search(const std::string &name, std::string_view query,
+                               int flags) const;
+    /// @brief Positions of rows with values matching 'pattern', in order of
+    ///        rows. Numbers are matched by their decimal representation.
+    ///        Case-insensitive patterns use the same folded copy of 'str'
+    ///        columns as TS_NOCASE.
+    std::vector<size_t> search(const std::string &name, const Pattern &pattern) const;
+    /// @brief Positions of rows with ID from 'min' to 'max' inclusive, in
+    ///        order of IDs.
+    /// O(log n + k)
+    std::vector<size_t> search_range(const size_t &min, const size_t &max) const;
+    /// @brief Amount of rows search_range() would return.
+    /// O(log n)
+    size_t count_range(const size_t &min, const size_t &max) const;
+    /// @brief Selects rows where value of 'int' or 'uint' column satisfies
+    ///        'op' against 'a' ('a' and 'b' for TC_BETWEEN).
+    ///        Values are compared as numbers, so passing negative values for
+    ///        'uint' columns is fine.
+    ///        O(n), compares many values at a time when CPU supports it.
+    /// @throws std::logic_error when column does not exist or is not numeric.
+    Selection filter(const std::string &name, ToiletCompare op, int a,
+                     int b = 0) const;
+    /// @brief Same as above, for values that don't fit into int.
+    Selection filter(const std::string &name, ToiletCompare op, size_t a,
+                     size_t b = 0) const;
+    /// @brief Same as above, for 'str' columns. Strings are compared byte by
+    ///        byte, like std::string does.
+    /// @throws std::logic_error when column does not exist or is not 'str'.
+    Selection filter(const std::string &name, ToiletCompare op,
+                     std::string_view a, std::string_view b = {}) const;
+    /// @brief Count, sum, minimum, maximum and average of column 'name'.
+    ///        T should be int for 'int' columns and size_t for 'uint'.
+    ///        If selection is passed, only rows selected are aggregated.
+    ///        O(n), large tables are split between threads.
+    /// @throws std::logic_error when column does not exist, T does not match
+    ///         its type, or selection is of different row count.
+    /// @see filter()
+    template <typename T>
+    Aggregate<T> aggregate(const std::string &name,
+                           const Selection *selection = nullptr) const;
+    /// @brief Splits rows into groups with equal values of 'keys' columns,
+    ///        and aggregates 'columns' of each group. Keys can be of any type,
+    ///        aggregated columns should be 'int' or 'uint'.
+    ///        If selection is passed, only rows selected are grouped.
+    ///        O(n), large tables are split between threads.
+    /// @throws std::logic_error when columns don't exist, there are no keys,
+    ///         or selection is of different row count.
+    /// @see aggregate()
+    Groups group_by(const std::vector<std::string> &keys,
+                    const std::vector<std::string> &columns = {},
+                    const Selection *selection = nullptr) const;
+    /// @brief Pairs every row of this table with rows of 'other' whose value
+    ///        of 'other_name' equals value of 'name'. Keys should both be 'str',
+    ///        or both be 'int' or 'uint'.
+    ///        Hash table is built from the smaller table and probed with rows
+    ///        of the larger one, large tables are split between threads.
+    ///        O(n + m + pairs)
+    /// @throws std::logic_error when columns don't exist or can't be compared.
+    Joined join(const std::string &name, const InMemoryTable &other,
+                const std::string &other_name) const;
+    /// @brief Positions of rows sorted by column 'name'. Only first 'limit'
+    ///        positions are returned, which is cheaper than sorting all of
+    ///        them. Rows with equal values are kept in order of positions.
+    ///        If selection is passed, only rows selected are sorted.
+    ///        O(n) for full sorts of numeric columns, O(n log n) otherwise.
+    /// @throws std::logic_error when column does not exist, or selection is
+    ///         of different row count.
+    std::vector<size_t> sort_positions(const std::string &name,
+                                       ToiletOrder order = TO_ASC,
+                                       size_t limit = TDB_NO_LIMIT,
+                                       const Selection *selection = nullptr) const;
+    /// @brief Same as above, by several columns. Rows equal by first key
+    ///        are compared by the next one, and so on.
+    /// @throws std::logic_error when there are no keys.
+    std::vector<size_t> sort_positions(const std::vector<SortKey> &keys,
+                                       size_t limit = TDB_NO_LIMIT,
+                                       const Selection *selection = nullptr) const;
     /// @brief Get copy of a row from vector as strings.
     ///        One row means a value from each column.
     const std::vector<std::string> get_row(const size_t &pos) const;
+    /// @brief Same as above, for row with this ID. Row is found and read
+    ///        under one lock, so it can't move in between in concurrent mode.
+    /// @returns Empty vector when there is no such row.
+    std::vector<std::string> get_row_by_id(size_t id) const;
     /// @brief Get one row from vector.
     ///        One row means a value from each column.
     /// @warning You will need to get types and cast them yourself.
+    ///          Table can't see writes through these pointers, so it stops
+    ///          caching search results and case-folded values for good once
+    ///          this is called. Snapshots made after that copy values
+    ///          instead of sharing them, and don't see later writes through
+    ///          these pointers. 'uint' columns are decompressed.
+    ///          Use RowRef to edit rows instead.
     /// @see get_types()
     /// @see get_column_type()
+    /// @see get_row_ref()
     std::vector<void *> unsafe_get_mut_row(const size_t &pos);
+    /// @brief Get a view of one row, that reads values straight from columns.
+    ///        Does not allocate or copy anything.
+    /// @see RowView
+    RowView get_row_view(const size_t &pos) const;
+    /// @brief Same as get_row_view(), but values can be changed.
+    /// @see RowRef
+    RowRef get_row_ref(const size_t &pos);
     /// @brief Adds one row. Converts strings to appropriate types.
     ///        One row means a value from each column *EXCEPT* ID.
     /// @warning ID row for new entry will be set automatically.
@@ -212,9 +669,21 @@ public:
     ///              not convertible to int.
     ///          3 - Argument of type 'uint' is found to be
     ///              not convertible to size_t.
+    ///          Row is either added whole, or not at all, even if this throws.
     /// @see get_types()
     /// @see get_column_type()
     int add_row(std::vector<std::string> &args);
+    /// @brief Same as above, but row gets 'id' instead of get_next_id().
+    /// @returns Same error codes as above, and
+    ///          4 - Row with 'id' already exists.
+    int add_row(std::vector<std::string> &args, size_t id);
+    /// @brief Adds one row from typed values, without converting them to
+    ///        strings and back. Strings passed as rvalues are moved.
+    ///        Same rules as add_row() apply: skip the ID column.
+    /// @returns Same error codes as RowBuilder.finish().
+    /// @see RowBuilder
+    template <typename... Args>
+    int emplace_row(Args &&...args);
     /// @brief Erases element with ID.
     bool erase_id(const size_t &id);
     /// @brief Erases element at pos.
@@ -235,8 +704,987 @@ public:
     size_t get_row_count() const;
     /// @return Suitable ID for a new element.
     size_t get_next_id() const;
+    /// @brief Compresses 'uint' columns, choosing the narrowest encoding for
+    ///        each of them. Stays in effect after reread_file().
+    ///        Rows added later are kept uncompressed until next compact().
+    ///        Tables are not compressed on load unless this was called,
+    ///        since erasing rows from a compressed column decompresses it
+    ///        whole, which tables that change often would pay for again
+    ///        and again. Call it on tables that are mostly read.
+    /// @warning Erasing values decompresses the column again. Edits keep
+    ///          it compressed.
+    void compact();
+    /// @brief Memory taken by the table, broken down by column and index.
+    MemoryUsage memory_usage() const;
+    /// @brief Sets amount of threads scans of this table are split between.
+    ///        0 means default set by set_default_thread_count().
+    void set_thread_count(size_t threads);
+    /// @brief Amount set by set_thread_count(), 0 if it wasn't.
+    size_t get_thread_count() const;
+    /// @brief Keeps results of search() by column name and query, up to
+    ///        'bytes' in total, dropping least recently used ones past that.
+    ///        Results are dropped once rows are added, erased or edited, or
+    ///        file is reread. 0 disables the cache, which is the default.
+    void set_search_cache(size_t bytes);
+    CacheStats get_search_cache_stats() const;
+    /// @brief In concurrent mode, table can be used from several threads at
+    ///        once. Methods that only read take a shared lock, and methods
+    ///        that change rows take an exclusive one, for the duration of the
+    ///        call. Same goes for each RowView.get(), RowRef.set() and
+    ///        SearchCursor call. RowBuilder holds the lock from first value
+    ///        of a row until it is finished.
+    ///        Off by default, should be set before table is shared.
+    /// @warning Positions returned by one call can be outdated by the time
+    ///          they are passed to another, if rows were erased in between.
+    ///          RowView.get() throws when its row is gone, but values it
+    ///          returns one by one can come from different writes, and
+    ///          std::string_view it returns is only valid until the row is
+    ///          changed. Readers that need several values or rows as they
+    ///          were at one point should read them from snapshot().
+    ///          References returned by get_column_names() and get_types()
+    ///          are not protected.
+    void set_concurrent(bool concurrent);
+    bool is_concurrent() const;
+    /// @brief Read-only copy of the table as it is now, which later changes
+    ///        to the table don't affect. Columns and index are shared until
+    ///        the table changes them, so readers of a snapshot never wait
+    ///        for writers and writers never wait for them. Same snapshot is
+    ///        returned, without locking, until rows change.
+    ///        Rows added while a snapshot is used don't copy anything, as
+    ///        long as their IDs are larger than the others. First edit or
+    ///        erase of a column while a snapshot still uses it copies the
+    ///        column, so those are cheapest when made in batches between
+    ///        snapshots.
+    ///        Outside of concurrent mode, one thread may change the table
+    ///        while others take snapshots of it and read them.
+    /// @throws std::logic_error when a row is being built on this thread.
+    /// @warning Resource passed to the constructor should outlive snapshots
+    ///          too, and be thread-safe if they are released on other
+    ///          threads.
+    std::shared_ptr<const InMemoryTable> snapshot() const;
+    /// @brief Starts a transaction. Inserts, erases and edits made until
+    ///        commit() or rollback() are recorded in an undo log, by every
+    ///        thread, and are visible to readers right away.
+    ///        Rows are not written by flush(), the background thread or
+    ///        prepare_write() until transaction is over. Writes that were due
+    ///        in the meantime are made then. Transaction that is still open
+    ///        when the table is destroyed is rolled back.
+    /// @throws std::logic_error when a transaction is already started.
+    void begin();
+    /// @brief Keeps changes made since begin() and drops the undo log.
+    ///        Does not write the file.
+    /// @throws std::logic_error when no transaction was started.
+    void commit();
+    /// @brief Undoes changes made since begin(), newest first. Takes time
+    ///        proportional to the changes rather than to the table. Unless
+    ///        rows were written in the meantime, table is left as unchanged
+    ///        as it was at begin(), cached search results included.
+    /// @throws std::logic_error when no transaction was started.
+    void rollback();
+    bool in_transaction() const;
+    /// @brief Starts a background thread that writes the table to its file
+    ///        'delay' milliseconds after first unwritten change, or once
+    ///        'changes' changes pile up, whichever comes first. 0 turns
+    ///        either condition off, and 0 for both stops the thread.
+    ///        Rows are written from a snapshot, so they can change in the
+    ///        meantime. Unwritten changes are written when the thread is
+    ///        stopped or the table is destroyed.
+    ///        Should be called from one thread at a time.
+    /// @see flush(), get_flush_stats()
+    void set_auto_flush(size_t delay, size_t changes);
+    /// @brief Writes changes made so far to the file, from a snapshot.
+    ///        With background thread running, asks it to write right away,
+    ///        and waits for that unless 'wait' is unset. Otherwise writes on
+    ///        calling thread. Does nothing while a transaction is open.
+    /// @throws std::runtime_error when the write failed.
+    /// @throws std::logic_error when a row is being built on this thread.
+    void flush(bool wait = true);
+    FlushStats get_flush_stats() const;
+    /// @brief First half of a write that can be called off. Writes rows as
+    ///        they are now to 'filepath', from a snapshot, and returns their
+    ///        version to pass to finish_write(). Returns 0 and writes
+    ///        nothing when table file has these rows already, or while a
+    ///        transaction is open.
+    /// @throws Same as write_file(), and std::logic_error when a row is
+    ///         being built on this thread.
+    size_t prepare_write(const std::string &filepath) const;
+    /// @brief Second half: moves file written by prepare_write() over the
+    ///        table file, and counts its rows as written. File is removed
+    ///        instead when newer rows were written in the meantime.
+    /// @throws std::runtime_error when file can't be moved.
+    /// @throws std::logic_error when a row is being built on this thread.
+    void finish_write(const std::string &filepath, size_t version) const;
+};
+
+template <>
+Aggregate<int> InMemoryTable::aggregate<int>(const std::string &name,
+                                             const Selection *selection) const;
+template <>
+Aggregate<size_t> InMemoryTable::aggregate<size_t>(const std::string &name,
+                                                   const Selection *selection) const;
+
+/**
+ * @class RowView
+ * @brief Reference to one row of a table. Costs as much as a pointer and a
+ *        position, values are read straight from columns.
+ * @warning Is invalidated by erasing rows, clear() and reread_file().
+ */
+class RowView
+{
+protected:
+    const InMemoryTable *table;
+    size_t pos;
+
+    const ColumnBase &column(size_t column, int type) const;
+
+public:
+    /// @throws std::logic_error when pos is larger than row count.
+    RowView(const InMemoryTable &table, size_t pos);
+    size_t get_pos() const;
+    /// @brief Value of a column in this row. T should be int for 'int'
+    ///        columns, size_t for 'uint', and std::string_view for 'str'.
+    ///        Returned std::string_view is valid until the row is changed.
+    /// @throws std::logic_error when T does not match type of the column,
+    ///         or when pos is past the rows left.
+    /// @see InMemoryTable.set_concurrent()
+    template <typename T>
+    T get(size_t column) const;
+};
+
+template <>
+int RowView::get<int>(size_t column) const;
+template <>
+size_t RowView::get<size_t>(size_t column) const;
+template <>
+std::string_view RowView::get<std::string_view>(size_t column) const;
+
+/**
+ * @class RowRef
+ * @brief RowView that can also change values.
+ * @warning Is invalidated by erasing rows, clear() and reread_file().
+ */
+class RowRef : public RowView
+{
+public:
+    RowRef(InMemoryTable &table, size_t pos);
+    /// @brief Sets 'int' column. Non-negative values can be set to 'uint'.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, int value);
+    /// @brief Sets 'uint' column. Values that fit can be set to 'int'.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, size_t value);
+    /// @brief Sets 'str' column, moving the string into it.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, std::string value);
+};
+
+/**
+ * @class RowBuilder
+ * @brief Appends one row to a table value by value, checking every value
+ *        against get_types(). Values are written straight into columns.
+ *        Unfinished rows are removed when builder is destroyed.
+ *        One RowBuilder can be reused for several rows.
+ * @warning ID column is skipped, it will be set automatically.
+ */
+class RowBuilder
+{
+private:
+    InMemoryTable &table;
+    size_t column;
+    int error;
+    bool locked;
+
+    size_t next_column(int type);
+    RowBuilder &reject(int type);
+    void rollback();
+    void lock();
+    void unlock();
+
+public:
+    RowBuilder(InMemoryTable &table);
+    ~RowBuilder();
+    /// @brief Sets next column of type 'int'. Non-negative values are also
+    ///        accepted by 'uint' columns.
+    RowBuilder &add(int value);
+    /// @brief Sets next column of type 'uint'. Values that fit are also
+    ///        accepted by 'int' columns.
+    RowBuilder &add(size_t value);
+    /// @brief Sets next numeric column from any other integer type, the
+    ///        way add(int) does for signed and add(size_t) for unsigned
+    ///        values. Values too big for both are rejected as not
+    ///        convertible.
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> &&
+                                                      !std::is_same_v<T, bool> &&
+                                                      !std::is_same_v<T, char>>>
+    RowBuilder &add(T value);
+    /// @brief Sets next column of type 'str', moving the string into it.
+    RowBuilder &add(std::string &&value);
+    /// @brief Sets next column of type 'str'.
+    RowBuilder &add(std::string_view value);
+    RowBuilder &add(const char *value);
+    /// @brief Adds ID to the row and makes it visible.
+    /// @returns Returns 0 on success, otherwise the row is discarded.
+    ///          1 - Too many/not enough values.
+    ///          2 - Value is found to be not convertible to int.
+    ///          3 - Value is found to be not convertible to size_t.
+    ///          4 - String was passed to a numeric column, or a number was
+    ///              passed to 'str' column.
+    int finish();
+};
+
+/**
+ * @class SearchCursor
+ * @brief Matches of InMemoryTable.search(), found one by one as they are
+ *        asked for. Rows are scanned in blocks that grow as the cursor goes
+ *        on, so first matches are returned without reading the whole column,
+ *        and nothing is read once limit() is reached.
+ * @warning Is invalidated by any change to the table.
+ */
+class SearchCursor
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Matches 'query' against column 'name' the way
+    ///        InMemoryTable.search() does. With TS_NOCASE, values are folded
+    ///        as they are read unless the table already has a folded copy.
+    /// @throws std::logic_error when column does not exist.
+    SearchCursor(const InMemoryTable &table, const std::string &name,
+                 std::string_view query, int flags = TS_PREFIX);
+    SearchCursor(SearchCursor &&other);
+    SearchCursor &operator=(SearchCursor &&other);
+    ~SearchCursor();
+    /// @brief Skips first 'count' matches.
+    SearchCursor &offset(size_t count);
+    /// @brief Stops after 'count' matches. There is no limit by default.
+    SearchCursor &limit(size_t count);
+    /// @brief Columns callers should read from matched rows, all of them by
+    ///        default. Only changes what get_columns() returns.
+    /// @throws std::logic_error when column does not exist.
+    SearchCursor &select(const std::vector<std::string> &names);
+    /// @brief Positions of columns set by select().
+    const std::vector<size_t> &get_columns() const;
+    /// @brief Position of next match, in order of rows.
+    /// @return TDB_NOT_FOUND when there are no more matches.
+    size_t next();
+};
+
+template <typename T, typename>
+RowBuilder &RowBuilder::add(T value)
+{
+    if constexpr (std::is_signed_v<T>) {
+        if (static_cast<T>(static_cast<int>(value)) == value) {
+            return this->add(static_cast<int>(value));
+        }
+
+        if (value < 0) {
+            return this->reject(TT_INT);
+        }
+    }
+
+    if (static_cast<T>(static_cast<size_t>(value)) != value) {
+        return this->reject(TT_UINT);
+    }
+
+    return this->add(static_cast<size_t>(value));
+}
+
+template <typename... Args>
+int InMemoryTable::emplace_row(Args &&...args)
+{
+    RowBuilder row(*this);
+    (row.add(std::forward<Args>(args)), ...);
+    return row.finish();
+}
+
+/**
+ * @brief Rows and columns picked by a query.
+ * @see Query.run()
+ */
+struct QueryResult
+{
+    /// @brief Positions of rows, in the order they should be shown.
+    std::vector<size_t> rows;
+    /// @brief Positions of columns, in the order they should be shown.
+    std::vector<size_t> columns;
+};
+
+/**
+ * @class Query
+ * @brief Query of form:
+ *
+ *        SELECT * | <column>[, <column>...]
+ *        [WHERE <predicate>]
+ *        [ORDER BY <column> [ASC | DESC][, ...]]
+ *        [LIMIT <count>]
+ *
+ *        Predicate is '<column> <op> <value>', where op is one of
+ *        =, !=, <, <=, > and >=, or '<column> BETWEEN <value> AND <value>'.
+ *        Predicates can be joined with AND, OR and parentheses. Strings are
+ *        quoted with ' or ", keywords are case-insensitive.
+ *
+ *        Query is parsed once, and can then be run against any table that
+ *        has columns it refers to.
+ */
+class Query
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @throws ParsingError when query is malformed.
+    Query(const std::string &text);
+    Query(Query &&other);
+    Query &operator=(Query &&other);
+    ~Query();
+    /// @brief Plans the query for this table and runs it. Predicates on ID
+    ///        column are answered with the index when it narrows rows down
+    ///        enough, otherwise typed columns are scanned.
+    ///        In concurrent mode, query runs on a snapshot of the table, so
+    ///        positions are of rows as they were when it started.
+    /// @throws std::logic_error when columns don't exist, or values can't be
+    ///         compared with them.
+    /// @see InMemoryTable.snapshot()
+    QueryResult run(const InMemoryTable &table) const;
+    /// @brief Plan run() would use for this table, one operator per line.
+    /// @throws Same as run().
+    std::string explain(const InMemoryTable &table) const;
+};
+
+/**
+ * @class ShardedTable
+ * @brief Table split between several shards by hash of ID. Each shard is an
+ *        InMemoryTable in concurrent mode, with a file, lock and index of
+ *        its own, so rows that land in different shards can be added, changed
+ *        and erased from several threads without waiting for each other.
+ *        Shards are loaded, written and scanned in parallel, and results of
+ *        scans are merged.
+ *        Shard i of table 'name' is kept in file 'name.i'.
+ */
+class ShardedTable
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Opens shard files of 'filename'. When there are none yet,
+    ///        splits rows of 'filename' between 'shards' new shard files
+    ///        first. File itself is left as it is.
+    /// @throws std::logic_error when 'shards' is 0, shard files exist for a
+    ///         different amount of shards, or shards have different columns.
+    /// @throws Same as InMemoryTable constructor.
+    ShardedTable(const std::string &filename, size_t shards);
+    ~ShardedTable();
+    size_t get_shard_count() const;
+    /// @brief Shard that row with 'id' is kept in.
+    size_t shard_of(size_t id) const;
+    /// @brief Shard itself, for anything not covered here.
+    /// @warning Rows should be added through ShardedTable, so they get an
+    ///          ID that is unique between shards and hashes to their shard.
+    InMemoryTable &get_shard(size_t shard);
+    const InMemoryTable &get_shard(size_t shard) const;
+    /// @brief Rereads files of all shards, in parallel.
+    /// @see InMemoryTable.reread_file()
+    void reread_file();
+    /// @brief Writes all shards to their files, in parallel.
+    /// @see InMemoryTable.write_file()
+    void write_file() const;
+    /// @brief Adds one row to the shard its new ID hashes to. Only that shard
+    ///        is locked.
+    /// @returns Same error codes as InMemoryTable.add_row().
+    int add_row(std::vector<std::string> &args);
+    bool erase_id(size_t id);
+    /// @brief Copy of a row with 'id' as strings, empty if there is none.
+    std::vector<std::string> get_row(size_t id) const;
+    size_t get_row_count() const;
+    /// @return ID next row will get. IDs are never reused before reread_file().
+    size_t get_next_id() const;
+    size_t get_column_count() const;
+    const std::vector<std::string> &get_column_names() const;
+    /// @see ToiletType
+    const std::vector<int> &get_types() const;
+    /// @brief IDs of rows matching 'query', in ascending order. Each shard is
+    ///        searched on a snapshot, see InMemoryTable.snapshot().
+    /// @see InMemoryTable.search()
+    std::vector<size_t> search(const std::string &name, std::string_view query,
+                               int flags = TS_PREFIX) const;
+    /// @brief Same as above, for rows matching 'pattern'.
+    std::vector<size_t> search(const std::string &name, const Pattern &pattern) const;
+    /// @brief IDs from 'min' to 'max' inclusive that exist, in ascending
+    ///        order.
+    std::vector<size_t> search_range(size_t min, size_t max) const;
+    /// @brief IDs of rows selected by InMemoryTable.filter() in every shard,
+    ///        in ascending order.
+    /// @throws Same as InMemoryTable.filter().
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op, int a,
+                               int b = 0) const;
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op, size_t a,
+                               size_t b = 0) const;
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op,
+                               std::string_view a, std::string_view b = {}) const;
+    /// @brief Aggregates of every shard, merged.
+    /// @throws Same as InMemoryTable.aggregate().
+    template <typename T>
+    Aggregate<T> aggregate(const std::string &name) const;
+};
+
+template <>
+Aggregate<int> ShardedTable::aggregate<int>(const std::string &name) const;
+template <>
+Aggregate<size_t> ShardedTable::aggregate<size_t>(const std::string &name) const;
+
+/**
+ * @brief Counters of one table of a database.
+ * @see Database.get_stats()
+ */
+struct TableStats
+{
+    std::string name;
+    size_t rows;
+    /// @brief Bytes allocated for values and index, see MemoryUsage.
+    size_t allocated;
+    /// @brief Changes that are not in the file yet, see FlushStats.
+    size_t pending;
+    /// @brief Milliseconds it took to read the table when it was opened.
+    double open_ms;
+};
+
+/**
+ * @brief Counters of a database and all of its tables.
+ * @see Database.get_stats()
+ */
+struct DatabaseStats
+{
+    /// @brief One entry per table, in order of names.
+    std::vector<TableStats> tables;
+    /// @brief Sums of the same fields of all tables.
+    size_t rows;
+    size_t allocated;
+    size_t pending;
+    /// @brief Milliseconds it took to open all tables.
+    double open_ms;
+    /// @brief Amount of commit() calls that wrote something.
+    size_t commits;
+    /// @brief Milliseconds last such call took.
+    double last_commit_ms;
+};
+
+/**
+ * @class Database
+ * @brief Tables in one directory, one per '.tdb' file, named after their
+ *        files without extension. Tables are opened in parallel on the
+ *        thread pool scans use, and take memory from one pool shared
+ *        between them.
+ */
+class Database
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Opens every table in 'directory'. Subdirectories are skipped.
+    /// @throws std::runtime_error when directory can't be read.
+    /// @throws Same as InMemoryTable constructor, for first table that
+    ///         failed to open.
+    Database(const std::string &directory);
+    ~Database();
+    const std::string &get_directory() const;
+    /// @brief Names of all tables, sorted.
+    const std::vector<std::string> &get_table_names() const;
+    bool has_table(const std::string &name) const;
+    /// @throws std::logic_error when there is no such table.
+    InMemoryTable &get_table(const std::string &name);
+    const InMemoryTable &get_table(const std::string &name) const;
+    /// @brief Writes every table that changed since it was last written.
+    ///        Rows of all of them are written to temporary files in
+    ///        parallel first, and moved over table files only once every
+    ///        one of them is written, so a commit that failed to write a
+    ///        table leaves all files as they were. Each table is written as
+    ///        it was at some moment during the commit. Tables with an open
+    ///        transaction are skipped.
+    ///        Files are then moved one by one. If moving one fails, files
+    ///        moved before it keep new rows, and temporary files of the rest
+    ///        are removed.
+    /// @returns Amount of tables written.
+    /// @throws Same as InMemoryTable.prepare_write() and finish_write(), or
+    ///         PartialCommit when some files were moved before one failed.
+    size_t commit();
+    DatabaseStats get_stats() const;
 };
 
 }; // namespace toiletdb
 
+// Async API needs coroutines, and is left out of C++17 builds, where only
+// the blocking API is there.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+/// @brief Defined when async API is available.
+#define TDB_ASYNC 1
+#endif
+
+#ifdef TDB_ASYNC
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace toiletdb {
+
+template <typename T>
+class Task;
+
+// Resumes whoever awaits the task once it's done.
+struct TaskFinal
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+    {
+        std::coroutine_handle<> next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept
+    {}
+};
+
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // Tasks start when they are awaited.
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    TaskFinal final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        this->error = std::current_exception();
+    }
+
+    void rethrow() const
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+    }
+
+    void return_value(T value)
+    {
+        this->value.emplace(std::move(value));
+    }
+
+    T result()
+    {
+        this->rethrow();
+        return std::move(*this->value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void()
+    {}
+
+    void result()
+    {
+        this->rethrow();
+    }
+};
+
+/**
+ * @class Task
+ * @brief Result of an async call, to be co_await'ed. Does nothing until it
+ *        is awaited, then runs until its work is offloaded to the thread
+ *        pool, and resumes the awaiting coroutine once it's done, on the
+ *        thread that did the work. Exceptions are rethrown from co_await.
+ * @see offload(), sync_wait()
+ */
+template <typename T>
+class [[nodiscard]] Task
+{
+private:
+    std::coroutine_handle<TaskPromise<T>> handle;
+
+    template <typename U>
+    friend U sync_wait(Task<U> task);
+
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<TaskPromise<T>> handle) :
+        handle(handle)
+    {}
+
+    Task(Task &&other) noexcept :
+        handle(std::exchange(other.handle, nullptr))
+    {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other) {
+            if (this->handle) {
+                this->handle.destroy();
+            }
+
+            this->handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (this->handle) {
+            this->handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        this->handle.promise().continuation = awaiting;
+        return this->handle;
+    }
+
+    T await_resume()
+    {
+        return this->handle.promise().result();
+    }
+};
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+/**
+ * @class Offload
+ * @brief Awaitable that calls f() on a thread of the pool scans use, and
+ *        resumes the awaiting coroutine with its result on that thread.
+ * @see offload()
+ */
+template <typename F>
+class Offload
+{
+private:
+    using Result = std::invoke_result_t<F &>;
+    using Value  = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+
+    F f;
+    std::coroutine_handle<> handle;
+    std::optional<Value> value;
+    std::exception_ptr error;
+
+    static void run(void *context)
+    {
+        Offload &self = *static_cast<Offload *>(context);
+
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                self.f();
+            }
+            else {
+                self.value.emplace(self.f());
+            }
+        }
+        catch (...) {
+            self.error = std::current_exception();
+        }
+
+        // Coroutine can finish and free this awaitable before resume()
+        // returns, so it's not touched after.
+        self.handle.resume();
+    }
+
+public:
+    explicit Offload(F f) :
+        f(std::move(f))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+        post_task(&Offload::run, this);
+    }
+
+    Result await_resume()
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*this->value);
+        }
+    }
+};
+
+/**
+ * @brief co_await offload(f) calls f() on a thread of the pool and gives
+ *        back what it returned, or rethrows what it threw. For blocking
+ *        calls that have no async version. Anything f refers to should stay
+ *        alive until co_await returns.
+ * @see post_task()
+ */
+template <typename F>
+Offload<std::decay_t<F>> offload(F &&f)
+{
+    return Offload<std::decay_t<F>>(std::forward<F>(f));
+}
+
+// Wakes sync_wait() once the task it waits on is done.
+struct SyncLatch
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+
+    void set()
+    {
+        // Notified under the lock, since waiter frees the latch as soon as
+        // it sees 'done'.
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        this->done = true;
+        this->cv.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cv.wait(lock, [this]() { return this->done; });
+    }
+};
+
+struct SyncWaiter
+{
+    struct promise_type
+    {
+        SyncLatch &latch;
+
+        promise_type(SyncLatch &latch) :
+            latch(latch)
+        {}
+
+        SyncWaiter get_return_object()
+        {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        // Latch is set only once coroutine is suspended, so sync_wait() can
+        // destroy it right away.
+        auto final_suspend() const noexcept
+        {
+            struct Final
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+                {
+                    handle.promise().latch.set();
+                }
+
+                void await_resume() const noexcept
+                {}
+            };
+
+            return Final{};
+        }
+
+        void return_void()
+        {}
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+inline SyncWaiter make_sync_waiter(SyncLatch &)
+{
+    co_return;
+}
+
+/**
+ * @brief Runs the task and blocks until it's done, for code that is not a
+ *        coroutine itself.
+ * @returns What task returned.
+ * @throws What task threw.
+ */
+template <typename T>
+T sync_wait(Task<T> task)
+{
+    SyncLatch latch;
+    SyncWaiter waiter = make_sync_waiter(latch);
+
+    task.handle.promise().continuation = waiter.handle;
+    task.handle.resume();
+
+    latch.wait();
+    waiter.handle.destroy();
+
+    return task.handle.promise().result();
+}
+
+// Async versions of blocking calls. Each does its work on a thread of the
+// pool, and resumes the awaiting coroutine there. Tables, databases, patterns
+// and queries passed by reference should stay alive until the task is done.
+// Tables used from several coroutines at once should be set concurrent.
+
+/// @see InMemoryTable constructor.
+inline Task<std::unique_ptr<InMemoryTable>> open_table_async(std::string filename)
+{
+    co_return co_await offload([&]() { return std::make_unique<InMemoryTable>(filename); });
+}
+
+/// @see Database constructor.
+inline Task<std::unique_ptr<Database>> open_database_async(std::string directory)
+{
+    co_return co_await offload([&]() { return std::make_unique<Database>(directory); });
+}
+
+/// @see InMemoryTable.reread_file()
+inline Task<void> reread_file_async(InMemoryTable &table)
+{
+    co_await offload([&]() { table.reread_file(); });
+}
+
+/// @see InMemoryTable.write_file()
+inline Task<void> write_file_async(const InMemoryTable &table)
+{
+    co_await offload([&]() { table.write_file(); });
+}
+
+/// @see Database.commit()
+inline Task<size_t> commit_async(Database &database)
+{
+    co_return co_await offload([&]() { return database.commit(); });
+}
+
+/// @see InMemoryTable.get_row_by_id()
+inline Task<std::vector<std::string>> get_row_async(const InMemoryTable &table, size_t id)
+{
+    co_return co_await offload([&]() { return table.get_row_by_id(id); });
+}
+
+/// @see InMemoryTable.search()
+inline Task<std::vector<size_t>> search_async(const InMemoryTable &table, std::string name,
+                                              std::string query, int flags = TS_PREFIX)
+{
+    co_return co_await offload([&]() { return table.search(name, query, flags); });
+}
+
+/// @see InMemoryTable.search()
+inline Task<std::vector<size_t>> search_async(const InMemoryTable &table, std::string name,
+                                              const Pattern &pattern)
+{
+    co_return co_await offload([&]() { return table.search(name, pattern); });
+}
+
+/// @see InMemoryTable.search_range()
+inline Task<std::vector<size_t>> search_range_async(const InMemoryTable &table, size_t min,
+                                                    size_t max)
+{
+    co_return co_await offload([&]() { return table.search_range(min, max); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, int a, int b = 0)
+{
+    co_return co_await offload([&]() { return table.filter(name, op, a, b); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, size_t a, size_t b = 0)
+{
+    co_return co_await offload([&]() { return table.filter(name, op, a, b); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, std::string a, std::string b = {})
+{
+    co_return co_await offload([&]() {
+        return table.filter(name, op, std::string_view(a), std::string_view(b));
+    });
+}
+
+/// @see InMemoryTable.aggregate()
+template <typename T>
+Task<Aggregate<T>> aggregate_async(const InMemoryTable &table, std::string name)
+{
+    co_return co_await offload([&]() { return table.aggregate<T>(name); });
+}
+
+/// @see Query.run()
+inline Task<QueryResult> query_async(const InMemoryTable &table, const Query &query)
+{
+    co_return co_await offload([&]() { return query.run(table); });
+}
+
+} // namespace toiletdb
+
+#endif // TDB_ASYNC
+
 #endif // TOILETDB_H_
@@ -0,0 +1,477 @@
+#ifndef TOILET_ASYNC_H_
+#define TOILET_ASYNC_H_
+
+// Async API needs coroutines, and is left out of C++17 builds, where only
+// the blocking API is there.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+/// @brief Defined when async API is available.
+#define TDB_ASYNC 1
+#endif
+
+#ifdef TDB_ASYNC
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "database.hpp"
+#include "parallel.hpp"
+#include "query.hpp"
+#include "table.hpp"
+
+namespace toiletdb {
+
+template <typename T>
+class Task;
+
+// Resumes whoever awaits the task once it's done.
+struct TaskFinal
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+    {
+        std::coroutine_handle<> next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept
+    {}
+};
+
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // Tasks start when they are awaited.
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    TaskFinal final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        this->error = std::current_exception();
+    }
+
+    void rethrow() const
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+    }
+
+    void return_value(T value)
+    {
+        this->value.emplace(std::move(value));
+    }
+
+    T result()
+    {
+        this->rethrow();
+        return std::move(*this->value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void()
+    {}
+
+    void result()
+    {
+        this->rethrow();
+    }
+};
+
+/**
+ * @class Task
+ * @brief Result of an async call, to be co_await'ed. Does nothing until it
+ *        is awaited, then runs until its work is offloaded to the thread
+ *        pool, and resumes the awaiting coroutine once it's done, on the
+ *        thread that did the work. Exceptions are rethrown from co_await.
+ * @see offload(), sync_wait()
+ */
+template <typename T>
+class [[nodiscard]] Task
+{
+private:
+    std::coroutine_handle<TaskPromise<T>> handle;
+
+    template <typename U>
+    friend U sync_wait(Task<U> task);
+
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<TaskPromise<T>> handle) :
+        handle(handle)
+    {}
+
+    Task(Task &&other) noexcept :
+        handle(std::exchange(other.handle, nullptr))
+    {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other) {
+            if (this->handle) {
+                this->handle.destroy();
+            }
+
+            this->handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (this->handle) {
+            this->handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        this->handle.promise().continuation = awaiting;
+        return this->handle;
+    }
+
+    T await_resume()
+    {
+        return this->handle.promise().result();
+    }
+};
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+/**
+ * @class Offload
+ * @brief Awaitable that calls f() on a thread of the pool scans use, and
+ *        resumes the awaiting coroutine with its result on that thread.
+ * @see offload()
+ */
+template <typename F>
+class Offload
+{
+private:
+    using Result = std::invoke_result_t<F &>;
+    using Value  = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+
+    F f;
+    std::coroutine_handle<> handle;
+    std::optional<Value> value;
+    std::exception_ptr error;
+
+    static void run(void *context)
+    {
+        Offload &self = *static_cast<Offload *>(context);
+
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                self.f();
+            }
+            else {
+                self.value.emplace(self.f());
+            }
+        }
+        catch (...) {
+            self.error = std::current_exception();
+        }
+
+        // Coroutine can finish and free this awaitable before resume()
+        // returns, so it's not touched after.
+        self.handle.resume();
+    }
+
+public:
+    explicit Offload(F f) :
+        f(std::move(f))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+        post_task(&Offload::run, this);
+    }
+
+    Result await_resume()
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*this->value);
+        }
+    }
+};
+
+/**
+ * @brief co_await offload(f) calls f() on a thread of the pool and gives
+ *        back what it returned, or rethrows what it threw. For blocking
+ *        calls that have no async version. Anything f refers to should stay
+ *        alive until co_await returns.
+ * @see post_task()
+ */
+template <typename F>
+Offload<std::decay_t<F>> offload(F &&f)
+{
+    return Offload<std::decay_t<F>>(std::forward<F>(f));
+}
+
+// Wakes sync_wait() once the task it waits on is done.
+struct SyncLatch
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+
+    void set()
+    {
+        // Notified under the lock, since waiter frees the latch as soon as
+        // it sees 'done'.
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        this->done = true;
+        this->cv.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cv.wait(lock, [this]() { return this->done; });
+    }
+};
+
+struct SyncWaiter
+{
+    struct promise_type
+    {
+        SyncLatch &latch;
+
+        promise_type(SyncLatch &latch) :
+            latch(latch)
+        {}
+
+        SyncWaiter get_return_object()
+        {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        // Latch is set only once coroutine is suspended, so sync_wait() can
+        // destroy it right away.
+        auto final_suspend() const noexcept
+        {
+            struct Final
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+                {
+                    handle.promise().latch.set();
+                }
+
+                void await_resume() const noexcept
+                {}
+            };
+
+            return Final{};
+        }
+
+        void return_void()
+        {}
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+inline SyncWaiter make_sync_waiter(SyncLatch &)
+{
+    co_return;
+}
+
+/**
+ * @brief Runs the task and blocks until it's done, for code that is not a
+ *        coroutine itself.
+ * @returns What task returned.
+ * @throws What task threw.
+ */
+template <typename T>
+T sync_wait(Task<T> task)
+{
+    SyncLatch latch;
+    SyncWaiter waiter = make_sync_waiter(latch);
+
+    task.handle.promise().continuation = waiter.handle;
+    task.handle.resume();
+
+    latch.wait();
+    waiter.handle.destroy();
+
+    return task.handle.promise().result();
+}
+
+// Async versions of blocking calls. Each does its work on a thread of the
+// pool, and resumes the awaiting coroutine there. Tables, databases, patterns
+// and queries passed by reference should stay alive until the task is done.
+// Tables used from several coroutines at once should be set concurrent.
+
+/// @see InMemoryTable constructor.
+inline Task<std::unique_ptr<InMemoryTable>> open_table_async(std::string filename)
+{
+    co_return co_await offload([&]() { return std::make_unique<InMemoryTable>(filename); });
+}
+
+/// @see Database constructor.
+inline Task<std::unique_ptr<Database>> open_database_async(std::string directory)
+{
+    co_return co_await offload([&]() { return std::make_unique<Database>(directory); });
+}
+
+/// @see InMemoryTable.reread_file()
+inline Task<void> reread_file_async(InMemoryTable &table)
+{
+    co_await offload([&]() { table.reread_file(); });
+}
+
+/// @see InMemoryTable.write_file()
+inline Task<void> write_file_async(const InMemoryTable &table)
+{
+    co_await offload([&]() { table.write_file(); });
+}
+
+/// @see Database.commit()
+inline Task<size_t> commit_async(Database &database)
+{
+    co_return co_await offload([&]() { return database.commit(); });
+}
+
+/// @see InMemoryTable.get_row_by_id()
+inline Task<std::vector<std::string>> get_row_async(const InMemoryTable &table, size_t id)
+{
+    co_return co_await offload([&]() { return table.get_row_by_id(id); });
+}
+
+/// @see InMemoryTable.search()
+inline Task<std::vector<size_t>> search_async(const InMemoryTable &table, std::string name,
+                                              std::string query, int flags = TS_PREFIX)
+{
+    co_return co_await offload([&]() { return table.search(name, query, flags); });
+}
+
+/// @see InMemoryTable.search()
+inline Task<std::vector<size_t>> search_async(const InMemoryTable &table, std::string name,
+                                              const Pattern &pattern)
+{
+    co_return co_await offload([&]() { return table.search(name, pattern); });
+}
+
+/// @see InMemoryTable.search_range()
+inline Task<std::vector<size_t>> search_range_async(const InMemoryTable &table, size_t min,
+                                                    size_t max)
+{
+    co_return co_await offload([&]() { return table.search_range(min, max); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, int a, int b = 0)
+{
+    co_return co_await offload([&]() { return table.filter(name, op, a, b); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, size_t a, size_t b = 0)
+{
+    co_return co_await offload([&]() { return table.filter(name, op, a, b); });
+}
+
+/// @see InMemoryTable.filter()
+inline Task<Selection> filter_async(const InMemoryTable &table, std::string name,
+                                    ToiletCompare op, std::string a, std::string b = {})
+{
+    co_return co_await offload([&]() {
+        return table.filter(name, op, std::string_view(a), std::string_view(b));
+    });
+}
+
+/// @see InMemoryTable.aggregate()
+template <typename T>
+Task<Aggregate<T>> aggregate_async(const InMemoryTable &table, std::string name)
+{
+    co_return co_await offload([&]() { return table.aggregate<T>(name); });
+}
+
+/// @see Query.run()
+inline Task<QueryResult> query_async(const InMemoryTable &table, const Query &query)
+{
+    co_return co_await offload([&]() { return query.run(table); });
+}
+
+} // namespace toiletdb
+
+#endif // TDB_ASYNC
+
+#endif // TOILET_ASYNC_H_
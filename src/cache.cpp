@@ -0,0 +1,101 @@
+#include "cache.hpp"
+
+namespace toiletdb {
+
+SearchCache::SearchCache() :
+    capacity(0), bytes(0), hits(0), misses(0), evictions(0)
+{}
+
+void SearchCache::erase(std::list<Entry>::iterator it)
+{
+    this->bytes -= it->bytes;
+    this->index.erase(it->key);
+    this->entries.erase(it);
+}
+
+void SearchCache::shrink(size_t capacity)
+{
+    while (this->bytes > capacity) {
+        this->erase(std::prev(this->entries.end()));
+        ++this->evictions;
+    }
+}
+
+void SearchCache::set_capacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->capacity = capacity;
+    this->shrink(capacity);
+}
+
+bool SearchCache::is_enabled()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    return this->capacity != 0;
+}
+
+bool SearchCache::find(const std::string &key, uint64_t epoch, std::vector<size_t> &out)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    auto found = this->index.find(key);
+
+    if (found == this->index.end() || found->second->epoch != epoch) {
+        if (found != this->index.end()) {
+            this->erase(found->second);
+        }
+
+        ++this->misses;
+        return false;
+    }
+
+    // Moves entry to the front.
+    this->entries.splice(this->entries.begin(), this->entries, found->second);
+    out = found->second->positions;
+
+    ++this->hits;
+    return true;
+}
+
+void SearchCache::insert(std::string key, uint64_t epoch, const std::vector<size_t> &positions)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    size_t bytes = sizeof(Entry) + key.size() + positions.size() * sizeof(size_t);
+
+    // Results that would push out everything else are not worth keeping.
+    if (bytes > this->capacity) {
+        return;
+    }
+
+    auto found = this->index.find(key);
+
+    if (found != this->index.end()) {
+        this->erase(found->second);
+    }
+
+    this->shrink(this->capacity - bytes);
+
+    this->entries.push_front({std::move(key), epoch, positions, bytes});
+    this->index.emplace(this->entries.front().key, this->entries.begin());
+    this->bytes += bytes;
+}
+
+void SearchCache::clear()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->shrink(0);
+}
+
+CacheStats SearchCache::stats()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    return {this->hits, this->misses, this->evictions, this->entries.size(),
+            this->bytes, this->capacity};
+}
+
+} // namespace toiletdb
@@ -0,0 +1,82 @@
+#ifndef TOILET_CACHE_H_
+#define TOILET_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace toiletdb {
+
+/**
+ * @brief Counters and size of a table's search cache.
+ * @see InMemoryTable.set_search_cache()
+ */
+struct CacheStats
+{
+    size_t hits;
+    size_t misses;
+    /// @brief Entries dropped to stay under the cap.
+    size_t evictions;
+    size_t entries;
+    /// @brief Bytes taken by cached keys and positions.
+    size_t bytes;
+    /// @brief Cap on bytes, 0 when cache is disabled.
+    size_t capacity;
+};
+
+/**
+ * @class SearchCache
+ * @brief Least recently used cache of positions returned by
+ *        InMemoryTable.search(), keyed by column and query.
+ *        Each entry remembers epoch of its column at the time it was
+ *        computed, and is only returned while epoch stays the same.
+ *        Can be used from several threads at once.
+ */
+class SearchCache
+{
+private:
+    struct Entry
+    {
+        std::string key;
+        uint64_t epoch;
+        std::vector<size_t> positions;
+        size_t bytes;
+    };
+
+    std::mutex mutex;
+    // Most recently used first.
+    std::list<Entry> entries;
+    // Keys point into entries, which don't move.
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    size_t capacity;
+    size_t bytes;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+
+    void erase(std::list<Entry>::iterator it);
+    void shrink(size_t capacity);
+
+public:
+    SearchCache();
+    /// @brief Sets cap on bytes, evicting entries past it. 0 drops every
+    ///        entry and disables the cache.
+    void set_capacity(size_t capacity);
+    bool is_enabled();
+    /// @brief Copies positions of entry 'key' into 'out' if it was computed
+    ///        at 'epoch'. Stale entries are dropped.
+    bool find(const std::string &key, uint64_t epoch, std::vector<size_t> &out);
+    /// @brief Adds entry, or replaces one with the same key.
+    void insert(std::string key, uint64_t epoch, const std::vector<size_t> &positions);
+    /// @brief Drops every entry, counters are kept.
+    void clear();
+    CacheStats stats();
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_CACHE_H_
@@ -3,14 +3,18 @@
 
 #include <cctype>
 #include <climits>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define TOILETDB_VERSION "1.3.4"
 
 #define TDB_NOT_FOUND (size_t)(-1)
+/// @brief Limit that does not limit anything.
+#define TDB_NO_LIMIT (size_t)(-1)
 
 #define TDB_INVALID_ULL (size_t)(-1)
 #define TDB_INVALID_I 2147483647
@@ -20,12 +24,12 @@ namespace toiletdb {
  *  @brief Parse size_t.
  *  @return TDB_INVALID_ULL if string cannot be parsed.i
  */
-size_t parse_long_long(const std::string &str);
+size_t parse_long_long(std::string_view str);
 /**
  *  @brief Parse signed int.
  *  return TDB_INVALID_I if string cannot be parsed.
  */
-int parse_int(const std::string &str);
+int parse_int(std::string_view str);
 /**
  *  @brief Returns copy of a string with all characters lowercased.
  */
@@ -34,6 +38,15 @@ std::string to_lower_string(const std::string &str);
  *  @brief Replaces all characters in a string with their lowercase variants.
  */
 void to_lower_pstring(std::string &str);
+/**
+ *  @brief Returns copy of a UTF-8 string with simple case folding applied,
+ *         so strings that differ only in case fold to the same string.
+ *         Covers Latin, Greek, Cyrillic and Armenian letters of the Basic
+ *         Multilingual Plane, folded as Unicode CaseFolding.txt (status C
+ *         and S) folds them. Other characters are left as they are.
+ *         Bytes that are not valid UTF-8 are copied as is.
+ */
+std::string fold_case(std::string_view str);
 
 template <class T>
 std::vector<std::shared_ptr<T>> vector_raw_into_shared(std::vector<T *> &v)
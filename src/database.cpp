@@ -0,0 +1,252 @@
+#include "database.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <numeric>
+
+namespace toiletdb {
+
+struct Database::Private
+{
+    std::string directory;
+    // Tables take memory from here. Declared before tables, so it outlives
+    // them.
+    std::pmr::synchronized_pool_resource pool;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<InMemoryTable>> tables;
+    std::vector<double> open_ms;
+    double total_open_ms;
+    // One commit at a time, since they share temporary files.
+    std::mutex commit_mutex;
+    size_t commits;
+    double last_commit_ms;
+
+    Private(const std::string &directory) :
+        directory(directory), total_open_ms(0), commits(0), last_commit_ms(0)
+    {}
+
+    std::string table_path(size_t table) const
+    {
+        return (std::filesystem::path(this->directory) /
+                (this->names[table] + TDB_TABLE_EXTENSION))
+            .string();
+    }
+
+    // Rows are written here before they are moved over the table file.
+    std::string commit_path(size_t table) const
+    {
+        return this->table_path(table) + ".commit";
+    }
+
+    size_t find(const std::string &name) const
+    {
+        std::vector<std::string>::const_iterator it =
+            std::lower_bound(this->names.begin(), this->names.end(), name);
+
+        if (it == this->names.end() || *it != name) {
+            return TDB_NOT_FOUND;
+        }
+
+        return it - this->names.begin();
+    }
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+Database::Database(const std::string &directory) :
+    internal(std::make_unique<Private>(directory))
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<std::string, uintmax_t>> files;
+
+    try {
+        for (const std::filesystem::directory_entry &entry :
+             std::filesystem::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == TDB_TABLE_EXTENSION) {
+                files.emplace_back(entry.path().stem().string(), entry.file_size());
+            }
+        }
+    }
+    catch (const std::filesystem::filesystem_error &e) {
+        throw std::runtime_error("In ToiletDB, In Database(), Could not read directory '" +
+                                 directory + "': " + e.what());
+    }
+
+    std::sort(files.begin(), files.end());
+
+    size_t count = files.size();
+
+    this->internal->names.reserve(count);
+
+    for (const std::pair<std::string, uintmax_t> &file : files) {
+        this->internal->names.push_back(file.first);
+    }
+
+    this->internal->tables.resize(count);
+    this->internal->open_ms.resize(count);
+
+    // Largest tables go first, so one of them is not left for last while
+    // other threads sit idle.
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+        return files[a].second > files[b].second;
+    });
+
+    for_each_task(count, get_default_thread_count(), [this, &order](size_t task) {
+        size_t table = order[task];
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        this->internal->tables[table] = std::make_unique<InMemoryTable>(
+            this->internal->table_path(table), &this->internal->pool);
+        this->internal->open_ms[table] = elapsed_ms(start);
+    });
+
+    this->internal->total_open_ms = elapsed_ms(start);
+}
+
+Database::~Database()
+{}
+
+const std::string &Database::get_directory() const
+{
+    return this->internal->directory;
+}
+
+const std::vector<std::string> &Database::get_table_names() const
+{
+    return this->internal->names;
+}
+
+bool Database::has_table(const std::string &name) const
+{
+    return this->internal->find(name) != TDB_NOT_FOUND;
+}
+
+InMemoryTable &Database::get_table(const std::string &name)
+{
+    size_t table = this->internal->find(name);
+
+    if (table == TDB_NOT_FOUND) {
+        throw std::logic_error("In ToiletDB, In Database.get_table(), Table '" + name +
+                               "' does not exist");
+    }
+
+    return *this->internal->tables[table];
+}
+
+const InMemoryTable &Database::get_table(const std::string &name) const
+{
+    return const_cast<Database *>(this)->get_table(name);
+}
+
+size_t Database::commit()
+{
+    std::lock_guard<std::mutex> lock(this->internal->commit_mutex);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t count = this->internal->tables.size();
+    std::vector<size_t> versions(count);
+
+    // Rows of every table are written next to it first.
+    try {
+        for_each_task(count, get_default_thread_count(), [this, &versions](size_t table) {
+            std::string path = this->internal->commit_path(table);
+
+            // Left over by a commit that did not finish.
+            std::remove(path.c_str());
+
+            versions[table] = this->internal->tables[table]->prepare_write(path);
+        });
+    }
+    catch (...) {
+        for (size_t table = 0; table < count; ++table) {
+            std::remove(this->internal->commit_path(table).c_str());
+        }
+
+        throw;
+    }
+
+    // And are moved over table files only once all of them are written.
+    std::vector<std::string> committed;
+
+    for (size_t table = 0; table < count; ++table) {
+        if (!versions[table]) {
+            continue;
+        }
+
+        try {
+            this->internal->tables[table]->finish_write(this->internal->commit_path(table),
+                                                        versions[table]);
+        }
+        catch (const std::exception &e) {
+            for (size_t rest = table; rest < count; ++rest) {
+                std::remove(this->internal->commit_path(rest).c_str());
+            }
+
+            if (committed.empty()) {
+                throw;
+            }
+
+            std::string message = "In ToiletDB, In Database.commit(), Table '" +
+                                  this->internal->names[table] + "' was not committed after " +
+                                  std::to_string(committed.size()) +
+                                  " other tables were: " + e.what();
+
+            throw PartialCommit(message, std::move(committed));
+        }
+
+        committed.push_back(this->internal->names[table]);
+    }
+
+    if (!committed.empty()) {
+        ++this->internal->commits;
+        this->internal->last_commit_ms = elapsed_ms(start);
+    }
+
+    return committed.size();
+}
+
+DatabaseStats Database::get_stats() const
+{
+    DatabaseStats stats = {};
+
+    stats.open_ms = this->internal->total_open_ms;
+
+    for (size_t table = 0; table < this->internal->tables.size(); ++table) {
+        const InMemoryTable &t = *this->internal->tables[table];
+
+        TableStats entry;
+
+        entry.name      = this->internal->names[table];
+        entry.rows      = t.get_row_count();
+        entry.allocated = t.memory_usage().allocated;
+        entry.pending   = t.get_flush_stats().pending;
+        entry.open_ms   = this->internal->open_ms[table];
+
+        stats.rows += entry.rows;
+        stats.allocated += entry.allocated;
+        stats.pending += entry.pending;
+
+        stats.tables.push_back(std::move(entry));
+    }
+
+    std::lock_guard<std::mutex> lock(this->internal->commit_mutex);
+
+    stats.commits        = this->internal->commits;
+    stats.last_commit_ms = this->internal->last_commit_ms;
+
+    return stats;
+}
+
+} // namespace toiletdb
@@ -0,0 +1,98 @@
+#ifndef TOILET_DATABASE_H_
+#define TOILET_DATABASE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include "table.hpp"
+
+/// @brief Extension of table files a Database opens.
+#define TDB_TABLE_EXTENSION ".tdb"
+
+namespace toiletdb {
+
+/**
+ * @brief Counters of one table of a database.
+ * @see Database.get_stats()
+ */
+struct TableStats
+{
+    std::string name;
+    size_t rows;
+    /// @brief Bytes allocated for values and index, see MemoryUsage.
+    size_t allocated;
+    /// @brief Changes that are not in the file yet, see FlushStats.
+    size_t pending;
+    /// @brief Milliseconds it took to read the table when it was opened.
+    double open_ms;
+};
+
+/**
+ * @brief Counters of a database and all of its tables.
+ * @see Database.get_stats()
+ */
+struct DatabaseStats
+{
+    /// @brief One entry per table, in order of names.
+    std::vector<TableStats> tables;
+    /// @brief Sums of the same fields of all tables.
+    size_t rows;
+    size_t allocated;
+    size_t pending;
+    /// @brief Milliseconds it took to open all tables.
+    double open_ms;
+    /// @brief Amount of commit() calls that wrote something.
+    size_t commits;
+    /// @brief Milliseconds last such call took.
+    double last_commit_ms;
+};
+
+/**
+ * @class Database
+ * @brief Tables in one directory, one per '.tdb' file, named after their
+ *        files without extension. Tables are opened in parallel on the
+ *        thread pool scans use, and take memory from one pool shared
+ *        between them.
+ */
+class Database
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Opens every table in 'directory'. Subdirectories are skipped.
+    /// @throws std::runtime_error when directory can't be read.
+    /// @throws Same as InMemoryTable constructor, for first table that
+    ///         failed to open.
+    Database(const std::string &directory);
+    ~Database();
+    const std::string &get_directory() const;
+    /// @brief Names of all tables, sorted.
+    const std::vector<std::string> &get_table_names() const;
+    bool has_table(const std::string &name) const;
+    /// @throws std::logic_error when there is no such table.
+    InMemoryTable &get_table(const std::string &name);
+    const InMemoryTable &get_table(const std::string &name) const;
+    /// @brief Writes every table that changed since it was last written.
+    ///        Rows of all of them are written to temporary files in
+    ///        parallel first, and moved over table files only once every
+    ///        one of them is written, so a commit that failed to write a
+    ///        table leaves all files as they were. Each table is written as
+    ///        it was at some moment during the commit. Tables with an open
+    ///        transaction are skipped.
+    ///        Files are then moved one by one. If moving one fails, files
+    ///        moved before it keep new rows, and temporary files of the rest
+    ///        are removed.
+    /// @returns Amount of tables written.
+    /// @throws Same as InMemoryTable.prepare_write() and finish_write(), or
+    ///         PartialCommit when some files were moved before one failed.
+    size_t commit();
+    DatabaseStats get_stats() const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_DATABASE_H_
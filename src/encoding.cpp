@@ -0,0 +1,452 @@
+#include <algorithm>
+
+#include "encoding.hpp"
+
+namespace toiletdb {
+
+// Amount of bits needed to store value.
+static size_t bit_width(size_t value)
+{
+    size_t bits = 0;
+
+    while (value) {
+        value >>= 1;
+        ++bits;
+    }
+
+    return bits;
+}
+
+// Amount of words needed to store 'count' values of 'bits' width.
+static size_t words_for(size_t count, size_t bits)
+{
+    return (count * bits + 63) / 64;
+}
+
+static void put_bits(uint64_t *words, size_t offset, size_t bits, uint64_t value)
+{
+    size_t word  = offset >> 6;
+    size_t shift = offset & 63;
+
+    words[word] |= value << shift;
+
+    if (shift + bits > 64) {
+        words[word + 1] |= value >> (64 - shift);
+    }
+}
+
+// Same as put_bits(), over bits that are set already.
+static void replace_bits(uint64_t *words, size_t offset, size_t bits, uint64_t value)
+{
+    if (bits == 0) {
+        return;
+    }
+
+    uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    size_t word   = offset >> 6;
+    size_t shift  = offset & 63;
+
+    words[word] &= ~(mask << shift);
+
+    if (shift + bits > 64) {
+        words[word + 1] &= ~(mask >> (64 - shift));
+    }
+
+    put_bits(words, offset, bits, value);
+}
+
+// Whether predicate holds for every value in [lo, hi].
+// Returns 1 if it always does, 0 if it never does, -1 if values should be
+// checked one by one.
+static int decide(ToiletCompare op, size_t a, size_t b, size_t lo, size_t hi)
+{
+    switch (op) {
+        case TC_EQ: {
+            if (a < lo || a > hi) return 0;
+            if (lo == a && hi == a) return 1;
+        } break;
+
+        case TC_NE: {
+            if (a < lo || a > hi) return 1;
+            if (lo == a && hi == a) return 0;
+        } break;
+
+        case TC_LT: {
+            if (hi < a) return 1;
+            if (lo >= a) return 0;
+        } break;
+
+        case TC_LE: {
+            if (hi <= a) return 1;
+            if (lo > a) return 0;
+        } break;
+
+        case TC_GT: {
+            if (lo > a) return 1;
+            if (hi <= a) return 0;
+        } break;
+
+        case TC_GE: {
+            if (lo >= a) return 1;
+            if (hi < a) return 0;
+        } break;
+
+        case TC_BETWEEN: {
+            if (a > b || hi < a || lo > b) return 0;
+            if (lo >= a && hi <= b) return 1;
+        } break;
+    }
+
+    return -1;
+}
+
+static void fill_bits(uint64_t *out, size_t count, bool value)
+{
+    size_t full = count / 64;
+
+    std::fill(out, out + full, value ? ~0ULL : 0ULL);
+
+    if (count % 64) {
+        out[full] = value ? (1ULL << (count % 64)) - 1 : 0;
+    }
+}
+
+PackedUints::PackedUints(std::pmr::memory_resource *resource) :
+    words(resource), groups(resource), loose(resource), loose_at(resource)
+{
+    this->kind  = PACKED_FOR;
+    this->count = 0;
+    this->min   = 0;
+    this->max   = 0;
+    this->base  = 0;
+    this->bits  = 0;
+}
+
+std::unique_ptr<PackedUints> PackedUints::encode(const size_t *values, size_t count,
+                                                 std::pmr::memory_resource *resource)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+
+    size_t min  = values[0];
+    size_t max  = values[0];
+    bool sorted = true;
+
+    for (size_t i = 1; i < count; ++i) {
+        min    = std::min(min, values[i]);
+        max    = std::max(max, values[i]);
+        sorted = sorted && values[i - 1] <= values[i];
+    }
+
+    size_t group_count = (count + TDB_PACK_GROUP - 1) / TDB_PACK_GROUP;
+
+    size_t for_bits  = bit_width(max - min);
+    size_t for_bytes = words_for(count, for_bits) * sizeof(uint64_t);
+
+    size_t delta_bytes = TDB_INVALID_ULL;
+    std::vector<size_t> group_bits;
+
+    if (sorted) {
+        group_bits.reserve(group_count);
+        delta_bytes = group_count * sizeof(Group);
+
+        for (size_t g = 0; g < group_count; ++g) {
+            size_t begin = g * TDB_PACK_GROUP;
+            size_t end   = std::min(begin + TDB_PACK_GROUP, count);
+
+            size_t widest = 0;
+
+            for (size_t i = begin + 1; i < end; ++i) {
+                widest = std::max(widest, values[i] - values[i - 1]);
+            }
+
+            group_bits.push_back(bit_width(widest));
+            delta_bytes += words_for(end - begin, group_bits.back()) * sizeof(uint64_t);
+        }
+    }
+
+    if (std::min(for_bytes, delta_bytes) >= count * sizeof(size_t)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<PackedUints> packed(new PackedUints(resource));
+
+    packed->count = count;
+    packed->min   = min;
+    packed->max   = max;
+    packed->base  = min;
+
+    if (delta_bytes < for_bytes) {
+        packed->kind = PACKED_DELTA;
+
+        size_t total = 0;
+
+        packed->groups.reserve(group_count);
+
+        for (size_t g = 0; g < group_count; ++g) {
+            size_t len = std::min<size_t>(TDB_PACK_GROUP, count - g * TDB_PACK_GROUP);
+
+            packed->groups.push_back({values[g * TDB_PACK_GROUP], total, group_bits[g]});
+            total += words_for(len, group_bits[g]);
+        }
+
+        // Two words of padding, see unpack_bits().
+        packed->words.assign(total + 2, 0);
+
+        for (size_t g = 0; g < group_count; ++g) {
+            const Group &group = packed->groups[g];
+
+            size_t begin = g * TDB_PACK_GROUP;
+            size_t end   = std::min(begin + TDB_PACK_GROUP, count);
+
+            for (size_t i = begin + 1; i < end; ++i) {
+                put_bits(packed->words.data() + group.word, (i - begin) * group.bits,
+                         group.bits, values[i] - values[i - 1]);
+            }
+        }
+    }
+    else {
+        packed->kind = PACKED_FOR;
+        packed->bits = for_bits;
+
+        packed->words.assign(words_for(count, for_bits) + 2, 0);
+
+        for (size_t i = 0; i < count; ++i) {
+            put_bits(packed->words.data(), i * for_bits, for_bits, values[i] - min);
+        }
+    }
+
+    return packed;
+}
+
+std::unique_ptr<PackedUints> PackedUints::clone() const
+{
+    std::unique_ptr<PackedUints> clone(new PackedUints(this->words.get_allocator().resource()));
+
+    // Copy assignment keeps allocators of the clone.
+    *clone = *this;
+
+    return clone;
+}
+
+PackedUints::Kind PackedUints::get_kind() const
+{
+    return this->kind;
+}
+
+size_t PackedUints::size() const
+{
+    return this->count;
+}
+
+size_t PackedUints::bytes() const
+{
+    return sizeof(PackedUints) + this->words.capacity() * sizeof(uint64_t) +
+           this->groups.capacity() * sizeof(Group) +
+           (this->loose.capacity() + this->loose_at.capacity()) * sizeof(size_t);
+}
+
+const size_t *PackedUints::find_loose(size_t group) const
+{
+    if (this->loose_at.empty() || this->loose_at[group] == TDB_NOT_FOUND) {
+        return nullptr;
+    }
+
+    return this->loose.data() + this->loose_at[group];
+}
+
+// Decodes group into 'loose', if it's not there yet.
+size_t *PackedUints::loosen(size_t group)
+{
+    if (this->loose_at.empty()) {
+        this->loose_at.assign((this->count + TDB_PACK_GROUP - 1) / TDB_PACK_GROUP, TDB_NOT_FOUND);
+    }
+
+    if (this->loose_at[group] == TDB_NOT_FOUND) {
+        size_t first = group * TDB_PACK_GROUP;
+        size_t values[TDB_PACK_GROUP] = {};
+
+        this->decode(first, std::min<size_t>(TDB_PACK_GROUP, this->count - first), values);
+
+        this->loose_at[group] = this->loose.size();
+        this->loose.insert(this->loose.end(), values, values + TDB_PACK_GROUP);
+    }
+
+    return this->loose.data() + this->loose_at[group];
+}
+
+// Decodes whole group of delta encoded values.
+void PackedUints::decode_group(size_t group, size_t *out) const
+{
+    const Group &g = this->groups[group];
+
+    size_t len = std::min<size_t>(TDB_PACK_GROUP, this->count - group * TDB_PACK_GROUP);
+
+    unpack_bits(this->words.data() + g.word, g.bits, 0, len, 0, out);
+
+    out[0] = g.base;
+
+    for (size_t i = 1; i < len; ++i) {
+        out[i] += out[i - 1];
+    }
+}
+
+size_t PackedUints::get(size_t pos) const
+{
+    if (const size_t *values = this->find_loose(pos / TDB_PACK_GROUP)) {
+        return values[pos % TDB_PACK_GROUP];
+    }
+
+    if (this->kind == PACKED_FOR) {
+        size_t value;
+        unpack_bits(this->words.data(), this->bits, pos, 1, this->base, &value);
+        return value;
+    }
+
+    size_t group[TDB_PACK_GROUP];
+    this->decode_group(pos / TDB_PACK_GROUP, group);
+
+    return group[pos % TDB_PACK_GROUP];
+}
+
+void PackedUints::decode(size_t first, size_t count, size_t *out) const
+{
+    if (this->kind == PACKED_FOR && this->loose_at.empty()) {
+        unpack_bits(this->words.data(), this->bits, first, count, this->base, out);
+        return;
+    }
+
+    size_t group[TDB_PACK_GROUP];
+    size_t end = first + count;
+
+    while (first < end) {
+        size_t g      = first / TDB_PACK_GROUP;
+        size_t offset = first % TDB_PACK_GROUP;
+        size_t len    = std::min(TDB_PACK_GROUP - offset, end - first);
+
+        if (const size_t *values = this->find_loose(g)) {
+            std::copy(values + offset, values + offset + len, out);
+        }
+        else if (this->kind == PACKED_FOR) {
+            unpack_bits(this->words.data(), this->bits, first, len, this->base, out);
+        }
+        else if (offset == 0 && len == TDB_PACK_GROUP) {
+            this->decode_group(g, out);
+        }
+        else {
+            this->decode_group(g, group);
+            std::copy(group + offset, group + offset + len, out);
+        }
+
+        first += len;
+        out += len;
+    }
+}
+
+void PackedUints::set(size_t pos, size_t value)
+{
+    size_t group  = pos / TDB_PACK_GROUP;
+    size_t offset = pos % TDB_PACK_GROUP;
+
+    this->min = std::min(this->min, value);
+    this->max = std::max(this->max, value);
+
+    if (this->find_loose(group)) {
+        this->loosen(group)[offset] = value;
+        return;
+    }
+
+    if (this->kind == PACKED_FOR) {
+        if (value >= this->base && bit_width(value - this->base) <= this->bits) {
+            replace_bits(this->words.data(), pos * this->bits, this->bits, value - this->base);
+            return;
+        }
+    }
+    else if (offset != 0) {
+        // Base of the group can't change in place, as compare() bounds the
+        // previous group by it.
+        const Group &g = this->groups[group];
+
+        size_t values[TDB_PACK_GROUP];
+        size_t len = std::min<size_t>(TDB_PACK_GROUP, this->count - group * TDB_PACK_GROUP);
+
+        this->decode_group(group, values);
+
+        // Group should stay sorted and below the next one.
+        size_t prev = values[offset - 1];
+        size_t next = offset + 1 < len                  ? values[offset + 1]
+                      : group + 1 < this->groups.size() ? this->groups[group + 1].base
+                                                        : this->max;
+
+        if (prev <= value && value <= next && bit_width(value - prev) <= g.bits &&
+            (offset + 1 == len || bit_width(next - value) <= g.bits)) {
+            uint64_t *words = this->words.data() + g.word;
+
+            replace_bits(words, offset * g.bits, g.bits, value - prev);
+
+            if (offset + 1 < len) {
+                replace_bits(words, (offset + 1) * g.bits, g.bits, next - value);
+            }
+
+            return;
+        }
+    }
+
+    this->loosen(group)[offset] = value;
+}
+
+size_t &PackedUints::get_mut(size_t pos)
+{
+    // Anything can be written through the reference.
+    this->min = 0;
+    this->max = TDB_INVALID_ULL;
+
+    return this->loosen(pos / TDB_PACK_GROUP)[pos % TDB_PACK_GROUP];
+}
+
+void PackedUints::compare(size_t first, size_t count, ToiletCompare op, size_t a,
+                          size_t b, uint64_t *out) const
+{
+    int decided = decide(op, a, b, this->min, this->max);
+
+    if (decided != -1) {
+        fill_bits(out, count, decided);
+        return;
+    }
+
+    size_t group[TDB_PACK_GROUP];
+    size_t end = first + count;
+
+    for (size_t pos = first; pos < end; pos += TDB_PACK_GROUP, ++out) {
+        size_t len = std::min<size_t>(TDB_PACK_GROUP, end - pos);
+
+        if (const size_t *values = this->find_loose(pos / TDB_PACK_GROUP)) {
+            compare_uints(values, len, op, a, b, out);
+            continue;
+        }
+
+        if (this->kind == PACKED_FOR) {
+            unpack_bits(this->words.data(), this->bits, pos, len, this->base, group);
+        }
+        else {
+            // Values are sorted, so group lies between its base and base of
+            // the next one.
+            size_t g  = pos / TDB_PACK_GROUP;
+            size_t hi = g + 1 < this->groups.size() ? this->groups[g + 1].base : this->max;
+
+            decided = decide(op, a, b, this->groups[g].base, hi);
+
+            if (decided != -1) {
+                fill_bits(out, len, decided);
+                continue;
+            }
+
+            this->decode_group(g, group);
+        }
+
+        compare_uints(group, len, op, a, b, out);
+    }
+}
+
+} // namespace toiletdb
@@ -0,0 +1,96 @@
+#ifndef TOILET_ENCODING_H_
+#define TOILET_ENCODING_H_
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "common.hpp"
+#include "kernels.hpp"
+
+/// @brief Values are decoded and compared in groups of this size.
+#define TDB_PACK_GROUP 64
+
+namespace toiletdb {
+
+/**
+ * @class PackedUints
+ * @brief Read-only compressed storage for unsigned integers.
+ *        Uses whichever of the encodings is smaller:
+ *        - Frame of reference: value - min, packed with as many bits as
+ *          max - min needs.
+ *        - Delta: only for non-decreasing values. Difference with the
+ *          previous value, packed per group of TDB_PACK_GROUP values.
+ *        Values are changed in place while they fit the encoding. Otherwise
+ *        only the group of TDB_PACK_GROUP values they are in is decoded and
+ *        kept aside.
+ */
+class PackedUints
+{
+public:
+    enum Kind
+    {
+        PACKED_FOR,
+        PACKED_DELTA,
+    };
+
+private:
+    struct Group
+    {
+        size_t base;
+        size_t word;
+        size_t bits;
+    };
+
+    Kind kind;
+    size_t count;
+    // Bounds of all values. Only ever grow as values are changed.
+    size_t min;
+    size_t max;
+    // Frame of reference values are packed against.
+    size_t base;
+    size_t bits;
+    std::pmr::vector<uint64_t> words;
+    std::pmr::vector<Group> groups;
+    // Groups that were decoded to change values which don't fit. Values of
+    // group g are at loose[loose_at[g]]. Empty until there is any.
+    std::pmr::vector<size_t> loose;
+    std::pmr::vector<size_t> loose_at;
+
+    PackedUints(std::pmr::memory_resource *resource);
+    void decode_group(size_t group, size_t *out) const;
+    const size_t *find_loose(size_t group) const;
+    size_t *loosen(size_t group);
+
+public:
+    /// @brief Encodes values with the smallest encoding available.
+    /// @returns nullptr if encoding won't take less memory than plain values.
+    static std::unique_ptr<PackedUints> encode(const size_t *values, size_t count,
+                                               std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+    /// @brief Copy, allocated from the same memory resource.
+    std::unique_ptr<PackedUints> clone() const;
+    Kind get_kind() const;
+    size_t size() const;
+    /// @brief Amount of memory taken by encoded values.
+    size_t bytes() const;
+    size_t get(size_t pos) const;
+    /// @brief Changes value at pos.
+    void set(size_t pos, size_t value);
+    /// @brief Reference to value at pos, that can be changed to anything.
+    ///        Decodes its group, and stops compare() from deciding by bounds.
+    size_t &get_mut(size_t pos);
+    /// @brief Decodes 'count' values starting from 'first' into 'out'.
+    void decode(size_t first, size_t count, size_t *out) const;
+    /// @brief Evaluates predicate on 'count' values starting from 'first',
+    ///        which should be a multiple of TDB_PACK_GROUP.
+    ///        Groups are decoded one by one, and skipped entirely when min/max
+    ///        of the whole column already decide the result.
+    /// @see compare_uints()
+    void compare(size_t first, size_t count, ToiletCompare op, size_t a,
+                 size_t b, uint64_t *out) const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_ENCODING_H_
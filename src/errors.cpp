@@ -1,8 +1,13 @@
 #include "errors.hpp"
 
+#include <utility>
+
 namespace toiletdb {
 
 ParsingError::ParsingError(std::string const &msg) :
     std::logic_error(msg) {}
 
+PartialCommit::PartialCommit(std::string const &msg, std::vector<std::string> committed) :
+    std::runtime_error(msg), committed(std::move(committed)) {}
+
 } // namespace toiletdb
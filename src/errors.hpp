@@ -2,6 +2,8 @@
 #define TOILET_ERRORS_H_
 
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace toiletdb {
 
@@ -15,6 +17,21 @@ public:
     ParsingError(std::string const &msg);
 };
 
+/**
+ * @class PartialCommit
+ * @brief Is thrown by Database.commit() when a table file could not be
+ *        replaced after files of other tables already were.
+ */
+class PartialCommit : public std::runtime_error
+{
+public:
+    /// @brief Tables whose files have the new rows. Files of the rest are
+    ///        left as they were.
+    std::vector<std::string> committed;
+
+    PartialCommit(std::string const &msg, std::vector<std::string> committed);
+};
+
 } // namespace toiletdb
 
 #endif // TOILET_ERRORS_H_
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include <algorithm>
+#include <charconv>
 #include <cstdio>
-#include <fstream>
 #include <string>
 #include <vector>
 
@@ -10,11 +10,14 @@
 namespace toiletdb {
 
 // Reads first line of a file and updates InMemoryFileParser format version
-size_t FormatOne::read_version(std::fstream &file)
+size_t FormatOne::read_version(FileInput &file)
 {
     // Check first line of the file.
     std::string temp;
-    std::getline(file, temp);
+
+    for (int c = file.get(); c != '\n' && c != EOF; c = file.get()) {
+        temp += static_cast<char>(c);
+    }
 
     // Check for magic string
     for (int i = 0; i < 3; ++i) {
@@ -52,7 +55,7 @@ size_t FormatOne::read_version(std::fstream &file)
     return version;
 }
 
-TableInfo FormatOne::read_types(std::fstream &file)
+TableInfo FormatOne::read_types(FileInput &file)
 {
     TableInfo fields;
     std::vector<std::string> names;
@@ -181,7 +184,8 @@ TableInfo FormatOne::read_types(std::fstream &file)
     return fields;
 }
 
-std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &file, TableInfo &columns, std::vector<std::string> &names)
+std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(FileInput &file, TableInfo &columns, std::vector<std::string> &names,
+                                                                std::pmr::memory_resource *resource)
 {
     // Allocate memory for each field.
 
@@ -202,20 +206,37 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
         int type = columns.types[i];
 
         if (type & TT_INT) {
-            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnInt>(names[i], type);
+            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnInt>(names[i], type, resource);
             parsed_columns.push_back(v);
         }
         else if (type & TT_UINT) {
-            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnUint>(names[i], type);
+            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnUint>(names[i], type, resource);
             parsed_columns.push_back(v);
         }
         else if (type & TT_STR) {
-            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnStr>(names[i], type);
+            std::shared_ptr<ColumnBase> v = std::make_shared<ColumnStr>(names[i], type, resource);
             parsed_columns.push_back(v);
         }
     }
 
-    std::string temp;
+    // Resolve column types once, so values below are pushed without going
+    // through ColumnBase for every field.
+    std::vector<void *> column_data;
+    column_data.reserve(columns.size);
+
+    for (std::shared_ptr<ColumnBase> &c : parsed_columns) {
+        visit_column(*c, [&column_data](auto &c) {
+            column_data.push_back(static_cast<void *>(&c.get_data()));
+        });
+    }
+
+    // Fields of a row are kept in an arena that is dropped when loading is
+    // done. Strings are reused for every row, so the arena stays small.
+    char arena_buffer[4096];
+    std::pmr::monotonic_buffer_resource arena(arena_buffer, sizeof(arena_buffer));
+
+    std::pmr::vector<std::pmr::string> fields(&arena);
+    fields.reserve(columns.size + 1);
 
     // Data starts from third line.
     // First line is magic, second is types.
@@ -239,10 +260,18 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
             c = file.get();
         }
 
-        std::vector<std::string> fields;
-        fields.reserve(columns.size);
+        for (std::pmr::string &f : fields) {
+            f.clear();
+        }
+
         size_t field = 0;
 
+        if (fields.empty()) {
+            fields.resize(1);
+        }
+
+        std::pmr::string *current = &fields[0];
+
         while (c != '\n' && c != EOF) {
             if (c == '\r') {
                 if (!debug_crlf) {
@@ -266,12 +295,16 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
             }
 
             if (c == '|') {
-                fields.push_back(temp);
-                temp.clear();
                 ++field;
+
+                if (fields.size() <= field) {
+                    fields.resize(field + 1);
+                }
+
+                current = &fields[field];
             }
             else {
-                temp += c;
+                current->push_back(c);
             }
 
             c = file.get();
@@ -332,7 +365,7 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
                     throw ParsingError(failstring);
                 }
 
-                std::static_pointer_cast<ColumnInt>(parsed_columns[i])->get_data().push_back(num);
+                TDB_CAST(std::pmr::vector<int>, column_data[i]).push_back(num);
             }
             else if (columns.types[i] & TT_UINT) {
                 size_t num = parse_long_long(fields[i]);
@@ -348,11 +381,11 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
                     throw ParsingError(failstring);
                 }
 
-                (std::static_pointer_cast<ColumnUint>(parsed_columns[i]))->get_data().push_back(num);
+                TDB_CAST(std::pmr::vector<size_t>, column_data[i]).push_back(num);
             }
 
             else if (columns.types[i] & TT_STR) {
-                (std::static_pointer_cast<ColumnStr>(parsed_columns[i]))->get_data().push_back(fields[i]);
+                TDB_CAST(std::pmr::vector<std::string>, column_data[i]).emplace_back(fields[i].data(), fields[i].size());
             }
         }
 
@@ -364,7 +397,7 @@ std::vector<std::shared_ptr<ColumnBase>> FormatOne::deserealize(std::fstream &fi
     return parsed_columns;
 }
 
-void FormatOne::write_header(std::fstream &file,
+void FormatOne::write_header(FileWriter &file,
                              const std::vector<std::shared_ptr<ColumnBase>> &data)
 {
     std::string header = "tdb1\n";
@@ -405,10 +438,23 @@ void FormatOne::write_header(std::fstream &file,
 
     TDB_DEBUGS(header, "InMemoryFileParser.write_header");
 
-    file << header << std::endl;
+    header += '\n';
+
+    file.write(header.data(), header.size());
 }
 
-void FormatOne::serialize(std::fstream &file, const std::vector<std::shared_ptr<ColumnBase>> &data)
+// Appends decimal representation of a number to the buffer.
+template <typename T>
+static void append_number(std::string &buf, T value)
+{
+    char num[24];
+    std::to_chars_result end = std::to_chars(num, num + sizeof(num), value);
+    buf.append(num, end.ptr - num);
+}
+
+#define FORMAT_WRITE_BUFFER_SIZE (1 << 16)
+
+void FormatOne::serialize(FileWriter &file, const std::vector<std::shared_ptr<ColumnBase>> &data)
 {
     FormatOne::write_header(file, data);
 
@@ -420,35 +466,73 @@ void FormatOne::serialize(std::fstream &file, const std::vector<std::shared_ptr<
 
     size_t row_count = data[0]->size();
 
+    // Resolve types once, rows are then written straight from column storage,
+    // one block of rows at a time. Packed columns are decoded into scratch.
     std::vector<int> types;
+    std::vector<const void *> values(column_count);
+    std::vector<std::vector<size_t>> scratch(column_count);
+
     types.reserve(column_count);
 
-    for (const std::shared_ptr<ColumnBase> &c : data) {
-        types.push_back(c->get_type());
+    for (size_t col = 0; col < column_count; ++col) {
+        types.push_back(TDB_TYPE(data[col]->get_type()));
+
+        if (types[col] == TT_UINT) {
+            scratch[col].resize(TDB_BLOCK_SIZE);
+        }
     }
 
-    for (size_t row = 0; row < row_count; ++row) {
-        for (size_t col = 0; col < column_count; ++col) {
-            file << '|';
-            std::shared_ptr<ColumnBase> c = data[col];
+    std::string buf;
+    buf.reserve(FORMAT_WRITE_BUFFER_SIZE + 1024);
+
+    for (size_t first = 0; first < row_count; first += TDB_BLOCK_SIZE) {
+        size_t count = std::min<size_t>(TDB_BLOCK_SIZE, row_count - first);
 
-            switch (c->get_type() & TDB_TMASK) {
+        for (size_t col = 0; col < column_count; ++col) {
+            switch (types[col]) {
                 case TT_INT: {
-                    file << (static_cast<ColumnInt *>(c.get()))->get(row);
+                    values[col] = static_cast<const ColumnInt *>(data[col].get())->get_data().data() + first;
                 } break;
 
                 case TT_UINT: {
-                    file << (static_cast<ColumnUint *>(c.get()))->get(row);
+                    values[col] = static_cast<const ColumnUint *>(data[col].get())->read(first, count, scratch[col].data());
                 } break;
 
                 case TT_STR: {
-                    file << (static_cast<ColumnStr *>(c.get()))->get(row);
+                    values[col] = static_cast<const ColumnStr *>(data[col].get())->get_data().data() + first;
                 } break;
             }
         }
-        file << "|\n";
+
+        for (size_t row = 0; row < count; ++row) {
+            for (size_t col = 0; col < column_count; ++col) {
+                buf += '|';
+
+                switch (types[col]) {
+                    case TT_INT: {
+                        append_number(buf, static_cast<const int *>(values[col])[row]);
+                    } break;
+
+                    case TT_UINT: {
+                        append_number(buf, static_cast<const size_t *>(values[col])[row]);
+                    } break;
+
+                    case TT_STR: {
+                        buf += static_cast<const std::string *>(values[col])[row];
+                    } break;
+                }
+            }
+            buf += "|\n";
+
+            if (buf.size() >= FORMAT_WRITE_BUFFER_SIZE) {
+                file.write(buf.data(), buf.size());
+                buf.clear();
+            }
+        }
     }
 
+    file.write(buf.data(), buf.size());
+
     TDB_DEBUGS(row_count, "InMemoryFileParser.serialize rows saved");
 }
 
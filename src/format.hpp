@@ -2,25 +2,28 @@
 #define TOILET_FORMAT_H_
 
 #include <memory>
+#include <memory_resource>
 #include <vector>
 
 #include "debug.hpp"
 
 #include "errors.hpp"
+#include "io.hpp"
 #include "types.hpp"
 
 namespace toiletdb {
 
 struct FormatOne
 {
-    static size_t read_version(std::fstream &file);
-    static TableInfo read_types(std::fstream &file);
-    static std::vector<std::shared_ptr<ColumnBase>> deserealize(std::fstream &file,
+    static size_t read_version(FileInput &file);
+    static TableInfo read_types(FileInput &file);
+    static std::vector<std::shared_ptr<ColumnBase>> deserealize(FileInput &file,
                                                                 TableInfo &columns,
-                                                                std::vector<std::string> &names);
-    static void write_header(std::fstream &file,
+                                                                std::vector<std::string> &names,
+                                                                std::pmr::memory_resource *resource);
+    static void write_header(FileWriter &file,
                              const std::vector<std::shared_ptr<ColumnBase>> &data);
-    static void serialize(std::fstream &file,
+    static void serialize(FileWriter &file,
                           const std::vector<std::shared_ptr<ColumnBase>> &data);
 };
 
@@ -0,0 +1,197 @@
+#include "group.hpp"
+
+#include <cstring>
+
+namespace toiletdb {
+
+uint64_t hash_group_key(uint64_t number)
+{
+    // Finalizer of splitmix64.
+    number ^= number >> 30;
+    number *= 0xbf58476d1ce4e5b9ULL;
+    number ^= number >> 27;
+    number *= 0x94d049bb133111ebULL;
+    number ^= number >> 31;
+
+    return number;
+}
+
+uint64_t hash_group_key(std::string_view str)
+{
+    // Keys are mostly short, so bytes are mixed in 8 at a time and the result
+    // is finalized once.
+    const char *data = str.data();
+    size_t len       = str.size();
+    uint64_t hash    = len * 0x9e3779b97f4a7c15ULL;
+
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+
+    // Tail is read with fixed-size loads that may overlap, which is cheaper
+    // than copying a variable amount of bytes.
+    if (len >= 4) {
+        uint32_t first, last;
+        std::memcpy(&first, data, 4);
+        std::memcpy(&last, data + len - 4, 4);
+        hash = (hash ^ (first | static_cast<uint64_t>(last) << 32)) * 0xff51afd7ed558ccdULL;
+    }
+    else if (len) {
+        uint64_t word = static_cast<unsigned char>(data[0]) |
+                        static_cast<uint64_t>(static_cast<unsigned char>(data[len / 2])) << 8 |
+                        static_cast<uint64_t>(static_cast<unsigned char>(data[len - 1])) << 16;
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    }
+
+    return hash_group_key(hash);
+}
+
+uint64_t combine_group_hash(uint64_t seed, uint64_t hash)
+{
+    // Hashes of single keys are already mixed.
+    return seed ^ (hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+GroupTable::GroupTable(const std::vector<bool> &str_keys, size_t int_columns,
+                       size_t uint_columns) :
+    str_keys(str_keys), int_columns(int_columns), uint_columns(uint_columns),
+    slots(64, 0)
+{
+}
+
+bool GroupTable::equal(size_t group, const GroupKey *keys) const
+{
+    size_t len           = this->str_keys.size();
+    const GroupKey *have = this->keys.data() + group * len;
+
+    for (size_t k = 0; k < len; ++k) {
+        if (this->str_keys[k] ? have[k].str != keys[k].str
+                              : have[k].number != keys[k].number) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GroupTable::grow()
+{
+    std::vector<size_t> slots(this->slots.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+
+    for (size_t group = 0; group < this->hashes.size(); ++group) {
+        size_t slot = this->hashes[group] & mask;
+
+        while (slots[slot]) {
+            slot = (slot + 1) & mask;
+        }
+
+        slots[slot] = group + 1;
+    }
+
+    this->slots = std::move(slots);
+}
+
+size_t GroupTable::find_or_add(uint64_t hash, const GroupKey *keys, size_t row)
+{
+    size_t mask = this->slots.size() - 1;
+    size_t slot = hash & mask;
+
+    // Linear probing, table is kept at most half full.
+    while (this->slots[slot]) {
+        size_t group = this->slots[slot] - 1;
+
+        if (this->hashes[group] == hash && this->equal(group, keys)) {
+            return group;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    size_t group = this->hashes.size();
+
+    this->slots[slot] = group + 1;
+    this->hashes.push_back(hash);
+    this->keys.insert(this->keys.end(), keys, keys + this->str_keys.size());
+    this->rows.push_back(row);
+    this->counts.push_back(0);
+    this->ints.resize(this->ints.size() + this->int_columns);
+    this->uints.resize(this->uints.size() + this->uint_columns);
+
+    if (this->hashes.size() * 2 > this->slots.size()) {
+        this->grow();
+    }
+
+    return group;
+}
+
+void GroupTable::add_row(size_t group)
+{
+    ++this->counts[group];
+}
+
+IntStats *GroupTable::int_stats(size_t group)
+{
+    return this->ints.data() + group * this->int_columns;
+}
+
+UintStats *GroupTable::uint_stats(size_t group)
+{
+    return this->uints.data() + group * this->uint_columns;
+}
+
+const IntStats *GroupTable::int_stats(size_t group) const
+{
+    return this->ints.data() + group * this->int_columns;
+}
+
+const UintStats *GroupTable::uint_stats(size_t group) const
+{
+    return this->uints.data() + group * this->uint_columns;
+}
+
+void GroupTable::merge(const GroupTable &other)
+{
+    size_t len = this->str_keys.size();
+
+    for (size_t g = 0; g < other.size(); ++g) {
+        size_t group = this->find_or_add(other.hashes[g], other.keys.data() + g * len,
+                                         other.rows[g]);
+
+        this->counts[group] += other.counts[g];
+
+        IntStats *ints         = this->int_stats(group);
+        const IntStats *theirs = other.int_stats(g);
+
+        for (size_t c = 0; c < this->int_columns; ++c) {
+            ints[c].merge(theirs[c]);
+        }
+
+        UintStats *uints         = this->uint_stats(group);
+        const UintStats *utheirs = other.uint_stats(g);
+
+        for (size_t c = 0; c < this->uint_columns; ++c) {
+            uints[c].merge(utheirs[c]);
+        }
+    }
+}
+
+size_t GroupTable::size() const
+{
+    return this->hashes.size();
+}
+
+size_t GroupTable::get_row(size_t group) const
+{
+    return this->rows[group];
+}
+
+size_t GroupTable::get_count(size_t group) const
+{
+    return this->counts[group];
+}
+
+} // namespace toiletdb
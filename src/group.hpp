@@ -0,0 +1,86 @@
+#ifndef TOILET_GROUP_H_
+#define TOILET_GROUP_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "kernels.hpp"
+
+namespace toiletdb {
+
+/**
+ * @brief Value of one key column of a row. Numbers are stored in 'number',
+ *        'int' values sign-extended. Strings point straight into column
+ *        storage.
+ */
+struct GroupKey
+{
+    uint64_t number;
+    std::string_view str;
+};
+
+/// @brief Hash of a number for GroupTable.
+uint64_t hash_group_key(uint64_t number);
+/// @brief Hash of a string for GroupTable.
+uint64_t hash_group_key(std::string_view str);
+/// @brief Combines hashes of key columns into one.
+uint64_t combine_group_hash(uint64_t seed, uint64_t hash);
+
+/**
+ * @class GroupTable
+ * @brief Open addressing hash table from values of key columns to groups,
+ *        used by InMemoryTable.group_by(). Groups are numbered in order they
+ *        were added, and keep running stats of columns aggregated.
+ *        Slots only hold group numbers, hashes and keys are kept alongside
+ *        groups, so the table itself stays small and probing is cheap.
+ * @warning String keys point into columns, which should not change while
+ *          the table is used.
+ */
+class GroupTable
+{
+private:
+    std::vector<bool> str_keys;
+    size_t int_columns;
+    size_t uint_columns;
+
+    // Group number + 1, 0 for empty slots.
+    std::vector<size_t> slots;
+    std::vector<uint64_t> hashes;
+    // Group-major: keys of group g start at g * str_keys.size().
+    std::vector<GroupKey> keys;
+    std::vector<size_t> rows;
+    std::vector<size_t> counts;
+    // Group-major, same as keys.
+    std::vector<IntStats> ints;
+    std::vector<UintStats> uints;
+
+    bool equal(size_t group, const GroupKey *keys) const;
+    void grow();
+
+public:
+    /// @brief 'str_keys' tells which of key columns are 'str'.
+    GroupTable(const std::vector<bool> &str_keys, size_t int_columns,
+               size_t uint_columns);
+    /// @brief Group with 'keys', new one if there is none yet. 'row' becomes
+    ///        first row of a new group.
+    size_t find_or_add(uint64_t hash, const GroupKey *keys, size_t row);
+    /// @brief Counts one more row into group.
+    void add_row(size_t group);
+    /// @brief Stats of 'int' columns of a group, one per column.
+    IntStats *int_stats(size_t group);
+    /// @brief Stats of 'uint' columns of a group, one per column.
+    UintStats *uint_stats(size_t group);
+    /// @brief Merges groups of other table. Groups that are not in this
+    ///        table yet are added after existing ones, in their order.
+    void merge(const GroupTable &other);
+    size_t size() const;
+    size_t get_row(size_t group) const;
+    size_t get_count(size_t group) const;
+    const IntStats *int_stats(size_t group) const;
+    const UintStats *uint_stats(size_t group) const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_GROUP_H_
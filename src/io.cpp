@@ -0,0 +1,756 @@
+#include "io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <new>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define TDB_HAVE_URING
+    #include <fcntl.h>
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+namespace toiletdb {
+
+static std::atomic<int> io_backend(TI_AUTO);
+
+static std::ios::failure io_failure(const std::string &method, const std::string &what,
+                                    int error)
+{
+    return std::ios::failure("In ToiletDB, In " + method + "(), " + what + ": " +
+                             std::strerror(error));
+}
+
+struct FreeBlock
+{
+    void operator()(char *block) const
+    {
+        ::operator delete(block, std::align_val_t(TDB_IO_BLOCK_SIZE));
+    }
+};
+
+// TDB_IO_BLOCK_SIZE bytes, aligned to their size.
+using Block = std::unique_ptr<char, FreeBlock>;
+
+static Block allocate_block()
+{
+    return Block(static_cast<char *>(
+        ::operator new(TDB_IO_BLOCK_SIZE, std::align_val_t(TDB_IO_BLOCK_SIZE))));
+}
+
+class SyncReader : public FileReader
+{
+private:
+    std::FILE *file;
+    Block block;
+
+public:
+    SyncReader(std::FILE *file) :
+        file(file), block(allocate_block())
+    {
+        // Blocks are large enough, another buffer would only copy them.
+        std::setvbuf(file, nullptr, _IONBF, 0);
+    }
+
+    ~SyncReader() override
+    {
+        std::fclose(this->file);
+    }
+
+    std::string_view next() override
+    {
+        size_t size = std::fread(this->block.get(), 1, TDB_IO_BLOCK_SIZE, this->file);
+
+        if (size < TDB_IO_BLOCK_SIZE && std::ferror(this->file)) {
+            throw io_failure("FileReader.next", "could not read file", errno);
+        }
+
+        return std::string_view(this->block.get(), size);
+    }
+};
+
+class SyncWriter : public FileWriter
+{
+private:
+    std::FILE *file;
+    Block block;
+    size_t used;
+
+    void flush()
+    {
+        if (std::fwrite(this->block.get(), 1, this->used, this->file) != this->used) {
+            throw io_failure("FileWriter.write", "could not write file", errno);
+        }
+
+        this->used = 0;
+    }
+
+public:
+    SyncWriter(std::FILE *file) :
+        file(file), block(allocate_block()), used(0)
+    {
+        std::setvbuf(file, nullptr, _IONBF, 0);
+    }
+
+    ~SyncWriter() override
+    {
+        std::fclose(this->file);
+    }
+
+    void write(const char *data, size_t size) override
+    {
+        while (size > 0) {
+            size_t count = std::min(size, TDB_IO_BLOCK_SIZE - this->used);
+
+            std::memcpy(this->block.get() + this->used, data, count);
+            this->used += count;
+            data += count;
+            size -= count;
+
+            if (this->used == TDB_IO_BLOCK_SIZE) {
+                this->flush();
+            }
+        }
+    }
+
+    void finish() override
+    {
+        this->flush();
+
+        if (std::fflush(this->file) != 0) {
+            throw io_failure("FileWriter.finish", "could not write file", errno);
+        }
+    }
+};
+
+#ifdef TDB_HAVE_URING
+
+// io_uring instance, set up with raw system calls so liburing is not needed.
+// Used by one thread at a time.
+class Ring
+{
+private:
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+
+    // Entries added since last submit().
+    unsigned queued;
+    // Entries kernel took, whose completions were not seen yet.
+    unsigned in_flight;
+
+public:
+    Ring() :
+        fd(-1), sq_ring(MAP_FAILED), sq_ring_size(0), cq_ring(MAP_FAILED),
+        cq_ring_size(0), sqes(static_cast<io_uring_sqe *>(MAP_FAILED)), sqes_size(0),
+        queued(0), in_flight(0)
+    {}
+
+    ~Ring()
+    {
+        if (this->sqes != MAP_FAILED) {
+            munmap(this->sqes, this->sqes_size);
+        }
+
+        if (this->cq_ring != MAP_FAILED && this->cq_ring != this->sq_ring) {
+            munmap(this->cq_ring, this->cq_ring_size);
+        }
+
+        if (this->sq_ring != MAP_FAILED) {
+            munmap(this->sq_ring, this->sq_ring_size);
+        }
+
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+    }
+
+    // Returns false when kernel does not support io_uring, or does not let
+    // this process use it.
+    bool setup(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        this->fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+        if (this->fd < 0) {
+            return false;
+        }
+
+        this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        // Both rings can share one mapping on newer kernels.
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            this->sq_ring_size = this->cq_ring_size =
+                std::max(this->sq_ring_size, this->cq_ring_size);
+        }
+
+        this->sq_ring = mmap(nullptr, this->sq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+
+        if (this->sq_ring == MAP_FAILED) {
+            return false;
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            this->cq_ring = this->sq_ring;
+        }
+        else {
+            this->cq_ring = mmap(nullptr, this->cq_ring_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+
+            if (this->cq_ring == MAP_FAILED) {
+                return false;
+            }
+        }
+
+        this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        this->sqes      = static_cast<io_uring_sqe *>(
+            mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 this->fd, IORING_OFF_SQES));
+
+        if (this->sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char *sq = static_cast<char *>(this->sq_ring);
+        char *cq = static_cast<char *>(this->cq_ring);
+
+        this->sq_tail  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        this->sq_mask  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        this->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        this->cq_head  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        this->cq_tail  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        this->cq_mask  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        this->cqes     = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    // Queues a read or write of one buffer. Callers never have more entries
+    // in flight than the ring was set up with, so there is always room.
+    void push(int opcode, int file, iovec *iov, uint64_t offset, uint64_t data)
+    {
+        unsigned tail  = *this->sq_tail;
+        unsigned index = tail & *this->sq_mask;
+
+        io_uring_sqe &sqe = this->sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+
+        sqe.opcode    = static_cast<uint8_t>(opcode);
+        sqe.fd        = file;
+        sqe.addr      = reinterpret_cast<uint64_t>(iov);
+        sqe.len       = 1;
+        sqe.off       = offset;
+        sqe.user_data = data;
+
+        this->sq_array[index] = index;
+
+        __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        ++this->queued;
+    }
+
+    // Hands queued entries to the kernel. Returns errno on failure.
+    int submit()
+    {
+        while (this->queued > 0) {
+            long submitted = syscall(__NR_io_uring_enter, this->fd, this->queued, 0, 0,
+                                     nullptr, 0);
+
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return errno;
+            }
+
+            this->queued -= static_cast<unsigned>(submitted);
+            this->in_flight += static_cast<unsigned>(submitted);
+        }
+
+        return 0;
+    }
+
+    // Waits for next completion. Returns errno on failure, and ECANCELED
+    // when kernel has nothing to complete, as entries that failed to submit
+    // never will be.
+    int wait(io_uring_cqe &cqe)
+    {
+        while (true) {
+            if (this->in_flight == 0) {
+                return ECANCELED;
+            }
+
+            unsigned head = *this->cq_head;
+
+            if (head != __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) {
+                cqe = this->cqes[head & *this->cq_mask];
+                __atomic_store_n(this->cq_head, head + 1, __ATOMIC_RELEASE);
+                --this->in_flight;
+                return 0;
+            }
+
+            if (syscall(__NR_io_uring_enter, this->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                        nullptr, 0) < 0 &&
+                errno != EINTR) {
+                return errno;
+            }
+        }
+    }
+
+    // Waits until kernel is done with all buffers it was given.
+    void drain()
+    {
+        io_uring_cqe cqe;
+
+        while (this->in_flight > 0) {
+            if (this->wait(cqe) != 0) {
+                break;
+            }
+        }
+    }
+};
+
+// Reads 'size' bytes at 'offset', or less at end of file. For what is left
+// of a short read.
+static size_t read_at(int fd, char *data, size_t size, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t count = pread(fd, data + done, size - done, offset + done);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count < 0) {
+            throw io_failure("FileReader.next", "could not read file", errno);
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        done += count;
+    }
+
+    return done;
+}
+
+// Writes 'size' bytes at 'offset', for what is left of a short write.
+static void write_at(int fd, const char *data, size_t size, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t count = pwrite(fd, data + done, size - done, offset + done);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            throw io_failure("FileWriter.write", "could not write file", count < 0 ? errno : EIO);
+        }
+
+        done += count;
+    }
+}
+
+// One block of a file being read or written through the ring.
+struct RingSlot
+{
+    Block block;
+    iovec iov;
+    uint64_t offset;
+    size_t size;
+    // Submitted, and its completion was not seen yet.
+    bool active;
+    // Completed read, waiting to be handed out by next().
+    bool ready;
+    int result;
+};
+
+// Keeps TDB_IO_QUEUE_DEPTH blocks ahead of the parser in flight. Blocks are
+// handed out in order of offsets, whatever order reads complete in.
+class UringReader : public FileReader
+{
+private:
+    int fd;
+    std::unique_ptr<Ring> ring;
+    uint64_t file_size;
+    uint64_t next_offset;
+    std::vector<RingSlot> slots;
+    // Slot next() hands out next.
+    size_t current;
+    // Slot handed out by last call, to be reused by the next one.
+    size_t returned;
+
+    void submit(size_t slot)
+    {
+        RingSlot &s = this->slots[slot];
+
+        s.offset = this->next_offset;
+        s.size   = std::min<uint64_t>(TDB_IO_BLOCK_SIZE, this->file_size - this->next_offset);
+        s.iov    = {s.block.get(), s.size};
+        s.active = true;
+        s.ready  = false;
+
+        this->next_offset += s.size;
+
+        this->ring->push(IORING_OP_READV, this->fd, &s.iov, s.offset, slot);
+    }
+
+    void reap()
+    {
+        io_uring_cqe cqe;
+        int error = this->ring->wait(cqe);
+
+        if (error) {
+            throw io_failure("FileReader.next", "could not wait for read", error);
+        }
+
+        RingSlot &s = this->slots[cqe.user_data];
+
+        s.active = false;
+        s.ready  = true;
+        s.result = cqe.res;
+    }
+
+public:
+    UringReader(int fd, std::unique_ptr<Ring> ring) :
+        fd(fd), ring(std::move(ring)), file_size(0), next_offset(0), current(0),
+        returned(TDB_IO_QUEUE_DEPTH)
+    {
+        struct stat info;
+
+        // Reading nothing would leave the table empty, and its next write
+        // would wipe the file.
+        if (fstat(fd, &info) != 0) {
+            int error = errno;
+            close(fd);
+            throw io_failure("open_reader", "could not read file size", error);
+        }
+
+        this->file_size = info.st_size;
+
+        this->slots.resize(TDB_IO_QUEUE_DEPTH);
+
+        for (size_t slot = 0; slot < this->slots.size(); ++slot) {
+            this->slots[slot].block  = allocate_block();
+            this->slots[slot].active = false;
+            this->slots[slot].ready  = false;
+
+            if (this->next_offset < this->file_size) {
+                this->submit(slot);
+            }
+        }
+
+        int error = this->ring->submit();
+
+        if (error) {
+            // Kernel could already be writing into blocks.
+            this->ring->drain();
+            close(fd);
+            throw io_failure("open_reader", "could not submit read", error);
+        }
+    }
+
+    ~UringReader() override
+    {
+        // Kernel could still be writing into blocks.
+        this->ring->drain();
+        close(this->fd);
+    }
+
+    std::string_view next() override
+    {
+        // Block handed out last time is done with, and is refilled with the
+        // next one behind those already in flight.
+        if (this->returned < this->slots.size() && this->next_offset < this->file_size) {
+            this->submit(this->returned);
+
+            int error = this->ring->submit();
+
+            if (error) {
+                throw io_failure("FileReader.next", "could not submit read", error);
+            }
+        }
+
+        this->returned = this->slots.size();
+
+        RingSlot &s = this->slots[this->current];
+
+        if (!s.active && !s.ready) {
+            return {};
+        }
+
+        while (!s.ready) {
+            this->reap();
+        }
+
+        s.ready = false;
+
+        if (s.result < 0) {
+            throw io_failure("FileReader.next", "could not read file", -s.result);
+        }
+
+        size_t size = static_cast<size_t>(s.result);
+
+        if (size < s.size) {
+            size += read_at(this->fd, s.block.get() + size, s.size - size, s.offset + size);
+        }
+
+        this->returned = this->current;
+        this->current  = (this->current + 1) % this->slots.size();
+
+        return std::string_view(s.block.get(), size);
+    }
+};
+
+// Fills one block while up to TDB_IO_QUEUE_DEPTH - 1 others are written.
+class UringWriter : public FileWriter
+{
+private:
+    int fd;
+    std::unique_ptr<Ring> ring;
+    uint64_t offset;
+    std::vector<RingSlot> slots;
+    // Slot being filled.
+    size_t current;
+    size_t used;
+    int error;
+
+    void reap()
+    {
+        io_uring_cqe cqe;
+        int error = this->ring->wait(cqe);
+
+        if (error) {
+            throw io_failure("FileWriter.write", "could not wait for write", error);
+        }
+
+        RingSlot &s = this->slots[cqe.user_data];
+
+        s.active = false;
+
+        if (cqe.res < 0) {
+            this->error = -cqe.res;
+        }
+        else if (static_cast<size_t>(cqe.res) < s.size) {
+            write_at(this->fd, s.block.get() + cqe.res, s.size - cqe.res, s.offset + cqe.res);
+        }
+    }
+
+    void check()
+    {
+        if (this->error) {
+            throw io_failure("FileWriter.write", "could not write file", this->error);
+        }
+    }
+
+    // Starts writing the block being filled, and waits for the next one to
+    // be free.
+    void flush()
+    {
+        RingSlot &s = this->slots[this->current];
+
+        s.offset = this->offset;
+        s.size   = this->used;
+        s.iov    = {s.block.get(), s.size};
+        s.active = true;
+
+        this->offset += this->used;
+        this->used = 0;
+
+        this->ring->push(IORING_OP_WRITEV, this->fd, &s.iov, s.offset, this->current);
+
+        int error = this->ring->submit();
+
+        if (error) {
+            throw io_failure("FileWriter.write", "could not submit write", error);
+        }
+
+        this->current = (this->current + 1) % this->slots.size();
+
+        while (this->slots[this->current].active) {
+            this->reap();
+        }
+
+        this->check();
+    }
+
+public:
+    UringWriter(int fd, std::unique_ptr<Ring> ring) :
+        fd(fd), ring(std::move(ring)), offset(0), current(0), used(0), error(0)
+    {
+        this->slots.resize(TDB_IO_QUEUE_DEPTH);
+
+        for (RingSlot &s : this->slots) {
+            s.block  = allocate_block();
+            s.active = false;
+        }
+    }
+
+    ~UringWriter() override
+    {
+        // Kernel could still be reading from blocks.
+        this->ring->drain();
+        close(this->fd);
+    }
+
+    void write(const char *data, size_t size) override
+    {
+        while (size > 0) {
+            char *block = this->slots[this->current].block.get();
+            size_t count = std::min(size, TDB_IO_BLOCK_SIZE - this->used);
+
+            std::memcpy(block + this->used, data, count);
+            this->used += count;
+            data += count;
+            size -= count;
+
+            if (this->used == TDB_IO_BLOCK_SIZE) {
+                this->flush();
+            }
+        }
+    }
+
+    void finish() override
+    {
+        if (this->used > 0) {
+            this->flush();
+        }
+
+        for (const RingSlot &s : this->slots) {
+            while (s.active) {
+                this->reap();
+            }
+        }
+
+        this->check();
+    }
+};
+
+static std::unique_ptr<Ring> make_ring()
+{
+    std::unique_ptr<Ring> ring = std::make_unique<Ring>();
+
+    if (!ring->setup(TDB_IO_QUEUE_DEPTH)) {
+        return nullptr;
+    }
+
+    return ring;
+}
+
+static bool uring_supported()
+{
+    static const bool supported = make_ring() != nullptr;
+    return supported;
+}
+
+#endif // TDB_HAVE_URING
+
+void set_io_backend(ToiletIo backend)
+{
+    io_backend.store(backend, std::memory_order_relaxed);
+}
+
+ToiletIo get_io_backend()
+{
+    if (io_backend.load(std::memory_order_relaxed) == TI_SYNC) {
+        return TI_SYNC;
+    }
+
+#ifdef TDB_HAVE_URING
+    if (uring_supported()) {
+        return TI_URING;
+    }
+#endif
+
+    return TI_SYNC;
+}
+
+std::unique_ptr<FileReader> open_reader(const std::string &filepath)
+{
+#ifdef TDB_HAVE_URING
+    if (get_io_backend() == TI_URING) {
+        int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            throw io_failure("open_reader", "could not open file", errno);
+        }
+
+        // Ring can still fail to set up when too many are open.
+        if (std::unique_ptr<Ring> ring = make_ring()) {
+            return std::make_unique<UringReader>(fd, std::move(ring));
+        }
+
+        close(fd);
+    }
+#endif
+
+    std::FILE *file = std::fopen(filepath.c_str(), "rb");
+
+    if (!file) {
+        throw io_failure("open_reader", "could not open file", errno);
+    }
+
+    return std::make_unique<SyncReader>(file);
+}
+
+std::unique_ptr<FileWriter> open_writer(const std::string &filepath)
+{
+#ifdef TDB_HAVE_URING
+    if (get_io_backend() == TI_URING) {
+        int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+        if (fd < 0) {
+            throw io_failure("open_writer", "could not open file", errno);
+        }
+
+        if (std::unique_ptr<Ring> ring = make_ring()) {
+            return std::make_unique<UringWriter>(fd, std::move(ring));
+        }
+
+        close(fd);
+    }
+#endif
+
+    std::FILE *file = std::fopen(filepath.c_str(), "wb");
+
+    if (!file) {
+        throw io_failure("open_writer", "could not open file", errno);
+    }
+
+    return std::make_unique<SyncWriter>(file);
+}
+
+} // namespace toiletdb
@@ -0,0 +1,129 @@
+#ifndef TOILET_IO_H_
+#define TOILET_IO_H_
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/// @brief Size of blocks files are read and written in. Buffers and file
+///        offsets of blocks are aligned to it.
+#define TDB_IO_BLOCK_SIZE (1 << 20)
+/// @brief Amount of blocks of one file that are read ahead, or written
+///        behind, at once.
+#define TDB_IO_QUEUE_DEPTH 4
+
+namespace toiletdb {
+
+/**
+ * @brief How table files are read and written.
+ * @see set_io_backend()
+ */
+enum ToiletIo
+{
+    /// @brief io_uring where kernel supports it, plain reads and writes
+    ///        otherwise. This is the default.
+    TI_AUTO,
+    /// @brief Plain blocking reads and writes, one block at a time.
+    TI_SYNC,
+    /// @brief Several blocks are queued to the kernel through io_uring, so
+    ///        reading and writing overlaps parsing and formatting. Falls back
+    ///        to TI_SYNC where io_uring is not available.
+    TI_URING,
+};
+
+/**
+ * @brief Sets how table files are read and written, for files opened after
+ *        the call.
+ */
+void set_io_backend(ToiletIo backend);
+
+/**
+ * @brief Backend files are read and written with, TI_AUTO resolved to
+ *        TI_SYNC or TI_URING.
+ */
+ToiletIo get_io_backend();
+
+/**
+ * @class FileReader
+ * @brief Reads one file from start to end, block by block.
+ */
+class FileReader
+{
+public:
+    virtual ~FileReader(){};
+    /// @brief Next block of the file, empty when whole file was read.
+    ///        Block stays valid until next call.
+    /// @throws std::ios::failure when read fails.
+    virtual std::string_view next() = 0;
+};
+
+/**
+ * @class FileWriter
+ * @brief Writes one file from start to end. Data is gathered into blocks,
+ *        which can be written after write() returns.
+ */
+class FileWriter
+{
+public:
+    virtual ~FileWriter(){};
+    /// @brief Appends 'size' bytes of 'data' to the file.
+    /// @throws std::ios::failure when an earlier write failed.
+    virtual void write(const char *data, size_t size) = 0;
+    /// @brief Writes what is left and waits for all writes to finish.
+    ///        File is incomplete until this returns.
+    /// @throws std::ios::failure when a write failed.
+    virtual void finish() = 0;
+};
+
+/// @throws std::ios::failure when file can't be opened.
+std::unique_ptr<FileReader> open_reader(const std::string &filepath);
+/// @brief Creates the file, or truncates it if it exists.
+/// @throws std::ios::failure when file can't be opened.
+std::unique_ptr<FileWriter> open_writer(const std::string &filepath);
+
+/**
+ * @class FileInput
+ * @brief FileReader read one character at a time, for parsers.
+ */
+class FileInput
+{
+private:
+    FileReader &reader;
+    const char *pos;
+    const char *end;
+
+    int refill()
+    {
+        std::string_view block = this->reader.next();
+
+        if (block.empty()) {
+            return EOF;
+        }
+
+        this->pos = block.data();
+        this->end = block.data() + block.size();
+
+        return static_cast<unsigned char>(*this->pos++);
+    }
+
+public:
+    FileInput(FileReader &reader) :
+        reader(reader), pos(nullptr), end(nullptr)
+    {}
+
+    /// @brief Next character, EOF at end of file.
+    int get()
+    {
+        if (this->pos == this->end) {
+            return this->refill();
+        }
+
+        return static_cast<unsigned char>(*this->pos++);
+    }
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_IO_H_
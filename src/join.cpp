@@ -0,0 +1,34 @@
+#include "join.hpp"
+
+namespace toiletdb {
+
+JoinTable::JoinTable(bool str, size_t rows) :
+    str(str), hashes(rows), keys(rows), next(rows)
+{
+    // At most half of slots are taken, so probes stay short.
+    size_t capacity = 16;
+
+    while (capacity < rows * 2) {
+        capacity *= 2;
+    }
+
+    this->slots.resize(capacity);
+    this->mask = capacity - 1;
+}
+
+void JoinTable::add(size_t row, uint64_t hash, const GroupKey &key)
+{
+    this->hashes[row] = hash;
+    this->keys[row]   = key;
+
+    size_t slot = hash & this->mask;
+
+    while (this->slots[slot] && !this->equal(this->slots[slot] - 1, hash, key)) {
+        slot = (slot + 1) & this->mask;
+    }
+
+    this->next[row]   = this->slots[slot];
+    this->slots[slot] = row + 1;
+}
+
+} // namespace toiletdb
@@ -0,0 +1,70 @@
+#ifndef TOILET_JOIN_H_
+#define TOILET_JOIN_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "group.hpp"
+
+namespace toiletdb {
+
+/**
+ * @class JoinTable
+ * @brief Open addressing hash table from values of a key column to rows
+ *        with that value, used by InMemoryTable.join(). Rows with equal keys
+ *        are chained, each chain takes one slot.
+ *        Size is fixed, table is built once and then only probed, which
+ *        can be done from several threads at once.
+ * @warning String keys point into columns, which should not change while
+ *          the table is used.
+ */
+class JoinTable
+{
+private:
+    bool str;
+    size_t mask;
+
+    // Row + 1 of first row of a chain, 0 for empty slots.
+    std::vector<size_t> slots;
+    // Per row.
+    std::vector<uint64_t> hashes;
+    std::vector<GroupKey> keys;
+    // Row + 1 of next row with the same key, 0 at the end of a chain.
+    std::vector<size_t> next;
+
+    bool equal(size_t row, uint64_t hash, const GroupKey &key) const
+    {
+        return this->hashes[row] == hash &&
+               (this->str ? this->keys[row].str == key.str
+                          : this->keys[row].number == key.number);
+    }
+
+public:
+    /// @brief Table for keys of 'rows' rows, 'str' if key column is 'str'.
+    JoinTable(bool str, size_t rows);
+    /// @brief Adds a row to the chain of its key, in front of rows already
+    ///        there. Adding rows from last to first keeps chains in order.
+    void add(size_t row, uint64_t hash, const GroupKey &key);
+    /// @brief Calls f(row) for every row with 'key', in order of the chain.
+    template <typename F>
+    void find(uint64_t hash, const GroupKey &key, F &&f) const
+    {
+        for (size_t slot = hash & this->mask; this->slots[slot]; slot = (slot + 1) & this->mask) {
+            size_t row = this->slots[slot] - 1;
+
+            if (!this->equal(row, hash, key)) {
+                continue;
+            }
+
+            for (size_t r = row + 1; r; r = this->next[r - 1]) {
+                f(r - 1);
+            }
+
+            return;
+        }
+    }
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_JOIN_H_
@@ -0,0 +1,579 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+
+#ifdef TDB_AVX2_KERNELS
+    #include <immintrin.h>
+    #define TDB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace toiletdb {
+
+bool cpu_has_avx2()
+{
+#ifdef TDB_AVX2_KERNELS
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+static inline uint64_t low_bits_mask(size_t bits)
+{
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+static void unpack_bits_scalar(const uint64_t *words, size_t bits, size_t first,
+                               size_t count, size_t base, size_t *out)
+{
+    uint64_t mask = low_bits_mask(bits);
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t offset = (first + i) * bits;
+        size_t word   = offset >> 6;
+        size_t shift  = offset & 63;
+
+        uint64_t value = words[word] >> shift;
+
+        if (shift + bits > 64) {
+            value |= words[word + 1] << (64 - shift);
+        }
+
+        out[i] = (value & mask) + base;
+    }
+}
+
+// Sets bits of 'out' from predicate, 64 values per word.
+template <typename T, typename P>
+static void compare_scalar(const T *values, size_t count, P predicate, uint64_t *out)
+{
+    size_t full = count / 64;
+
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+
+        for (size_t i = 0; i < 64; ++i) {
+            word |= static_cast<uint64_t>(predicate(values[w * 64 + i])) << i;
+        }
+
+        out[w] = word;
+    }
+
+    size_t rest = count % 64;
+
+    if (rest) {
+        uint64_t word = 0;
+
+        for (size_t i = 0; i < rest; ++i) {
+            word |= static_cast<uint64_t>(predicate(values[full * 64 + i])) << i;
+        }
+
+        out[full] = word;
+    }
+}
+
+template <typename T>
+static void compare_dispatch_scalar(const T *values, size_t count, ToiletCompare op,
+                                    T a, T b, uint64_t *out)
+{
+    switch (op) {
+        case TC_EQ: {
+            compare_scalar(values, count, [a](T v) { return v == a; }, out);
+        } break;
+
+        case TC_NE: {
+            compare_scalar(values, count, [a](T v) { return v != a; }, out);
+        } break;
+
+        case TC_LT: {
+            compare_scalar(values, count, [a](T v) { return v < a; }, out);
+        } break;
+
+        case TC_LE: {
+            compare_scalar(values, count, [a](T v) { return v <= a; }, out);
+        } break;
+
+        case TC_GT: {
+            compare_scalar(values, count, [a](T v) { return v > a; }, out);
+        } break;
+
+        case TC_GE: {
+            compare_scalar(values, count, [a](T v) { return v >= a; }, out);
+        } break;
+
+        case TC_BETWEEN: {
+            compare_scalar(values, count, [a, b](T v) { return v >= a && v <= b; }, out);
+        } break;
+    }
+}
+
+static inline bool mask_bit(const uint64_t *mask, size_t i)
+{
+    return !mask || ((mask[i / 64] >> (i % 64)) & 1);
+}
+
+// Amount of values aggregate_*() will count.
+static size_t mask_count(const uint64_t *mask, size_t count)
+{
+    if (!mask) {
+        return count;
+    }
+
+    size_t result = 0;
+
+    for (size_t w = 0; w < count / 64; ++w) {
+        result += count_bits(mask[w]);
+    }
+
+    if (count % 64) {
+        result += count_bits(mask[count / 64] & low_bits_mask(count % 64));
+    }
+
+    return result;
+}
+
+static void aggregate_uints_scalar(const size_t *values, size_t first, size_t count,
+                                   const uint64_t *mask, UintStats &stats)
+{
+    for (size_t i = first; i < count; ++i) {
+        if (!mask_bit(mask, i)) {
+            continue;
+        }
+
+        size_t v = values[i];
+
+        stats.sum += v;
+        stats.carry += stats.sum < v;
+        stats.min = std::min(stats.min, v);
+        stats.max = std::max(stats.max, v);
+    }
+}
+
+static void aggregate_ints_scalar(const int *values, size_t first, size_t count,
+                                  const uint64_t *mask, IntStats &stats)
+{
+    for (size_t i = first; i < count; ++i) {
+        if (!mask_bit(mask, i)) {
+            continue;
+        }
+
+        int v = values[i];
+
+        stats.sum += v;
+        stats.min = std::min(stats.min, v);
+        stats.max = std::max(stats.max, v);
+    }
+}
+
+#ifdef TDB_AVX2_KERNELS
+
+TDB_TARGET_AVX2
+static void unpack_bits_avx2(const uint64_t *words, size_t bits, size_t first,
+                             size_t count, size_t base, size_t *out)
+{
+    const long long *w = reinterpret_cast<const long long *>(words);
+
+    const __m256i mask  = _mm256_set1_epi64x(static_cast<long long>(low_bits_mask(bits)));
+    const __m256i vbase = _mm256_set1_epi64x(static_cast<long long>(base));
+    const __m256i step  = _mm256_set1_epi64x(static_cast<long long>(4 * bits));
+    const __m256i c63   = _mm256_set1_epi64x(63);
+    const __m256i c64   = _mm256_set1_epi64x(64);
+
+    __m256i offsets = _mm256_set_epi64x(static_cast<long long>((first + 3) * bits),
+                                        static_cast<long long>((first + 2) * bits),
+                                        static_cast<long long>((first + 1) * bits),
+                                        static_cast<long long>(first * bits));
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i index = _mm256_srli_epi64(offsets, 6);
+        __m256i shift = _mm256_and_si256(offsets, c63);
+
+        __m256i lo = _mm256_i64gather_epi64(w, index, 8);
+        __m256i hi = _mm256_i64gather_epi64(w + 1, index, 8);
+
+        // Shifting by 64 gives zero, so values inside one word are fine.
+        __m256i value = _mm256_or_si256(_mm256_srlv_epi64(lo, shift),
+                                        _mm256_sllv_epi64(hi, _mm256_sub_epi64(c64, shift)));
+
+        value = _mm256_add_epi64(_mm256_and_si256(value, mask), vbase);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), value);
+
+        offsets = _mm256_add_epi64(offsets, step);
+    }
+
+    unpack_bits_scalar(words, bits, first + i, count - i, base, out + i);
+}
+
+// AVX2 only has signed 64-bit comparison, values are compared with their
+// sign bit flipped.
+template <ToiletCompare OP>
+TDB_TARGET_AVX2 static void compare_uints_avx2(const size_t *values, size_t count,
+                                                size_t a, size_t b, uint64_t *out)
+{
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m256i va   = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(a)), sign);
+    const __m256i vb   = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(b)), sign);
+
+    size_t full = count / 64;
+
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+
+        for (size_t i = 0; i < 64; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + w * 64 + i));
+            v         = _mm256_xor_si256(v, sign);
+
+            __m256i m;
+
+            if constexpr (OP == TC_EQ || OP == TC_NE) {
+                m = _mm256_cmpeq_epi64(v, va);
+            }
+            else if constexpr (OP == TC_LT || OP == TC_GE) {
+                m = _mm256_cmpgt_epi64(va, v);
+            }
+            else if constexpr (OP == TC_GT || OP == TC_LE) {
+                m = _mm256_cmpgt_epi64(v, va);
+            }
+            else {
+                // Outside of [a, b].
+                m = _mm256_or_si256(_mm256_cmpgt_epi64(va, v), _mm256_cmpgt_epi64(v, vb));
+            }
+
+            uint64_t bits = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+
+            if constexpr (OP == TC_NE || OP == TC_GE || OP == TC_LE || OP == TC_BETWEEN) {
+                bits = ~bits & 0xF;
+            }
+
+            word |= bits << i;
+        }
+
+        out[w] = word;
+    }
+
+    compare_dispatch_scalar(values + full * 64, count % 64, OP, a, b, out + full);
+}
+
+template <ToiletCompare OP>
+TDB_TARGET_AVX2 static void compare_ints_avx2(const int *values, size_t count,
+                                               int a, int b, uint64_t *out)
+{
+    const __m256i va = _mm256_set1_epi32(a);
+    const __m256i vb = _mm256_set1_epi32(b);
+
+    size_t full = count / 64;
+
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+
+        for (size_t i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + w * 64 + i));
+            __m256i m;
+
+            if constexpr (OP == TC_EQ || OP == TC_NE) {
+                m = _mm256_cmpeq_epi32(v, va);
+            }
+            else if constexpr (OP == TC_LT || OP == TC_GE) {
+                m = _mm256_cmpgt_epi32(va, v);
+            }
+            else if constexpr (OP == TC_GT || OP == TC_LE) {
+                m = _mm256_cmpgt_epi32(v, va);
+            }
+            else {
+                m = _mm256_or_si256(_mm256_cmpgt_epi32(va, v), _mm256_cmpgt_epi32(v, vb));
+            }
+
+            uint64_t bits = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+
+            if constexpr (OP == TC_NE || OP == TC_GE || OP == TC_LE || OP == TC_BETWEEN) {
+                bits = ~bits & 0xFF;
+            }
+
+            word |= bits << i;
+        }
+
+        out[w] = word;
+    }
+
+    compare_dispatch_scalar(values + full * 64, count % 64, OP, a, b, out + full);
+}
+
+// Sums are kept in four 64-bit lanes, a lane carries when its new sum is
+// smaller than the value added. Minimum and maximum are kept with sign bit
+// flipped, like in compare_uints_avx2().
+TDB_TARGET_AVX2
+static void aggregate_uints_avx2(const size_t *values, size_t count,
+                                 const uint64_t *mask, UintStats &stats)
+{
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256i high = _mm256_set1_epi64x(LLONG_MAX);
+
+    __m256i sum   = _mm256_setzero_si256();
+    __m256i carry = _mm256_setzero_si256();
+    __m256i min   = high;
+    __m256i max   = sign;
+
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        __m256i selected;
+
+        if (mask) {
+            long long m = static_cast<long long>((mask[i / 64] >> (i % 64)) & 0xF);
+            selected    = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(m), bits), bits);
+            // Skipped values become zero, which does not change sum or
+            // maximum.
+            v = _mm256_and_si256(v, selected);
+        }
+        else {
+            selected = _mm256_cmpeq_epi64(v, v);
+        }
+
+        sum   = _mm256_add_epi64(sum, v);
+        carry = _mm256_sub_epi64(carry, _mm256_cmpgt_epi64(_mm256_xor_si256(v, sign),
+                                                           _mm256_xor_si256(sum, sign)));
+
+        __m256i flipped = _mm256_xor_si256(v, sign);
+        __m256i low     = _mm256_blendv_epi8(high, flipped, selected);
+
+        min = _mm256_blendv_epi8(min, low, _mm256_cmpgt_epi64(min, low));
+        max = _mm256_blendv_epi8(max, flipped, _mm256_cmpgt_epi64(flipped, max));
+    }
+
+    alignas(32) uint64_t lanes[4][4];
+
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[0]), sum);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[1]), carry);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[2]), _mm256_xor_si256(min, sign));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[3]), _mm256_xor_si256(max, sign));
+
+    for (size_t lane = 0; lane < 4; ++lane) {
+        stats.sum += lanes[0][lane];
+        stats.carry += lanes[1][lane] + (stats.sum < lanes[0][lane]);
+        stats.min = std::min<size_t>(stats.min, lanes[2][lane]);
+        stats.max = std::max<size_t>(stats.max, lanes[3][lane]);
+    }
+
+    aggregate_uints_scalar(values, i, count, mask, stats);
+}
+
+TDB_TARGET_AVX2
+static void aggregate_ints_avx2(const int *values, size_t count,
+                                const uint64_t *mask, IntStats &stats)
+{
+    const __m256i bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i high = _mm256_set1_epi32(INT_MAX);
+    const __m256i low  = _mm256_set1_epi32(INT_MIN);
+
+    __m256i sum = _mm256_setzero_si256();
+    __m256i min = high;
+    __m256i max = low;
+
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+
+        if (mask) {
+            int m = static_cast<int>((mask[i / 64] >> (i % 64)) & 0xFF);
+
+            __m256i selected = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(m), bits), bits);
+
+            min = _mm256_min_epi32(min, _mm256_blendv_epi8(high, v, selected));
+            max = _mm256_max_epi32(max, _mm256_blendv_epi8(low, v, selected));
+            v   = _mm256_and_si256(v, selected);
+        }
+        else {
+            min = _mm256_min_epi32(min, v);
+            max = _mm256_max_epi32(max, v);
+        }
+
+        // Widened to 64 bits, so sums of up to 2^32 values can't overflow.
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+
+    alignas(32) long long sums[4];
+    alignas(32) int mins[8];
+    alignas(32) int maxs[8];
+
+    _mm256_store_si256(reinterpret_cast<__m256i *>(sums), sum);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(mins), min);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maxs), max);
+
+    for (size_t lane = 0; lane < 8; ++lane) {
+        stats.min = std::min(stats.min, mins[lane]);
+        stats.max = std::max(stats.max, maxs[lane]);
+    }
+
+    stats.sum += sums[0] + sums[1] + sums[2] + sums[3];
+
+    aggregate_ints_scalar(values, i, count, mask, stats);
+}
+
+#endif
+
+void unpack_bits(const uint64_t *words, size_t bits, size_t first,
+                 size_t count, size_t base, size_t *out)
+{
+#ifdef TDB_AVX2_KERNELS
+    if (cpu_has_avx2()) {
+        unpack_bits_avx2(words, bits, first, count, base, out);
+        return;
+    }
+#endif
+    unpack_bits_scalar(words, bits, first, count, base, out);
+}
+
+void compare_uints(const size_t *values, size_t count, ToiletCompare op,
+                   size_t a, size_t b, uint64_t *out)
+{
+#ifdef TDB_AVX2_KERNELS
+    if (cpu_has_avx2()) {
+        switch (op) {
+            case TC_EQ: {
+                compare_uints_avx2<TC_EQ>(values, count, a, b, out);
+            } break;
+
+            case TC_NE: {
+                compare_uints_avx2<TC_NE>(values, count, a, b, out);
+            } break;
+
+            case TC_LT: {
+                compare_uints_avx2<TC_LT>(values, count, a, b, out);
+            } break;
+
+            case TC_LE: {
+                compare_uints_avx2<TC_LE>(values, count, a, b, out);
+            } break;
+
+            case TC_GT: {
+                compare_uints_avx2<TC_GT>(values, count, a, b, out);
+            } break;
+
+            case TC_GE: {
+                compare_uints_avx2<TC_GE>(values, count, a, b, out);
+            } break;
+
+            case TC_BETWEEN: {
+                compare_uints_avx2<TC_BETWEEN>(values, count, a, b, out);
+            } break;
+        }
+        return;
+    }
+#endif
+    compare_dispatch_scalar(values, count, op, a, b, out);
+}
+
+void compare_ints(const int *values, size_t count, ToiletCompare op,
+                  int a, int b, uint64_t *out)
+{
+#ifdef TDB_AVX2_KERNELS
+    if (cpu_has_avx2()) {
+        switch (op) {
+            case TC_EQ: {
+                compare_ints_avx2<TC_EQ>(values, count, a, b, out);
+            } break;
+
+            case TC_NE: {
+                compare_ints_avx2<TC_NE>(values, count, a, b, out);
+            } break;
+
+            case TC_LT: {
+                compare_ints_avx2<TC_LT>(values, count, a, b, out);
+            } break;
+
+            case TC_LE: {
+                compare_ints_avx2<TC_LE>(values, count, a, b, out);
+            } break;
+
+            case TC_GT: {
+                compare_ints_avx2<TC_GT>(values, count, a, b, out);
+            } break;
+
+            case TC_GE: {
+                compare_ints_avx2<TC_GE>(values, count, a, b, out);
+            } break;
+
+            case TC_BETWEEN: {
+                compare_ints_avx2<TC_BETWEEN>(values, count, a, b, out);
+            } break;
+        }
+        return;
+    }
+#endif
+    compare_dispatch_scalar(values, count, op, a, b, out);
+}
+
+bool compare_str(std::string_view value, ToiletCompare op, std::string_view a,
+                 std::string_view b)
+{
+    switch (op) {
+        case TC_EQ:
+            return value == a;
+        case TC_NE:
+            return value != a;
+        case TC_LT:
+            return value < a;
+        case TC_LE:
+            return value <= a;
+        case TC_GT:
+            return value > a;
+        case TC_GE:
+            return value >= a;
+        case TC_BETWEEN:
+            return value >= a && value <= b;
+    }
+
+    return false;
+}
+
+void UintStats::merge(const UintStats &other)
+{
+    this->count += other.count;
+    this->sum += other.sum;
+    this->carry += other.carry + (this->sum < other.sum);
+    this->min = std::min(this->min, other.min);
+    this->max = std::max(this->max, other.max);
+}
+
+void IntStats::merge(const IntStats &other)
+{
+    this->count += other.count;
+    this->sum += other.sum;
+    this->min = std::min(this->min, other.min);
+    this->max = std::max(this->max, other.max);
+}
+
+void aggregate_uints(const size_t *values, size_t count, const uint64_t *mask,
+                     UintStats &stats)
+{
+    stats.count += mask_count(mask, count);
+#ifdef TDB_AVX2_KERNELS
+    if (cpu_has_avx2()) {
+        aggregate_uints_avx2(values, count, mask, stats);
+        return;
+    }
+#endif
+    aggregate_uints_scalar(values, 0, count, mask, stats);
+}
+
+void aggregate_ints(const int *values, size_t count, const uint64_t *mask,
+                    IntStats &stats)
+{
+    stats.count += mask_count(mask, count);
+#ifdef TDB_AVX2_KERNELS
+    if (cpu_has_avx2()) {
+        aggregate_ints_avx2(values, count, mask, stats);
+        return;
+    }
+#endif
+    aggregate_ints_scalar(values, 0, count, mask, stats);
+}
+
+} // namespace toiletdb
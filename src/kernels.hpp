@@ -0,0 +1,146 @@
+#ifndef TOILET_KERNELS_H_
+#define TOILET_KERNELS_H_
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+    #define TDB_AVX2_KERNELS
+#endif
+
+namespace toiletdb {
+
+/**
+ * @brief Comparison used by predicates on numeric columns.
+ *        TC_BETWEEN is inclusive on both ends.
+ */
+enum ToiletCompare
+{
+    TC_EQ,
+    TC_NE,
+    TC_LT,
+    TC_LE,
+    TC_GT,
+    TC_GE,
+    TC_BETWEEN,
+};
+
+/**
+ * @brief Returns true if AVX2 kernels can be used on this machine.
+ *        Detected once, on first call.
+ */
+bool cpu_has_avx2();
+
+/**
+ * @brief Unpacks 'count' values of 'bits' width, starting from value with
+ *        index 'first', adding 'base' to each of them.
+ * @warning 'words' should have two extra words of padding at the end.
+ */
+void unpack_bits(const uint64_t *words, size_t bits, size_t first,
+                 size_t count, size_t base, size_t *out);
+
+/**
+ * @brief Sets bit i in 'out' if values[i] satisfies 'op' against 'a'
+ *        ('a' and 'b' for TC_BETWEEN). Other bits of the words written are
+ *        cleared.
+ */
+void compare_uints(const size_t *values, size_t count, ToiletCompare op,
+                   size_t a, size_t b, uint64_t *out);
+
+/**
+ * @brief Same as compare_uints(), for signed integers.
+ */
+void compare_ints(const int *values, size_t count, ToiletCompare op,
+                  int a, int b, uint64_t *out);
+
+/**
+ * @brief True if 'value' satisfies 'op' against 'a' ('a' and 'b' for
+ *        TC_BETWEEN). Strings are compared byte by byte.
+ */
+bool compare_str(std::string_view value, ToiletCompare op, std::string_view a,
+                 std::string_view b);
+
+/**
+ * @brief Running count, sum, minimum and maximum of unsigned values.
+ *        'carry' counts how many times 'sum' wrapped around.
+ */
+struct UintStats
+{
+    size_t count = 0;
+    size_t sum   = 0;
+    size_t carry = 0;
+    size_t min   = SIZE_MAX;
+    size_t max   = 0;
+
+    void merge(const UintStats &other);
+};
+
+/**
+ * @brief Same as UintStats, for signed integers. Sum can't realistically
+ *        overflow.
+ */
+struct IntStats
+{
+    size_t count  = 0;
+    long long sum = 0;
+    int min       = INT_MAX;
+    int max       = INT_MIN;
+
+    void merge(const IntStats &other);
+};
+
+/**
+ * @brief Adds values to 'stats'. If 'mask' is not null, only values[i] with
+ *        bit i of 'mask' set are counted.
+ */
+void aggregate_uints(const size_t *values, size_t count, const uint64_t *mask,
+                     UintStats &stats);
+/**
+ * @brief Same as aggregate_uints(), for signed integers.
+ */
+void aggregate_ints(const int *values, size_t count, const uint64_t *mask,
+                    IntStats &stats);
+
+/**
+ * @brief Amount of bits set in a word.
+ */
+inline size_t count_bits(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    size_t count = 0;
+
+    for (; word; word &= word - 1) {
+        ++count;
+    }
+
+    return count;
+#endif
+}
+
+/**
+ * @brief Index of the lowest bit set in a word.
+ * @warning Word should not be zero.
+ */
+inline size_t lowest_bit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    size_t index = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        ++index;
+    }
+
+    return index;
+#endif
+}
+
+} // namespace toiletdb
+
+#endif // TOILET_KERNELS_H_
@@ -0,0 +1,35 @@
+#include "memory.hpp"
+
+namespace toiletdb {
+
+TableResource::TableResource(std::pmr::memory_resource *upstream) :
+    allocated(0)
+{
+    this->upstream = upstream ? upstream : std::pmr::get_default_resource();
+}
+
+void *TableResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void *p = this->upstream->allocate(bytes, alignment);
+    this->allocated.fetch_add(bytes, std::memory_order_relaxed);
+
+    return p;
+}
+
+void TableResource::do_deallocate(void *p, size_t bytes, size_t alignment)
+{
+    this->upstream->deallocate(p, bytes, alignment);
+    this->allocated.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+bool TableResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+size_t TableResource::get_allocated() const
+{
+    return this->allocated.load(std::memory_order_relaxed);
+}
+
+} // namespace toiletdb
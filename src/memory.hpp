@@ -0,0 +1,34 @@
+#ifndef TOILET_MEMORY_H_
+#define TOILET_MEMORY_H_
+
+#include <atomic>
+#include <memory_resource>
+
+namespace toiletdb {
+
+/**
+ * @class TableResource
+ * @brief Memory resource that backs storage of one table.
+ *        Forwards allocations to upstream resource and keeps count of bytes
+ *        currently allocated through it.
+ */
+class TableResource : public std::pmr::memory_resource
+{
+private:
+    std::pmr::memory_resource *upstream;
+    std::atomic<size_t> allocated;
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+    TableResource(std::pmr::memory_resource *upstream);
+    /// @brief Bytes that are allocated and not yet freed.
+    size_t get_allocated() const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_MEMORY_H_
@@ -0,0 +1,293 @@
+#include "parallel.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace toiletdb {
+
+static std::atomic<size_t> default_threads(0);
+
+void set_default_thread_count(size_t threads)
+{
+    default_threads.store(threads, std::memory_order_relaxed);
+}
+
+size_t get_default_thread_count()
+{
+    static const size_t hardware = std::max(1U, std::thread::hardware_concurrency());
+
+    size_t threads = default_threads.load(std::memory_order_relaxed);
+
+    return threads ? threads : hardware;
+}
+
+size_t scan_thread_count(size_t rows, size_t threads)
+{
+    return std::max<size_t>(1, std::min(threads, rows / TDB_PARTITION_ROWS));
+}
+
+size_t morsel_size(size_t rows, size_t threads)
+{
+    if (threads <= 1) {
+        return std::max<size_t>(rows, 1);
+    }
+
+    size_t morsels = threads * TDB_MORSELS_PER_THREAD;
+
+    return std::max<size_t>((rows / morsels + 63) / 64 * 64, 64);
+}
+
+size_t morsel_count(size_t rows, size_t size)
+{
+    return std::max<size_t>(1, (rows + size - 1) / size);
+}
+
+// One call of run_morsels(). Every thread working on it owns a range of
+// morsels, packed as (first << 32 | end) so it can be taken from and stolen
+// from with a single compare-and-swap.
+struct MorselJob
+{
+    size_t rows;
+    size_t size;
+    void (*call)(void *, size_t, size_t, size_t);
+    void *context;
+
+    size_t slots;
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges;
+
+    // Pool threads currently working on the job. Guarded by pool's mutex.
+    size_t running;
+    std::condition_variable done;
+
+    void run(size_t morsel)
+    {
+        size_t first = morsel * this->size;
+        size_t end   = std::min(this->rows, first + this->size);
+
+        this->call(this->context, morsel, first, end);
+    }
+
+    // Takes the first morsel of slot's own range.
+    bool take(size_t slot, size_t &morsel)
+    {
+        std::atomic<uint64_t> &range = this->ranges[slot];
+        uint64_t value               = range.load(std::memory_order_acquire);
+
+        while ((value >> 32) < (value & 0xFFFFFFFF)) {
+            if (range.compare_exchange_weak(value, value + (uint64_t(1) << 32),
+                                            std::memory_order_acq_rel)) {
+                morsel = value >> 32;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Moves back half of some other slot's range into slot's own, which
+    // should be empty.
+    bool steal(size_t slot)
+    {
+        for (size_t i = 1; i < this->slots; ++i) {
+            std::atomic<uint64_t> &victim = this->ranges[(slot + i) % this->slots];
+            uint64_t value                = victim.load(std::memory_order_acquire);
+
+            while (true) {
+                uint64_t first = value >> 32;
+                uint64_t end   = value & 0xFFFFFFFF;
+
+                if (first >= end) {
+                    break;
+                }
+
+                uint64_t middle = end - (end - first + 1) / 2;
+
+                if (victim.compare_exchange_weak(value, first << 32 | middle,
+                                                 std::memory_order_acq_rel)) {
+                    this->ranges[slot].store(middle << 32 | end, std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void work(size_t slot)
+    {
+        size_t morsel;
+
+        do {
+            while (this->take(slot, morsel)) {
+                this->run(morsel);
+            }
+        } while (this->steal(slot));
+    }
+};
+
+// Threads shared by every table. Callers hand out one ticket per extra thread
+// they want on their job, and take back tickets no thread picked up before
+// they were done, so jobs never wait on busy threads. Posted tasks are run by
+// the same threads, once there are no tickets left.
+class ThreadPool
+{
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<MorselJob *, size_t>> tickets;
+    std::deque<std::pair<void (*)(void *), void *>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping;
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        while (true) {
+            this->wake.wait(lock, [this]() {
+                return this->stopping || !this->tickets.empty() || !this->tasks.empty();
+            });
+
+            if (this->stopping) {
+                return;
+            }
+
+            // Someone is waiting on a ticket, while nobody waits on a task.
+            if (this->tickets.empty()) {
+                auto [call, context] = this->tasks.front();
+                this->tasks.pop_front();
+
+                lock.unlock();
+                call(context);
+                lock.lock();
+
+                continue;
+            }
+
+            auto [job, slot] = this->tickets.front();
+            this->tickets.pop_front();
+
+            ++job->running;
+
+            lock.unlock();
+            job->work(slot);
+            lock.lock();
+
+            if (--job->running == 0) {
+                job->done.notify_all();
+            }
+        }
+    }
+
+public:
+    ThreadPool() :
+        stopping(false)
+    {}
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+
+        this->wake.notify_all();
+
+        for (std::thread &t : this->threads) {
+            t.join();
+        }
+    }
+
+    static ThreadPool &shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // Threads are started on first use, and only as many as were asked for.
+    // Should be called with mutex held.
+    void start_threads(size_t count)
+    {
+        while (this->threads.size() < count) {
+            this->threads.emplace_back([this]() { this->loop(); });
+        }
+    }
+
+    void post(void (*call)(void *), void *context)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+
+            this->start_threads(get_default_thread_count());
+            this->tasks.emplace_back(call, context);
+        }
+
+        this->wake.notify_one();
+    }
+
+    void run(MorselJob &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+
+            this->start_threads(job.slots - 1);
+
+            for (size_t slot = 1; slot < job.slots; ++slot) {
+                this->tickets.emplace_back(&job, slot);
+            }
+        }
+
+        this->wake.notify_all();
+
+        job.work(0);
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        this->tickets.erase(std::remove_if(this->tickets.begin(), this->tickets.end(),
+                                           [&job](const std::pair<MorselJob *, size_t> &t) {
+                                               return t.first == &job;
+                                           }),
+                            this->tickets.end());
+
+        job.done.wait(lock, [&job]() { return job.running == 0; });
+    }
+};
+
+void post_task(void (*call)(void *), void *context)
+{
+    ThreadPool::shared().post(call, context);
+}
+
+void run_morsels(size_t rows, size_t size, size_t threads,
+                 void (*call)(void *, size_t, size_t, size_t), void *context)
+{
+    size_t count = morsel_count(rows, size);
+
+    MorselJob job;
+
+    job.rows    = rows;
+    job.size    = size;
+    job.call    = call;
+    job.context = context;
+    job.slots   = std::min(threads, count);
+    job.ranges  = std::make_unique<std::atomic<uint64_t>[]>(job.slots);
+    job.running = 0;
+
+    // Every slot starts with a run of consecutive morsels.
+    for (size_t slot = 0; slot < job.slots; ++slot) {
+        uint64_t first = count * slot / job.slots;
+        uint64_t end   = count * (slot + 1) / job.slots;
+
+        job.ranges[slot].store(first << 32 | end, std::memory_order_relaxed);
+    }
+
+    ThreadPool::shared().run(job);
+}
+
+} // namespace toiletdb
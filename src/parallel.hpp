@@ -0,0 +1,128 @@
+#ifndef TOILET_PARALLEL_H_
+#define TOILET_PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <type_traits>
+#include <vector>
+
+/// @brief Least amount of rows worth handing to a separate thread.
+#define TDB_PARTITION_ROWS 65536
+/// @brief Amount of morsels per thread scans are split into, so threads that
+///        finish early have something to steal.
+#define TDB_MORSELS_PER_THREAD 4
+
+namespace toiletdb {
+
+/**
+ * @brief Sets amount of threads scans are split between, for tables that
+ *        don't set their own. 0 means one per hardware thread, which is the
+ *        default.
+ * @see InMemoryTable.set_thread_count()
+ */
+void set_default_thread_count(size_t threads);
+
+/**
+ * @brief Amount of threads scans are split between by default, with 0
+ *        resolved to amount of hardware threads.
+ */
+size_t get_default_thread_count();
+
+/**
+ * @brief Amount of threads worth using for a scan of 'rows' rows, at most
+ *        'threads'. Is 1 for small tables.
+ */
+size_t scan_thread_count(size_t rows, size_t threads);
+
+/**
+ * @brief Rows in one morsel when 'rows' rows are scanned on 'threads'
+ *        threads. A multiple of 64, so morsels line up with words of a
+ *        Selection. All rows are one morsel when there is one thread.
+ */
+size_t morsel_size(size_t rows, size_t threads);
+
+/**
+ * @brief Amount of morsels of 'size' rows that 'rows' rows are split into.
+ *        Is at least 1.
+ */
+size_t morsel_count(size_t rows, size_t size);
+
+/**
+ * @brief Calls call(context, morsel, first, end) for every morsel.
+ * @see for_each_morsel()
+ */
+void run_morsels(size_t rows, size_t size, size_t threads,
+                 void (*call)(void *, size_t, size_t, size_t), void *context);
+
+/**
+ * @brief Calls call(context) on a thread of the same pool scans use, without
+ *        waiting for it, for work started by async API. Pool is grown to
+ *        get_default_thread_count() threads, and calls that find all of
+ *        them busy wait in order they were made.
+ * @warning call should not throw.
+ * @see offload()
+ */
+void post_task(void (*call)(void *), void *context);
+
+/**
+ * @brief Splits [0, rows) into morsels of 'size' rows and calls
+ *        f(morsel, first, end) for each of them, on up to 'threads' threads
+ *        of a shared pool, calling thread included. Each thread starts with
+ *        a run of consecutive morsels, and threads that run out of them steal
+ *        half of what is left from others.
+ *        Morsels are numbered in order of rows, so results kept per morsel
+ *        can be merged in order no matter which thread did what.
+ * @warning f should not throw.
+ */
+template <typename F>
+void for_each_morsel(size_t rows, size_t size, size_t threads, F &&f)
+{
+    using Function = std::remove_reference_t<F>;
+
+    if (threads <= 1 || size >= rows) {
+        f(0, 0, rows);
+        return;
+    }
+
+    run_morsels(
+        rows, size, threads,
+        [](void *context, size_t morsel, size_t first, size_t end) {
+            (*static_cast<Function *>(context))(morsel, first, end);
+        },
+        const_cast<void *>(static_cast<const void *>(&f)));
+}
+
+/**
+ * @brief Calls f(task) for every task in [0, count), on up to 'threads'
+ *        threads of the same pool, for work that is split into a few large
+ *        pieces, like separate files. Unlike for_each_morsel(), f can throw:
+ *        exception of the first task that threw is rethrown once all tasks
+ *        are done.
+ */
+template <typename F>
+void for_each_task(size_t count, size_t threads, F &&f)
+{
+    std::vector<std::exception_ptr> errors(count);
+
+    for_each_morsel(count, 1, std::min(count, threads), [&](size_t, size_t first, size_t end) {
+        for (size_t task = first; task < end; ++task) {
+            try {
+                f(task);
+            }
+            catch (...) {
+                errors[task] = std::current_exception();
+            }
+        }
+    });
+
+    for (const std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+} // namespace toiletdb
+
+#endif // TOILET_PARALLEL_H_
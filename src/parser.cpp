@@ -19,38 +19,8 @@
 
 namespace toiletdb {
 
-std::fstream InMemoryFileParser::open(const std::string &filepath, const std::ios_base::openmode mode)
-{
-    std::fstream file;
-
-    file.open(filepath, mode);
-
-    TDB_DEBUGS(filepath, "InMemoryFileParser.open");
-
-    if (!file.is_open()) {
-        throw std::ios::failure("In ToiletDB, In InMemoryFileParser.open(), could not open file");
-    }
-
-    return file;
-}
-
-std::fstream InMemoryFileParser::open(const std::ios_base::openmode mode)
-{
-    std::fstream file;
-
-    file.open(this->filename, mode);
-
-    TDB_DEBUGS(this->filename, "InMemoryFileParser.open");
-
-    if (!file.is_open()) {
-        throw std::ios::failure("In ToiletDB, In InMemoryFileParser.open(), could not open file");
-    }
-
-    return file;
-}
-
 // Reads first line of a file and updates InMemoryFileParser format version
-void InMemoryFileParser::update_version(std::fstream &file)
+void InMemoryFileParser::update_version(FileInput &file)
 {
     switch (this->format_version) {
         case 1: {
@@ -66,7 +36,7 @@ void InMemoryFileParser::update_version(std::fstream &file)
 // Line should look like this:
 // `|[modifier] <type> <name>|...`
 // Updates this->columns.
-void InMemoryFileParser::read_types(std::fstream &file)
+void InMemoryFileParser::read_types(FileInput &file)
 {
     switch (this->format_version) {
         case 1: {
@@ -79,12 +49,13 @@ void InMemoryFileParser::read_types(std::fstream &file)
 }
 
 // Read file from disk into memory.
-std::vector<std::shared_ptr<ColumnBase>> InMemoryFileParser::deserealize(std::fstream &file,
-                                                                         std::vector<std::string> &names)
+std::vector<std::shared_ptr<ColumnBase>> InMemoryFileParser::deserealize(FileInput &file,
+                                                                         std::vector<std::string> &names,
+                                                                         std::pmr::memory_resource *resource)
 {
     switch (this->format_version) {
         case 1: {
-            return FormatOne::deserealize(file, this->columns, names);
+            return FormatOne::deserealize(file, this->columns, names, resource);
         } break;
 
         default:
@@ -92,7 +63,7 @@ std::vector<std::shared_ptr<ColumnBase>> InMemoryFileParser::deserealize(std::fs
     }
 }
 
-void InMemoryFileParser::serialize(std::fstream &file,
+void InMemoryFileParser::serialize(FileWriter &file,
                                    const std::vector<std::shared_ptr<ColumnBase>> &columns)
 {
     switch (this->format_version) {
@@ -120,6 +91,11 @@ const size_t &InMemoryFileParser::get_version() const
     return this->format_version;
 }
 
+const std::string &InMemoryFileParser::get_filename() const
+{
+    return this->filename;
+}
+
 const size_t &InMemoryFileParser::id_column_index() const
 {
     TDB_DEBUGS(this->columns.id_field_index, "InMemoryFileParser.id_column_index");
@@ -171,22 +147,17 @@ bool InMemoryFileParser::exists_or_create() const
     return true;
 }
 
-std::vector<std::shared_ptr<ColumnBase>> InMemoryFileParser::read_file()
+std::vector<std::shared_ptr<ColumnBase>> InMemoryFileParser::read_file(std::pmr::memory_resource *resource)
 {
-    std::fstream file;
-
-    file = this->open(std::ios::in | std::ios::out | std::ios::binary);
+    std::unique_ptr<FileReader> reader = open_reader(this->filename);
+    FileInput file(*reader);
 
     this->update_version(file);
     this->read_types(file);
 
     std::vector<std::string> names = this->columns.names;
 
-    std::vector<std::shared_ptr<ColumnBase>> columns = this->deserealize(file, names);
-
-    file.close();
-
-    return columns;
+    return this->deserealize(file, names, resource);
 }
 
 void InMemoryFileParser::write_file(const std::string filepath, const std::vector<std::shared_ptr<ColumnBase>> &columns)
@@ -195,12 +166,11 @@ void InMemoryFileParser::write_file(const std::string filepath, const std::vecto
         throw std::logic_error("In ToiletDB, InMemoryFileParser.write_file(), refusing to overwrite existing file");
     }
 
-    std::fstream file =
-        this->open(filepath, std::ios::out | std::ios::trunc | std::ios::binary);
+    std::unique_ptr<FileWriter> file = open_writer(filepath);
 
-    this->serialize(file, columns);
+    this->serialize(*file, columns);
 
-    file.close();
+    file->finish();
 }
 
 void InMemoryFileParser::write_file(const std::vector<std::shared_ptr<ColumnBase>> &columns)
@@ -209,12 +179,11 @@ void InMemoryFileParser::write_file(const std::vector<std::shared_ptr<ColumnBase
         throw std::runtime_error("In ToiletDB, InMemoryFileParser.write_file(), file does not exist");
     }
 
-    std::fstream file =
-        this->open(std::ios::out | std::ios::trunc | std::ios::binary);
+    std::unique_ptr<FileWriter> file = open_writer(this->filename);
 
-    this->serialize(file, columns);
+    this->serialize(*file, columns);
 
-    file.close();
+    file->finish();
 }
 
 const std::vector<int> &InMemoryFileParser::types() const
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <vector>
 
 #include "debug.hpp"
@@ -12,6 +13,7 @@
 #include "common.hpp"
 #include "errors.hpp"
 #include "format.hpp"
+#include "io.hpp"
 #include "types.hpp"
 
 namespace toiletdb {
@@ -23,22 +25,23 @@ private:
     size_t format_version;
     TableInfo columns;
 
-    std::fstream open(const std::string &filepath, const std::ios_base::openmode mode);
-    std::fstream open(const std::ios_base::openmode mode);
-    void update_version(std::fstream &file);
-    void read_types(std::fstream &file);
-    std::vector<std::shared_ptr<ColumnBase>> deserealize(std::fstream &file, std::vector<std::string> &names);
-    void serialize(std::fstream &file, const std::vector<std::shared_ptr<ColumnBase>> &columns);
+    void update_version(FileInput &file);
+    void read_types(FileInput &file);
+    std::vector<std::shared_ptr<ColumnBase>> deserealize(FileInput &file, std::vector<std::string> &names,
+                                                         std::pmr::memory_resource *resource);
+    void serialize(FileWriter &file, const std::vector<std::shared_ptr<ColumnBase>> &columns);
 
 public:
     InMemoryFileParser(const std::string filename);
     ~InMemoryFileParser();
     const size_t &get_version() const;
+    const std::string &get_filename() const;
     const size_t &id_column_index() const;
     bool exists(const std::string &filepath) const;
     bool exists() const;
     bool exists_or_create() const;
-    std::vector<std::shared_ptr<ColumnBase>> read_file();
+    /// @brief Reads file into columns, allocated from resource.
+    std::vector<std::shared_ptr<ColumnBase>> read_file(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
     void write_file(const std::string filepath, const std::vector<std::shared_ptr<ColumnBase>> &columns);
     void write_file(const std::vector<std::shared_ptr<ColumnBase>> &columns);
     const std::vector<int> &types() const;
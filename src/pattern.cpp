@@ -0,0 +1,317 @@
+#include "pattern.hpp"
+
+namespace toiletdb {
+
+enum PatternKind
+{
+    PK_EXACT,
+    PK_PREFIX,
+    PK_SUFFIX,
+    PK_CONTAINS,
+    // Anything with '_', or with literals between several '%'.
+    PK_SEGMENTS,
+};
+
+// Part of a segment, either literal text or 'any' characters matched by '_'.
+struct PatternPiece
+{
+    std::string literal;
+    size_t any;
+};
+
+// Part of a pattern between two '%'.
+struct PatternSegment
+{
+    std::vector<PatternPiece> pieces;
+    // Length in characters, every '_' counted as one.
+    size_t chars;
+
+    bool is_literal() const
+    {
+        return this->pieces.empty() || (this->pieces.size() == 1 && this->pieces[0].any == 0);
+    }
+};
+
+struct Pattern::Private
+{
+    PatternKind kind;
+    bool nocase;
+    // Whether there is no '%' before first segment and after last one.
+    bool anchored_start;
+    bool anchored_end;
+    // Empty segments are dropped, unless pattern has no '%' at all.
+    std::vector<PatternSegment> segments;
+    // Text compared by every kind but PK_SEGMENTS.
+    std::string literal;
+};
+
+// Size of UTF-8 character starting with byte 'lead'. Bytes that can't start
+// a character count as one.
+static size_t pattern_char_size(unsigned char lead)
+{
+    if (lead >= 0xF0) {
+        return 4;
+    }
+    if (lead >= 0xE0) {
+        return 3;
+    }
+    if (lead >= 0xC0) {
+        return 2;
+    }
+    return 1;
+}
+
+// End of segment matched at 'pos', or std::string_view::npos.
+static size_t match_segment(const PatternSegment &segment, std::string_view value, size_t pos)
+{
+    for (const PatternPiece &piece : segment.pieces) {
+        if (piece.any == 0) {
+            if (value.size() - pos < piece.literal.size() ||
+                value.compare(pos, piece.literal.size(), piece.literal) != 0) {
+                return std::string_view::npos;
+            }
+
+            pos += piece.literal.size();
+            continue;
+        }
+
+        for (size_t i = 0; i < piece.any; ++i) {
+            if (pos >= value.size()) {
+                return std::string_view::npos;
+            }
+
+            pos += std::min(pattern_char_size(value[pos]), value.size() - pos);
+        }
+    }
+
+    return pos;
+}
+
+// End of leftmost match of segment that starts at 'pos' or later, or
+// std::string_view::npos.
+static size_t find_segment(const PatternSegment &segment, std::string_view value, size_t pos)
+{
+    const PatternPiece &first = segment.pieces[0];
+
+    // Candidates are found with memchr() on first byte of the literal.
+    if (first.any == 0) {
+        size_t start;
+
+        while ((start = value.find(first.literal, pos)) != std::string_view::npos) {
+            size_t end = match_segment(segment, value, start);
+
+            if (end != std::string_view::npos) {
+                return end;
+            }
+
+            pos = start + 1;
+        }
+
+        return std::string_view::npos;
+    }
+
+    while (pos < value.size()) {
+        size_t end = match_segment(segment, value, pos);
+
+        if (end != std::string_view::npos) {
+            return end;
+        }
+
+        pos += std::min(pattern_char_size(value[pos]), value.size() - pos);
+    }
+
+    return std::string_view::npos;
+}
+
+// Segments are fixed in length, so placing each one as far left as possible
+// never rules out a match for the ones after it.
+static bool match_segments(const std::vector<PatternSegment> &segments, bool anchored_start,
+                           bool anchored_end, std::string_view value)
+{
+    size_t first = 0;
+    size_t last  = segments.size();
+    size_t pos   = 0;
+
+    if (anchored_start) {
+        pos = match_segment(segments[0], value, 0);
+
+        if (pos == std::string_view::npos) {
+            return false;
+        }
+
+        // Pattern without '%'.
+        if (anchored_end && last == 1) {
+            return pos == value.size();
+        }
+
+        first = 1;
+    }
+
+    // Last segment can only start where it ends exactly at the end.
+    if (anchored_end && last > first) {
+        const PatternSegment &segment = segments[last - 1];
+        size_t start                  = value.size();
+
+        for (size_t i = 0; i < segment.chars; ++i) {
+            if (start == 0) {
+                return false;
+            }
+
+            --start;
+
+            while (start > 0 && (static_cast<unsigned char>(value[start]) & 0xC0) == 0x80) {
+                --start;
+            }
+        }
+
+        if (start < pos || match_segment(segment, value, start) != value.size()) {
+            return false;
+        }
+
+        value = value.substr(0, start);
+        --last;
+    }
+
+    for (size_t i = first; i < last; ++i) {
+        pos = find_segment(segments[i], value, pos);
+
+        if (pos == std::string_view::npos) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Pattern::Pattern(std::string_view text, bool nocase)
+{
+    this->internal = std::make_unique<Private>();
+
+    Private &p = *this->internal;
+
+    p.nocase = nocase;
+
+    // Folding leaves '%', '_' and '\' as they are.
+    std::string folded;
+
+    if (nocase) {
+        folded = fold_case(text);
+        text   = folded;
+    }
+
+    std::vector<PatternSegment> segments(1);
+    segments[0].chars = 0;
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c                  = text[i];
+        PatternSegment &segment = segments.back();
+
+        if (c == '%') {
+            segments.push_back({{}, 0});
+            continue;
+        }
+
+        if (c == '_') {
+            if (segment.pieces.empty() || segment.pieces.back().any == 0) {
+                segment.pieces.push_back({"", 0});
+            }
+
+            ++segment.pieces.back().any;
+            ++segment.chars;
+            continue;
+        }
+
+        if (c == '\\') {
+            if (++i == text.size()) {
+                throw ParsingError("In ToiletDB, In Pattern constructor, Pattern '" +
+                                   std::string(text) + "' ends with unpaired '\\'");
+            }
+
+            c = text[i];
+        }
+
+        if (segment.pieces.empty() || segment.pieces.back().any != 0) {
+            segment.pieces.push_back({"", 0});
+        }
+
+        segment.pieces.back().literal += c;
+
+        if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+            ++segment.chars;
+        }
+    }
+
+    bool has_percent = segments.size() > 1;
+
+    p.anchored_start = !segments.front().pieces.empty() || !has_percent;
+    p.anchored_end   = !segments.back().pieces.empty() || !has_percent;
+
+    if (has_percent) {
+        for (PatternSegment &segment : segments) {
+            if (!segment.pieces.empty()) {
+                p.segments.push_back(std::move(segment));
+            }
+        }
+    }
+    else {
+        p.segments = std::move(segments);
+    }
+
+    p.kind = PK_SEGMENTS;
+
+    if (p.segments.size() > 1 || (p.segments.size() == 1 && !p.segments[0].is_literal())) {
+        return;
+    }
+
+    if (!p.segments.empty() && !p.segments[0].pieces.empty()) {
+        p.literal = p.segments[0].pieces[0].literal;
+    }
+
+    if (p.anchored_start && p.anchored_end) {
+        p.kind = PK_EXACT;
+    }
+    else if (p.anchored_start) {
+        p.kind = PK_PREFIX;
+    }
+    else if (p.anchored_end) {
+        p.kind = PK_SUFFIX;
+    }
+    else {
+        p.kind = PK_CONTAINS;
+    }
+}
+
+Pattern::Pattern(Pattern &&other) = default;
+
+Pattern &Pattern::operator=(Pattern &&other) = default;
+
+Pattern::~Pattern()
+{}
+
+bool Pattern::matches(std::string_view value) const
+{
+    const Private &p           = *this->internal;
+    const std::string &literal = p.literal;
+
+    switch (p.kind) {
+        case PK_EXACT:
+            return value == literal;
+        case PK_PREFIX:
+            return value.size() >= literal.size() &&
+                   value.compare(0, literal.size(), literal) == 0;
+        case PK_SUFFIX:
+            return value.size() >= literal.size() &&
+                   value.compare(value.size() - literal.size(), literal.size(), literal) == 0;
+        case PK_CONTAINS:
+            return value.find(literal) != std::string_view::npos;
+        default:
+            return match_segments(p.segments, p.anchored_start, p.anchored_end, value);
+    }
+}
+
+bool Pattern::is_nocase() const
+{
+    return this->internal->nocase;
+}
+
+} // namespace toiletdb
@@ -0,0 +1,44 @@
+#ifndef TOILET_PATTERN_H_
+#define TOILET_PATTERN_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+#include "errors.hpp"
+
+namespace toiletdb {
+
+/**
+ * @class Pattern
+ * @brief SQL LIKE pattern, compiled once and matched against any amount of
+ *        values. '%' matches any amount of characters, '_' matches one
+ *        character, and '\' makes the next '%', '_' or '\' literal.
+ *        Characters are UTF-8 code points.
+ *        Patterns of form 'abc', 'abc%', '%abc' and '%abc%' are compared
+ *        directly, others are matched segment by segment, looking for the
+ *        literal start of each segment with memchr().
+ */
+class Pattern
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief With 'nocase', pattern is folded with fold_case(), and values
+    ///        passed to matches() should be folded the same way.
+    /// @throws ParsingError when pattern ends with an unpaired '\'.
+    Pattern(std::string_view text, bool nocase = false);
+    Pattern(Pattern &&other);
+    Pattern &operator=(Pattern &&other);
+    ~Pattern();
+    bool matches(std::string_view value) const;
+    bool is_nocase() const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_PATTERN_H_
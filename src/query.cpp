@@ -0,0 +1,1090 @@
+#include "query.hpp"
+
+namespace toiletdb {
+
+// Index is used when it narrows rows down to at most 1/16 of the table.
+// Past that, reading rows one by one costs more than scanning typed columns.
+static constexpr size_t QUERY_INDEX_RATIO = 16;
+
+enum QueryToken
+{
+    QT_END,
+    QT_WORD,
+    QT_NUMBER,
+    QT_STRING,
+    QT_SYMBOL,
+};
+
+struct Token
+{
+    QueryToken kind;
+    std::string text;
+    size_t offset;
+};
+
+// Values in queries can be out of range of the column they are compared
+// with, so they are kept as sign and magnitude.
+struct QueryNumber
+{
+    bool negative;
+    size_t magnitude;
+};
+
+struct Literal
+{
+    // QT_NUMBER or QT_STRING.
+    QueryToken kind;
+    // Numbers keep their text too, to be compared with 'str' columns.
+    std::string text;
+    QueryNumber number;
+};
+
+enum QueryCondition
+{
+    QC_COMPARE,
+    QC_AND,
+    QC_OR,
+};
+
+struct Condition
+{
+    QueryCondition kind;
+    // Set for QC_COMPARE.
+    std::string column;
+    ToiletCompare op;
+    Literal a;
+    Literal b;
+    // Set for QC_AND and QC_OR.
+    std::vector<Condition> children;
+};
+
+// Condition with its columns looked up in one table.
+struct BoundCondition
+{
+    const Condition *source;
+    size_t column;
+    int type;
+    std::vector<BoundCondition> children;
+};
+
+struct QueryPlan
+{
+    std::vector<size_t> columns;
+    // Conditions joined with AND. When index is used, conditions that it
+    // answers are taken out.
+    std::vector<BoundCondition> filters;
+    bool use_index;
+    size_t min_id;
+    size_t max_id;
+    size_t index_rows;
+};
+
+static ParsingError query_error(const std::string &message, size_t offset)
+{
+    return ParsingError("In ToiletDB, In Query(), " + message + " at position " +
+                        std::to_string(offset + 1));
+}
+
+static bool is_word_char(unsigned char c)
+{
+    return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+static std::vector<Token> query_tokenize(const std::string &text)
+{
+    static const char *symbols[] = {"<=", ">=", "!=", "<>", "==", "=", "<",
+                                    ">", ",", "(", ")", "*", ";"};
+
+    std::vector<Token> tokens;
+
+    size_t len = text.size();
+    size_t i   = 0;
+
+    while (true) {
+        while (i < len && std::isspace(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+
+        if (i >= len) {
+            break;
+        }
+
+        size_t begin    = i;
+        unsigned char c = text[i];
+
+        if (is_word_char(c) && !std::isdigit(c)) {
+            while (i < len && is_word_char(text[i])) {
+                ++i;
+            }
+
+            tokens.push_back({QT_WORD, text.substr(begin, i - begin), begin});
+        }
+        else if (std::isdigit(c) ||
+                 (c == '-' && i + 1 < len && std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+            ++i;
+
+            while (i < len && std::isdigit(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+
+            tokens.push_back({QT_NUMBER, text.substr(begin, i - begin), begin});
+        }
+        else if (c == '\'' || c == '"') {
+            std::string value;
+
+            for (++i; i < len && text[i] != c; ++i) {
+                if (text[i] == '\\' && i + 1 < len) {
+                    ++i;
+                }
+                value += text[i];
+            }
+
+            if (i >= len) {
+                throw query_error("Unterminated string", begin);
+            }
+
+            ++i;
+
+            tokens.push_back({QT_STRING, std::move(value), begin});
+        }
+        else {
+            const char *symbol = nullptr;
+
+            for (const char *s : symbols) {
+                if (text.compare(i, std::strlen(s), s) == 0) {
+                    symbol = s;
+                    break;
+                }
+            }
+
+            if (!symbol) {
+                throw query_error("Unexpected character '" + std::string(1, c) + "'",
+                                  begin);
+            }
+
+            i += std::strlen(symbol);
+
+            tokens.push_back({QT_SYMBOL, symbol, begin});
+        }
+    }
+
+    tokens.push_back({QT_END, "", len});
+
+    return tokens;
+}
+
+static bool equals_keyword(const std::string &word, const char *keyword)
+{
+    size_t len = std::strlen(keyword);
+
+    if (word.size() != len) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (std::toupper(static_cast<unsigned char>(word[i])) != keyword[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Recursive descent parser. AND binds tighter than OR.
+class QueryParser
+{
+private:
+    std::vector<Token> tokens;
+    size_t pos;
+
+    const Token &next()
+    {
+        const Token &token = this->tokens[this->pos];
+
+        if (token.kind != QT_END) {
+            ++this->pos;
+        }
+
+        return token;
+    }
+
+    [[noreturn]] void unexpected(const std::string &expected) const
+    {
+        const Token &token = this->peek();
+
+        throw query_error("Expected " + expected + ", found " +
+                              (token.kind == QT_END ? "end of query"
+                                                    : "'" + token.text + "'"),
+                          token.offset);
+    }
+
+public:
+    QueryParser(const std::string &text) :
+        tokens(query_tokenize(text)), pos(0)
+    {}
+
+    const Token &peek() const
+    {
+        return this->tokens[this->pos];
+    }
+
+    bool accept_keyword(const char *keyword)
+    {
+        if (this->peek().kind == QT_WORD && equals_keyword(this->peek().text, keyword)) {
+            ++this->pos;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool accept_symbol(const char *symbol)
+    {
+        if (this->peek().kind == QT_SYMBOL && this->peek().text == symbol) {
+            ++this->pos;
+            return true;
+        }
+
+        return false;
+    }
+
+    void expect_keyword(const char *keyword)
+    {
+        if (!this->accept_keyword(keyword)) {
+            this->unexpected(keyword);
+        }
+    }
+
+    void expect_symbol(const char *symbol)
+    {
+        if (!this->accept_symbol(symbol)) {
+            this->unexpected(std::string("'") + symbol + "'");
+        }
+    }
+
+    void expect_end()
+    {
+        if (this->peek().kind != QT_END) {
+            this->unexpected("end of query");
+        }
+    }
+
+    std::string expect_column()
+    {
+        if (this->peek().kind != QT_WORD) {
+            this->unexpected("field name");
+        }
+
+        return this->next().text;
+    }
+
+    Literal expect_literal()
+    {
+        const Token &token = this->peek();
+
+        if (token.kind == QT_STRING) {
+            this->next();
+            return {QT_STRING, token.text, {false, 0}};
+        }
+
+        if (token.kind != QT_NUMBER) {
+            this->unexpected("value");
+        }
+
+        this->next();
+
+        bool negative = token.text[0] == '-';
+        size_t magnitude;
+
+        const char *first = token.text.data() + negative;
+        const char *end   = token.text.data() + token.text.size();
+
+        if (std::from_chars(first, end, magnitude).ec != std::errc()) {
+            throw query_error("Number '" + token.text + "' is too large", token.offset);
+        }
+
+        // '-0' is just 0.
+        return {QT_NUMBER, token.text, {negative && magnitude != 0, magnitude}};
+    }
+
+    size_t expect_count()
+    {
+        size_t offset   = this->peek().offset;
+        Literal literal = this->expect_literal();
+
+        if (literal.kind != QT_NUMBER || literal.number.negative) {
+            throw query_error("Expected non-negative number", offset);
+        }
+
+        return literal.number.magnitude;
+    }
+
+    Condition parse_or()
+    {
+        Condition condition = this->parse_and();
+
+        while (this->accept_keyword("OR")) {
+            if (condition.kind != QC_OR) {
+                condition = {QC_OR, "", TC_EQ, {}, {}, {std::move(condition)}};
+            }
+
+            condition.children.push_back(this->parse_and());
+        }
+
+        return condition;
+    }
+
+    Condition parse_and()
+    {
+        Condition condition = this->parse_primary();
+
+        while (this->accept_keyword("AND")) {
+            if (condition.kind != QC_AND) {
+                condition = {QC_AND, "", TC_EQ, {}, {}, {std::move(condition)}};
+            }
+
+            condition.children.push_back(this->parse_primary());
+        }
+
+        return condition;
+    }
+
+    Condition parse_primary()
+    {
+        if (this->accept_symbol("(")) {
+            Condition condition = this->parse_or();
+            this->expect_symbol(")");
+
+            return condition;
+        }
+
+        Condition condition = {QC_COMPARE, this->expect_column(), TC_EQ, {}, {}, {}};
+
+        if (this->accept_keyword("BETWEEN")) {
+            condition.op = TC_BETWEEN;
+            condition.a  = this->expect_literal();
+            this->expect_keyword("AND");
+            condition.b = this->expect_literal();
+
+            return condition;
+        }
+
+        const std::string &op = this->peek().text;
+
+        if (this->peek().kind != QT_SYMBOL) {
+            this->unexpected("comparison");
+        }
+        else if (op == "=" || op == "==") {
+            condition.op = TC_EQ;
+        }
+        else if (op == "!=" || op == "<>") {
+            condition.op = TC_NE;
+        }
+        else if (op == "<") {
+            condition.op = TC_LT;
+        }
+        else if (op == "<=") {
+            condition.op = TC_LE;
+        }
+        else if (op == ">") {
+            condition.op = TC_GT;
+        }
+        else if (op == ">=") {
+            condition.op = TC_GE;
+        }
+        else {
+            this->unexpected("comparison");
+        }
+
+        this->next();
+
+        condition.a = this->expect_literal();
+
+        return condition;
+    }
+};
+
+static int compare_numbers(const QueryNumber &x, const QueryNumber &y)
+{
+    if (x.negative != y.negative) {
+        return x.negative ? -1 : 1;
+    }
+
+    if (x.magnitude == y.magnitude) {
+        return 0;
+    }
+
+    return (x.magnitude < y.magnitude) != x.negative ? -1 : 1;
+}
+
+static bool compare_number(const QueryNumber &value, ToiletCompare op,
+                           const QueryNumber &a, const QueryNumber &b)
+{
+    int c = compare_numbers(value, a);
+
+    switch (op) {
+        case TC_EQ:
+            return c == 0;
+        case TC_NE:
+            return c != 0;
+        case TC_LT:
+            return c < 0;
+        case TC_LE:
+            return c <= 0;
+        case TC_GT:
+            return c > 0;
+        case TC_GE:
+            return c >= 0;
+        case TC_BETWEEN:
+            return c >= 0 && compare_numbers(value, b) <= 0;
+    }
+
+    return false;
+}
+
+// Narrows [min, max] down to IDs that satisfy the condition. Returns false
+// for conditions that aren't one range of IDs.
+static bool narrow_id_range(const Condition &condition, size_t &min, size_t &max)
+{
+    const QueryNumber &a = condition.a.number;
+    const QueryNumber &b = condition.b.number;
+
+    size_t low  = 0;
+    size_t high = SIZE_MAX;
+
+    // No ID is negative, and an empty range is any with low > high.
+    switch (condition.op) {
+        case TC_NE: {
+            return false;
+        } break;
+
+        case TC_EQ: {
+            if (a.negative) {
+                low = SIZE_MAX, high = 0;
+            }
+            else {
+                low = high = a.magnitude;
+            }
+        } break;
+
+        case TC_LT: {
+            if (a.negative || a.magnitude == 0) {
+                low = SIZE_MAX, high = 0;
+            }
+            else {
+                high = a.magnitude - 1;
+            }
+        } break;
+
+        case TC_LE: {
+            if (a.negative) {
+                low = SIZE_MAX, high = 0;
+            }
+            else {
+                high = a.magnitude;
+            }
+        } break;
+
+        case TC_GT: {
+            if (!a.negative) {
+                if (a.magnitude == SIZE_MAX) {
+                    low = SIZE_MAX, high = 0;
+                }
+                else {
+                    low = a.magnitude + 1;
+                }
+            }
+        } break;
+
+        case TC_GE: {
+            if (!a.negative) {
+                low = a.magnitude;
+            }
+        } break;
+
+        case TC_BETWEEN: {
+            if (b.negative) {
+                low = SIZE_MAX, high = 0;
+            }
+            else {
+                high = b.magnitude;
+
+                if (!a.negative) {
+                    low = a.magnitude;
+                }
+            }
+        } break;
+    }
+
+    min = std::max(min, low);
+    max = std::min(max, high);
+
+    return true;
+}
+
+// Runs a numeric comparison through InMemoryTable.filter(), picking the
+// overload values fit into.
+static Selection filter_number(const InMemoryTable &table, const BoundCondition &bound)
+{
+    const Condition &c   = *bound.source;
+    const QueryNumber &a = c.a.number;
+    const QueryNumber &b = c.b.number;
+
+    const size_t int_min = static_cast<size_t>(INT_MAX) + 1;
+
+    size_t len = table.get_row_count();
+
+    if (c.op != TC_BETWEEN) {
+        if (!a.negative) {
+            return table.filter(c.column, c.op, a.magnitude);
+        }
+
+        if (a.magnitude <= int_min) {
+            return table.filter(c.column, c.op, static_cast<int>(-static_cast<long long>(a.magnitude)));
+        }
+
+        // Less than any value a column can hold.
+        return Selection(len, c.op == TC_NE || c.op == TC_GT || c.op == TC_GE);
+    }
+
+    if (compare_numbers(b, a) < 0) {
+        return Selection(len);
+    }
+
+    if (!a.negative) {
+        return table.filter(c.column, TC_BETWEEN, a.magnitude, b.magnitude);
+    }
+
+    if (TDB_TYPE(bound.type) == TT_UINT) {
+        if (b.negative) {
+            return Selection(len);
+        }
+
+        return table.filter(c.column, TC_BETWEEN, size_t(0), b.magnitude);
+    }
+
+    int low = a.magnitude >= int_min ? INT_MIN : -static_cast<int>(a.magnitude);
+    int high;
+
+    if (b.negative) {
+        if (b.magnitude > int_min) {
+            return Selection(len);
+        }
+
+        high = static_cast<int>(-static_cast<long long>(b.magnitude));
+    }
+    else {
+        high = static_cast<int>(std::min(b.magnitude, static_cast<size_t>(INT_MAX)));
+    }
+
+    return table.filter(c.column, TC_BETWEEN, low, high);
+}
+
+static Selection select_rows(const InMemoryTable &table, const BoundCondition &bound)
+{
+    const Condition &c = *bound.source;
+
+    switch (c.kind) {
+        case QC_AND: {
+            Selection result = select_rows(table, bound.children[0]);
+
+            for (size_t i = 1; i < bound.children.size(); ++i) {
+                result &= select_rows(table, bound.children[i]);
+            }
+
+            return result;
+        } break;
+
+        case QC_OR: {
+            Selection result = select_rows(table, bound.children[0]);
+
+            for (size_t i = 1; i < bound.children.size(); ++i) {
+                result |= select_rows(table, bound.children[i]);
+            }
+
+            return result;
+        } break;
+
+        case QC_COMPARE: {
+            if (TDB_TYPE(bound.type) == TT_STR) {
+                return table.filter(c.column, c.op, std::string_view(c.a.text),
+                                    std::string_view(c.b.text));
+            }
+
+            return filter_number(table, bound);
+        } break;
+    }
+
+    throw std::logic_error("Unreachable");
+}
+
+static bool row_matches(const RowView &row, const BoundCondition &bound)
+{
+    const Condition &c = *bound.source;
+
+    switch (c.kind) {
+        case QC_AND: {
+            for (const BoundCondition &child : bound.children) {
+                if (!row_matches(row, child)) {
+                    return false;
+                }
+            }
+
+            return true;
+        } break;
+
+        case QC_OR: {
+            for (const BoundCondition &child : bound.children) {
+                if (row_matches(row, child)) {
+                    return true;
+                }
+            }
+
+            return false;
+        } break;
+
+        case QC_COMPARE: {
+            switch (TDB_TYPE(bound.type)) {
+                case TT_INT: {
+                    long long value = row.get<int>(bound.column);
+                    QueryNumber number = {value < 0, static_cast<size_t>(value < 0 ? -value : value)};
+
+                    return compare_number(number, c.op, c.a.number, c.b.number);
+                } break;
+
+                case TT_UINT: {
+                    QueryNumber number = {false, row.get<size_t>(bound.column)};
+
+                    return compare_number(number, c.op, c.a.number, c.b.number);
+                } break;
+
+                case TT_STR: {
+                    return compare_str(row.get<std::string_view>(bound.column), c.op,
+                                       c.a.text, c.b.text);
+                } break;
+            }
+        } break;
+    }
+
+    throw std::logic_error("Unreachable");
+}
+
+// First 'limit' positions of selection, without collecting the rest.
+static std::vector<size_t> first_positions(const Selection &selection, size_t limit)
+{
+    std::vector<size_t> result;
+
+    const uint64_t *words = selection.data();
+    size_t word_count     = (selection.get_row_count() + 63) / 64;
+
+    for (size_t w = 0; w < word_count && result.size() < limit; ++w) {
+        for (uint64_t word = words[w]; word && result.size() < limit; word &= word - 1) {
+            result.push_back(w * 64 + lowest_bit(word));
+        }
+    }
+
+    return result;
+}
+
+static std::string literal_to_string(const Literal &literal)
+{
+    if (literal.kind == QT_NUMBER) {
+        return literal.text;
+    }
+
+    std::string result = "'";
+
+    for (char c : literal.text) {
+        if (c == '\'' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+
+    return result + "'";
+}
+
+static std::string condition_to_string(const Condition &condition)
+{
+    static const char *ops[] = {"=", "!=", "<", "<=", ">", ">=", "BETWEEN"};
+
+    if (condition.kind == QC_COMPARE) {
+        std::string result = condition.column + ' ' + ops[condition.op] + ' ' +
+                             literal_to_string(condition.a);
+
+        if (condition.op == TC_BETWEEN) {
+            result += " AND " + literal_to_string(condition.b);
+        }
+
+        return result;
+    }
+
+    std::string result;
+
+    for (const Condition &child : condition.children) {
+        if (!result.empty()) {
+            result += condition.kind == QC_AND ? " AND " : " OR ";
+        }
+
+        // AND binds tighter, so only OR inside of AND needs parentheses.
+        if (condition.kind == QC_AND && child.kind == QC_OR) {
+            result += '(' + condition_to_string(child) + ')';
+        }
+        else {
+            result += condition_to_string(child);
+        }
+    }
+
+    return result;
+}
+
+struct Query::Private
+{
+    // Empty when every column is selected.
+    std::vector<std::string> columns;
+    bool has_where;
+    Condition where;
+    std::vector<SortKey> order;
+    size_t limit;
+
+    size_t column_index(const InMemoryTable &table, const std::string &name) const
+    {
+        size_t index = table.search_column_index(name);
+
+        if (index == TDB_NOT_FOUND) {
+            throw std::logic_error("In ToiletDB, In Query.run(), Field '" + name +
+                                   "' does not exist");
+        }
+
+        return index;
+    }
+
+    BoundCondition bind(const InMemoryTable &table, const Condition &condition) const
+    {
+        BoundCondition bound = {&condition, 0, 0, {}};
+
+        if (condition.kind != QC_COMPARE) {
+            for (const Condition &child : condition.children) {
+                bound.children.push_back(this->bind(table, child));
+            }
+
+            return bound;
+        }
+
+        bound.column = this->column_index(table, condition.column);
+        bound.type   = table.get_column_type(bound.column);
+
+        bool numeric = TDB_TYPE(bound.type) != TT_STR;
+
+        if (numeric && (condition.a.kind != QT_NUMBER ||
+                        (condition.op == TC_BETWEEN && condition.b.kind != QT_NUMBER))) {
+            throw std::logic_error("In ToiletDB, In Query.run(), Field '" +
+                                   condition.column + "' is numeric, but is compared "
+                                   "with a string");
+        }
+
+        return bound;
+    }
+
+    QueryPlan plan(const InMemoryTable &table) const
+    {
+        QueryPlan plan = {{}, {}, false, 0, SIZE_MAX, 0};
+
+        if (this->columns.empty()) {
+            plan.columns.resize(table.get_column_count());
+            std::iota(plan.columns.begin(), plan.columns.end(), 0);
+        }
+
+        for (const std::string &name : this->columns) {
+            plan.columns.push_back(this->column_index(table, name));
+        }
+
+        for (const SortKey &key : this->order) {
+            this->column_index(table, key.name);
+        }
+
+        if (!this->has_where) {
+            return plan;
+        }
+
+        // Top-level conditions joined with AND can be answered separately.
+        if (this->where.kind == QC_AND) {
+            for (const Condition &child : this->where.children) {
+                plan.filters.push_back(this->bind(table, child));
+            }
+        }
+        else {
+            plan.filters.push_back(this->bind(table, this->where));
+        }
+
+        size_t min  = 0;
+        size_t max  = SIZE_MAX;
+        bool ranged = false;
+
+        std::vector<BoundCondition> rest;
+
+        for (const BoundCondition &bound : plan.filters) {
+            if (bound.source->kind == QC_COMPARE && TDB_IS(bound.type, TT_ID) &&
+                narrow_id_range(*bound.source, min, max)) {
+                ranged = true;
+                continue;
+            }
+
+            rest.push_back(bound);
+        }
+
+        if (!ranged) {
+            return plan;
+        }
+
+        plan.index_rows = table.count_range(min, max);
+
+        if (plan.index_rows > table.get_row_count() / QUERY_INDEX_RATIO) {
+            return plan;
+        }
+
+        plan.use_index = true;
+        plan.min_id    = min;
+        plan.max_id    = max;
+        plan.filters   = std::move(rest);
+
+        return plan;
+    }
+};
+
+Query::Query(const std::string &text)
+{
+    this->internal = std::make_unique<Private>();
+
+    Private &q = *this->internal;
+
+    q.has_where = false;
+    q.limit     = TDB_NO_LIMIT;
+
+    QueryParser parser(text);
+
+    parser.expect_keyword("SELECT");
+
+    if (!parser.accept_symbol("*")) {
+        do {
+            q.columns.push_back(parser.expect_column());
+        } while (parser.accept_symbol(","));
+    }
+
+    if (parser.accept_keyword("WHERE")) {
+        q.has_where = true;
+        q.where     = parser.parse_or();
+    }
+
+    if (parser.accept_keyword("ORDER")) {
+        parser.expect_keyword("BY");
+
+        do {
+            SortKey key = {parser.expect_column(), TO_ASC};
+
+            if (parser.accept_keyword("DESC")) {
+                key.order = TO_DESC;
+            }
+            else {
+                parser.accept_keyword("ASC");
+            }
+
+            q.order.push_back(std::move(key));
+        } while (parser.accept_symbol(","));
+    }
+
+    if (parser.accept_keyword("LIMIT")) {
+        q.limit = parser.expect_count();
+    }
+
+    parser.accept_symbol(";");
+    parser.expect_end();
+}
+
+Query::Query(Query &&other) = default;
+
+Query &Query::operator=(Query &&other) = default;
+
+Query::~Query()
+{}
+
+QueryResult Query::run(const InMemoryTable &table) const
+{
+    // Plan is made and run with several calls, each locking on its own, so
+    // rows could change between them. Snapshot keeps them as they are, and
+    // is not concurrent itself.
+    if (table.is_concurrent()) {
+        return this->run(*table.snapshot());
+    }
+
+    const Private &q = *this->internal;
+
+    QueryPlan plan = q.plan(table);
+    QueryResult result;
+
+    result.columns = std::move(plan.columns);
+
+    size_t len = table.get_row_count();
+
+    if (plan.use_index) {
+        std::vector<size_t> rows = table.search_range(plan.min_id, plan.max_id);
+
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                  [&table, &plan](size_t pos) {
+                                      RowView row(table, pos);
+
+                                      for (const BoundCondition &bound : plan.filters) {
+                                          if (!row_matches(row, bound)) {
+                                              return true;
+                                          }
+                                      }
+
+                                      return false;
+                                  }),
+                   rows.end());
+
+        // Index hands rows out in order of IDs, scans do in order of positions.
+        std::sort(rows.begin(), rows.end());
+
+        if (q.order.empty()) {
+            rows.resize(std::min(rows.size(), q.limit));
+            result.rows = std::move(rows);
+
+            return result;
+        }
+
+        Selection selection(len);
+
+        for (size_t pos : rows) {
+            selection.set(pos);
+        }
+
+        result.rows = table.sort_positions(q.order, q.limit, &selection);
+
+        return result;
+    }
+
+    if (plan.filters.empty()) {
+        if (q.order.empty()) {
+            result.rows.resize(std::min(len, q.limit));
+            std::iota(result.rows.begin(), result.rows.end(), 0);
+        }
+        else {
+            result.rows = table.sort_positions(q.order, q.limit);
+        }
+
+        return result;
+    }
+
+    Selection selection = select_rows(table, plan.filters[0]);
+
+    for (size_t i = 1; i < plan.filters.size(); ++i) {
+        selection &= select_rows(table, plan.filters[i]);
+    }
+
+    if (q.order.empty()) {
+        result.rows = first_positions(selection, q.limit);
+    }
+    else {
+        result.rows = table.sort_positions(q.order, q.limit, &selection);
+    }
+
+    return result;
+}
+
+std::string Query::explain(const InMemoryTable &table) const
+{
+    const Private &q = *this->internal;
+
+    QueryPlan plan = q.plan(table);
+
+    // Operators from the one producing results down to the one reading rows.
+    std::vector<std::string> steps;
+
+    std::string project = "Project ";
+
+    if (q.columns.empty()) {
+        project += '*';
+    }
+
+    for (size_t i = 0; i < q.columns.size(); ++i) {
+        project += (i ? ", " : "") + table.get_column_name(plan.columns[i]);
+    }
+
+    steps.push_back(project);
+
+    if (!q.order.empty()) {
+        std::string sort = "Sort ";
+
+        for (size_t i = 0; i < q.order.size(); ++i) {
+            sort += (i ? ", " : "") + q.order[i].name +
+                    (q.order[i].order == TO_DESC ? " DESC" : " ASC");
+        }
+
+        if (q.limit != TDB_NO_LIMIT) {
+            sort += " (top " + std::to_string(q.limit) + ")";
+        }
+
+        steps.push_back(sort);
+    }
+    else if (q.limit != TDB_NO_LIMIT) {
+        steps.push_back("Limit " + std::to_string(q.limit));
+    }
+
+    if (!plan.filters.empty()) {
+        std::string filter = "Filter ";
+
+        for (size_t i = 0; i < plan.filters.size(); ++i) {
+            const Condition &c = *plan.filters[i].source;
+
+            if (i) {
+                filter += " AND ";
+            }
+
+            if (plan.filters.size() > 1 && c.kind == QC_OR) {
+                filter += '(' + condition_to_string(c) + ')';
+            }
+            else {
+                filter += condition_to_string(c);
+            }
+        }
+
+        filter += plan.use_index ? " (per row)" : " (bitmap)";
+
+        steps.push_back(filter);
+    }
+
+    if (plan.use_index) {
+        const std::vector<int> &types = table.get_types();
+
+        size_t id_column = std::find_if(types.begin(), types.end(),
+                                        [](int type) { return TDB_IS(type, TT_ID); }) -
+                           types.begin();
+
+        std::string index = "Index " + table.get_column_name(id_column);
+
+        if (plan.min_id > plan.max_id) {
+            index += " (empty range)";
+        }
+        else {
+            index += " from " + std::to_string(plan.min_id) + " to " +
+                     std::to_string(plan.max_id) + " (" +
+                     std::to_string(plan.index_rows) + " rows)";
+        }
+
+        steps.push_back(index);
+    }
+    else {
+        steps.push_back("Scan " + std::to_string(table.get_row_count()) + " rows");
+    }
+
+    std::string result;
+
+    for (size_t i = 0; i < steps.size(); ++i) {
+        result += std::string(i * 2, ' ') + steps[i] + '\n';
+    }
+
+    return result;
+}
+
+} // namespace toiletdb
@@ -0,0 +1,72 @@
+#ifndef TOILET_QUERY_H_
+#define TOILET_QUERY_H_
+
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include "table.hpp"
+
+namespace toiletdb {
+
+/**
+ * @brief Rows and columns picked by a query.
+ * @see Query.run()
+ */
+struct QueryResult
+{
+    /// @brief Positions of rows, in the order they should be shown.
+    std::vector<size_t> rows;
+    /// @brief Positions of columns, in the order they should be shown.
+    std::vector<size_t> columns;
+};
+
+/**
+ * @class Query
+ * @brief Query of form:
+ *
+ *        SELECT * | <column>[, <column>...]
+ *        [WHERE <predicate>]
+ *        [ORDER BY <column> [ASC | DESC][, ...]]
+ *        [LIMIT <count>]
+ *
+ *        Predicate is '<column> <op> <value>', where op is one of
+ *        =, !=, <, <=, > and >=, or '<column> BETWEEN <value> AND <value>'.
+ *        Predicates can be joined with AND, OR and parentheses. Strings are
+ *        quoted with ' or ", keywords are case-insensitive.
+ *
+ *        Query is parsed once, and can then be run against any table that
+ *        has columns it refers to.
+ */
+class Query
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @throws ParsingError when query is malformed.
+    Query(const std::string &text);
+    Query(Query &&other);
+    Query &operator=(Query &&other);
+    ~Query();
+    /// @brief Plans the query for this table and runs it. Predicates on ID
+    ///        column are answered with the index when it narrows rows down
+    ///        enough, otherwise typed columns are scanned.
+    ///        In concurrent mode, query runs on a snapshot of the table, so
+    ///        positions are of rows as they were when it started.
+    /// @throws std::logic_error when columns don't exist, or values can't be
+    ///         compared with them.
+    /// @see InMemoryTable.snapshot()
+    QueryResult run(const InMemoryTable &table) const;
+    /// @brief Plan run() would use for this table, one operator per line.
+    /// @throws Same as run().
+    std::string explain(const InMemoryTable &table) const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_QUERY_H_
@@ -0,0 +1,140 @@
+#include "selection.hpp"
+
+namespace toiletdb {
+
+Selection::Selection(size_t rows, bool value) :
+    words((rows + 63) / 64, value ? ~0ULL : 0), rows(rows)
+{
+    this->clear_tail();
+}
+
+void Selection::clear_tail()
+{
+    // Bits past the last row are kept cleared, so that count() and
+    // positions() don't need to care about them.
+    if (this->rows % 64) {
+        this->words.back() &= (1ULL << (this->rows % 64)) - 1;
+    }
+}
+
+void Selection::check_rows(const Selection &other) const
+{
+    if (this->rows != other.rows) {
+        throw std::logic_error(
+            "In ToiletDB, In Selection, Combining selections of different "
+            "row count");
+    }
+}
+
+size_t Selection::get_row_count() const
+{
+    return this->rows;
+}
+
+bool Selection::contains(size_t pos) const
+{
+    if (pos >= this->rows) {
+        return false;
+    }
+
+    return (this->words[pos / 64] >> (pos % 64)) & 1;
+}
+
+void Selection::set(size_t pos, bool value)
+{
+    if (pos >= this->rows) {
+        throw std::logic_error(
+            "In ToiletDB, In Selection.set(), pos is larger than row count");
+    }
+
+    if (value) {
+        this->words[pos / 64] |= 1ULL << (pos % 64);
+    }
+    else {
+        this->words[pos / 64] &= ~(1ULL << (pos % 64));
+    }
+}
+
+size_t Selection::count() const
+{
+    size_t count = 0;
+
+    for (uint64_t word : this->words) {
+        count += count_bits(word);
+    }
+
+    return count;
+}
+
+std::vector<size_t> Selection::positions() const
+{
+    std::vector<size_t> result;
+    result.reserve(this->count());
+
+    for (size_t w = 0; w < this->words.size(); ++w) {
+        for (uint64_t word = this->words[w]; word; word &= word - 1) {
+            result.push_back(w * 64 + lowest_bit(word));
+        }
+    }
+
+    return result;
+}
+
+uint64_t *Selection::data()
+{
+    return this->words.data();
+}
+
+const uint64_t *Selection::data() const
+{
+    return this->words.data();
+}
+
+Selection &Selection::operator&=(const Selection &other)
+{
+    this->check_rows(other);
+
+    for (size_t w = 0; w < this->words.size(); ++w) {
+        this->words[w] &= other.words[w];
+    }
+
+    return *this;
+}
+
+Selection &Selection::operator|=(const Selection &other)
+{
+    this->check_rows(other);
+
+    for (size_t w = 0; w < this->words.size(); ++w) {
+        this->words[w] |= other.words[w];
+    }
+
+    return *this;
+}
+
+Selection Selection::operator&(const Selection &other) const
+{
+    Selection result = *this;
+    return result &= other;
+}
+
+Selection Selection::operator|(const Selection &other) const
+{
+    Selection result = *this;
+    return result |= other;
+}
+
+Selection Selection::operator~() const
+{
+    Selection result = *this;
+
+    for (uint64_t &word : result.words) {
+        word = ~word;
+    }
+
+    result.clear_tail();
+
+    return result;
+}
+
+} // namespace toiletdb
@@ -0,0 +1,53 @@
+#ifndef TOILET_SELECTION_H_
+#define TOILET_SELECTION_H_
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "kernels.hpp"
+
+namespace toiletdb {
+
+/**
+ * @class Selection
+ * @brief Set of rows of one table, stored as a bitmap with one bit per row.
+ *        Selections of the same table can be combined with &, | and ~.
+ * @see InMemoryTable.filter()
+ */
+class Selection
+{
+private:
+    std::vector<uint64_t> words;
+    size_t rows;
+
+    void clear_tail();
+    void check_rows(const Selection &other) const;
+
+public:
+    /// @brief Selection of 'rows' rows. All of them are selected if 'value'
+    ///        is true.
+    Selection(size_t rows = 0, bool value = false);
+    /// @brief Amount of rows selection covers, selected or not.
+    size_t get_row_count() const;
+    bool contains(size_t pos) const;
+    void set(size_t pos, bool value = true);
+    /// @brief Amount of rows selected.
+    size_t count() const;
+    /// @brief Positions of selected rows, in ascending order.
+    std::vector<size_t> positions() const;
+    /// @brief Raw bitmap, bit (pos % 64) of word (pos / 64) is row pos.
+    uint64_t *data();
+    const uint64_t *data() const;
+    /// @throws std::logic_error when row counts don't match.
+    Selection &operator&=(const Selection &other);
+    /// @throws std::logic_error when row counts don't match.
+    Selection &operator|=(const Selection &other);
+    Selection operator&(const Selection &other) const;
+    Selection operator|(const Selection &other) const;
+    Selection operator~() const;
+};
+
+} // namespace toiletdb
+
+#endif // TOILET_SELECTION_H_
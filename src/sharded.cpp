@@ -0,0 +1,345 @@
+#include "sharded.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace toiletdb {
+
+struct ShardedTable::Private
+{
+    std::string filename;
+    std::vector<std::unique_ptr<InMemoryTable>> shards;
+    // Position of ID column, same in every shard.
+    size_t id_column;
+    // IDs are handed out here rather than by shards, so they are unique
+    // between shards.
+    std::atomic<size_t> next_id;
+
+    Private(const std::string &filename) :
+        filename(filename), id_column(0), next_id(0)
+    {}
+
+    std::string shard_path(size_t shard) const
+    {
+        return this->filename + "." + std::to_string(shard);
+    }
+
+    size_t shard_of(size_t id) const
+    {
+        return hash_group_key(static_cast<uint64_t>(id)) % this->shards.size();
+    }
+
+    template <typename F>
+    void for_each_shard(F &&f) const
+    {
+        for_each_task(this->shards.size(), get_default_thread_count(), f);
+    }
+
+    // Splits rows of the table file between new shard files.
+    void split(size_t count)
+    {
+        InMemoryTable source(this->filename);
+
+        size_t len = source.get_row_count();
+        size_t id  = this->find_id_column(source);
+
+        std::vector<Selection> rows(count, Selection(len));
+
+        for (size_t pos = 0; pos < len; ++pos) {
+            size_t shard = hash_group_key(source.get_row_view(pos).get<size_t>(id)) % count;
+            rows[shard].set(pos);
+        }
+
+        // Shards are not opened yet, so they are counted here.
+        this->shards.resize(count);
+
+        this->for_each_shard([&](size_t shard) {
+            source.write_file(this->shard_path(shard), rows[shard]);
+        });
+    }
+
+    static size_t find_id_column(const InMemoryTable &table)
+    {
+        const std::vector<int> &types = table.get_types();
+
+        return std::find_if(types.begin(), types.end(),
+                            [](int type) { return TDB_IS(type, TT_ID); }) -
+               types.begin();
+    }
+
+    // Checks that shards agree on columns, and finds the next ID.
+    void opened()
+    {
+        const InMemoryTable &first = *this->shards[0];
+
+        for (size_t shard = 1; shard < this->shards.size(); ++shard) {
+            const InMemoryTable &other = *this->shards[shard];
+
+            if (other.get_types() != first.get_types() ||
+                other.get_column_names() != first.get_column_names()) {
+                throw std::logic_error("In ToiletDB, In ShardedTable(), Shard '" +
+                                       this->shard_path(shard) +
+                                       "' has different columns than '" +
+                                       this->shard_path(0) + "'");
+            }
+        }
+
+        this->id_column = find_id_column(first);
+
+        const std::string &id_name = first.get_column_name(this->id_column);
+        std::vector<size_t> next(this->shards.size());
+
+        this->for_each_shard([&](size_t shard) {
+            Aggregate<size_t> ids = this->shards[shard]->aggregate<size_t>(id_name);
+            next[shard]           = ids.count ? ids.max + 1 : 0;
+        });
+
+        this->next_id.store(*std::max_element(next.begin(), next.end()));
+    }
+
+    // Runs 'positions' against a snapshot of every shard, and returns IDs of
+    // rows at positions it returned, in ascending order.
+    template <typename F>
+    std::vector<size_t> collect_ids(F &&positions) const
+    {
+        std::vector<std::vector<size_t>> ids(this->shards.size());
+
+        this->for_each_shard([&](size_t shard) {
+            std::shared_ptr<const InMemoryTable> snapshot = this->shards[shard]->snapshot();
+
+            std::vector<size_t> rows = positions(*snapshot);
+            std::vector<size_t> &result = ids[shard];
+
+            result.reserve(rows.size());
+
+            for (size_t pos : rows) {
+                result.push_back(snapshot->get_row_view(pos).get<size_t>(this->id_column));
+            }
+
+            std::sort(result.begin(), result.end());
+        });
+
+        std::vector<size_t> result;
+        size_t total = 0;
+
+        for (const std::vector<size_t> &i : ids) {
+            total += i.size();
+        }
+
+        result.reserve(total);
+
+        for (const std::vector<size_t> &i : ids) {
+            size_t middle = result.size();
+
+            result.insert(result.end(), i.begin(), i.end());
+            std::inplace_merge(result.begin(), result.begin() + middle, result.end());
+        }
+
+        return result;
+    }
+
+    template <typename T>
+    Aggregate<T> aggregate(const std::string &name) const
+    {
+        std::vector<Aggregate<T>> partial(this->shards.size());
+
+        this->for_each_shard([&](size_t shard) {
+            partial[shard] = this->shards[shard]->template aggregate<T>(name);
+        });
+
+        Aggregate<T> result = {0, 0, false, 0, 0, 0};
+
+        for (const Aggregate<T> &p : partial) {
+            result = merge_aggregates(result, p);
+        }
+
+        return result;
+    }
+};
+
+ShardedTable::ShardedTable(const std::string &filename, size_t shards) :
+    internal(std::make_unique<Private>(filename))
+{
+    if (shards == 0) {
+        throw std::logic_error("In ToiletDB, In ShardedTable(), Amount of shards "
+                               "should be at least 1");
+    }
+
+    size_t found = 0;
+
+    while (InMemoryFileParser(this->internal->shard_path(found)).exists()) {
+        ++found;
+    }
+
+    if (found == 0) {
+        this->internal->split(shards);
+    }
+    else if (found != shards) {
+        throw std::logic_error("In ToiletDB, In ShardedTable(), Table '" + filename +
+                               "' has " + std::to_string(found) + " shards, not " +
+                               std::to_string(shards));
+    }
+
+    this->internal->shards.resize(shards);
+
+    this->internal->for_each_shard([this](size_t shard) {
+        auto table = std::make_unique<InMemoryTable>(this->internal->shard_path(shard));
+        table->set_concurrent(true);
+
+        this->internal->shards[shard] = std::move(table);
+    });
+
+    this->internal->opened();
+}
+
+ShardedTable::~ShardedTable()
+{}
+
+size_t ShardedTable::get_shard_count() const
+{
+    return this->internal->shards.size();
+}
+
+size_t ShardedTable::shard_of(size_t id) const
+{
+    return this->internal->shard_of(id);
+}
+
+InMemoryTable &ShardedTable::get_shard(size_t shard)
+{
+    if (shard >= this->internal->shards.size()) {
+        throw std::logic_error("In ToiletDB, In ShardedTable.get_shard(), shard "
+                               "is larger than amount of shards");
+    }
+
+    return *this->internal->shards[shard];
+}
+
+const InMemoryTable &ShardedTable::get_shard(size_t shard) const
+{
+    return const_cast<ShardedTable *>(this)->get_shard(shard);
+}
+
+void ShardedTable::reread_file()
+{
+    this->internal->for_each_shard([this](size_t shard) {
+        this->internal->shards[shard]->reread_file();
+    });
+
+    this->internal->opened();
+}
+
+void ShardedTable::write_file() const
+{
+    this->internal->for_each_shard([this](size_t shard) {
+        this->internal->shards[shard]->write_file();
+    });
+}
+
+int ShardedTable::add_row(std::vector<std::string> &args)
+{
+    size_t id = this->internal->next_id.fetch_add(1);
+
+    return this->internal->shards[this->shard_of(id)]->add_row(args, id);
+}
+
+bool ShardedTable::erase_id(size_t id)
+{
+    return this->internal->shards[this->shard_of(id)]->erase_id(id);
+}
+
+std::vector<std::string> ShardedTable::get_row(size_t id) const
+{
+    return this->internal->shards[this->shard_of(id)]->get_row_by_id(id);
+}
+
+size_t ShardedTable::get_row_count() const
+{
+    size_t count = 0;
+
+    for (const std::unique_ptr<InMemoryTable> &shard : this->internal->shards) {
+        count += shard->get_row_count();
+    }
+
+    return count;
+}
+
+size_t ShardedTable::get_next_id() const
+{
+    return this->internal->next_id.load();
+}
+
+size_t ShardedTable::get_column_count() const
+{
+    return this->internal->shards[0]->get_column_count();
+}
+
+const std::vector<std::string> &ShardedTable::get_column_names() const
+{
+    return this->internal->shards[0]->get_column_names();
+}
+
+const std::vector<int> &ShardedTable::get_types() const
+{
+    return this->internal->shards[0]->get_types();
+}
+
+std::vector<size_t> ShardedTable::search(const std::string &name, std::string_view query,
+                                         int flags) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.search(name, query, flags);
+    });
+}
+
+std::vector<size_t> ShardedTable::search(const std::string &name, const Pattern &pattern) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.search(name, pattern);
+    });
+}
+
+std::vector<size_t> ShardedTable::search_range(size_t min, size_t max) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.search_range(min, max);
+    });
+}
+
+std::vector<size_t> ShardedTable::filter(const std::string &name, ToiletCompare op, int a,
+                                         int b) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.filter(name, op, a, b).positions();
+    });
+}
+
+std::vector<size_t> ShardedTable::filter(const std::string &name, ToiletCompare op,
+                                         size_t a, size_t b) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.filter(name, op, a, b).positions();
+    });
+}
+
+std::vector<size_t> ShardedTable::filter(const std::string &name, ToiletCompare op,
+                                         std::string_view a, std::string_view b) const
+{
+    return this->internal->collect_ids([&](const InMemoryTable &shard) {
+        return shard.filter(name, op, a, b).positions();
+    });
+}
+
+template <>
+Aggregate<int> ShardedTable::aggregate<int>(const std::string &name) const
+{
+    return this->internal->aggregate<int>(name);
+}
+
+template <>
+Aggregate<size_t> ShardedTable::aggregate<size_t>(const std::string &name) const
+{
+    return this->internal->aggregate<size_t>(name);
+}
+
+} // namespace toiletdb
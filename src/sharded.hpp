@@ -0,0 +1,99 @@
+#ifndef TOILET_SHARDED_H_
+#define TOILET_SHARDED_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "errors.hpp"
+#include "table.hpp"
+
+namespace toiletdb {
+
+/**
+ * @class ShardedTable
+ * @brief Table split between several shards by hash of ID. Each shard is an
+ *        InMemoryTable in concurrent mode, with a file, lock and index of
+ *        its own, so rows that land in different shards can be added, changed
+ *        and erased from several threads without waiting for each other.
+ *        Shards are loaded, written and scanned in parallel, and results of
+ *        scans are merged.
+ *        Shard i of table 'name' is kept in file 'name.i'.
+ */
+class ShardedTable
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Opens shard files of 'filename'. When there are none yet,
+    ///        splits rows of 'filename' between 'shards' new shard files
+    ///        first. File itself is left as it is.
+    /// @throws std::logic_error when 'shards' is 0, shard files exist for a
+    ///         different amount of shards, or shards have different columns.
+    /// @throws Same as InMemoryTable constructor.
+    ShardedTable(const std::string &filename, size_t shards);
+    ~ShardedTable();
+    size_t get_shard_count() const;
+    /// @brief Shard that row with 'id' is kept in.
+    size_t shard_of(size_t id) const;
+    /// @brief Shard itself, for anything not covered here.
+    /// @warning Rows should be added through ShardedTable, so they get an
+    ///          ID that is unique between shards and hashes to their shard.
+    InMemoryTable &get_shard(size_t shard);
+    const InMemoryTable &get_shard(size_t shard) const;
+    /// @brief Rereads files of all shards, in parallel.
+    /// @see InMemoryTable.reread_file()
+    void reread_file();
+    /// @brief Writes all shards to their files, in parallel.
+    /// @see InMemoryTable.write_file()
+    void write_file() const;
+    /// @brief Adds one row to the shard its new ID hashes to. Only that shard
+    ///        is locked.
+    /// @returns Same error codes as InMemoryTable.add_row().
+    int add_row(std::vector<std::string> &args);
+    bool erase_id(size_t id);
+    /// @brief Copy of a row with 'id' as strings, empty if there is none.
+    std::vector<std::string> get_row(size_t id) const;
+    size_t get_row_count() const;
+    /// @return ID next row will get. IDs are never reused before reread_file().
+    size_t get_next_id() const;
+    size_t get_column_count() const;
+    const std::vector<std::string> &get_column_names() const;
+    /// @see ToiletType
+    const std::vector<int> &get_types() const;
+    /// @brief IDs of rows matching 'query', in ascending order. Each shard is
+    ///        searched on a snapshot, see InMemoryTable.snapshot().
+    /// @see InMemoryTable.search()
+    std::vector<size_t> search(const std::string &name, std::string_view query,
+                               int flags = TS_PREFIX) const;
+    /// @brief Same as above, for rows matching 'pattern'.
+    std::vector<size_t> search(const std::string &name, const Pattern &pattern) const;
+    /// @brief IDs from 'min' to 'max' inclusive that exist, in ascending
+    ///        order.
+    std::vector<size_t> search_range(size_t min, size_t max) const;
+    /// @brief IDs of rows selected by InMemoryTable.filter() in every shard,
+    ///        in ascending order.
+    /// @throws Same as InMemoryTable.filter().
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op, int a,
+                               int b = 0) const;
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op, size_t a,
+                               size_t b = 0) const;
+    std::vector<size_t> filter(const std::string &name, ToiletCompare op,
+                               std::string_view a, std::string_view b = {}) const;
+    /// @brief Aggregates of every shard, merged.
+    /// @throws Same as InMemoryTable.aggregate().
+    template <typename T>
+    Aggregate<T> aggregate(const std::string &name) const;
+};
+
+template <>
+Aggregate<int> ShardedTable::aggregate<int>(const std::string &name) const;
+template <>
+Aggregate<size_t> ShardedTable::aggregate<size_t>(const std::string &name) const;
+
+} // namespace toiletdb
+
+#endif // TOILET_SHARDED_H_
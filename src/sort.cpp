@@ -0,0 +1,101 @@
+#include "sort.hpp"
+
+#include <algorithm>
+#include <memory>
+
+namespace toiletdb {
+
+// Sorts by key - base, which is known to fit into K. Positions are known to
+// fit into P. Narrow entries halve the memory every pass has to move.
+template <typename K, typename P>
+static void radix_sort_entries(std::vector<size_t> &positions, const uint64_t *keys,
+                               uint64_t base)
+{
+    struct Entry
+    {
+        K key;
+        P pos;
+    };
+
+    const size_t passes = sizeof(K);
+
+    size_t len = positions.size();
+
+    // Buffers are left uninitialized, every entry is written before it is
+    // read.
+    std::unique_ptr<Entry[]> current(new Entry[len]);
+    std::unique_ptr<Entry[]> next(new Entry[len]);
+
+    size_t counts[passes][256] = {};
+
+    for (size_t i = 0; i < len; ++i) {
+        K key      = static_cast<K>(keys[positions[i]] - base);
+        current[i] = {key, static_cast<P>(positions[i])};
+
+        for (size_t pass = 0; pass < passes; ++pass) {
+            ++counts[pass][(key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+    for (size_t pass = 0; pass < passes; ++pass) {
+        size_t shift = pass * 8;
+
+        // Every key has the same byte here.
+        if (counts[pass][(current[0].key >> shift) & 0xFF] == len) {
+            continue;
+        }
+
+        size_t offsets[256];
+        size_t sum = 0;
+
+        for (size_t b = 0; b < 256; ++b) {
+            offsets[b] = sum;
+            sum += counts[pass][b];
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            next[offsets[(current[i].key >> shift) & 0xFF]++] = current[i];
+        }
+
+        current.swap(next);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        positions[i] = current[i].pos;
+    }
+}
+
+void radix_sort(std::vector<size_t> &positions, const uint64_t *keys)
+{
+    if (positions.empty()) {
+        return;
+    }
+
+    uint64_t min   = UINT64_MAX;
+    uint64_t max   = 0;
+    size_t max_pos = 0;
+
+    for (size_t pos : positions) {
+        min     = std::min(min, keys[pos]);
+        max     = std::max(max, keys[pos]);
+        max_pos = std::max(max_pos, pos);
+    }
+
+    bool narrow_keys      = max - min <= UINT32_MAX;
+    bool narrow_positions = max_pos <= UINT32_MAX;
+
+    if (narrow_keys && narrow_positions) {
+        radix_sort_entries<uint32_t, uint32_t>(positions, keys, min);
+    }
+    else if (narrow_keys) {
+        radix_sort_entries<uint32_t, size_t>(positions, keys, min);
+    }
+    else if (narrow_positions) {
+        radix_sort_entries<uint64_t, uint32_t>(positions, keys, min);
+    }
+    else {
+        radix_sort_entries<uint64_t, size_t>(positions, keys, min);
+    }
+}
+
+} // namespace toiletdb
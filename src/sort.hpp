@@ -0,0 +1,48 @@
+#ifndef TOILET_SORT_H_
+#define TOILET_SORT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace toiletdb {
+
+/**
+ * @brief Maps 'int' value to unsigned key with the same order.
+ */
+inline uint64_t int_sort_key(int value)
+{
+    return static_cast<uint32_t>(value) ^ 0x80000000U;
+}
+
+/**
+ * @brief First 7 bytes of a string as a big-endian number, followed by a
+ *        byte with length of the string, up to 8. Strings with different
+ *        keys compare the same way as their keys do. Equal keys mean equal
+ *        strings, unless both strings are longer than 7 bytes.
+ */
+inline uint64_t str_sort_key(std::string_view str)
+{
+    size_t len   = std::min<size_t>(str.size(), 7);
+    uint64_t key = std::min<size_t>(str.size(), 8);
+
+    for (size_t i = 0; i < len; ++i) {
+        key |= static_cast<uint64_t>(static_cast<unsigned char>(str[i])) << (56 - i * 8);
+    }
+
+    return key;
+}
+
+/**
+ * @brief Stable LSD radix sort of positions by keys[position], 8 bits per
+ *        pass. Keys are sorted relative to the smallest one, in 32 bits when
+ *        they fit, and passes where every key has the same byte are
+ *        skipped, so narrow ranges of keys take fewer passes.
+ */
+void radix_sort(std::vector<size_t> &positions, const uint64_t *keys);
+
+} // namespace toiletdb
+
+#endif // TOILET_SORT_H_
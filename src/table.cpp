@@ -2,436 +2,3479 @@
 
 namespace toiletdb {
 
+// Tables whose lock this thread holds, so that methods calling each other
+// don't lock the same table twice.
+static thread_local std::vector<const void *> held_locks;
+
+// Old value of a field, kept in undo log. Numbers of both 'int' and 'uint'
+// columns go to 'number'.
+struct UndoValue
+{
+    size_t number;
+    std::string text;
+};
+
+// Change made during a transaction, with what is needed to undo it.
+struct Undo
+{
+    enum Kind
+    {
+        UNDO_INSERT,
+        UNDO_ERASE,
+        UNDO_EDIT,
+        UNDO_CLEAR,
+    };
+
+    Kind kind;
+    size_t pos;
+    // Edited column for UNDO_EDIT.
+    size_t column;
+    // Old value for UNDO_EDIT, whole row for UNDO_ERASE.
+    std::vector<UndoValue> values;
+    // Rows before UNDO_CLEAR.
+    std::vector<std::shared_ptr<ColumnBase>> columns;
+    std::optional<SharedValues<size_t>> index;
+};
+
+// State of a table at begin(), given back by rollback() when nothing was
+// written in the meantime.
+struct Begun
+{
+    uint64_t clock;
+    uint64_t file_clock;
+    std::vector<uint64_t> epochs;
+    bool dirty;
+    size_t pending;
+    std::chrono::steady_clock::time_point dirty_since;
+};
+
+static UndoValue undo_value(const ColumnBase &column, size_t pos)
+{
+    UndoValue value;
+
+    visit_column(column, [&value, pos](const auto &c) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(c)>, ColumnStr>) {
+            value.text = c.value(pos);
+        }
+        else {
+            value.number = static_cast<size_t>(c.value(pos));
+        }
+    });
+
+    return value;
+}
+
+// Puts value back at 'pos', inserting it there if 'insert' is set.
+static void undo_restore(ColumnBase &column, size_t pos, UndoValue &value, bool insert)
+{
+    visit_column(column, [&value, pos, insert](auto &c) {
+        using T = typename std::remove_reference_t<decltype(c.get_data())>::value_type;
+
+        T restored;
+
+        if constexpr (std::is_same_v<T, std::string>) {
+            restored = std::move(value.text);
+        }
+        else {
+            restored = static_cast<T>(value.number);
+        }
+
+        if (insert) {
+            c.get_data().insert(c.get_data().begin() + pos, std::move(restored));
+        }
+        else {
+            c.set(pos, std::move(restored));
+        }
+    });
+}
+
 struct InMemoryTable::Private
 {
-    std::vector<size_t> index;
+    // Should outlive everything allocated from it, so it goes first.
+    // Shared with snapshots, which keep columns allocated from it.
+    std::shared_ptr<TableResource> memory;
+    // Values of columns and index are shared with snapshots. Rows can be
+    // added without copying them, other changes copy them first.
+    SharedValues<size_t> index;
     std::vector<std::shared_ptr<ColumnBase>> columns;
     std::unique_ptr<InMemoryFileParser> parser;
+    bool compacted;
+    // 0 means process-wide default.
+    size_t threads;
+    SearchCache cache;
+    // Bumped on every change, so no two states of a column share an epoch.
+    uint64_t clock;
+    // Epoch of each column's last change.
+    std::vector<uint64_t> epochs;
+    // Case-folded copies of 'str' columns, made on first case-insensitive
+    // search over them and kept in sync with edits afterwards. Empty
+    // pointers are columns that were not searched that way.
+    std::vector<std::unique_ptr<std::vector<std::string>>> folded;
+    // Guards making copies from const methods.
+    std::mutex folded_mutex;
+    // Set once unsafe_get_mut_row() handed out pointers, through which
+    // values can change without the table knowing. Search results and
+    // folded copies are not kept from then on.
+    bool unsafe_rows;
+    // Taken by every public method in concurrent mode, shared by those
+    // that only read.
+    std::shared_mutex mutex;
+    // Held by writers while they wait for 'mutex', so readers coming after
+    // them wait too, and a steady stream of readers can't starve writers.
+    std::mutex turnstile;
+    bool concurrent;
+    // Taken by every method that changes rows, even outside of concurrent
+    // mode, so snapshots are never made of half-changed columns.
+    std::mutex writer;
+    // Snapshot of current rows, handed out until rows change.
+    std::shared_ptr<const InMemoryTable> published;
+    bool transaction;
+    // Changes made since begin(), oldest first.
+    std::vector<Undo> undo;
+    Begun begun;
+    // Writes rows to the file in background, see set_auto_flush().
+    std::thread flusher;
+    // Guards everything below, except for 'file_clock'.
+    std::mutex flush_mutex;
+    // Wakes flusher when there is something to write, or it should stop.
+    std::condition_variable flush_wake;
+    // Wakes flush() callers when a write is done.
+    std::condition_variable flush_done;
+    // Milliseconds since first change, and amount of changes, after which
+    // flusher writes. 0 means never.
+    size_t flush_delay;
+    size_t flush_changes;
+    bool flush_stopping;
+    bool flush_requested;
+    // Set while a transaction is open, so its rows are not written until
+    // commit() or rollback().
+    bool flush_held;
+    // Whether rows changed since they were last written, and how many times.
+    bool dirty;
+    size_t pending;
+    std::chrono::steady_clock::time_point dirty_since;
+    // Numbers of writes that were started, finished and failed last.
+    uint64_t flush_started;
+    uint64_t flush_finished;
+    uint64_t flush_failed;
+    FlushStats flush_stats;
+    // Held while the file is read or written.
+    std::mutex file_mutex;
+    // Clock of rows that are in the file.
+    uint64_t file_clock;
+
+    Private(std::string filename, std::pmr::memory_resource *upstream) :
+        memory(std::make_shared<TableResource>(upstream)),
+        index(this->memory.get())
+    {
+        this->parser      = std::make_unique<InMemoryFileParser>(filename);
+        this->compacted   = false;
+        this->threads     = 0;
+        this->clock       = 0;
+        this->unsafe_rows = false;
+        this->concurrent  = false;
+        this->transaction = false;
+        this->reset_flush();
+    }
+
+    // Snapshot of 'origin', sharing its columns and index. Has cache and
+    // folded copies of its own. Columns are copied once raw pointers to
+    // values are out, since writes through them would show up in snapshot.
+    explicit Private(const Private &origin) :
+        memory(origin.memory), index(origin.index.share())
+    {
+        for (const std::shared_ptr<ColumnBase> &c : origin.columns) {
+            this->columns.push_back(origin.unsafe_rows ? c->clone() : c->share());
+        }
+
+        this->parser      = std::make_unique<InMemoryFileParser>(*origin.parser);
+        this->compacted   = origin.compacted;
+        this->threads     = origin.threads;
+        this->clock       = 0;
+        this->unsafe_rows = origin.unsafe_rows;
+        this->concurrent  = false;
+        this->transaction = false;
+        this->reset_flush();
+        this->touch_all();
+    }
+
+    ~Private()
+    {
+        this->stop_flusher();
+    }
+
+    void reset_flush()
+    {
+        this->flush_delay     = 0;
+        this->flush_changes   = 0;
+        this->flush_stopping  = false;
+        this->flush_requested = false;
+        this->flush_held      = false;
+        this->dirty           = false;
+        this->pending         = 0;
+        this->flush_started   = 0;
+        this->flush_finished  = 0;
+        this->flush_failed    = 0;
+        this->file_clock      = 0;
+        this->flush_stats     = FlushStats();
+    }
+
+    // Counts a change for flushing. Called by touch() and touch_all().
+    void changed()
+    {
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        if (!this->dirty) {
+            this->dirty       = true;
+            this->dirty_since = std::chrono::steady_clock::now();
+            this->flush_wake.notify_one();
+        }
+
+        if (++this->pending == this->flush_changes) {
+            this->flush_wake.notify_one();
+        }
+    }
+
+    // Marks rows as written, as of 'clock'. 'file_mutex' should be held.
+    void saved(uint64_t clock)
+    {
+        this->file_clock = clock;
+
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        this->dirty           = false;
+        this->pending         = 0;
+        this->flush_requested = false;
+        this->flush_started   = this->flush_finished = std::max(this->flush_started, this->flush_finished) + 1;
+
+        this->flush_done.notify_all();
+    }
+
+    // Holds back writing rows while a transaction is open. Writes that were
+    // due in the meantime are made once it's released.
+    void hold_flush(bool held)
+    {
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        this->flush_held = held;
+
+        if (!held) {
+            this->flush_wake.notify_all();
+        }
+    }
+
+    // Remembers state of rows at begin(). 'writer' should be held.
+    void save_begun()
+    {
+        std::lock_guard<std::mutex> file(this->file_mutex);
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        this->begun.clock       = this->clock;
+        this->begun.file_clock  = this->file_clock;
+        this->begun.epochs      = this->epochs;
+        this->begun.dirty       = this->dirty;
+        this->begun.pending     = this->pending;
+        this->begun.dirty_since = this->dirty_since;
+    }
+
+    // Gives back state of rows at begin() after every change since was
+    // undone, unless rows were written in the meantime. Clock keeps going,
+    // so search results cached for undone rows are never taken for newer
+    // ones. 'writer' should be held.
+    bool restore_begun()
+    {
+        std::lock_guard<std::mutex> file(this->file_mutex);
+
+        if (this->file_clock != this->begun.file_clock) {
+            return false;
+        }
+
+        this->epochs = this->begun.epochs;
+
+        // File has the rows there are again.
+        if (this->file_clock == this->begun.clock) {
+            this->file_clock = this->clock;
+        }
+
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        this->dirty       = this->begun.dirty;
+        this->pending     = this->begun.pending;
+        this->dirty_since = this->begun.dirty_since;
+
+        return true;
+    }
+
+    // Snapshot of current rows. 'writer' should be held.
+    std::shared_ptr<const InMemoryTable> make_snapshot()
+    {
+        std::shared_ptr<const InMemoryTable> snapshot = std::atomic_load(&this->published);
+
+        if (!snapshot) {
+            snapshot.reset(new InMemoryTable(std::make_unique<Private>(*this)));
+
+            // Rows can change through raw pointers without unpublishing it.
+            if (!this->unsafe_rows) {
+                std::atomic_store(&this->published, snapshot);
+            }
+        }
+
+        return snapshot;
+    }
+
+    // Writes rows to the file from a snapshot, so they can change in the
+    // meantime. Writes nothing while a transaction is open. Returns error
+    // message if write failed.
+    std::string write_snapshot()
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::shared_ptr<const InMemoryTable> snapshot;
+        uint64_t clock;
+        uint64_t write;
+        size_t pending;
+        Clock::time_point since;
+
+        {
+            std::lock_guard<std::mutex> writer(this->writer);
+
+            if (this->transaction) {
+                return {};
+            }
+
+            snapshot = this->make_snapshot();
+            clock    = this->clock;
+
+            std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+            since   = this->dirty ? this->dirty_since : Clock::now();
+            pending = this->pending;
+            write   = ++this->flush_started;
+
+            this->dirty           = false;
+            this->pending         = 0;
+            this->flush_requested = false;
+        }
+
+        std::string error;
+        Clock::time_point start = Clock::now();
+
+        {
+            std::lock_guard<std::mutex> file(this->file_mutex);
+
+            // Newer rows could have been written by write_file() already.
+            if (clock > this->file_clock) {
+                try {
+                    const Private &rows = *snapshot->internal;
+                    rows.parser->write_file(rows.columns);
+                    this->file_clock = clock;
+                }
+                catch (const std::exception &e) {
+                    error = e.what();
+                }
+            }
+        }
+
+        Clock::time_point end = Clock::now();
+
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+        this->flush_finished            = std::max(this->flush_finished, write);
+        this->flush_stats.last_write_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        if (error.empty()) {
+            ++this->flush_stats.flushes;
+            this->flush_stats.max_lag_ms = std::max(
+                this->flush_stats.max_lag_ms,
+                std::chrono::duration<double, std::milli>(end - since).count());
+        }
+        else {
+            ++this->flush_stats.failures;
+            this->flush_stats.last_error = error;
+            this->flush_failed           = write;
+
+            // Changes are still not in the file. Next try is made after the
+            // usual delay, so a missing file is not retried in a loop.
+            this->dirty       = true;
+            this->dirty_since = end;
+            this->pending += pending;
+        }
+
+        this->flush_done.notify_all();
+
+        return error;
+    }
+
+    // Whether flusher should write now. 'flush_mutex' should be held.
+    bool flush_due() const
+    {
+        using Clock = std::chrono::steady_clock;
+
+        if (!this->dirty || this->flush_held) {
+            return false;
+        }
+
+        return this->flush_requested ||
+               (this->flush_changes && this->pending >= this->flush_changes) ||
+               (this->flush_delay &&
+                Clock::now() >= this->dirty_since + std::chrono::milliseconds(this->flush_delay));
+    }
+
+    void flush_loop()
+    {
+        std::unique_lock<std::mutex> lock(this->flush_mutex);
+
+        while (!this->flush_stopping) {
+            if (this->flush_due()) {
+                lock.unlock();
+                this->write_snapshot();
+                lock.lock();
+            }
+            else if (this->dirty && this->flush_delay && !this->flush_held) {
+                this->flush_wake.wait_until(lock, this->dirty_since + std::chrono::milliseconds(this->flush_delay));
+            }
+            else {
+                this->flush_wake.wait(lock);
+            }
+        }
+    }
+
+    // Stops flusher, writing changes it did not get to.
+    void stop_flusher()
+    {
+        if (!this->flusher.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->flush_mutex);
+            this->flush_stopping = true;
+        }
+
+        this->flush_wake.notify_all();
+        this->flusher.join();
+
+        bool dirty;
+
+        {
+            std::lock_guard<std::mutex> lock(this->flush_mutex);
+
+            this->flush_stopping = false;
+            this->flush_delay    = 0;
+            this->flush_changes  = 0;
+
+            dirty = this->dirty;
+        }
+
+        if (dirty) {
+            this->write_snapshot();
+        }
+    }
+
+    // Takes lock, unless this thread holds it already. Outside of
+    // concurrent mode only writers lock, and only against snapshot().
+    // Returns whether it was taken.
+    bool lock(bool exclusive)
+    {
+        if ((!exclusive && !this->concurrent) ||
+            std::find(held_locks.begin(), held_locks.end(), this) != held_locks.end()) {
+            return false;
+        }
+
+        if (exclusive) {
+            if (this->concurrent) {
+                std::lock_guard<std::mutex> turn(this->turnstile);
+                this->mutex.lock();
+            }
+            this->writer.lock();
+        }
+        else {
+            { std::lock_guard<std::mutex> turn(this->turnstile); }
+            this->mutex.lock_shared();
+        }
+
+        held_locks.push_back(this);
+
+        return true;
+    }
+
+    void unlock(bool exclusive)
+    {
+        held_locks.erase(std::find(held_locks.begin(), held_locks.end(), this));
+
+        if (exclusive) {
+            this->writer.unlock();
+            if (this->concurrent) {
+                this->mutex.unlock();
+            }
+        }
+        else {
+            this->mutex.unlock_shared();
+        }
+    }
+
+    // Drops published snapshot, since rows are about to change.
+    void unpublish()
+    {
+        std::atomic_store(&this->published, std::shared_ptr<const InMemoryTable>());
+    }
+
+    // Makes column safe to change. Snapshots have columns of their own, and
+    // values they share with it are copied by the column once they change,
+    // so it's only copied here if something still holds it as a whole.
+    void own(size_t column)
+    {
+        this->unpublish();
+
+        if (column >= this->columns.size()) {
+            return;
+        }
+
+        if (this->columns[column].use_count() > 1) {
+            this->columns[column] = this->columns[column]->clone();
+        }
+        else {
+            // Pairs with release of the last owner that used column on
+            // some other thread.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+    }
+
+    // Index to be changed, copied first if a snapshot still uses it.
+    std::pmr::vector<size_t> &own_index()
+    {
+        this->unpublish();
+
+        return this->index.get();
+    }
+
+    // Makes every column and index safe to change.
+    void own_all()
+    {
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            this->own(i);
+        }
+
+        this->own_index();
+    }
+
+    // Holds lock for the duration of a call.
+    class Lock
+    {
+    private:
+        Private &table;
+        bool exclusive;
+        bool taken;
+
+    public:
+        Lock(Private &table, bool exclusive) :
+            table(table), exclusive(exclusive), taken(table.lock(exclusive))
+        {}
+
+        ~Lock()
+        {
+            if (this->taken) {
+                this->table.unlock(this->exclusive);
+            }
+        }
+
+        Lock(const Lock &) = delete;
+        Lock &operator=(const Lock &) = delete;
+    };
+
+    // Marks column as changed, invalidating cached searches over it.
+    void touch(size_t column)
+    {
+        if (column < this->epochs.size()) {
+            this->epochs[column] = ++this->clock;
+            this->changed();
+        }
+    }
+
+    // Marks every column as changed, after rows are added or removed.
+    void touch_all()
+    {
+        this->epochs.assign(this->columns.size(), ++this->clock);
+        this->changed();
+    }
+
+    // Case-folded copy of 'str' column, made if there is none yet.
+    const std::vector<std::string> &folded_column(size_t column)
+    {
+        std::lock_guard<std::mutex> lock(this->folded_mutex);
+
+        this->folded.resize(this->columns.size());
+
+        std::unique_ptr<std::vector<std::string>> &copy = this->folded[column];
+
+        if (copy) {
+            return *copy;
+        }
+
+        const ColumnStr &c = static_cast<const ColumnStr &>(*this->columns[column]);
+
+        size_t len     = c.size();
+        size_t threads = this->scan_threads(len);
+
+        copy = std::make_unique<std::vector<std::string>>(len);
+
+        std::vector<std::string> &values = *copy;
+
+        for_each_morsel(len, morsel_size(len, threads), threads, [&](size_t, size_t first, size_t end) {
+            for (size_t i = first; i < end; ++i) {
+                values[i] = fold_case(c.value(i));
+            }
+        });
+
+        return values;
+    }
+
+    // Case-folded copy for searching column, nullptr when values should be
+    // folded one by one instead.
+    const std::vector<std::string> *search_folded(size_t column)
+    {
+        if (this->unsafe_rows) {
+            return nullptr;
+        }
+
+        return &this->folded_column(column);
+    }
+
+    // Case-folded copy of column if one was made, nullptr otherwise.
+    const std::vector<std::string> *find_folded(size_t column)
+    {
+        std::lock_guard<std::mutex> lock(this->folded_mutex);
+
+        return column < this->folded.size() ? this->folded[column].get() : nullptr;
+    }
+
+    // Keeps folded copies in sync after a row was inserted at 'pos'.
+    void fold_inserted_row(size_t pos)
+    {
+        for (size_t i = 0; i < this->folded.size(); ++i) {
+            if (this->folded[i]) {
+                const ColumnStr &c = static_cast<const ColumnStr &>(*this->columns[i]);
+                this->folded[i]->insert(this->folded[i]->begin() + pos, fold_case(c.value(pos)));
+            }
+        }
+    }
 
-    Private(std::string filename)
+    // Keeps folded copies in sync after row at 'pos' was erased.
+    void fold_erased_row(size_t pos)
     {
-        this->parser = std::make_unique<InMemoryFileParser>(filename);
+        for (std::unique_ptr<std::vector<std::string>> &copy : this->folded) {
+            if (copy) {
+                copy->erase(copy->begin() + pos);
+            }
+        }
+    }
+
+    // Keeps folded copy in sync after value at 'pos' was edited.
+    void fold_value(size_t column, size_t pos)
+    {
+        if (column < this->folded.size() && this->folded[column]) {
+            const ColumnStr &c = static_cast<const ColumnStr &>(*this->columns[column]);
+            (*this->folded[column])[pos] = fold_case(c.value(pos));
+        }
+    }
+
+    // Threads a scan of 'len' rows is split between.
+    size_t scan_threads(size_t len) const
+    {
+        return scan_thread_count(len, this->threads ? this->threads
+                                                    : get_default_thread_count());
+    }
+
+    void read_file()
+    {
+        std::lock_guard<std::mutex> file(this->file_mutex);
+
+        this->unpublish();
+
+        this->columns = this->parser->read_file(this->memory.get());
+
+        if (this->compacted) {
+            this->pack_columns();
+        }
+
+        this->update_index();
+        this->touch_all();
+        this->folded.clear();
+        this->saved(this->clock);
+    }
+
+    void pack_columns()
+    {
+        for (size_t i = 0; i < this->columns.size(); ++i) {
+            if (TDB_TYPE(this->columns[i]->get_type()) == TT_UINT) {
+                this->own(i);
+                static_cast<ColumnUint *>(this->columns[i].get())->pack();
+            }
+        }
+    }
+
+    // Column marked as 'id'.
+    const ColumnUint &id_column() const
+    {
+        return *static_cast<const ColumnUint *>(this->columns[this->parser->id_column_index()].get());
     }
 
     // Reads column marked as 'id',
     // updates index with a sorted list that maps position to ID.
     void update_index()
     {
-        std::vector<size_t> id_column =
-            std::static_pointer_cast<ColumnUint>(this->columns[this->parser->id_column_index()])
-                ->get_data();
+        const ColumnUint &column = this->id_column();
+        size_t len               = column.size();
+
+        // Packed IDs are decoded once, instead of on every comparison.
+        std::vector<size_t> scratch;
+
+        if (column.is_packed()) {
+            scratch.resize(len);
+        }
 
-        std::vector<size_t> index;
-        index.resize(id_column.size());
+        const size_t *id_column = column.read(0, len, scratch.data());
+
+        std::pmr::vector<size_t> index(len, this->memory.get());
 
         std::iota(index.begin(), index.end(), 0);
 
         std::stable_sort(index.begin(), index.end(),
-                         [&id_column](size_t a, size_t b) {
+                         [id_column](size_t a, size_t b) {
                              return id_column[a] < id_column[b];
                          });
 
-        TDB_DEBUGV(id_column, "ids");
         TDB_DEBUGV(index, "index");
 
-        this->index = index;
+        this->index = SharedValues<size_t>(std::move(index));
     }
-};
 
-InMemoryTable::InMemoryTable(const std::string &filename)
-{
+    // Puts a freshly inserted row at pos into the index, so the whole index
+    // does not have to be sorted again.
+    void insert_index(size_t pos)
+    {
+        this->unpublish();
+
+        const ColumnUint &id_column = this->id_column();
+
+        // Rows after pos moved one place forward.
+        if (pos + 1 < id_column.size()) {
+            for (size_t &p : this->own_index()) {
+                p += p >= pos;
+            }
+        }
+
+        size_t id = id_column.value(pos);
+
+        size_t slot = std::upper_bound(this->index.begin(), this->index.end(), id,
+                                       [&id_column](size_t a, size_t b) {
+                                           return a < id_column.value(b);
+                                       }) -
+                      this->index.begin();
+
+        // Rows with growing IDs go last, which snapshots don't need copied.
+        if (slot == this->index.size()) {
+            this->index.push_back(pos);
+            return;
+        }
+
+        std::pmr::vector<size_t> &index = this->own_index();
+
+        index.insert(index.begin() + slot, pos);
+    }
+
+    // Place of row at pos in the index.
+    size_t index_slot(size_t pos) const
+    {
+        const ColumnUint &id_column = this->id_column();
+
+        size_t id = id_column.value(pos);
+
+        const size_t *it =
+            std::lower_bound(this->index.begin(), this->index.end(), id,
+                             [&id_column](size_t a, size_t b) {
+                                 return id_column.value(a) < b;
+                             });
+
+        // Skip rows with the same ID.
+        while (it != this->index.end() && *it != pos) {
+            ++it;
+        }
+
+        // IDs were changed through unsafe_get_mut_row().
+        if (it == this->index.end()) {
+            it = std::find(this->index.begin(), this->index.end(), pos);
+        }
+
+        return it - this->index.begin();
+    }
+
+    // Takes row at pos out of the index, before it is erased from columns.
+    void erase_index(size_t pos)
+    {
+        const ColumnUint &id_column = this->id_column();
+
+        std::pmr::vector<size_t> &index = this->own_index();
+
+        index.erase(index.begin() + this->index_slot(pos));
+
+        // Rows after pos will move one place back.
+        if (pos + 1 < id_column.size()) {
+            for (size_t &p : index) {
+                p -= p > pos;
+            }
+        }
+    }
+
+    // Takes several rows out of the index in one pass, before they are
+    // erased from columns. 'rows' should be sorted.
+    void erase_index(const std::vector<size_t> &rows)
+    {
+        if (rows.empty()) {
+            return;
+        }
+
+        std::pmr::vector<size_t> &index = this->own_index();
+        std::vector<size_t> slots;
+
+        slots.reserve(rows.size());
+
+        for (size_t pos : rows) {
+            slots.push_back(this->index_slot(pos));
+        }
+
+        std::sort(slots.begin(), slots.end());
+
+        // Entries between erased ones are moved back in runs.
+        std::pmr::vector<size_t>::iterator kept = index.begin() + slots.front();
+
+        for (size_t i = 0; i < slots.size(); ++i) {
+            size_t end = i + 1 < slots.size() ? slots[i + 1] : index.size();
+            kept = std::copy(index.begin() + slots[i] + 1, index.begin() + end, kept);
+        }
+
+        index.erase(kept, index.end());
+
+        // Rows after erased ones will move back by as many as were before
+        // them, unless erased rows are the last ones.
+        if (rows.front() + rows.size() < this->id_column().size()) {
+            for (size_t &p : index) {
+                if (p > rows.front()) {
+                    p -= std::lower_bound(rows.begin(), rows.end(), p) - rows.begin();
+                }
+            }
+        }
+    }
+
+    // Removes values of an unfinished row at 'pos', which is the last one,
+    // from columns and everything kept in sync with them.
+    void discard_row(size_t pos)
+    {
+        if (this->index.size() > pos) {
+            this->erase_index(pos);
+        }
+
+        for (std::unique_ptr<std::vector<std::string>> &copy : this->folded) {
+            if (copy && copy->size() > pos) {
+                copy->resize(pos);
+            }
+        }
+
+        for (std::shared_ptr<ColumnBase> &c : this->columns) {
+            while (c->size() > pos) {
+                c->erase(c->size() - 1);
+            }
+        }
+    }
+
+    // Records row at 'pos' that was just inserted.
+    void log_insert(size_t pos)
+    {
+        if (this->transaction) {
+            Undo &undo = this->undo.emplace_back();
+            undo.kind  = Undo::UNDO_INSERT;
+            undo.pos   = pos;
+        }
+    }
+
+    // Records row at 'pos' that is about to be erased.
+    void log_erase(size_t pos)
+    {
+        if (!this->transaction) {
+            return;
+        }
+
+        Undo &undo = this->undo.emplace_back();
+        undo.kind  = Undo::UNDO_ERASE;
+        undo.pos   = pos;
+
+        undo.values.reserve(this->columns.size());
+
+        for (const std::shared_ptr<ColumnBase> &c : this->columns) {
+            undo.values.push_back(undo_value(*c, pos));
+        }
+    }
+
+    // Records field that is about to be edited.
+    void log_edit(size_t column, size_t pos)
+    {
+        if (!this->transaction || column >= this->columns.size() ||
+            pos >= this->columns[column]->size()) {
+            return;
+        }
+
+        Undo &undo  = this->undo.emplace_back();
+        undo.kind   = Undo::UNDO_EDIT;
+        undo.pos    = pos;
+        undo.column = column;
+        undo.values.push_back(undo_value(*this->columns[column], pos));
+    }
+
+    // Undoes one change. Changes should be undone newest first. Index is
+    // left alone unless 'reindex' is set, so it can be rebuilt once after
+    // many changes.
+    void apply_undo(Undo &undo, bool reindex)
+    {
+        switch (undo.kind) {
+            case Undo::UNDO_INSERT: {
+                if (reindex) {
+                    this->erase_index(undo.pos);
+                }
+
+                this->fold_erased_row(undo.pos);
+
+                for (size_t i = 0; i < this->columns.size(); ++i) {
+                    this->own(i);
+                    this->columns[i]->erase(undo.pos);
+                }
+            } break;
+
+            case Undo::UNDO_ERASE: {
+                for (size_t i = 0; i < this->columns.size(); ++i) {
+                    this->own(i);
+                    undo_restore(*this->columns[i], undo.pos, undo.values[i], true);
+                }
+
+                if (reindex) {
+                    this->insert_index(undo.pos);
+                }
+
+                this->fold_inserted_row(undo.pos);
+            } break;
+
+            case Undo::UNDO_EDIT: {
+                this->own(undo.column);
+                undo_restore(*this->columns[undo.column], undo.pos, undo.values[0], false);
+                this->fold_value(undo.column, undo.pos);
+            } break;
+
+            case Undo::UNDO_CLEAR: {
+                this->unpublish();
+                this->columns = std::move(undo.columns);
+                this->index   = std::move(*undo.index);
+                this->folded.clear();
+            } break;
+        }
+    }
+
+    // Column for filter() and aggregate(), which should be 'int' or 'uint'.
+    const ColumnBase &numeric_column(const std::string &name,
+                                     const std::string &method) const
+    {
+        for (const std::shared_ptr<ColumnBase> &c : this->columns) {
+            if (c->get_name() != name) {
+                continue;
+            }
+
+            if (TDB_TYPE(c->get_type()) == TT_STR) {
+                throw std::logic_error("In ToiletDB, In InMemoryTable." + method +
+                                       "(), Field '" + name + "' is not numeric");
+            }
+
+            return *c;
+        }
+
+        throw std::logic_error("In ToiletDB, In InMemoryTable." + method +
+                               "(), Field '" + name + "' does not exist");
+    }
+
+    // Part of the index with IDs from min to max.
+    std::pair<const size_t *, const size_t *> index_range(size_t min, size_t max) const
+    {
+        const ColumnUint &id_column = this->id_column();
+
+        const size_t *first =
+            std::lower_bound(this->index.begin(), this->index.end(), min,
+                             [&id_column](size_t a, size_t b) {
+                                 return id_column.value(a) < b;
+                             });
+
+        if (max < min) {
+            return {first, first};
+        }
+
+        const size_t *end =
+            std::upper_bound(first, this->index.end(), max,
+                             [&id_column](size_t a, size_t b) {
+                                 return a < id_column.value(b);
+                             });
+
+        return {first, end};
+    }
+
+    // Calls compare(first, end, words) for morsels of 'len' rows, where
+    // 'words' is where bits of row 'first' go in 'result'.
+    template <typename F>
+    void compare_rows(size_t len, Selection &result, F &&compare) const
+    {
+        size_t threads  = this->scan_threads(len);
+        uint64_t *words = result.data();
+
+        for_each_morsel(len, morsel_size(len, threads), threads,
+                        [&compare, words](size_t, size_t first, size_t end) {
+                            compare(first, end, words + first / 64);
+                        });
+    }
+
+    // Bitmap of selection, null if every row is selected.
+    const uint64_t *selection_mask(const Selection *selection, size_t len,
+                                   const std::string &method) const
+    {
+        if (!selection) {
+            return nullptr;
+        }
+
+        if (selection->get_row_count() != len) {
+            throw std::logic_error("In ToiletDB, In InMemoryTable." + method +
+                                   "(), Selection is of different row count");
+        }
+
+        return selection->data();
+    }
+};
+
+InMemoryTable::InMemoryTable(const std::string &filename) :
+    InMemoryTable(filename, std::pmr::get_default_resource())
+{}
+
+InMemoryTable::InMemoryTable(const std::string &filename, std::pmr::memory_resource *resource)
+{
     TDB_DEBUGS(filename, "InMemoryTable filename");
 
-    this->internal = std::make_unique<Private>(filename);
+    this->internal = std::make_unique<Private>(filename, resource);
 
     if (!this->internal->parser->exists()) {
         std::string failstring = "In InMemoryTable constructor, ";
         failstring += strerror(errno);
 
-        throw std::runtime_error(failstring);
+        throw std::runtime_error(failstring);
+    }
+
+    // IDs from loaded file will be indexed here to be used for binary search.
+    this->internal->read_file();
+}
+
+InMemoryTable::InMemoryTable(std::unique_ptr<Private> internal) :
+    internal(std::move(internal))
+{}
+
+InMemoryTable::~InMemoryTable()
+{
+    // Rows of a transaction that was not committed are never written, but
+    // changes made before it still are.
+    if (this->internal->transaction) {
+        this->rollback();
+    }
+}
+
+void InMemoryTable::reread_file()
+{
+    Private::Lock lock(*this->internal, true);
+
+    this->internal->read_file();
+
+    this->internal->transaction = false;
+    this->internal->undo.clear();
+    this->internal->hold_flush(false);
+}
+
+void InMemoryTable::write_file() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    std::lock_guard<std::mutex> file(this->internal->file_mutex);
+
+    this->internal->parser->write_file(this->internal->columns);
+    this->internal->saved(this->internal->clock);
+}
+
+void InMemoryTable::write_file(const std::string &filepath) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    this->internal->parser->write_file(filepath, this->internal->columns);
+}
+
+void InMemoryTable::write_file(const std::string &filepath, const Selection &selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    this->internal->selection_mask(&selection, this->get_row_count(), "write_file");
+
+    std::vector<size_t> rows = selection.positions();
+    std::vector<std::shared_ptr<ColumnBase>> columns;
+
+    columns.reserve(this->internal->columns.size());
+
+    // Selected rows are copied into columns of their own, which are written
+    // as a whole table.
+    for (const std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+        columns.push_back(visit_column(*c, [&rows](const auto &c) -> std::shared_ptr<ColumnBase> {
+            auto copy = std::make_shared<std::decay_t<decltype(c)>>(c.get_name(), c.get_type());
+
+            copy->get_data().reserve(rows.size());
+
+            for (size_t pos : rows) {
+                copy->add(c.value(pos));
+            }
+
+            return copy;
+        }));
+    }
+
+    this->internal->parser->write_file(filepath, columns);
+}
+
+size_t InMemoryTable::search(const size_t &id) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (this->get_row_count() == 0) {
+        return TDB_NOT_FOUND;
+    }
+
+    // Search methods return index of the element in the vector.
+    // If element is not found, return TDB_NOT_FOUND.
+
+    const ColumnUint &id_column       = this->internal->id_column();
+    const SharedValues<size_t> &index = this->internal->index;
+
+    // Binary search by id.
+    const size_t *it =
+        std::lower_bound(index.begin(), index.end(), id,
+                         [&id_column](size_t a, size_t b) {
+                             return id_column.value(a) < b;
+                         });
+
+    if (it != index.end() && id_column.value(*it) == id) {
+        return *it;
+    }
+
+    return TDB_NOT_FOUND;
+}
+
+std::vector<size_t> InMemoryTable::search_range(const size_t &min,
+                                                const size_t &max) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    auto [first, end] = this->internal->index_range(min, max);
+
+    return std::vector<size_t>(first, end);
+}
+
+size_t InMemoryTable::count_range(const size_t &min, const size_t &max) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    auto [first, end] = this->internal->index_range(min, max);
+
+    return end - first;
+}
+
+std::vector<size_t> InMemoryTable::search(const std::string &name,
+                                          std::string &query) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->search(name, query, TS_PREFIX);
+}
+
+// Whether 'value' matches 'query' in search().
+static bool search_matches(std::string_view value, std::string_view query, bool exact)
+{
+    return exact ? value == query : value.compare(0, query.size(), query) == 0;
+}
+
+// Appends positions of rows in [first, end) whose values satisfy
+// match(value) to 'found'. Numbers are passed in decimal representation.
+// With 'nocase', values are taken from 'folded', or folded one by one when
+// it is nullptr.
+template <typename Match>
+static void search_rows(const ColumnBase &column, const std::vector<std::string> *folded,
+                        bool nocase, size_t first, size_t end,
+                        std::vector<size_t> &found, const Match &match)
+{
+    if (nocase && folded) {
+        for (size_t i = first; i < end; ++i) {
+            if (match((*folded)[i])) {
+                found.push_back(i);
+            }
+        }
+
+        return;
+    }
+
+    visit_column(column, [&](const auto &c) {
+        c.for_each_block(first, end, [&](const auto *values, size_t count, size_t block) {
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_same_v<std::decay_t<decltype(*values)>, std::string>) {
+                    if (nocase ? match(fold_case(values[i])) : match(values[i])) {
+                        found.push_back(block + i);
+                    }
+                }
+                else {
+                    char buf[24];
+                    std::to_chars_result end = std::to_chars(buf, buf + sizeof(buf), values[i]);
+
+                    if (match(std::string_view(buf, end.ptr - buf))) {
+                        found.push_back(block + i);
+                    }
+                }
+            }
+        });
+    });
+}
+
+std::vector<size_t> InMemoryTable::search(const std::string &name,
+                                          std::string_view query, int flags) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    // Naive search any column by comparing strings.
+    // Numbers are compared by their decimal representation.
+    std::vector<size_t> result;
+
+    size_t column_index = this->search_column_index(name);
+
+    if (column_index == TDB_NOT_FOUND) {
+        std::string failstring =
+            "In ToiletDB, In InMemoryTable.search(), Field '" + name +
+            "' does not exist";
+        throw std::logic_error(failstring);
+    }
+
+    SearchCache &cache = this->internal->cache;
+
+    std::string key;
+    uint64_t epoch = this->internal->epochs[column_index];
+
+    if (cache.is_enabled() && !this->internal->unsafe_rows) {
+        key = std::to_string(column_index) + ':' + std::to_string(flags) + ':';
+        key += query;
+
+        if (cache.find(key, epoch, result)) {
+            return result;
+        }
+    }
+
+    const ColumnBase &column = *this->internal->columns[column_index];
+
+    bool exact  = flags & TS_EXACT;
+    bool nocase = (flags & TS_NOCASE) && TDB_TYPE(column.get_type()) == TT_STR;
+
+    size_t len     = column.size();
+    size_t threads = this->internal->scan_threads(len);
+    size_t size    = morsel_size(len, threads);
+
+    std::vector<std::vector<size_t>> partial(morsel_count(len, size));
+
+    // Both sides are folded, values once for all searches.
+    const std::vector<std::string> *folded = nullptr;
+    std::string folded_query;
+
+    if (nocase) {
+        folded       = this->internal->search_folded(column_index);
+        folded_query = fold_case(query);
+        query        = folded_query;
+    }
+
+    for_each_morsel(len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        search_rows(column, folded, nocase, first, end, partial[morsel],
+                    [query, exact](std::string_view value) {
+                        return search_matches(value, query, exact);
+                    });
+    });
+
+    // Morsels are merged in order, so positions stay sorted.
+    for (const std::vector<size_t> &found : partial) {
+        result.insert(result.end(), found.begin(), found.end());
+    }
+
+    if (!key.empty()) {
+        cache.insert(std::move(key), epoch, result);
+    }
+
+    return result;
+}
+
+std::vector<size_t> InMemoryTable::search(const std::string &name,
+                                          const Pattern &pattern) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    size_t column_index = this->search_column_index(name);
+
+    if (column_index == TDB_NOT_FOUND) {
+        std::string failstring =
+            "In ToiletDB, In InMemoryTable.search(), Field '" + name +
+            "' does not exist";
+        throw std::logic_error(failstring);
+    }
+
+    const ColumnBase &column = *this->internal->columns[column_index];
+
+    bool nocase = pattern.is_nocase() && TDB_TYPE(column.get_type()) == TT_STR;
+
+    const std::vector<std::string> *folded =
+        nocase ? this->internal->search_folded(column_index) : nullptr;
+
+    size_t len     = column.size();
+    size_t threads = this->internal->scan_threads(len);
+    size_t size    = morsel_size(len, threads);
+
+    std::vector<std::vector<size_t>> partial(morsel_count(len, size));
+
+    for_each_morsel(len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        search_rows(column, folded, nocase, first, end, partial[morsel],
+                    [&pattern](std::string_view value) {
+                        return pattern.matches(value);
+                    });
+    });
+
+    std::vector<size_t> result;
+
+    for (const std::vector<size_t> &found : partial) {
+        result.insert(result.end(), found.begin(), found.end());
+    }
+
+    return result;
+}
+
+// Values passed to filter() can be of different signedness than the column.
+// They are clamped to the range of the column, and predicates that hold for
+// every value or for none of them are resolved without reading the column.
+enum FilterRange
+{
+    FR_COMPARE,
+    FR_NONE,
+    FR_ALL,
+};
+
+static FilterRange filter_int_range(ToiletCompare op, size_t &a, size_t &b)
+{
+    const size_t max = INT_MAX;
+
+    if (op == TC_BETWEEN) {
+        if (a > max) {
+            return FR_NONE;
+        }
+        b = std::min(b, max);
+        return FR_COMPARE;
+    }
+
+    if (a <= max) {
+        return FR_COMPARE;
+    }
+
+    return (op == TC_NE || op == TC_LT || op == TC_LE) ? FR_ALL : FR_NONE;
+}
+
+static FilterRange filter_uint_range(ToiletCompare op, int &a, int &b)
+{
+    if (op == TC_BETWEEN) {
+        if (b < 0) {
+            return FR_NONE;
+        }
+        a = std::max(a, 0);
+        return FR_COMPARE;
+    }
+
+    if (a >= 0) {
+        return FR_COMPARE;
+    }
+
+    return (op == TC_NE || op == TC_GT || op == TC_GE) ? FR_ALL : FR_NONE;
+}
+
+Selection InMemoryTable::filter(const std::string &name, ToiletCompare op,
+                                int a, int b) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    const ColumnBase &column = this->internal->numeric_column(name, "filter");
+
+    size_t len = column.size();
+    Selection result(len);
+
+    if (TDB_TYPE(column.get_type()) == TT_INT) {
+        const int *values = static_cast<const ColumnInt &>(column).get_data().data();
+
+        this->internal->compare_rows(len, result, [&](size_t first, size_t end, uint64_t *words) {
+            compare_ints(values + first, end - first, op, a, b, words);
+        });
+
+        return result;
+    }
+
+    FilterRange range = filter_uint_range(op, a, b);
+
+    if (range != FR_COMPARE) {
+        return Selection(len, range == FR_ALL);
+    }
+
+    const ColumnUint &c = static_cast<const ColumnUint &>(column);
+
+    this->internal->compare_rows(len, result, [&](size_t first, size_t end, uint64_t *words) {
+        c.compare(first, end - first, op, a, b, words);
+    });
+
+    return result;
+}
+
+Selection InMemoryTable::filter(const std::string &name, ToiletCompare op,
+                                size_t a, size_t b) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    const ColumnBase &column = this->internal->numeric_column(name, "filter");
+
+    size_t len = column.size();
+    Selection result(len);
+
+    if (TDB_TYPE(column.get_type()) == TT_UINT) {
+        const ColumnUint &c = static_cast<const ColumnUint &>(column);
+
+        this->internal->compare_rows(len, result, [&](size_t first, size_t end, uint64_t *words) {
+            c.compare(first, end - first, op, a, b, words);
+        });
+
+        return result;
+    }
+
+    FilterRange range = filter_int_range(op, a, b);
+
+    if (range != FR_COMPARE) {
+        return Selection(len, range == FR_ALL);
+    }
+
+    const int *values = static_cast<const ColumnInt &>(column).get_data().data();
+
+    this->internal->compare_rows(len, result, [&](size_t first, size_t end, uint64_t *words) {
+        compare_ints(values + first, end - first, op, static_cast<int>(a),
+                     static_cast<int>(b), words);
+    });
+
+    return result;
+}
+
+Selection InMemoryTable::filter(const std::string &name, ToiletCompare op,
+                                std::string_view a, std::string_view b) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    size_t column_index = this->search_column_index(name);
+
+    if (column_index == TDB_NOT_FOUND) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.filter(), Field '" +
+                               name + "' does not exist");
+    }
+
+    const ColumnBase &column = *this->internal->columns[column_index];
+
+    if (TDB_TYPE(column.get_type()) != TT_STR) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.filter(), Field '" +
+                               name + "' is not of type 'str'");
+    }
+
+    size_t len = column.size();
+    Selection result(len);
+
+    const std::string *values = static_cast<const ColumnStr &>(column).get_data().data();
+
+    this->internal->compare_rows(len, result, [&](size_t first, size_t end, uint64_t *words) {
+        for (size_t i = 0; first + i < end; ++i) {
+            if (compare_str(values[first + i], op, a, b)) {
+                words[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+    });
+
+    return result;
+}
+
+static Aggregate<int> make_aggregate(const IntStats &stats)
+{
+    Aggregate<int> result = {stats.count, stats.sum, false, 0, 0, 0};
+
+    if (stats.count) {
+        result.min = stats.min;
+        result.max = stats.max;
+        result.avg = static_cast<double>(stats.sum) / stats.count;
+    }
+
+    return result;
+}
+
+static Aggregate<size_t> make_aggregate(const UintStats &stats)
+{
+    Aggregate<size_t> result = {stats.count, stats.sum, stats.carry != 0, 0, 0, 0};
+
+    if (stats.count) {
+        result.min = stats.min;
+        result.max = stats.max;
+        result.avg = (stats.carry * 18446744073709551616.0 + stats.sum) / stats.count;
+    }
+
+    return result;
+}
+
+template <typename T>
+static Aggregate<T> merge(const Aggregate<T> &a, const Aggregate<T> &b)
+{
+    if (!b.count) {
+        return a;
+    }
+
+    if (!a.count) {
+        return b;
+    }
+
+    Aggregate<T> result;
+
+    // Wraps around on overflow, as sums of single tables do.
+    bool overflow = __builtin_add_overflow(a.sum, b.sum, &result.sum);
+
+    result.count    = a.count + b.count;
+    result.overflow = overflow || a.overflow || b.overflow;
+    result.avg      = (a.avg * a.count + b.avg * b.count) / result.count;
+    result.min      = std::min(a.min, b.min);
+    result.max      = std::max(a.max, b.max);
+
+    return result;
+}
+
+Aggregate<int> merge_aggregates(const Aggregate<int> &a, const Aggregate<int> &b)
+{
+    return merge(a, b);
+}
+
+Aggregate<size_t> merge_aggregates(const Aggregate<size_t> &a, const Aggregate<size_t> &b)
+{
+    return merge(a, b);
+}
+
+template <>
+Aggregate<int> InMemoryTable::aggregate<int>(const std::string &name,
+                                             const Selection *selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    const ColumnBase &column = this->internal->numeric_column(name, "aggregate");
+
+    if (TDB_TYPE(column.get_type()) != TT_INT) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.aggregate(), Field '" +
+                               name + "' is not 'int'");
+    }
+
+    const int *values    = static_cast<const ColumnInt &>(column).get_data().data();
+    size_t len           = column.size();
+    const uint64_t *mask = this->internal->selection_mask(selection, len, "aggregate");
+
+    size_t threads = this->internal->scan_threads(len);
+    size_t size    = morsel_size(len, threads);
+    std::vector<IntStats> partial(morsel_count(len, size));
+
+    for_each_morsel(len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        aggregate_ints(values + first, end - first, mask ? mask + first / 64 : nullptr,
+                       partial[morsel]);
+    });
+
+    IntStats stats;
+
+    for (const IntStats &p : partial) {
+        stats.merge(p);
+    }
+
+    return make_aggregate(stats);
+}
+
+template <>
+Aggregate<size_t> InMemoryTable::aggregate<size_t>(const std::string &name,
+                                                   const Selection *selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    const ColumnBase &column = this->internal->numeric_column(name, "aggregate");
+
+    if (TDB_TYPE(column.get_type()) != TT_UINT) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.aggregate(), Field '" +
+                               name + "' is not 'uint'");
+    }
+
+    const ColumnUint &c  = static_cast<const ColumnUint &>(column);
+    size_t len           = c.size();
+    const uint64_t *mask = this->internal->selection_mask(selection, len, "aggregate");
+
+    size_t threads = this->internal->scan_threads(len);
+    size_t size    = morsel_size(len, threads);
+    std::vector<UintStats> partial(morsel_count(len, size));
+
+    for_each_morsel(len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        // Packed columns are decoded block by block, blocks start on a
+        // multiple of 64 as morsels do.
+        c.for_each_block(first, end, [&](const size_t *values, size_t count, size_t block) {
+            aggregate_uints(values, count, mask ? mask + block / 64 : nullptr,
+                            partial[morsel]);
+        });
+    });
+
+    UintStats stats;
+
+    for (const UintStats &p : partial) {
+        stats.merge(p);
+    }
+
+    return make_aggregate(stats);
+}
+
+Groups InMemoryTable::group_by(const std::vector<std::string> &keys,
+                               const std::vector<std::string> &columns,
+                               const Selection *selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (keys.empty()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.group_by(), No key columns given");
+    }
+
+    std::vector<const ColumnBase *> key_columns;
+    std::vector<bool> str_keys;
+
+    for (const std::string &name : keys) {
+        size_t pos = this->search_column_index(name);
+
+        if (pos == TDB_NOT_FOUND) {
+            throw std::logic_error("In ToiletDB, In InMemoryTable.group_by(), Field '" +
+                                   name + "' does not exist");
+        }
+
+        key_columns.push_back(this->internal->columns[pos].get());
+        str_keys.push_back(TDB_TYPE(key_columns.back()->get_type()) == TT_STR);
+    }
+
+    // Aggregated columns are split by type, 'slots' is position of a column
+    // among columns of its type.
+    std::vector<const ColumnBase *> value_columns;
+    std::vector<size_t> slots;
+    size_t int_columns  = 0;
+    size_t uint_columns = 0;
+
+    for (const std::string &name : columns) {
+        value_columns.push_back(&this->internal->numeric_column(name, "group_by"));
+
+        if (TDB_TYPE(value_columns.back()->get_type()) == TT_INT) {
+            slots.push_back(int_columns++);
+        }
+        else {
+            slots.push_back(uint_columns++);
+        }
+    }
+
+    size_t len           = this->get_row_count();
+    const uint64_t *mask = this->internal->selection_mask(selection, len, "group_by");
+    size_t key_count     = key_columns.size();
+
+    // Each morsel is grouped on its own and merged afterwards, in order,
+    // so groups end up ordered by their first row no matter the threads.
+    size_t threads = this->internal->scan_threads(len);
+    size_t size    = morsel_size(len, threads);
+    size_t parts   = morsel_count(len, size);
+    std::vector<GroupTable> partial(parts, GroupTable(str_keys, int_columns, uint_columns));
+
+    for_each_morsel(len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        GroupTable &groups = partial[morsel];
+
+        std::vector<GroupKey> block_keys(TDB_BLOCK_SIZE * key_count);
+        std::vector<uint64_t> hashes(TDB_BLOCK_SIZE);
+        // First block is for keys, others are for 'uint' columns.
+        std::vector<size_t> scratch(TDB_BLOCK_SIZE * (uint_columns + 1));
+        std::vector<const int *> int_values(int_columns);
+        std::vector<const size_t *> uint_values(uint_columns);
+
+        for (size_t block = first; block < end; block += TDB_BLOCK_SIZE) {
+            size_t count = std::min<size_t>(TDB_BLOCK_SIZE, end - block);
+
+            std::fill(hashes.begin(), hashes.begin() + count, 0);
+
+            for (size_t k = 0; k < key_count; ++k) {
+                visit_column(*key_columns[k], [&](const auto &c) {
+                    using T = std::decay_t<decltype(c.value(0))>;
+
+                    if constexpr (std::is_same_v<T, std::string>) {
+                        const std::string *values = c.get_data().data() + block;
+
+                        for (size_t i = 0; i < count; ++i) {
+                            std::string_view value = values[i];
+
+                            block_keys[i * key_count + k].str = value;
+                            hashes[i] = combine_group_hash(hashes[i], hash_group_key(value));
+                        }
+                    }
+                    else {
+                        const T *values;
+
+                        if constexpr (std::is_same_v<T, int>) {
+                            values = c.get_data().data() + block;
+                        }
+                        else {
+                            values = c.read(block, count, scratch.data());
+                        }
+
+                        for (size_t i = 0; i < count; ++i) {
+                            uint64_t value = static_cast<uint64_t>(static_cast<long long>(values[i]));
+
+                            block_keys[i * key_count + k].number = value;
+                            hashes[i] = combine_group_hash(hashes[i], hash_group_key(value));
+                        }
+                    }
+                });
+            }
+
+            for (size_t c = 0; c < value_columns.size(); ++c) {
+                if (TDB_TYPE(value_columns[c]->get_type()) == TT_INT) {
+                    const ColumnInt *column = static_cast<const ColumnInt *>(value_columns[c]);
+                    int_values[slots[c]]    = column->get_data().data() + block;
+                }
+                else {
+                    const ColumnUint *column = static_cast<const ColumnUint *>(value_columns[c]);
+                    uint_values[slots[c]] =
+                        column->read(block, count, scratch.data() + (slots[c] + 1) * TDB_BLOCK_SIZE);
+                }
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                size_t row = block + i;
+
+                if (mask && !((mask[row / 64] >> (row % 64)) & 1)) {
+                    continue;
+                }
+
+                size_t group = groups.find_or_add(hashes[i], &block_keys[i * key_count], row);
+                groups.add_row(group);
+
+                IntStats *ints = groups.int_stats(group);
+
+                for (size_t c = 0; c < int_columns; ++c) {
+                    int value = int_values[c][i];
+
+                    ++ints[c].count;
+                    ints[c].sum += value;
+                    ints[c].min = std::min(ints[c].min, value);
+                    ints[c].max = std::max(ints[c].max, value);
+                }
+
+                UintStats *uints = groups.uint_stats(group);
+
+                for (size_t c = 0; c < uint_columns; ++c) {
+                    size_t value = uint_values[c][i];
+
+                    ++uints[c].count;
+                    uints[c].sum += value;
+                    uints[c].carry += uints[c].sum < value;
+                    uints[c].min = std::min(uints[c].min, value);
+                    uints[c].max = std::max(uints[c].max, value);
+                }
+            }
+        }
+    });
+
+    GroupTable &groups = partial[0];
+
+    for (size_t morsel = 1; morsel < parts; ++morsel) {
+        groups.merge(partial[morsel]);
+    }
+
+    Groups result;
+
+    result.rows.reserve(groups.size());
+    result.counts.reserve(groups.size());
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        result.rows.push_back(groups.get_row(g));
+        result.counts.push_back(groups.get_count(g));
+    }
+
+    for (size_t c = 0; c < value_columns.size(); ++c) {
+        Groups::Values values;
+        values.name = columns[c];
+
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (TDB_TYPE(value_columns[c]->get_type()) == TT_INT) {
+                values.ints.push_back(make_aggregate(groups.int_stats(g)[slots[c]]));
+            }
+            else {
+                values.uints.push_back(make_aggregate(groups.uint_stats(g)[slots[c]]));
+            }
+        }
+
+        result.values.push_back(std::move(values));
+    }
+
+    return result;
+}
+
+// Keys of one block of rows of a join column.
+struct JoinBlock
+{
+    GroupKey keys[TDB_BLOCK_SIZE];
+    uint64_t hashes[TDB_BLOCK_SIZE];
+    bool skip[TDB_BLOCK_SIZE];
+    size_t scratch[TDB_BLOCK_SIZE];
+};
+
+// Reads keys of rows [first, first + count) of a join column. Negative 'int'
+// keys can't be equal to any 'uint' key, so they are skipped when columns
+// are of different types.
+static void read_join_keys(const ColumnBase &column, size_t first, size_t count,
+                           bool skip_negative, JoinBlock &block)
+{
+    visit_column(column, [&](const auto &c) {
+        using T = std::decay_t<decltype(c.value(0))>;
+
+        if constexpr (std::is_same_v<T, std::string>) {
+            const std::string *values = c.get_data().data() + first;
+
+            for (size_t i = 0; i < count; ++i) {
+                block.keys[i].str = values[i];
+                block.hashes[i]   = hash_group_key(block.keys[i].str);
+                block.skip[i]     = false;
+            }
+        }
+        else if constexpr (std::is_same_v<T, int>) {
+            const int *values = c.get_data().data() + first;
+
+            for (size_t i = 0; i < count; ++i) {
+                block.keys[i].number = static_cast<uint64_t>(static_cast<long long>(values[i]));
+                block.hashes[i]      = hash_group_key(block.keys[i].number);
+                block.skip[i]        = skip_negative && values[i] < 0;
+            }
+        }
+        else {
+            const size_t *values = c.read(first, count, block.scratch);
+
+            for (size_t i = 0; i < count; ++i) {
+                block.keys[i].number = values[i];
+                block.hashes[i]      = hash_group_key(block.keys[i].number);
+                block.skip[i]        = false;
+            }
+        }
+    });
+}
+
+Joined InMemoryTable::join(const std::string &name, const InMemoryTable &other,
+                           const std::string &other_name) const
+{
+    // Every thread locks both tables in the same order.
+    bool this_first = this->internal.get() < other.internal.get();
+
+    Private::Lock first(this_first ? *this->internal : *other.internal, false);
+    Private::Lock second(this_first ? *other.internal : *this->internal, false);
+
+    size_t pos       = this->search_column_index(name);
+    size_t other_pos = other.search_column_index(other_name);
+
+    if (pos == TDB_NOT_FOUND || other_pos == TDB_NOT_FOUND) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.join(), Field '" +
+                               (pos == TDB_NOT_FOUND ? name : other_name) +
+                               "' does not exist");
+    }
+
+    const ColumnBase &column       = *this->internal->columns[pos];
+    const ColumnBase &other_column = *other.internal->columns[other_pos];
+
+    int type       = TDB_TYPE(column.get_type());
+    int other_type = TDB_TYPE(other_column.get_type());
+    bool str       = type == TT_STR;
+
+    if (str != (other_type == TT_STR)) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.join(), Fields '" +
+                               name + "' and '" + other_name +
+                               "' can't be compared");
+    }
+
+    // Smaller table goes into the hash table, larger one probes it.
+    bool build_this = column.size() < other_column.size();
+
+    const ColumnBase &build = build_this ? column : other_column;
+    const ColumnBase &probe = build_this ? other_column : column;
+
+    size_t build_len = build.size();
+    size_t probe_len = probe.size();
+
+    JoinTable table(str, build_len);
+    std::unique_ptr<JoinBlock> block = std::make_unique<JoinBlock>();
+
+    // Rows are added from last to first, so rows with equal keys are found
+    // in order.
+    for (size_t first = build_len / TDB_BLOCK_SIZE * TDB_BLOCK_SIZE;; first -= TDB_BLOCK_SIZE) {
+        size_t count = std::min<size_t>(TDB_BLOCK_SIZE, build_len - first);
+
+        read_join_keys(build, first, count, type != other_type, *block);
+
+        for (size_t i = count; i-- > 0;) {
+            if (!block->skip[i]) {
+                table.add(first + i, block->hashes[i], block->keys[i]);
+            }
+        }
+
+        if (first == 0) {
+            break;
+        }
+    }
+
+    // Pairs of (probe row, build row), one list per morsel.
+    size_t threads = this->internal->scan_threads(probe_len);
+    size_t size    = morsel_size(probe_len, threads);
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> partial(morsel_count(probe_len, size));
+
+    for_each_morsel(probe_len, size, threads, [&](size_t morsel, size_t first, size_t end) {
+        std::vector<std::pair<size_t, size_t>> &pairs = partial[morsel];
+        std::unique_ptr<JoinBlock> block = std::make_unique<JoinBlock>();
+
+        for (size_t begin = first; begin < end; begin += TDB_BLOCK_SIZE) {
+            size_t count = std::min<size_t>(TDB_BLOCK_SIZE, end - begin);
+
+            read_join_keys(probe, begin, count, type != other_type, *block);
+
+            for (size_t i = 0; i < count; ++i) {
+                if (block->skip[i]) {
+                    continue;
+                }
+
+                table.find(block->hashes[i], block->keys[i], [&pairs, row = begin + i](size_t match) {
+                    pairs.emplace_back(row, match);
+                });
+            }
+        }
+    });
+
+    size_t total = 0;
+
+    for (const std::vector<std::pair<size_t, size_t>> &pairs : partial) {
+        total += pairs.size();
+    }
+
+    Joined result;
+
+    result.rows.resize(total);
+    result.other_rows.resize(total);
+
+    if (!build_this) {
+        size_t at = 0;
+
+        for (const std::vector<std::pair<size_t, size_t>> &pairs : partial) {
+            for (const std::pair<size_t, size_t> &p : pairs) {
+                result.rows[at]       = p.first;
+                result.other_rows[at] = p.second;
+                ++at;
+            }
+        }
+
+        return result;
+    }
+
+    // Pairs come ordered by rows of the other table. Counting sort by rows of
+    // this one keeps them in that order for each row.
+    std::vector<size_t> offsets(build_len + 1);
+
+    for (const std::vector<std::pair<size_t, size_t>> &pairs : partial) {
+        for (const std::pair<size_t, size_t> &p : pairs) {
+            ++offsets[p.second + 1];
+        }
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    for (const std::vector<std::pair<size_t, size_t>> &pairs : partial) {
+        for (const std::pair<size_t, size_t> &p : pairs) {
+            size_t at = offsets[p.second]++;
+
+            result.rows[at]       = p.second;
+            result.other_rows[at] = p.first;
+        }
+    }
+
+    return result;
+}
+
+std::vector<size_t> InMemoryTable::sort_positions(const std::string &name,
+                                                  ToiletOrder order, size_t limit,
+                                                  const Selection *selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->sort_positions({{name, order}}, limit, selection);
+}
+
+std::vector<size_t> InMemoryTable::sort_positions(const std::vector<SortKey> &keys,
+                                                  size_t limit,
+                                                  const Selection *selection) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (keys.empty()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.sort_positions(), No key columns given");
+    }
+
+    size_t len = this->get_row_count();
+    this->internal->selection_mask(selection, len, "sort_positions");
+
+    // Numbers are decoded once into unsigned keys with the same order,
+    // inverted for TO_DESC, so they can be compared as is and radix sorted.
+    // Strings get keys from their first bytes, and are only compared in
+    // place when those can't tell them apart.
+    struct Key
+    {
+        const std::string *strs;
+        std::vector<uint64_t> numbers;
+        bool descending;
+        // Applied to keys, so that TO_DESC keys sort in ascending order.
+        uint64_t inv;
+    };
+
+    std::vector<Key> sort_keys;
+    bool numeric = true;
+
+    for (const SortKey &k : keys) {
+        size_t pos = this->search_column_index(k.name);
+
+        if (pos == TDB_NOT_FOUND) {
+            throw std::logic_error(
+                "In ToiletDB, In InMemoryTable.sort_positions(), Field '" +
+                k.name + "' does not exist");
+        }
+
+        Key key = {nullptr, {}, k.order == TO_DESC, k.order == TO_DESC ? ~0ULL : 0};
+
+        visit_column(*this->internal->columns[pos], [&](const auto &c) {
+            using T = std::decay_t<decltype(c.value(0))>;
+
+            key.numbers.resize(len);
+
+            if constexpr (std::is_same_v<T, std::string>) {
+                key.strs = c.get_data().data();
+                numeric  = false;
+
+                for (size_t i = 0; i < len; ++i) {
+                    key.numbers[i] = str_sort_key(key.strs[i]) ^ key.inv;
+                }
+            }
+            else {
+                c.for_each_block(0, len, [&](const T *values, size_t count, size_t first) {
+                    for (size_t i = 0; i < count; ++i) {
+                        if constexpr (std::is_same_v<T, int>) {
+                            key.numbers[first + i] = int_sort_key(values[i]) ^ key.inv;
+                        }
+                        else {
+                            key.numbers[first + i] = values[i] ^ key.inv;
+                        }
+                    }
+                });
+            }
+        });
+
+        sort_keys.push_back(std::move(key));
+    }
+
+    std::vector<size_t> positions;
+
+    if (selection) {
+        positions = selection->positions();
+    }
+    else {
+        positions.resize(len);
+        std::iota(positions.begin(), positions.end(), 0);
+    }
+
+    limit = std::min(limit, positions.size());
+
+    // Stable sort by each key, last one first, leaves rows ordered by all
+    // of them and ties in order of positions.
+    if (numeric && limit == positions.size()) {
+        for (size_t k = sort_keys.size(); k-- > 0;) {
+            radix_sort(positions, sort_keys[k].numbers.data());
+        }
+
+        return positions;
+    }
+
+    // Ties are broken by position, so the order does not depend on the
+    // algorithm used.
+    auto less = [&sort_keys](size_t a, size_t b) {
+        for (const Key &key : sort_keys) {
+            if (key.numbers[a] != key.numbers[b]) {
+                return key.numbers[a] < key.numbers[b];
+            }
+
+            // See str_sort_key().
+            if (!key.strs || ((key.numbers[a] ^ key.inv) & 0xFF) < 8) {
+                continue;
+            }
+
+            int c = std::string_view(key.strs[a]).compare(key.strs[b]);
+
+            if (c != 0) {
+                return key.descending ? c > 0 : c < 0;
+            }
+        }
+
+        return a < b;
+    };
+
+    if (limit == positions.size()) {
+        std::sort(positions.begin(), positions.end(), less);
+    }
+    // Heap of 'limit' elements for small limits, otherwise partitioning
+    // around limit-th element and sorting what's before it.
+    else if (limit <= positions.size() / 16) {
+        std::partial_sort(positions.begin(), positions.begin() + limit,
+                          positions.end(), less);
+    }
+    else {
+        std::nth_element(positions.begin(), positions.begin() + limit,
+                         positions.end(), less);
+        std::sort(positions.begin(), positions.begin() + limit, less);
+    }
+
+    positions.resize(limit);
+
+    return positions;
+}
+
+const std::vector<std::string> InMemoryTable::get_row(const size_t &pos) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    std::vector<std::string> result;
+
+    if (pos >= this->get_row_count()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.get_row(), pos "
+            "is larger than data size");
+    }
+
+    result.reserve(this->internal->columns.size());
+
+    for (const std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+        visit_column(*c, [&result, &pos](const auto &c) {
+            const auto &value = c.value(pos);
+
+            if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>) {
+                result.push_back(value);
+            }
+            else {
+                result.push_back(std::to_string(value));
+            }
+        });
+    }
+
+    return result;
+}
+
+std::vector<std::string> InMemoryTable::get_row_by_id(size_t id) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    size_t pos = this->search(id);
+
+    if (pos == TDB_NOT_FOUND) {
+        return {};
+    }
+
+    return this->get_row(pos);
+}
+
+std::vector<void *> InMemoryTable::unsafe_get_mut_row(const size_t &pos)
+{
+    Private::Lock lock(*this->internal, true);
+
+    // To get types, use column_types().
+    // This returns void pointers to values from every column on a single row.
+
+    std::vector<void *> result;
+
+    if (pos >= this->get_row_count()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.get_row(), pos "
+            "is larger than data size");
+    }
+
+    // Caller can write anything through these.
+    this->internal->own_all();
+
+    for (size_t i = 0; i < this->internal->columns.size(); ++i) {
+        this->internal->log_edit(i, pos);
+    }
+
+    // Values can change through pointers at any time later, so nothing
+    // derived from them can be kept.
+    this->internal->unsafe_rows = true;
+    this->internal->touch_all();
+    this->internal->folded.clear();
+    this->internal->cache.clear();
+
+    result.reserve(this->internal->columns.size());
+
+    // Through get_data(), so 'uint' values are unpacked and snapshots copy
+    // them whole.
+    for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+        visit_column(*c, [&result, &pos](auto &c) {
+            result.push_back(static_cast<void *>(&c.get_data()[pos]));
+        });
+    }
+
+    return result;
+}
+
+RowView InMemoryTable::get_row_view(const size_t &pos) const
+{
+    return RowView(*this, pos);
+}
+
+RowRef InMemoryTable::get_row_ref(const size_t &pos)
+{
+    return RowRef(*this, pos);
+}
+
+int InMemoryTable::add_row(std::vector<std::string> &args)
+{
+    Private::Lock lock(*this->internal, true);
+
+    return this->add_row(args, this->get_next_id());
+}
+
+int InMemoryTable::add_row(std::vector<std::string> &args, size_t id)
+{
+    Private::Lock lock(*this->internal, true);
+
+    // NOTE: Do not pass ID column here.
+
+    // Returns 0 on success.
+    // Errors numbers:
+    // 1 - Args vector is too big/small.
+    // 2 - Argument of type 'int' is found to be
+    //     not convertible to int.
+    // 3 - Argument of type 'uint' is found to be
+    //     not convertible to size_t.
+    // 4 - Row with this ID already exists.
+
+    const std::vector<int> &types = this->get_types();
+
+    // Column count, ignoring ID.
+    if (args.size() != this->get_column_count() - 1) {
+        return 1;
+    }
+
+    std::vector<std::string>::iterator it = args.begin();
+
+    // TODO:
+    // This is just typechecking.
+    // Surely this can be compressed (Clueless)
+    for (size_t i = 1; i < this->get_column_count(); ++i) {
+
+        // Skip the ID column.
+        if (TDB_IS(types[i], TT_ID)) {
+            continue;
+        }
+
+        switch (TDB_TYPE(types[i])) {
+            case TT_INT: {
+                int value = parse_int(*it++);
+
+                if (value == TDB_INVALID_I) {
+                    return 2;
+                }
+            } break;
+
+            case TT_UINT: {
+                size_t value = parse_long_long(*it++);
+
+                if (value == TDB_INVALID_ULL) {
+                    return 3;
+                }
+            } break;
+
+            default: {
+                ++it;
+            }
+        }
+    }
+
+    if (this->search(id) != TDB_NOT_FOUND) {
+        return 4;
+    }
+
+    it = args.begin();
+
+    this->internal->own_all();
+
+    size_t pos = this->get_row_count();
+
+    // Row is either added whole, or not at all.
+    try {
+        for (size_t i = 0; i < this->get_column_count(); ++i) {
+
+            if (TDB_IS(types[i], TT_ID)) {
+                static_cast<ColumnUint *>(this->internal->columns[i].get())->add(id);
+            }
+
+            else if (TDB_IS(types[i], TT_INT)) {
+                int value = parse_int(*it++);
+                static_cast<ColumnInt *>(this->internal->columns[i].get())->add(value);
+            }
+
+            else if (TDB_IS(types[i], TT_UINT)) {
+                size_t value = parse_long_long(*it++);
+                static_cast<ColumnUint *>(this->internal->columns[i].get())->add(value);
+            }
+
+            else if (TDB_IS(types[i], TT_STR)) {
+                static_cast<ColumnStr *>(this->internal->columns[i].get())->add(*it++);
+            }
+        }
+
+        this->internal->insert_index(pos);
+        this->internal->fold_inserted_row(pos);
+        this->internal->log_insert(pos);
+    }
+    catch (...) {
+        this->internal->discard_row(pos);
+        this->internal->touch_all();
+        throw;
+    }
+
+    this->internal->touch_all();
+
+    return 0;
+}
+
+bool InMemoryTable::erase(const size_t &pos)
+{
+    Private::Lock lock(*this->internal, true);
+
+    size_t len = this->internal->columns.size();
+
+    if (pos >= this->get_row_count()) {
+        return false;
+    }
+
+    this->internal->own_all();
+    this->internal->log_erase(pos);
+    this->internal->erase_index(pos);
+
+    // Erase data from all columns in one row.
+    for (size_t i = 0; i < len; ++i) {
+        this->internal->columns[i]->erase(pos);
+    }
+
+    this->internal->touch_all();
+    this->internal->fold_erased_row(pos);
+
+    return true;
+}
+
+bool InMemoryTable::erase_id(const size_t &id)
+{
+    Private::Lock lock(*this->internal, true);
+
+    size_t result = this->search(id);
+
+    if (result != TDB_NOT_FOUND) {
+        this->erase(result);
+        return true;
+    }
+
+    return false;
+}
+
+void InMemoryTable::clear()
+{
+    Private::Lock lock(*this->internal, true);
+
+    if (this->internal->transaction) {
+        // Old rows are kept as they are, and replaced with empty columns.
+        Undo &undo   = this->internal->undo.emplace_back();
+        undo.kind    = Undo::UNDO_CLEAR;
+        undo.columns = this->internal->columns;
+        undo.index   = this->internal->index.share();
+
+        this->internal->unpublish();
+
+        for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+            c = visit_column(*c, [this](const auto &c) -> std::shared_ptr<ColumnBase> {
+                return std::make_shared<std::decay_t<decltype(c)>>(
+                    c.get_name(), c.get_type(), this->internal->memory.get());
+            });
+        }
+    }
+    else {
+        this->internal->own_all();
+
+        for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+            c->clear();
+        }
+    }
+
+    this->internal->update_index();
+    this->internal->touch_all();
+    this->internal->folded.clear();
+}
+
+size_t InMemoryTable::get_column_count() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->internal->columns.size();
+}
+
+const std::vector<std::string> &InMemoryTable::get_column_names() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->internal->parser->names();
+}
+
+const std::string &InMemoryTable::get_column_name(const size_t &pos) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (pos > this->get_column_count()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.get_column_name(), pos "
+            "is larger than column count");
+    }
+
+    return this->internal->parser->names()[pos];
+}
+
+size_t InMemoryTable::search_column_index(const std::string &name) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    std::vector<size_t> result;
+
+    size_t column_index = TDB_INVALID_ULL;
+    size_t i            = 0;
+
+    for (const std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+        if (c->get_name() == name) {
+            column_index = i;
+            break;
+        }
+        ++i;
+    }
+
+    if (column_index == TDB_INVALID_ULL) {
+        return TDB_NOT_FOUND;
+    }
+
+    return column_index;
+}
+
+const std::vector<int> &InMemoryTable::get_types() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->internal->parser->types();
+}
+
+const int &InMemoryTable::get_column_type(const size_t &pos) const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (pos > this->get_column_count()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.get_column_type(), pos "
+            "is larger than column count");
+    }
+
+    return this->internal->parser->types()[pos];
+}
+
+size_t InMemoryTable::get_row_count() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    if (!this->internal->columns[0]) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.size(), there is no columns");
+    }
+
+    return this->internal->columns[0]->size();
+}
+
+void InMemoryTable::compact()
+{
+    Private::Lock lock(*this->internal, true);
+
+    this->internal->compacted = true;
+    this->internal->pack_columns();
+}
+
+MemoryUsage InMemoryTable::memory_usage() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    MemoryUsage usage;
+    usage.total = 0;
+
+    for (const std::shared_ptr<ColumnBase> &c : this->internal->columns) {
+        size_t bytes = c->bytes();
+
+        usage.columns.push_back({c->get_name(), bytes});
+        usage.total += bytes;
+    }
+
+    size_t index_bytes = this->internal->index.capacity() * sizeof(size_t);
+
+    usage.indexes.push_back({this->get_column_name(this->internal->parser->id_column_index()), index_bytes});
+    usage.total += index_bytes;
+
+    // Case-folded copies count as indexes of their columns.
+    std::lock_guard<std::mutex> folded_lock(this->internal->folded_mutex);
+    std::string empty;
+
+    for (size_t i = 0; i < this->internal->folded.size(); ++i) {
+        const std::unique_ptr<std::vector<std::string>> &copy = this->internal->folded[i];
+
+        if (!copy) {
+            continue;
+        }
+
+        size_t bytes = copy->capacity() * sizeof(std::string);
+
+        for (const std::string &value : *copy) {
+            if (value.capacity() > empty.capacity()) {
+                bytes += value.capacity() + 1;
+            }
+        }
+
+        usage.indexes.push_back({this->get_column_name(i), bytes});
+        usage.total += bytes;
+    }
+
+    usage.allocated = this->internal->memory->get_allocated();
+
+    return usage;
+}
+
+void InMemoryTable::set_thread_count(size_t threads)
+{
+    this->internal->threads = threads;
+}
+
+size_t InMemoryTable::get_thread_count() const
+{
+    return this->internal->threads;
+}
+
+void InMemoryTable::set_concurrent(bool concurrent)
+{
+    this->internal->concurrent = concurrent;
+}
+
+bool InMemoryTable::is_concurrent() const
+{
+    return this->internal->concurrent;
+}
+
+// Amount of undone inserts and erases after which index is sorted again,
+// instead of being updated for each of them.
+static constexpr size_t UNDO_REINDEX_MOVES = 64;
+
+void InMemoryTable::begin()
+{
+    Private::Lock lock(*this->internal, true);
+
+    if (this->internal->transaction) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.begin(), Transaction is already started");
+    }
+
+    this->internal->save_begun();
+    this->internal->transaction = true;
+    this->internal->hold_flush(true);
+}
+
+void InMemoryTable::commit()
+{
+    Private::Lock lock(*this->internal, true);
+
+    if (!this->internal->transaction) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.commit(), No transaction was started");
+    }
+
+    this->internal->transaction = false;
+    this->internal->undo.clear();
+    this->internal->hold_flush(false);
+}
+
+void InMemoryTable::rollback()
+{
+    Private::Lock lock(*this->internal, true);
+
+    if (!this->internal->transaction) {
+        throw std::logic_error("In ToiletDB, In InMemoryTable.rollback(), No transaction was started");
+    }
+
+    std::vector<Undo> &undo = this->internal->undo;
+
+    // Every undone insert or erase moves part of the index. Past some amount
+    // of them, sorting it once is faster.
+    size_t moves = std::count_if(undo.begin(), undo.end(), [](const Undo &u) {
+        return u.kind == Undo::UNDO_INSERT || u.kind == Undo::UNDO_ERASE;
+    });
+
+    bool reindex = moves <= UNDO_REINDEX_MOVES;
+
+    while (!undo.empty()) {
+        if (!reindex || undo.back().kind != Undo::UNDO_INSERT) {
+            this->internal->apply_undo(undo.back(), reindex);
+            undo.pop_back();
+            continue;
+        }
+
+        // Inserts undone one after another are taken out of the index in
+        // one pass, instead of moving it once per row. Edits in between
+        // don't move rows, so they don't end the run.
+        size_t first = undo.size();
+
+        while (first > 0 && (undo[first - 1].kind == Undo::UNDO_INSERT ||
+                             undo[first - 1].kind == Undo::UNDO_EDIT)) {
+            --first;
+        }
+
+        std::vector<size_t> rows;
+
+        for (size_t i = undo.size(); i-- > first;) {
+            if (undo[i].kind != Undo::UNDO_INSERT) {
+                continue;
+            }
+
+            size_t pos = undo[i].pos;
+
+            // Newer inserts before it moved it forward.
+            for (size_t newer = i + 1; newer < undo.size(); ++newer) {
+                if (undo[newer].kind == Undo::UNDO_INSERT) {
+                    pos += pos >= undo[newer].pos;
+                }
+            }
+
+            rows.push_back(pos);
+        }
+
+        std::sort(rows.begin(), rows.end());
+        this->internal->erase_index(rows);
+
+        while (undo.size() > first) {
+            this->internal->apply_undo(undo.back(), false);
+            undo.pop_back();
+        }
+    }
+
+    if (!reindex) {
+        this->internal->update_index();
+    }
+
+    this->internal->transaction = false;
+
+    if (!this->internal->restore_begun()) {
+        this->internal->touch_all();
+    }
+
+    this->internal->hold_flush(false);
+}
+
+bool InMemoryTable::in_transaction() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    return this->internal->transaction;
+}
+
+std::shared_ptr<const InMemoryTable> InMemoryTable::snapshot() const
+{
+    Private &internal = *this->internal;
+
+    std::shared_ptr<const InMemoryTable> snapshot = std::atomic_load(&internal.published);
+
+    if (snapshot) {
+        return snapshot;
+    }
+
+    if (std::find(held_locks.begin(), held_locks.end(), &internal) != held_locks.end()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.snapshot(), Row is being built on this thread");
+    }
+
+    // Rows changed since last snapshot. Wait for writers to finish.
+    std::lock_guard<std::mutex> lock(internal.writer);
+
+    // Some other thread could have made one in the meantime.
+    return internal.make_snapshot();
+}
+
+void InMemoryTable::set_auto_flush(size_t delay, size_t changes)
+{
+    Private &internal = *this->internal;
+
+    if (!delay && !changes) {
+        internal.stop_flusher();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(internal.flush_mutex);
+
+        internal.flush_delay   = delay;
+        internal.flush_changes = changes;
+    }
+
+    if (internal.flusher.joinable()) {
+        internal.flush_wake.notify_all();
+    }
+    else {
+        internal.flusher = std::thread([&internal]() { internal.flush_loop(); });
+    }
+}
+
+void InMemoryTable::flush(bool wait)
+{
+    Private &internal = *this->internal;
+
+    if (std::find(held_locks.begin(), held_locks.end(), &internal) != held_locks.end()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.flush(), Row is being built on this thread");
+    }
+
+    std::unique_lock<std::mutex> lock(internal.flush_mutex);
+
+    // Changes are written once transaction is over.
+    if (internal.flush_held) {
+        return;
+    }
+
+    if (!internal.flusher.joinable()) {
+        if (!internal.dirty) {
+            return;
+        }
+
+        lock.unlock();
+
+        std::string error = internal.write_snapshot();
+
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+
+        return;
+    }
+
+    // Write that is in progress has every change made so far, unless there
+    // were changes after it started.
+    uint64_t write = internal.flush_started;
+
+    if (internal.dirty) {
+        internal.flush_requested = true;
+        internal.flush_wake.notify_all();
+        ++write;
+    }
+
+    if (!wait) {
+        return;
+    }
+
+    internal.flush_done.wait(lock, [&internal, write]() {
+        return internal.flush_finished >= write;
+    });
+
+    if (internal.flush_failed >= write) {
+        throw std::runtime_error(internal.flush_stats.last_error);
+    }
+}
+
+size_t InMemoryTable::prepare_write(const std::string &filepath) const
+{
+    Private &internal = *this->internal;
+
+    if (std::find(held_locks.begin(), held_locks.end(), &internal) != held_locks.end()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.prepare_write(), Row is being built on this thread");
+    }
+
+    std::shared_ptr<const InMemoryTable> snapshot;
+    uint64_t clock;
+
+    {
+        std::lock_guard<std::mutex> writer(internal.writer);
+
+        // Rows of an open transaction are not written.
+        if (internal.transaction) {
+            return 0;
+        }
+
+        snapshot = internal.make_snapshot();
+        clock    = internal.clock;
+    }
+
+    {
+        std::lock_guard<std::mutex> file(internal.file_mutex);
+
+        if (clock <= internal.file_clock) {
+            return 0;
+        }
+    }
+
+    snapshot->write_file(filepath);
+
+    return clock;
+}
+
+void InMemoryTable::finish_write(const std::string &filepath, size_t version) const
+{
+    Private &internal = *this->internal;
+
+    if (std::find(held_locks.begin(), held_locks.end(), &internal) != held_locks.end()) {
+        throw std::logic_error(
+            "In ToiletDB, In InMemoryTable.finish_write(), Row is being built on this thread");
+    }
+
+    std::lock_guard<std::mutex> writer(internal.writer);
+    std::lock_guard<std::mutex> file(internal.file_mutex);
+
+    // Newer rows could have been written by write_file() or flusher already.
+    if (version <= internal.file_clock) {
+        std::remove(filepath.c_str());
+        return;
+    }
+
+    const std::string &filename = internal.parser->get_filename();
+
+    if (std::rename(filepath.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("In ToiletDB, In InMemoryTable.finish_write(), Could not move '" +
+                                 filepath + "' to '" + filename + "'");
+    }
+
+    // Changes made after prepare_write() are still not in the file.
+    if (internal.clock == version) {
+        internal.saved(version);
+    }
+    else {
+        internal.file_clock = version;
+    }
+}
+
+FlushStats InMemoryTable::get_flush_stats() const
+{
+    Private &internal = *this->internal;
+
+    std::lock_guard<std::mutex> lock(internal.flush_mutex);
+
+    FlushStats stats = internal.flush_stats;
+
+    stats.background = internal.flush_delay || internal.flush_changes;
+    stats.pending    = internal.pending;
+    stats.lag_ms     = 0;
+
+    if (internal.dirty) {
+        stats.lag_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - internal.dirty_since)
+                           .count();
+    }
+
+    return stats;
+}
+
+void InMemoryTable::set_search_cache(size_t bytes)
+{
+    this->internal->cache.set_capacity(bytes);
+}
+
+CacheStats InMemoryTable::get_search_cache_stats() const
+{
+    return this->internal->cache.stats();
+}
+
+size_t InMemoryTable::get_next_id() const
+{
+    Private::Lock lock(*this->internal, false);
+
+    // This should return valid and unique ID for a new row.
+    // add() uses this.
+
+    size_t i = 0;
+
+    while (true) {
+        size_t next_id = this->get_row_count() + i;
+        if (this->search(next_id) == TDB_NOT_FOUND) {
+            TDB_DEBUGS(next_id, "InMemoryTable.get_next_id");
+            return next_id;
+        }
+        ++i;
+    }
+}
+
+RowView::RowView(const InMemoryTable &table, size_t pos) :
+    table(&table), pos(pos)
+{
+    if (pos >= table.get_row_count()) {
+        throw std::logic_error(
+            "In ToiletDB, In RowView constructor, pos "
+            "is larger than data size");
+    }
+}
+
+size_t RowView::get_pos() const
+{
+    return this->pos;
+}
+
+// Column at index, checked to be of type.
+const ColumnBase &RowView::column(size_t column, int type) const
+{
+    const std::vector<std::shared_ptr<ColumnBase>> &columns = this->table->internal->columns;
+
+    if (column >= columns.size()) {
+        throw std::logic_error(
+            "In ToiletDB, In RowView.get(), column "
+            "is larger than column count");
+    }
+
+    if (TDB_TYPE(columns[column]->get_type()) != type) {
+        throw std::logic_error(
+            "In ToiletDB, In RowView.get(), type does not match "
+            "type of column '" + columns[column]->get_name() + "'");
+    }
+
+    // Checked again under the lock, as another thread could have erased
+    // rows since constructor.
+    if (this->pos >= columns[column]->size()) {
+        throw std::logic_error(
+            "In ToiletDB, In RowView.get(), pos "
+            "is larger than data size");
+    }
+
+    return *columns[column];
+}
+
+template <>
+int RowView::get<int>(size_t column) const
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, false);
+
+    return static_cast<const ColumnInt &>(this->column(column, TT_INT)).value(this->pos);
+}
+
+template <>
+size_t RowView::get<size_t>(size_t column) const
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, false);
+
+    return static_cast<const ColumnUint &>(this->column(column, TT_UINT)).value(this->pos);
+}
+
+template <>
+std::string_view RowView::get<std::string_view>(size_t column) const
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, false);
+
+    return static_cast<const ColumnStr &>(this->column(column, TT_STR)).value(this->pos);
+}
+
+RowRef::RowRef(InMemoryTable &table, size_t pos) :
+    RowView(table, pos)
+{}
+
+// Table was passed as mutable to the constructor, so casting const away is
+// fine here.
+#define ROWREF_COLUMN(type, column, tt) \
+    static_cast<type &>(const_cast<ColumnBase &>(this->column(column, tt)))
+
+// Throws if column can not be edited.
+static void rowref_check_const(const InMemoryTable &table, size_t column)
+{
+    if (column < table.get_column_count() && TDB_IS(table.get_column_type(column), TT_CONST)) {
+        throw std::logic_error(
+            "In ToiletDB, In RowRef.set(), column '" + table.get_column_name(column) +
+            "' has 'const' modifier");
+    }
+}
+
+void RowRef::set(size_t column, int value)
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, true);
+
+    rowref_check_const(*this->table, column);
+    this->table->internal->own(column);
+    this->table->internal->log_edit(column, this->pos);
+
+    if (column < this->table->get_column_count() &&
+        TDB_TYPE(this->table->get_column_type(column)) == TT_UINT) {
+        if (value < 0) {
+            throw std::logic_error("In ToiletDB, In RowRef.set(), negative value for 'uint' column");
+        }
+
+        ROWREF_COLUMN(ColumnUint, column, TT_UINT).set(this->pos, static_cast<size_t>(value));
+        this->table->internal->touch(column);
+        return;
+    }
+
+    ROWREF_COLUMN(ColumnInt, column, TT_INT).get(this->pos) = value;
+    this->table->internal->touch(column);
+}
+
+void RowRef::set(size_t column, size_t value)
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, true);
+
+    rowref_check_const(*this->table, column);
+    this->table->internal->own(column);
+    this->table->internal->log_edit(column, this->pos);
+
+    if (column < this->table->get_column_count() &&
+        TDB_TYPE(this->table->get_column_type(column)) == TT_INT) {
+        // TDB_INVALID_I is reserved to mark invalid ints.
+        if (value >= TDB_INVALID_I) {
+            throw std::logic_error("In ToiletDB, In RowRef.set(), value does not fit 'int' column");
+        }
+
+        ROWREF_COLUMN(ColumnInt, column, TT_INT).get(this->pos) = static_cast<int>(value);
+        this->table->internal->touch(column);
+        return;
     }
 
-    this->internal->columns = this->internal->parser->read_file();
+    ROWREF_COLUMN(ColumnUint, column, TT_UINT).set(this->pos, value);
+    this->table->internal->touch(column);
+}
 
-    // IDs from loaded file will be indexed here to be used for binary search.
-    this->internal->update_index();
+void RowRef::set(size_t column, std::string value)
+{
+    InMemoryTable::Private::Lock lock(*this->table->internal, true);
+
+    rowref_check_const(*this->table, column);
+    this->table->internal->own(column);
+    this->table->internal->log_edit(column, this->pos);
+
+    ROWREF_COLUMN(ColumnStr, column, TT_STR).get(this->pos) = std::move(value);
+    this->table->internal->touch(column);
+    this->table->internal->fold_value(column, this->pos);
 }
 
-InMemoryTable::~InMemoryTable()
-{}
+RowBuilder::RowBuilder(InMemoryTable &table) :
+    table(table)
+{
+    this->column = 0;
+    this->error  = 0;
+    this->locked = false;
+}
 
-void InMemoryTable::reread_file()
+RowBuilder::~RowBuilder()
 {
-    this->internal->columns = this->internal->parser->read_file();
-    this->internal->update_index();
+    this->rollback();
 }
 
-void InMemoryTable::write_file() const
+// Table stays locked from first value of a row until the row is finished or
+// discarded, so nobody sees it half-built, snapshots included.
+void RowBuilder::lock()
 {
-    this->internal->parser->write_file(this->internal->columns);
+    if (!this->locked) {
+        this->locked = this->table.internal->lock(true);
+    }
 }
 
-void InMemoryTable::write_file(const std::string &filepath) const
+void RowBuilder::unlock()
 {
-    this->internal->parser->write_file(filepath, this->internal->columns);
+    if (this->locked) {
+        this->table.internal->unlock(true);
+        this->locked = false;
+    }
 }
 
-size_t InMemoryTable::search(const size_t &id) const
+// Finds next column to be filled, skipping ID.
+// Returns TDB_NOT_FOUND and sets error if value can't be put there.
+size_t RowBuilder::next_column(int type)
 {
-    if (this->get_row_count() == 0) {
+    this->lock();
+
+    if (this->error) {
         return TDB_NOT_FOUND;
     }
 
-    // Search methods return index of the element in the vector.
-    // If element is not found, return TDB_NOT_FOUND.
+    const std::vector<int> &types = this->table.get_types();
 
-    // NOTE: Long instead of size_t.
-    // Binary search by id.
-    long L = 0;
-    long R = this->internal->index.size();
-    long m;
+    while (this->column < types.size() && TDB_IS(types[this->column], TT_ID)) {
+        ++this->column;
+    }
+
+    if (this->column >= types.size()) {
+        this->error = 1;
+        return TDB_NOT_FOUND;
+    }
 
-    std::vector<size_t> id_column =
-        std::static_pointer_cast<ColumnUint>(this->internal->columns[this->internal->parser->id_column_index()])
-            ->get_data();
+    int column_type = TDB_TYPE(types[this->column]);
 
-    while (L <= R) {
-        m = (L + R) / 2;
+    if (column_type != type) {
+        bool numeric = (type & (TT_INT | TT_UINT)) && (column_type & (TT_INT | TT_UINT));
 
-        if (id_column[this->internal->index[m]] < id) {
-            L = m + 1;
-        }
-        else if (id_column[this->internal->index[m]] > id) {
-            // If this would become unsigned,
-            // here needs to be a test that breaks loop when R wraps.
-            R = m - 1;
-        }
-        else {
-            return this->internal->index[m];
+        if (!numeric) {
+            this->error = 4;
+            return TDB_NOT_FOUND;
         }
     }
 
-    return TDB_NOT_FOUND;
+    this->table.internal->own(this->column);
+
+    return this->column++;
 }
 
-std::vector<size_t> InMemoryTable::search(const std::string &name,
-                                          std::string &query) const
+// Takes next column for a value of 'type' that fits no numeric column, and
+// sets error the way add() would for that column.
+RowBuilder &RowBuilder::reject(int type)
 {
-    // Naive search any column by comparing strings.
-    size_t pos = 0;
-    std::vector<size_t> result;
-
-    size_t column_index = this->search_column_index(name);
+    size_t i = this->next_column(type);
 
-    if (column_index == TDB_NOT_FOUND) {
-        std::string failstring =
-            "In ToiletDB, In InMemoryTable.search(), Field '" + name +
-            "' does not exist";
-        throw std::logic_error(failstring);
+    if (i != TDB_NOT_FOUND) {
+        this->error = TDB_TYPE(this->table.get_types()[i]) == TT_UINT ? 3 : 2;
+        // Nothing was added to this column.
+        --this->column;
     }
 
-    int type = this->internal->columns[column_index]->get_type();
+    return *this;
+}
 
-    for (size_t i = 0; i < this->get_row_count(); ++i) {
-        std::string value;
-        switch (TDB_TYPE(type)) {
-            case TT_INT: {
-                value = std::static_pointer_cast<ColumnInt>(this->internal->columns[column_index])
-                            ->get(i);
-            } break;
-            case TT_UINT: {
-                value = std::static_pointer_cast<ColumnUint>(this->internal->columns[column_index])
-                            ->get(i);
-                break;
-            }
-            case TT_STR: {
-                value = std::static_pointer_cast<ColumnStr>(this->internal->columns[column_index])
-                            ->get(i);
-                break;
-            }
-        }
+// Removes values of an unfinished row. They were not indexed, folded or
+// seen by anyone, so columns end up as they were and nothing is touched.
+void RowBuilder::rollback()
+{
+    const std::vector<int> &types = this->table.get_types();
 
-        if (value.rfind(query, 0) == 0) {
-            result.push_back(pos);
+    for (size_t i = 0; i < this->column; ++i) {
+        if (TDB_IS(types[i], TT_ID)) {
+            continue;
         }
-        ++pos;
+
+        ColumnBase *c = this->table.internal->columns[i].get();
+        c->erase(c->size() - 1);
     }
 
-    return result;
+    this->column = 0;
+    this->unlock();
 }
 
-const std::vector<std::string> InMemoryTable::get_row(const size_t &pos) const
+RowBuilder &RowBuilder::add(int value)
 {
-    std::vector<std::string> result;
+    size_t i = this->next_column(TT_INT);
 
-    if (pos > this->get_row_count()) {
-        throw std::logic_error(
-            "In ToiletDB, In InMemoryTable.get_row(), pos "
-            "is larger than data size");
+    if (i == TDB_NOT_FOUND) {
+        return *this;
     }
 
-    for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
-        switch (TDB_TYPE(c->get_type())) {
-            case TT_INT: {
-                result.push_back(std::to_string((static_cast<ColumnInt *>(c.get()))->get(pos)));
-            } break;
-
-            case TT_UINT: {
-                result.push_back(std::to_string((static_cast<ColumnUint *>(c.get()))->get(pos)));
-            } break;
+    ColumnBase *c = this->table.internal->columns[i].get();
 
-            case TT_STR: {
-                result.push_back((static_cast<ColumnStr *>(c.get()))->get(pos));
-            } break;
+    if (TDB_TYPE(c->get_type()) == TT_UINT) {
+        if (value < 0) {
+            this->error = 3;
+            // Nothing was added to this column.
+            --this->column;
+            return *this;
         }
+
+        static_cast<ColumnUint *>(c)->add(static_cast<size_t>(value));
+    }
+    else {
+        static_cast<ColumnInt *>(c)->add(value);
     }
 
-    return result;
+    return *this;
 }
 
-std::vector<void *> InMemoryTable::unsafe_get_mut_row(const size_t &pos)
+RowBuilder &RowBuilder::add(size_t value)
 {
-    // To get types, use column_types().
-    // This returns void pointers to values from every column on a single row.
-
-    std::vector<void *> result;
+    size_t i = this->next_column(TT_UINT);
 
-    if (pos > this->get_row_count()) {
-        throw std::logic_error(
-            "In ToiletDB, In InMemoryTable.get_row(), pos "
-            "is larger than data size");
+    if (i == TDB_NOT_FOUND) {
+        return *this;
     }
 
-    for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
-        switch (TDB_TYPE(c->get_type())) {
-            case TT_INT: {
-                result.push_back(static_cast<void *>(&(static_cast<ColumnInt *>(c.get()))->get(pos)));
-            } break;
-
-            case TT_UINT: {
-                result.push_back(static_cast<void *>(&(static_cast<ColumnUint *>(c.get()))->get(pos)));
-            } break;
+    ColumnBase *c = this->table.internal->columns[i].get();
 
-            case TT_STR: {
-                result.push_back(static_cast<void *>(&(static_cast<ColumnStr *>(c.get()))->get(pos)));
-            } break;
+    if (TDB_TYPE(c->get_type()) == TT_INT) {
+        // TDB_INVALID_I is reserved to mark invalid ints.
+        if (value >= TDB_INVALID_I) {
+            this->error = 2;
+            --this->column;
+            return *this;
         }
+
+        static_cast<ColumnInt *>(c)->add(static_cast<int>(value));
+    }
+    else {
+        static_cast<ColumnUint *>(c)->add(value);
     }
 
-    return result;
+    return *this;
 }
 
-int InMemoryTable::add_row(std::vector<std::string> &args)
+RowBuilder &RowBuilder::add(std::string &&value)
 {
-    // NOTE: Do not pass ID column here.
-
-    // Returns 0 on success.
-    // Errors numbers:
-    // 1 - Args vector is too big/small.
-    // 2 - Argument of type 'int' is found to be
-    //     not convertible to int.
-    // 3 - Argument of type 'uint' is found to be
-    //     not convertible to size_t.
+    size_t i = this->next_column(TT_STR);
 
-    std::vector<int> types = this->get_types();
-
-    // Column count, ignoring ID.
-    if (args.size() != this->get_column_count() - 1) {
-        return 1;
+    if (i != TDB_NOT_FOUND) {
+        static_cast<ColumnStr *>(this->table.internal->columns[i].get())->add(std::move(value));
     }
 
-    std::vector<std::string>::iterator it = args.begin();
+    return *this;
+}
 
-    // TODO:
-    // This is just typechecking.
-    // Surely this can be compressed (Clueless)
-    for (size_t i = 1; i < this->get_column_count(); ++i) {
+RowBuilder &RowBuilder::add(std::string_view value)
+{
+    size_t i = this->next_column(TT_STR);
 
-        // Skip the ID column.
-        if (TDB_IS(types[i], TT_ID)) {
-            continue;
-        }
+    if (i != TDB_NOT_FOUND) {
+        static_cast<ColumnStr *>(this->table.internal->columns[i].get())->add(std::string(value));
+    }
 
-        switch (TDB_TYPE(types[i])) {
-            case TT_INT: {
-                int value = parse_int(*it++);
+    return *this;
+}
 
-                if (value == TDB_INVALID_I) {
-                    return 2;
-                }
-            } break;
+RowBuilder &RowBuilder::add(const char *value)
+{
+    return this->add(std::string_view(value));
+}
 
-            case TT_UINT: {
-                size_t value = parse_long_long(*it++);
+int RowBuilder::finish()
+{
+    this->lock();
 
-                if (value == TDB_INVALID_ULL) {
-                    return 3;
-                }
-            } break;
+    const std::vector<int> &types = this->table.get_types();
 
-            default: {
-                ++it;
-            }
-        }
+    while (this->column < types.size() && TDB_IS(types[this->column], TT_ID)) {
+        ++this->column;
     }
 
-    it = args.begin();
+    if (!this->error && this->column != types.size()) {
+        this->error = 1;
+    }
 
-    // TODO: Doesn't look like a transaction to me
-    // TODO: Removing rows that don't have a value in all columns?
-    for (size_t i = 0; i < this->get_column_count(); ++i) {
+    if (this->error) {
+        int error = this->error;
 
-        // NOTE: ID handling depends on get_next_id().
-        if (TDB_IS(types[i], TT_ID)) {
-            size_t new_id = this->get_next_id();
-            std::static_pointer_cast<ColumnUint>(this->internal->columns[i])->add(new_id);
-        }
+        this->rollback();
+        this->error = 0;
 
-        else if (TDB_IS(types[i], TT_INT)) {
-            int value = parse_int(*it++);
-            std::static_pointer_cast<ColumnInt>(this->internal->columns[i])->add(value);
-        }
+        return error;
+    }
 
-        else if (TDB_IS(types[i], TT_UINT)) {
-            size_t value = parse_long_long(*it++);
-            std::static_pointer_cast<ColumnUint>(this->internal->columns[i])->add(value);
-        }
+    // NOTE: ID handling depends on get_next_id().
+    size_t id_index = this->table.internal->parser->id_column_index();
+    size_t new_id   = this->table.get_next_id();
 
-        else if (TDB_IS(types[i], TT_STR)) {
-            std::static_pointer_cast<ColumnStr>(this->internal->columns[i])->add(*it++);
-        }
-    }
+    this->table.internal->own(id_index);
+    static_cast<ColumnUint *>(this->table.internal->columns[id_index].get())->add(new_id);
 
-    // TODO
-    this->internal->update_index();
+    size_t pos = this->table.get_row_count() - 1;
+
+    this->table.internal->insert_index(pos);
+    this->table.internal->touch_all();
+    this->table.internal->fold_inserted_row(pos);
+    this->table.internal->log_insert(pos);
+
+    // Row is complete, don't let destructor remove it.
+    this->column = 0;
+    this->unlock();
 
     return 0;
 }
 
-bool InMemoryTable::erase(const size_t &pos)
+// Rows scanned by first refill of SearchCursor. Every next refill scans
+// twice as many, up to TDB_PARTITION_ROWS.
+static constexpr size_t CURSOR_FIRST_ROWS = TDB_BLOCK_SIZE;
+
+struct SearchCursor::Private
 {
-    size_t len = this->internal->columns.size();
+    const InMemoryTable *table;
+    const ColumnBase *column;
+    // Folded copy of the column, if table had one.
+    const std::vector<std::string> *folded;
+    std::string query;
+    bool exact;
+    bool nocase;
+    std::vector<size_t> columns;
+
+    // Next row to scan, and how many rows next refill scans.
+    size_t row;
+    size_t step;
+    // Matches left to skip and to return.
+    size_t skip;
+    size_t left;
+
+    // Matches from last refill, returned from 'next_found' on.
+    std::vector<size_t> found;
+    size_t next_found;
+
+    // Scans next block of rows. Returns false when there are none.
+    bool refill()
+    {
+        size_t len = this->column->size();
 
-    if (pos >= this->get_row_count()) {
-        return false;
-    }
+        if (this->row >= len) {
+            return false;
+        }
 
-    // Erase data from all columns in one row.
-    for (size_t i = 0; i < len; ++i) {
-        this->internal->columns[i]->erase(pos);
-    }
+        size_t end = std::min(len, this->row + this->step);
 
-    // TODO
-    this->internal->update_index();
+        this->found.clear();
+        this->next_found = 0;
 
-    return true;
-}
+        std::string_view query = this->query;
+        bool exact             = this->exact;
 
-bool InMemoryTable::erase_id(const size_t &id)
-{
-    size_t result = this->search(id);
+        search_rows(*this->column, this->folded, this->nocase, this->row, end, this->found,
+                    [query, exact](std::string_view value) {
+                        return search_matches(value, query, exact);
+                    });
+
+        this->row  = end;
+        this->step = std::min<size_t>(this->step * 2, TDB_PARTITION_ROWS);
 
-    if (result != TDB_NOT_FOUND) {
-        this->erase(result);
         return true;
     }
+};
 
-    return false;
-}
-
-void InMemoryTable::clear()
+SearchCursor::SearchCursor(const InMemoryTable &table, const std::string &name,
+                           std::string_view query, int flags) :
+    internal(std::make_unique<Private>())
 {
-    for (std::shared_ptr<ColumnBase> &c : this->internal->columns) {
-        c->clear();
+    InMemoryTable::Private::Lock lock(*table.internal, false);
+
+    size_t column_index = table.search_column_index(name);
+
+    if (column_index == TDB_NOT_FOUND) {
+        throw std::logic_error("In ToiletDB, In SearchCursor constructor, Field '" +
+                               name + "' does not exist");
     }
 
-    this->internal->update_index();
-}
+    Private &p = *this->internal;
 
-size_t InMemoryTable::get_column_count() const
-{
-    return this->internal->columns.size();
+    p.table  = &table;
+    p.column = table.internal->columns[column_index].get();
+    p.exact  = flags & TS_EXACT;
+    p.nocase = (flags & TS_NOCASE) && TDB_TYPE(p.column->get_type()) == TT_STR;
+    p.folded = p.nocase ? table.internal->find_folded(column_index) : nullptr;
+    p.query  = p.nocase ? fold_case(query) : std::string(query);
+
+    p.columns.resize(table.get_column_count());
+    std::iota(p.columns.begin(), p.columns.end(), 0);
+
+    p.row        = 0;
+    p.step       = CURSOR_FIRST_ROWS;
+    p.skip       = 0;
+    p.left       = TDB_NO_LIMIT;
+    p.next_found = 0;
 }
 
-const std::vector<std::string> &InMemoryTable::get_column_names() const
+SearchCursor::SearchCursor(SearchCursor &&other) = default;
+
+SearchCursor &SearchCursor::operator=(SearchCursor &&other) = default;
+
+SearchCursor::~SearchCursor()
+{}
+
+SearchCursor &SearchCursor::offset(size_t count)
 {
-    return this->internal->parser->names();
+    this->internal->skip = count;
+    return *this;
 }
 
-const std::string &InMemoryTable::get_column_name(const size_t &pos) const
+SearchCursor &SearchCursor::limit(size_t count)
 {
-    if (pos > this->get_column_count()) {
-        throw std::logic_error(
-            "In ToiletDB, In InMemoryTable.get_column_name(), pos "
-            "is larger than column count");
-    }
-
-    return this->internal->parser->names()[pos];
+    this->internal->left = count;
+    return *this;
 }
 
-size_t InMemoryTable::search_column_index(const std::string &name) const
+SearchCursor &SearchCursor::select(const std::vector<std::string> &names)
 {
-    std::vector<size_t> result;
+    std::vector<size_t> columns;
 
-    size_t column_index = TDB_INVALID_ULL;
-    size_t i            = 0;
+    for (const std::string &name : names) {
+        size_t pos = this->internal->table->search_column_index(name);
 
-    for (const std::shared_ptr<ColumnBase> &c : this->internal->columns) {
-        if (c->get_name() == name) {
-            column_index = i;
-            break;
+        if (pos == TDB_NOT_FOUND) {
+            throw std::logic_error("In ToiletDB, In SearchCursor.select(), Field '" +
+                                   name + "' does not exist");
         }
-        ++i;
-    }
 
-    if (column_index == TDB_INVALID_ULL) {
-        return TDB_NOT_FOUND;
+        columns.push_back(pos);
     }
 
-    return column_index;
+    this->internal->columns = std::move(columns);
+
+    return *this;
 }
 
-const std::vector<int> &InMemoryTable::get_types() const
+const std::vector<size_t> &SearchCursor::get_columns() const
 {
-    return this->internal->parser->types();
+    return this->internal->columns;
 }
 
-const int &InMemoryTable::get_column_type(const size_t &pos) const
+size_t SearchCursor::next()
 {
-    if (pos > this->get_column_count()) {
-        throw std::logic_error(
-            "In ToiletDB, In InMemoryTable.get_column_type(), pos "
-            "is larger than column count");
-    }
+    Private &p = *this->internal;
 
-    return this->internal->parser->types()[pos];
-}
+    InMemoryTable::Private::Lock lock(*p.table->internal, false);
 
-size_t InMemoryTable::get_row_count() const
-{
-    if (!this->internal->columns[0]) {
-        throw std::logic_error(
-            "In ToiletDB, In InMemoryTable.size(), there is no columns");
-    }
+    while (p.left != 0) {
+        size_t available = p.found.size() - p.next_found;
 
-    return this->internal->columns[0]->size();
-}
+        if (available == 0) {
+            if (!p.refill()) {
+                break;
+            }
 
-size_t InMemoryTable::get_next_id() const
-{
-    // This should return valid and unique ID for a new row.
-    // add() uses this.
+            continue;
+        }
 
-    size_t i = 0;
+        // Skipped matches are dropped a block at a time.
+        if (p.skip != 0) {
+            size_t skipped = std::min(p.skip, available);
 
-    while (true) {
-        size_t next_id = this->get_row_count() + i;
-        if (this->search(next_id) == TDB_NOT_FOUND) {
-            TDB_DEBUGS(next_id, "InMemoryTable.get_next_id");
-            return next_id;
+            p.next_found += skipped;
+            p.skip -= skipped;
+
+            continue;
         }
-        ++i;
+
+        if (p.left != TDB_NO_LIMIT) {
+            --p.left;
+        }
+
+        return p.found[p.next_found++];
     }
+
+    return TDB_NOT_FOUND;
 }
 
 } // namespace toiletdb
@@ -2,22 +2,193 @@
 #define TOILET_IN_MEMORY_TABLE_H_
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 #include "debug.hpp"
 
+#include "cache.hpp"
 #include "common.hpp"
 #include "errors.hpp"
+#include "group.hpp"
+#include "join.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
 #include "parser.hpp"
+#include "pattern.hpp"
+#include "selection.hpp"
+#include "sort.hpp"
 #include "types.hpp"
 
 namespace toiletdb {
 
+class RowBuilder;
+class RowView;
+class RowRef;
+class SearchCursor;
+
+/**
+ * @brief Memory taken by a table, in bytes.
+ * @see InMemoryTable.memory_usage()
+ */
+struct MemoryUsage
+{
+    struct Entry
+    {
+        std::string name;
+        size_t bytes;
+    };
+
+    /// @brief One entry per column, in the same order as columns.
+    std::vector<Entry> columns;
+    /// @brief One entry per index, named after the column it indexes.
+    std::vector<Entry> indexes;
+    /// @brief Sum of everything above.
+    size_t total;
+    /// @brief Bytes currently allocated through table's memory resource.
+    size_t allocated;
+};
+
+/**
+ * @brief State of writing a table to its file.
+ * @see InMemoryTable.set_auto_flush()
+ */
+struct FlushStats
+{
+    /// @brief Whether background thread is running.
+    bool background;
+    /// @brief Changes made since rows were last written.
+    size_t pending;
+    /// @brief Milliseconds since oldest change that is not written yet, 0
+    ///        when there is none.
+    double lag_ms;
+    /// @brief Longest time a change waited to be written by flush().
+    double max_lag_ms;
+    /// @brief Milliseconds last write by flush() took.
+    double last_write_ms;
+    /// @brief Writes by flush() that were done and that failed.
+    size_t flushes;
+    size_t failures;
+    /// @brief Error of last write that failed.
+    std::string last_error;
+};
+
+/**
+ * @brief Count, sum, minimum, maximum and average of values of a numeric
+ *        column. T is int for 'int' columns and size_t for 'uint'.
+ * @see InMemoryTable.aggregate()
+ */
+template <typename T>
+struct Aggregate
+{
+    /// @brief Amount of values aggregated.
+    size_t count;
+    /// @brief Sum of values, long long for 'int' columns.
+    std::conditional_t<std::is_signed_v<T>, long long, size_t> sum;
+    /// @brief Set when sum did not fit into its type and wrapped around.
+    ///        Average is correct either way.
+    bool overflow;
+    /// @brief 0 when nothing was aggregated.
+    T min;
+    /// @brief 0 when nothing was aggregated.
+    T max;
+    /// @brief 0 when nothing was aggregated.
+    double avg;
+};
+
+/// @brief Aggregate of values of 'a' and 'b' together, e.g. of two tables.
+///        Sets overflow when sum of both doesn't fit into its type.
+Aggregate<int> merge_aggregates(const Aggregate<int> &a, const Aggregate<int> &b);
+Aggregate<size_t> merge_aggregates(const Aggregate<size_t> &a, const Aggregate<size_t> &b);
+
+/**
+ * @brief Result of InMemoryTable.group_by(). Groups are ordered by their
+ *        first row.
+ */
+struct Groups
+{
+    struct Values
+    {
+        /// @brief Name of column aggregated.
+        std::string name;
+        /// @brief One entry per group, set for 'int' columns.
+        std::vector<Aggregate<int>> ints;
+        /// @brief One entry per group, set for 'uint' columns.
+        std::vector<Aggregate<size_t>> uints;
+    };
+
+    /// @brief First row of each group. Values of key columns can be read
+    ///        from it.
+    std::vector<size_t> rows;
+    /// @brief Amount of rows in each group.
+    std::vector<size_t> counts;
+    /// @brief One entry per column aggregated, in the order they were passed.
+    std::vector<Values> values;
+};
+
+/**
+ * @brief How InMemoryTable.search() matches values against query. Bits can
+ *        be combined.
+ */
+enum ToiletSearch
+{
+    /// @brief Values starting with query match, which is the default.
+    TS_PREFIX = 0,
+    /// @brief Only values equal to query match.
+    TS_EXACT  = 1 << 0,
+    /// @brief Values of 'str' columns are compared after fold_case().
+    TS_NOCASE = 1 << 1,
+};
+
+/**
+ * @brief Direction of sorting.
+ */
+enum ToiletOrder
+{
+    TO_ASC,
+    TO_DESC,
+};
+
+/**
+ * @brief One column to sort by.
+ * @see InMemoryTable.sort_positions()
+ */
+struct SortKey
+{
+    std::string name;
+    ToiletOrder order;
+};
+
+/**
+ * @brief Pairs of rows with equal keys, result of InMemoryTable.join().
+ *        Pairs are ordered by 'rows', then by 'other_rows'.
+ */
+struct Joined
+{
+    /// @brief Positions of rows in the table join() was called on.
+    std::vector<size_t> rows;
+    /// @brief Positions of rows in the other table. Pair i is rows[i] and
+    ///        other_rows[i].
+    std::vector<size_t> other_rows;
+};
+
 /**
  * @class InMemoryTable
  * @brief Medium level abstraction representing one table.
@@ -29,6 +200,14 @@ private:
     struct Private;
     std::unique_ptr<Private> internal;
 
+    friend class RowBuilder;
+    friend class RowView;
+    friend class RowRef;
+    friend class SearchCursor;
+
+    // Makes a snapshot.
+    InMemoryTable(std::unique_ptr<Private> internal);
+
 public:
     /// @brief Opens up a file and loads it up into memory.
     /// @warning Does not create a file. Will throw an error.
@@ -36,9 +215,12 @@ public:
     /// @throws std::runtime_error when file does not exist.
     /// @throws ParsingError when parsing error is encountered.
     InMemoryTable(const std::string &filename);
+    /// @brief Same as above, but memory for values and index is taken from
+    ///        resource. Resource should outlive the table.
+    InMemoryTable(const std::string &filename, std::pmr::memory_resource *resource);
     ~InMemoryTable();
     /// @brief Discards all changes made to in-memory vector, and reads file
-    /// again.
+    /// again. Ends a transaction, if one was started.
     /// @throws std::runtime_error when table file was deleted or moved.
     void reread_file();
     /// @brief Writes data stored in memory back to the file.
@@ -46,6 +228,9 @@ public:
     void write_file() const;
     /// @brief Writes data stored in memory back to the file specified.
     void write_file(const std::string &filepath) const;
+    /// @brief Same as above, but only rows selected are written.
+    /// @throws std::logic_error when selection is of different row count.
+    void write_file(const std::string &filepath, const Selection &selection) const;
     /// @brief Search in-memory vector by ID.
     /// O(log n)
     /// @return TDB_NOT_FOUND if element is not found.
@@ -53,17 +238,117 @@ public:
     /// @brief Search in-memory vector by comparing values as std::string.
     /// O(n)
     /// @return TDB_NOT_FOUND if element is not found.
+    /// @see set_search_cache(), SearchCursor
     std::vector<size_t> search(const std::string &name,
                                std::string &query) const;
+    /// @brief Same as above, with matching set by 'flags'.
+    ///        With TS_NOCASE, a case-folded copy of the column is made on
+    ///        first use and kept in sync with edits afterwards.
+    /// @see ToiletSearch
+    std::vector<size_t> search(const std::string &name, std::string_view query,
+                               int flags) const;
+    /// @brief Positions of rows with values matching 'pattern', in order of
+    ///        rows. Numbers are matched by their decimal representation.
+    ///        Case-insensitive patterns use the same folded copy of 'str'
+    ///        columns as TS_NOCASE.
+    std::vector<size_t> search(const std::string &name, const Pattern &pattern) const;
+    /// @brief Positions of rows with ID from 'min' to 'max' inclusive, in
+    ///        order of IDs.
+    /// O(log n + k)
+    std::vector<size_t> search_range(const size_t &min, const size_t &max) const;
+    /// @brief Amount of rows search_range() would return.
+    /// O(log n)
+    size_t count_range(const size_t &min, const size_t &max) const;
+    /// @brief Selects rows where value of 'int' or 'uint' column satisfies
+    ///        'op' against 'a' ('a' and 'b' for TC_BETWEEN).
+    ///        Values are compared as numbers, so passing negative values for
+    ///        'uint' columns is fine.
+    ///        O(n), compares many values at a time when CPU supports it.
+    /// @throws std::logic_error when column does not exist or is not numeric.
+    Selection filter(const std::string &name, ToiletCompare op, int a,
+                     int b = 0) const;
+    /// @brief Same as above, for values that don't fit into int.
+    Selection filter(const std::string &name, ToiletCompare op, size_t a,
+                     size_t b = 0) const;
+    /// @brief Same as above, for 'str' columns. Strings are compared byte by
+    ///        byte, like std::string does.
+    /// @throws std::logic_error when column does not exist or is not 'str'.
+    Selection filter(const std::string &name, ToiletCompare op,
+                     std::string_view a, std::string_view b = {}) const;
+    /// @brief Count, sum, minimum, maximum and average of column 'name'.
+    ///        T should be int for 'int' columns and size_t for 'uint'.
+    ///        If selection is passed, only rows selected are aggregated.
+    ///        O(n), large tables are split between threads.
+    /// @throws std::logic_error when column does not exist, T does not match
+    ///         its type, or selection is of different row count.
+    /// @see filter()
+    template <typename T>
+    Aggregate<T> aggregate(const std::string &name,
+                           const Selection *selection = nullptr) const;
+    /// @brief Splits rows into groups with equal values of 'keys' columns,
+    ///        and aggregates 'columns' of each group. Keys can be of any type,
+    ///        aggregated columns should be 'int' or 'uint'.
+    ///        If selection is passed, only rows selected are grouped.
+    ///        O(n), large tables are split between threads.
+    /// @throws std::logic_error when columns don't exist, there are no keys,
+    ///         or selection is of different row count.
+    /// @see aggregate()
+    Groups group_by(const std::vector<std::string> &keys,
+                    const std::vector<std::string> &columns = {},
+                    const Selection *selection = nullptr) const;
+    /// @brief Pairs every row of this table with rows of 'other' whose value
+    ///        of 'other_name' equals value of 'name'. Keys should both be 'str',
+    ///        or both be 'int' or 'uint'.
+    ///        Hash table is built from the smaller table and probed with rows
+    ///        of the larger one, large tables are split between threads.
+    ///        O(n + m + pairs)
+    /// @throws std::logic_error when columns don't exist or can't be compared.
+    Joined join(const std::string &name, const InMemoryTable &other,
+                const std::string &other_name) const;
+    /// @brief Positions of rows sorted by column 'name'. Only first 'limit'
+    ///        positions are returned, which is cheaper than sorting all of
+    ///        them. Rows with equal values are kept in order of positions.
+    ///        If selection is passed, only rows selected are sorted.
+    ///        O(n) for full sorts of numeric columns, O(n log n) otherwise.
+    /// @throws std::logic_error when column does not exist, or selection is
+    ///         of different row count.
+    std::vector<size_t> sort_positions(const std::string &name,
+                                       ToiletOrder order = TO_ASC,
+                                       size_t limit = TDB_NO_LIMIT,
+                                       const Selection *selection = nullptr) const;
+    /// @brief Same as above, by several columns. Rows equal by first key
+    ///        are compared by the next one, and so on.
+    /// @throws std::logic_error when there are no keys.
+    std::vector<size_t> sort_positions(const std::vector<SortKey> &keys,
+                                       size_t limit = TDB_NO_LIMIT,
+                                       const Selection *selection = nullptr) const;
     /// @brief Get copy of a row from vector as strings.
     ///        One row means a value from each column.
     const std::vector<std::string> get_row(const size_t &pos) const;
+    /// @brief Same as above, for row with this ID. Row is found and read
+    ///        under one lock, so it can't move in between in concurrent mode.
+    /// @returns Empty vector when there is no such row.
+    std::vector<std::string> get_row_by_id(size_t id) const;
     /// @brief Get one row from vector.
     ///        One row means a value from each column.
     /// @warning You will need to get types and cast them yourself.
+    ///          Table can't see writes through these pointers, so it stops
+    ///          caching search results and case-folded values for good once
+    ///          this is called. Snapshots made after that copy values
+    ///          instead of sharing them, and don't see later writes through
+    ///          these pointers. 'uint' columns are decompressed.
+    ///          Use RowRef to edit rows instead.
     /// @see get_types()
     /// @see get_column_type()
+    /// @see get_row_ref()
     std::vector<void *> unsafe_get_mut_row(const size_t &pos);
+    /// @brief Get a view of one row, that reads values straight from columns.
+    ///        Does not allocate or copy anything.
+    /// @see RowView
+    RowView get_row_view(const size_t &pos) const;
+    /// @brief Same as get_row_view(), but values can be changed.
+    /// @see RowRef
+    RowRef get_row_ref(const size_t &pos);
     /// @brief Adds one row. Converts strings to appropriate types.
     ///        One row means a value from each column *EXCEPT* ID.
     /// @warning ID row for new entry will be set automatically.
@@ -74,9 +359,21 @@ public:
     ///              not convertible to int.
     ///          3 - Argument of type 'uint' is found to be
     ///              not convertible to size_t.
+    ///          Row is either added whole, or not at all, even if this throws.
     /// @see get_types()
     /// @see get_column_type()
     int add_row(std::vector<std::string> &args);
+    /// @brief Same as above, but row gets 'id' instead of get_next_id().
+    /// @returns Same error codes as above, and
+    ///          4 - Row with 'id' already exists.
+    int add_row(std::vector<std::string> &args, size_t id);
+    /// @brief Adds one row from typed values, without converting them to
+    ///        strings and back. Strings passed as rvalues are moved.
+    ///        Same rules as add_row() apply: skip the ID column.
+    /// @returns Same error codes as RowBuilder.finish().
+    /// @see RowBuilder
+    template <typename... Args>
+    int emplace_row(Args &&...args);
     /// @brief Erases element with ID.
     bool erase_id(const size_t &id);
     /// @brief Erases element at pos.
@@ -97,8 +394,301 @@ public:
     size_t get_row_count() const;
     /// @return Suitable ID for a new element.
     size_t get_next_id() const;
+    /// @brief Compresses 'uint' columns, choosing the narrowest encoding for
+    ///        each of them. Stays in effect after reread_file().
+    ///        Rows added later are kept uncompressed until next compact().
+    ///        Tables are not compressed on load unless this was called,
+    ///        since erasing rows from a compressed column decompresses it
+    ///        whole, which tables that change often would pay for again
+    ///        and again. Call it on tables that are mostly read.
+    /// @warning Erasing values decompresses the column again. Edits keep
+    ///          it compressed.
+    void compact();
+    /// @brief Memory taken by the table, broken down by column and index.
+    MemoryUsage memory_usage() const;
+    /// @brief Sets amount of threads scans of this table are split between.
+    ///        0 means default set by set_default_thread_count().
+    void set_thread_count(size_t threads);
+    /// @brief Amount set by set_thread_count(), 0 if it wasn't.
+    size_t get_thread_count() const;
+    /// @brief Keeps results of search() by column name and query, up to
+    ///        'bytes' in total, dropping least recently used ones past that.
+    ///        Results are dropped once rows are added, erased or edited, or
+    ///        file is reread. 0 disables the cache, which is the default.
+    void set_search_cache(size_t bytes);
+    CacheStats get_search_cache_stats() const;
+    /// @brief In concurrent mode, table can be used from several threads at
+    ///        once. Methods that only read take a shared lock, and methods
+    ///        that change rows take an exclusive one, for the duration of the
+    ///        call. Same goes for each RowView.get(), RowRef.set() and
+    ///        SearchCursor call. RowBuilder holds the lock from first value
+    ///        of a row until it is finished.
+    ///        Off by default, should be set before table is shared.
+    /// @warning Positions returned by one call can be outdated by the time
+    ///          they are passed to another, if rows were erased in between.
+    ///          RowView.get() throws when its row is gone, but values it
+    ///          returns one by one can come from different writes, and
+    ///          std::string_view it returns is only valid until the row is
+    ///          changed. Readers that need several values or rows as they
+    ///          were at one point should read them from snapshot().
+    ///          References returned by get_column_names() and get_types()
+    ///          are not protected.
+    void set_concurrent(bool concurrent);
+    bool is_concurrent() const;
+    /// @brief Read-only copy of the table as it is now, which later changes
+    ///        to the table don't affect. Columns and index are shared until
+    ///        the table changes them, so readers of a snapshot never wait
+    ///        for writers and writers never wait for them. Same snapshot is
+    ///        returned, without locking, until rows change.
+    ///        Rows added while a snapshot is used don't copy anything, as
+    ///        long as their IDs are larger than the others. First edit or
+    ///        erase of a column while a snapshot still uses it copies the
+    ///        column, so those are cheapest when made in batches between
+    ///        snapshots.
+    ///        Outside of concurrent mode, one thread may change the table
+    ///        while others take snapshots of it and read them.
+    /// @throws std::logic_error when a row is being built on this thread.
+    /// @warning Resource passed to the constructor should outlive snapshots
+    ///          too, and be thread-safe if they are released on other
+    ///          threads.
+    std::shared_ptr<const InMemoryTable> snapshot() const;
+    /// @brief Starts a transaction. Inserts, erases and edits made until
+    ///        commit() or rollback() are recorded in an undo log, by every
+    ///        thread, and are visible to readers right away.
+    ///        Rows are not written by flush(), the background thread or
+    ///        prepare_write() until transaction is over. Writes that were due
+    ///        in the meantime are made then. Transaction that is still open
+    ///        when the table is destroyed is rolled back.
+    /// @throws std::logic_error when a transaction is already started.
+    void begin();
+    /// @brief Keeps changes made since begin() and drops the undo log.
+    ///        Does not write the file.
+    /// @throws std::logic_error when no transaction was started.
+    void commit();
+    /// @brief Undoes changes made since begin(), newest first. Takes time
+    ///        proportional to the changes rather than to the table. Unless
+    ///        rows were written in the meantime, table is left as unchanged
+    ///        as it was at begin(), cached search results included.
+    /// @throws std::logic_error when no transaction was started.
+    void rollback();
+    bool in_transaction() const;
+    /// @brief Starts a background thread that writes the table to its file
+    ///        'delay' milliseconds after first unwritten change, or once
+    ///        'changes' changes pile up, whichever comes first. 0 turns
+    ///        either condition off, and 0 for both stops the thread.
+    ///        Rows are written from a snapshot, so they can change in the
+    ///        meantime. Unwritten changes are written when the thread is
+    ///        stopped or the table is destroyed.
+    ///        Should be called from one thread at a time.
+    /// @see flush(), get_flush_stats()
+    void set_auto_flush(size_t delay, size_t changes);
+    /// @brief Writes changes made so far to the file, from a snapshot.
+    ///        With background thread running, asks it to write right away,
+    ///        and waits for that unless 'wait' is unset. Otherwise writes on
+    ///        calling thread. Does nothing while a transaction is open.
+    /// @throws std::runtime_error when the write failed.
+    /// @throws std::logic_error when a row is being built on this thread.
+    void flush(bool wait = true);
+    FlushStats get_flush_stats() const;
+    /// @brief First half of a write that can be called off. Writes rows as
+    ///        they are now to 'filepath', from a snapshot, and returns their
+    ///        version to pass to finish_write(). Returns 0 and writes
+    ///        nothing when table file has these rows already, or while a
+    ///        transaction is open.
+    /// @throws Same as write_file(), and std::logic_error when a row is
+    ///         being built on this thread.
+    size_t prepare_write(const std::string &filepath) const;
+    /// @brief Second half: moves file written by prepare_write() over the
+    ///        table file, and counts its rows as written. File is removed
+    ///        instead when newer rows were written in the meantime.
+    /// @throws std::runtime_error when file can't be moved.
+    /// @throws std::logic_error when a row is being built on this thread.
+    void finish_write(const std::string &filepath, size_t version) const;
+};
+
+template <>
+Aggregate<int> InMemoryTable::aggregate<int>(const std::string &name,
+                                             const Selection *selection) const;
+template <>
+Aggregate<size_t> InMemoryTable::aggregate<size_t>(const std::string &name,
+                                                   const Selection *selection) const;
+
+/**
+ * @class RowView
+ * @brief Reference to one row of a table. Costs as much as a pointer and a
+ *        position, values are read straight from columns.
+ * @warning Is invalidated by erasing rows, clear() and reread_file().
+ */
+class RowView
+{
+protected:
+    const InMemoryTable *table;
+    size_t pos;
+
+    const ColumnBase &column(size_t column, int type) const;
+
+public:
+    /// @throws std::logic_error when pos is larger than row count.
+    RowView(const InMemoryTable &table, size_t pos);
+    size_t get_pos() const;
+    /// @brief Value of a column in this row. T should be int for 'int'
+    ///        columns, size_t for 'uint', and std::string_view for 'str'.
+    ///        Returned std::string_view is valid until the row is changed.
+    /// @throws std::logic_error when T does not match type of the column,
+    ///         or when pos is past the rows left.
+    /// @see InMemoryTable.set_concurrent()
+    template <typename T>
+    T get(size_t column) const;
+};
+
+template <>
+int RowView::get<int>(size_t column) const;
+template <>
+size_t RowView::get<size_t>(size_t column) const;
+template <>
+std::string_view RowView::get<std::string_view>(size_t column) const;
+
+/**
+ * @class RowRef
+ * @brief RowView that can also change values.
+ * @warning Is invalidated by erasing rows, clear() and reread_file().
+ */
+class RowRef : public RowView
+{
+public:
+    RowRef(InMemoryTable &table, size_t pos);
+    /// @brief Sets 'int' column. Non-negative values can be set to 'uint'.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, int value);
+    /// @brief Sets 'uint' column. Values that fit can be set to 'int'.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, size_t value);
+    /// @brief Sets 'str' column, moving the string into it.
+    /// @throws std::logic_error when column is 'const' or types don't match.
+    void set(size_t column, std::string value);
+};
+
+/**
+ * @class RowBuilder
+ * @brief Appends one row to a table value by value, checking every value
+ *        against get_types(). Values are written straight into columns.
+ *        Unfinished rows are removed when builder is destroyed.
+ *        One RowBuilder can be reused for several rows.
+ * @warning ID column is skipped, it will be set automatically.
+ */
+class RowBuilder
+{
+private:
+    InMemoryTable &table;
+    size_t column;
+    int error;
+    bool locked;
+
+    size_t next_column(int type);
+    RowBuilder &reject(int type);
+    void rollback();
+    void lock();
+    void unlock();
+
+public:
+    RowBuilder(InMemoryTable &table);
+    ~RowBuilder();
+    /// @brief Sets next column of type 'int'. Non-negative values are also
+    ///        accepted by 'uint' columns.
+    RowBuilder &add(int value);
+    /// @brief Sets next column of type 'uint'. Values that fit are also
+    ///        accepted by 'int' columns.
+    RowBuilder &add(size_t value);
+    /// @brief Sets next numeric column from any other integer type, the
+    ///        way add(int) does for signed and add(size_t) for unsigned
+    ///        values. Values too big for both are rejected as not
+    ///        convertible.
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> &&
+                                                      !std::is_same_v<T, bool> &&
+                                                      !std::is_same_v<T, char>>>
+    RowBuilder &add(T value);
+    /// @brief Sets next column of type 'str', moving the string into it.
+    RowBuilder &add(std::string &&value);
+    /// @brief Sets next column of type 'str'.
+    RowBuilder &add(std::string_view value);
+    RowBuilder &add(const char *value);
+    /// @brief Adds ID to the row and makes it visible.
+    /// @returns Returns 0 on success, otherwise the row is discarded.
+    ///          1 - Too many/not enough values.
+    ///          2 - Value is found to be not convertible to int.
+    ///          3 - Value is found to be not convertible to size_t.
+    ///          4 - String was passed to a numeric column, or a number was
+    ///              passed to 'str' column.
+    int finish();
+};
+
+/**
+ * @class SearchCursor
+ * @brief Matches of InMemoryTable.search(), found one by one as they are
+ *        asked for. Rows are scanned in blocks that grow as the cursor goes
+ *        on, so first matches are returned without reading the whole column,
+ *        and nothing is read once limit() is reached.
+ * @warning Is invalidated by any change to the table.
+ */
+class SearchCursor
+{
+private:
+    struct Private;
+    std::unique_ptr<Private> internal;
+
+public:
+    /// @brief Matches 'query' against column 'name' the way
+    ///        InMemoryTable.search() does. With TS_NOCASE, values are folded
+    ///        as they are read unless the table already has a folded copy.
+    /// @throws std::logic_error when column does not exist.
+    SearchCursor(const InMemoryTable &table, const std::string &name,
+                 std::string_view query, int flags = TS_PREFIX);
+    SearchCursor(SearchCursor &&other);
+    SearchCursor &operator=(SearchCursor &&other);
+    ~SearchCursor();
+    /// @brief Skips first 'count' matches.
+    SearchCursor &offset(size_t count);
+    /// @brief Stops after 'count' matches. There is no limit by default.
+    SearchCursor &limit(size_t count);
+    /// @brief Columns callers should read from matched rows, all of them by
+    ///        default. Only changes what get_columns() returns.
+    /// @throws std::logic_error when column does not exist.
+    SearchCursor &select(const std::vector<std::string> &names);
+    /// @brief Positions of columns set by select().
+    const std::vector<size_t> &get_columns() const;
+    /// @brief Position of next match, in order of rows.
+    /// @return TDB_NOT_FOUND when there are no more matches.
+    size_t next();
 };
 
+template <typename T, typename>
+RowBuilder &RowBuilder::add(T value)
+{
+    if constexpr (std::is_signed_v<T>) {
+        if (static_cast<T>(static_cast<int>(value)) == value) {
+            return this->add(static_cast<int>(value));
+        }
+
+        if (value < 0) {
+            return this->reject(TT_INT);
+        }
+    }
+
+    if (static_cast<T>(static_cast<size_t>(value)) != value) {
+        return this->reject(TT_UINT);
+    }
+
+    return this->add(static_cast<size_t>(value));
+}
+
+template <typename... Args>
+int InMemoryTable::emplace_row(Args &&...args)
+{
+    RowBuilder row(*this);
+    (row.add(std::forward<Args>(args)), ...);
+    return row.finish();
+}
+
 } // namespace toiletdb
 
 #endif // TOILET_IN_MEMORY_TABLE_H_
@@ -14,19 +14,14 @@ class ColumnBase;
 template <typename T>
 class Column;
 
-ColumnInt::ColumnInt(std::string name, int type)
+ColumnInt::ColumnInt(std::string name, int type, std::pmr::memory_resource *resource) :
+    data(resource)
 {
     TDB_DEBUGS(name, "ColumnInt name");
     TDB_DEBUGS(type, "ColumnInt type");
 
     this->name = name;
     this->type = type;
-    this->data = new std::vector<int>;
-}
-
-ColumnInt::~ColumnInt()
-{
-    delete this->data;
 }
 
 const int &ColumnInt::get_type() const
@@ -41,22 +36,48 @@ const std::string &ColumnInt::get_name() const
 
 size_t ColumnInt::size() const
 {
-    return this->data->size();
+    return this->data.size();
+}
+
+size_t ColumnInt::bytes() const
+{
+    return sizeof(*this) + sizeof(std::pmr::vector<int>) + this->data.capacity() * sizeof(int);
+}
+
+std::shared_ptr<ColumnBase> ColumnInt::clone() const
+{
+    auto clone = std::make_shared<ColumnInt>(this->name, this->type, this->data.resource());
+
+    clone->data.get().assign(this->data.begin(), this->data.end());
+
+    return clone;
+}
+
+std::shared_ptr<ColumnBase> ColumnInt::share() const
+{
+    auto view = std::make_shared<ColumnInt>(this->name, this->type, this->data.resource());
+
+    view->data = this->data.share();
+
+    return view;
 }
 
 void ColumnInt::erase(size_t pos)
 {
-    this->data->erase(this->data->begin() + pos);
+    std::pmr::vector<int> &values = this->data.get();
+
+    values.erase(values.begin() + pos);
 }
 
 void ColumnInt::clear()
 {
-    this->data->clear();
+    // Views keep old values.
+    this->data = SharedValues<int>(this->data.resource());
 }
 
 void ColumnInt::add(int data)
 {
-    this->data->push_back(data);
+    this->data.push_back(data);
 }
 
 int &ColumnInt::get(size_t pos)
@@ -65,27 +86,32 @@ int &ColumnInt::get(size_t pos)
         throw std::logic_error("In ToiletDB, In Column, pos > size of vector");
     }
 
-    return (*(this->data))[pos];
+    return this->data.get()[pos];
 }
 
-std::vector<int> &ColumnInt::get_data()
+std::pmr::vector<int> &ColumnInt::get_data()
 {
-    return *(this->data);
+    return this->data.get();
 }
 
-ColumnUint::ColumnUint(const std::string name, int type)
+const SharedValues<int> &ColumnInt::get_data() const
+{
+    return this->data;
+}
+
+const int &ColumnInt::value(size_t pos) const
+{
+    return this->data[pos];
+}
+
+ColumnUint::ColumnUint(const std::string name, int type, std::pmr::memory_resource *resource) :
+    data(resource)
 {
     TDB_DEBUGS(name, "ColumnB_Int name");
     TDB_DEBUGS(type, "ColumnB_Int type");
 
     this->name = name;
     this->type = type;
-    this->data = new std::vector<size_t>;
-}
-
-ColumnUint::~ColumnUint()
-{
-    delete this->data;
 }
 
 const int &ColumnUint::get_type() const
@@ -100,22 +126,84 @@ const std::string &ColumnUint::get_name() const
 
 size_t ColumnUint::size() const
 {
-    return this->data->size();
+    if (this->packed) {
+        return this->packed->size() + this->data.size();
+    }
+
+    return this->data.size();
+}
+
+size_t ColumnUint::bytes() const
+{
+    size_t bytes = sizeof(*this) + sizeof(std::pmr::vector<size_t>) +
+                   this->data.capacity() * sizeof(size_t);
+
+    if (this->packed) {
+        bytes += this->packed->bytes();
+    }
+
+    return bytes;
+}
+
+std::shared_ptr<ColumnBase> ColumnUint::clone() const
+{
+    auto clone = std::make_shared<ColumnUint>(this->name, this->type, this->data.resource());
+
+    clone->data.get().assign(this->data.begin(), this->data.end());
+    clone->packed = this->packed;
+
+    return clone;
+}
+
+std::shared_ptr<ColumnBase> ColumnUint::share() const
+{
+    auto view = std::make_shared<ColumnUint>(this->name, this->type, this->data.resource());
+
+    view->data   = this->data.share();
+    view->packed = this->packed;
+
+    return view;
 }
 
 void ColumnUint::erase(size_t pos)
 {
-    this->data->erase(this->data->begin() + pos);
+    // Values added after pack() can be erased without unpacking.
+    if (this->packed && pos >= this->packed->size()) {
+        pos -= this->packed->size();
+    }
+    else {
+        this->unpack();
+    }
+
+    std::pmr::vector<size_t> &values = this->data.get();
+
+    values.erase(values.begin() + pos);
 }
 
 void ColumnUint::clear()
 {
-    this->data->clear();
+    this->packed.reset();
+    this->data = SharedValues<size_t>(this->data.resource());
 }
 
 void ColumnUint::add(size_t data)
 {
-    this->data->push_back(data);
+    this->data.push_back(data);
+}
+
+// Packed values to be changed, copied first if a clone still uses them.
+PackedUints &ColumnUint::own_packed()
+{
+    if (this->packed.use_count() > 1) {
+        this->packed = this->packed->clone();
+    }
+    else {
+        // Pairs with release of the last clone that used them on some
+        // other thread.
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    return *(this->packed);
 }
 
 size_t &ColumnUint::get(size_t pos)
@@ -124,27 +212,142 @@ size_t &ColumnUint::get(size_t pos)
         throw std::logic_error("In ToiletDB, In Column, pos > size of vector");
     }
 
-    return (*(this->data))[pos];
+    size_t packed_size = this->packed ? this->packed->size() : 0;
+
+    if (pos >= packed_size) {
+        return this->data.get()[pos - packed_size];
+    }
+
+    return this->own_packed().get_mut(pos);
+}
+
+void ColumnUint::set(size_t pos, size_t value)
+{
+    if (pos >= this->size()) {
+        throw std::logic_error("In ToiletDB, In Column, pos > size of vector");
+    }
+
+    size_t packed_size = this->packed ? this->packed->size() : 0;
+
+    if (pos >= packed_size) {
+        this->data.get()[pos - packed_size] = value;
+        return;
+    }
+
+    this->own_packed().set(pos, value);
+}
+
+std::pmr::vector<size_t> &ColumnUint::get_data()
+{
+    this->unpack();
+
+    return this->data.get();
+}
+
+void ColumnUint::pack()
+{
+    // Values added after last pack() are in data.
+    this->unpack();
+
+    this->packed = PackedUints::encode(this->data.data(), this->data.size(),
+                                       this->data.resource());
+
+    if (this->packed) {
+        this->data = SharedValues<size_t>(this->data.resource());
+    }
+}
+
+void ColumnUint::unpack()
+{
+    if (!this->packed) {
+        return;
+    }
+
+    std::pmr::vector<size_t> values(this->size(), this->data.resource());
+
+    size_t packed_size = this->packed->size();
+
+    this->packed->decode(0, packed_size, values.data());
+    std::copy(this->data.begin(), this->data.end(), values.begin() + packed_size);
+
+    this->data = SharedValues<size_t>(std::move(values));
+    this->packed.reset();
+}
+
+bool ColumnUint::is_packed() const
+{
+    return this->packed != nullptr;
+}
+
+size_t ColumnUint::value(size_t pos) const
+{
+    if (!this->packed) {
+        return this->data[pos];
+    }
+
+    size_t packed_size = this->packed->size();
+
+    if (pos < packed_size) {
+        return this->packed->get(pos);
+    }
+
+    return this->data[pos - packed_size];
+}
+
+const size_t *ColumnUint::read(size_t first, size_t count, size_t *scratch) const
+{
+    size_t packed_size = this->packed ? this->packed->size() : 0;
+
+    if (first >= packed_size) {
+        return this->data.data() + (first - packed_size);
+    }
+
+    if (first + count <= packed_size) {
+        this->packed->decode(first, count, scratch);
+        return scratch;
+    }
+
+    // Part of the values is packed, and part is not.
+    size_t from_packed = packed_size - first;
+
+    this->packed->decode(first, from_packed, scratch);
+    std::copy(this->data.begin(), this->data.begin() + (count - from_packed),
+              scratch + from_packed);
+
+    return scratch;
 }
 
-std::vector<size_t> &ColumnUint::get_data()
+void ColumnUint::compare(size_t first, size_t count, ToiletCompare op, size_t a,
+                         size_t b, uint64_t *out) const
 {
-    return *(this->data);
+    size_t packed_size = this->packed ? this->packed->size() : 0;
+
+    if (first + count <= packed_size) {
+        this->packed->compare(first, count, op, a, b, out);
+        return;
+    }
+
+    if (first >= packed_size) {
+        compare_uints(this->data.data() + (first - packed_size), count, op, a, b, out);
+        return;
+    }
+
+    size_t scratch[TDB_PACK_GROUP];
+
+    for (size_t pos = 0; pos < count; pos += TDB_PACK_GROUP, ++out) {
+        size_t len = std::min<size_t>(TDB_PACK_GROUP, count - pos);
+        compare_uints(this->read(first + pos, len, scratch), len, op, a, b, out);
+    }
 }
 
-ColumnStr::ColumnStr(std::string name, int type)
+ColumnStr::ColumnStr(std::string name, int type, std::pmr::memory_resource *resource) :
+    data(resource)
 {
     TDB_DEBUGS(name, "ColumnStr name");
     TDB_DEBUGS(type, "ColumnStr type");
 
     this->name = name;
     this->type = type;
-    this->data = new std::vector<std::string>;
-}
-
-ColumnStr::~ColumnStr()
-{
-    delete this->data;
 }
 
 const int &ColumnStr::get_type() const
@@ -159,22 +362,60 @@ const std::string &ColumnStr::get_name() const
 
 size_t ColumnStr::size() const
 {
-    return this->data->size();
+    return this->data.size();
+}
+
+size_t ColumnStr::bytes() const
+{
+    size_t bytes = sizeof(*this) + sizeof(std::pmr::vector<std::string>) +
+                   this->data.capacity() * sizeof(std::string);
+
+    // Short strings are stored inside std::string itself.
+    std::string empty;
+
+    for (const std::string &s : this->data) {
+        if (s.capacity() > empty.capacity()) {
+            bytes += s.capacity() + 1;
+        }
+    }
+
+    return bytes;
+}
+
+std::shared_ptr<ColumnBase> ColumnStr::clone() const
+{
+    auto clone = std::make_shared<ColumnStr>(this->name, this->type, this->data.resource());
+
+    clone->data.get().assign(this->data.begin(), this->data.end());
+
+    return clone;
+}
+
+std::shared_ptr<ColumnBase> ColumnStr::share() const
+{
+    auto view = std::make_shared<ColumnStr>(this->name, this->type, this->data.resource());
+
+    view->data = this->data.share();
+
+    return view;
 }
 
 void ColumnStr::erase(size_t pos)
 {
-    this->data->erase(this->data->begin() + pos);
+    std::pmr::vector<std::string> &values = this->data.get();
+
+    values.erase(values.begin() + pos);
 }
 
 void ColumnStr::clear()
 {
-    this->data->clear();
+    // Views keep old values.
+    this->data = SharedValues<std::string>(this->data.resource());
 }
 
 void ColumnStr::add(std::string data)
 {
-    this->data->push_back(data);
+    this->data.push_back(std::move(data));
 }
 
 std::string &ColumnStr::get(size_t pos)
@@ -183,12 +424,22 @@ std::string &ColumnStr::get(size_t pos)
         throw std::logic_error("In ToiletDB, In Column, pos > size of vector");
     }
 
-    return (*(this->data))[pos];
+    return this->data.get()[pos];
+}
+
+std::pmr::vector<std::string> &ColumnStr::get_data()
+{
+    return this->data.get();
+}
+
+const SharedValues<std::string> &ColumnStr::get_data() const
+{
+    return this->data;
 }
 
-std::vector<std::string> &ColumnStr::get_data()
+const std::string &ColumnStr::value(size_t pos) const
 {
-    return *(this->data);
+    return this->data[pos];
 }
 
 } // namespace toiletdb
@@ -1,16 +1,24 @@
 #ifndef TOILET_TYPES_H_
 #define TOILET_TYPES_H_
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
 #include "debug.hpp"
 
 #include "common.hpp"
+#include "encoding.hpp"
 
 #define TOILETDB_PARSER_FORMAT_VERSION 1
 #define TOILETDB_MAGIC "tdb"
 
+/// @brief Amount of values handed out at once by for_each_block().
+#define TDB_BLOCK_SIZE 1024
+
 /// @brief Type mask for ToiletType
 #define TDB_TMASK 0b00000111
 /// @brief Modifier mask for ToiletType
@@ -64,6 +72,122 @@ struct TableInfo
     std::vector<int> types;
 };
 
+/**
+ * @brief Values of a column or index that snapshots share instead of
+ *        copying. A view made by share() sees as many values as there were
+ *        then, so values added after those go in place while vector has
+ *        room for them. Any other change copies values first while a view
+ *        still uses them.
+ */
+template <typename T>
+class SharedValues
+{
+    std::shared_ptr<std::pmr::vector<T>> values;
+    // Amount of values this view sees, TDB_INVALID_ULL when it sees all of
+    // them and is the one adding them.
+    size_t frozen;
+
+    SharedValues(std::shared_ptr<std::pmr::vector<T>> values, size_t frozen) :
+        values(std::move(values)), frozen(frozen)
+    {}
+
+public:
+    using value_type = T;
+
+    explicit SharedValues(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        values(std::make_shared<std::pmr::vector<T>>(resource)), frozen(TDB_INVALID_ULL)
+    {}
+
+    explicit SharedValues(std::pmr::vector<T> &&values) :
+        values(std::make_shared<std::pmr::vector<T>>(std::move(values))), frozen(TDB_INVALID_ULL)
+    {}
+
+    SharedValues(SharedValues &&other)            = default;
+    SharedValues &operator=(SharedValues &&other) = default;
+    SharedValues(const SharedValues &)            = delete;
+    SharedValues &operator=(const SharedValues &) = delete;
+
+    size_t size() const
+    {
+        return this->frozen == TDB_INVALID_ULL ? this->values->size() : this->frozen;
+    }
+
+    size_t capacity() const
+    {
+        return this->values->capacity();
+    }
+
+    std::pmr::memory_resource *resource() const
+    {
+        return this->values->get_allocator().resource();
+    }
+
+    const T *data() const
+    {
+        return this->values->data();
+    }
+
+    const T *begin() const
+    {
+        return this->data();
+    }
+
+    const T *end() const
+    {
+        return this->data() + this->size();
+    }
+
+    const T &operator[](size_t pos) const
+    {
+        return this->data()[pos];
+    }
+
+    /// @brief View of values there are now. Later changes don't affect it.
+    SharedValues share() const
+    {
+        return SharedValues(this->values, this->size());
+    }
+
+    /// @brief Values to be changed, copied first if a view still uses them.
+    std::pmr::vector<T> &get()
+    {
+        if (this->frozen != TDB_INVALID_ULL || this->values.use_count() > 1) {
+            this->values = std::make_shared<std::pmr::vector<T>>(this->begin(), this->end(),
+                                                                 this->values->get_allocator());
+            this->frozen = TDB_INVALID_ULL;
+        }
+        else {
+            // Pairs with release of the last view on some other thread.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        return *(this->values);
+    }
+
+    /// @brief Adds value after the others, without copying them for views.
+    void push_back(T value)
+    {
+        if (this->frozen != TDB_INVALID_ULL || this->values.use_count() == 1) {
+            this->get().push_back(std::move(value));
+            return;
+        }
+
+        // Views only read values they have, and never the vector itself, so
+        // it can grow in place. When it's full, values are moved elsewhere,
+        // as vector would do, and views keep the old ones.
+        if (this->values->size() == this->values->capacity()) {
+            auto grown = std::make_shared<std::pmr::vector<T>>(this->values->get_allocator());
+
+            grown->reserve(std::max<size_t>(this->values->capacity() * 2, 1));
+            grown->insert(grown->end(), this->values->begin(), this->values->end());
+
+            this->values = std::move(grown);
+        }
+
+        this->values->push_back(std::move(value));
+    }
+};
+
 /**
  * @brief Base class for columns in InMemoryTable table.
  *        This should be casted to appropriate column type.
@@ -78,6 +202,14 @@ public:
     virtual size_t size() const                 = 0;
     virtual void clear()                        = 0;
     virtual void erase(size_t pos)              = 0;
+    /// @brief Memory taken by values of the column.
+    virtual size_t bytes() const                = 0;
+    /// @brief Copy of the column, allocated from the same memory resource.
+    virtual std::shared_ptr<ColumnBase> clone() const = 0;
+    /// @brief Column with values there are now, that shares them with this
+    ///        one instead of copying them. Values added to this column
+    ///        later don't show up in it.
+    virtual std::shared_ptr<ColumnBase> share() const = 0;
 };
 
 /**
@@ -91,67 +223,181 @@ public:
     virtual void add(T data) = 0;
     /// @brief Void pointer to a vector member at 'pos'
     virtual T &get(size_t pos) = 0;
+    /// @brief Sets value at 'pos'. Can be cheaper than writing through get().
+    virtual void set(size_t pos, T value)
+    {
+        this->get(pos) = std::move(value);
+    }
     /// @brief Void pointer to the internal vector.
-    virtual std::vector<T> &get_data() = 0;
+    virtual std::pmr::vector<T> &get_data() = 0;
 };
 
-class ColumnInt : public Column<int>
+class ColumnInt final : public Column<int>
 {
-    std::vector<int> *data;
+    SharedValues<int> data;
     std::string name;
     int type;
 
 public:
-    ColumnInt(std::string name, int type);
-    ~ColumnInt() override;
+    ColumnInt(std::string name, int type,
+              std::pmr::memory_resource *resource = std::pmr::get_default_resource());
     const int &get_type() const override;
     const std::string &get_name() const override;
     size_t size() const override;
     void erase(size_t pos) override;
+    size_t bytes() const override;
+    std::shared_ptr<ColumnBase> clone() const override;
+    std::shared_ptr<ColumnBase> share() const override;
     void clear() override;
     void add(int data) override;
     int &get(size_t pos) override;
-    std::vector<int> &get_data() override;
+    std::pmr::vector<int> &get_data() override;
+    const SharedValues<int> &get_data() const;
+    const int &value(size_t pos) const;
+    /// @brief Calls f(values, count, first) for consecutive blocks of values
+    ///        in [first, end).
+    template <typename F>
+    void for_each_block(size_t first, size_t end, F &&f) const
+    {
+        if (first < end) {
+            f(this->data.data() + first, end - first, first);
+        }
+    }
 };
 
-class ColumnUint : public Column<size_t>
+/**
+ * @brief Column of unsigned integers that can be compressed with pack().
+ *        Values added after pack() are stored as is until next pack().
+ *        get() and set() change packed values without unpacking the rest
+ *        of the column. get_data() unpacks it.
+ */
+class ColumnUint final : public Column<size_t>
 {
-    std::vector<size_t> *data;
+    SharedValues<size_t> data;
+    // Shared between clones, and copied before it's changed while shared.
+    std::shared_ptr<PackedUints> packed;
     std::string name;
     int type;
 
+    PackedUints &own_packed();
+
 public:
-    ColumnUint(const std::string name, int type);
-    ~ColumnUint() override;
+    ColumnUint(const std::string name, int type,
+               std::pmr::memory_resource *resource = std::pmr::get_default_resource());
     const int &get_type() const override;
     const std::string &get_name() const override;
     size_t size() const override;
     void erase(size_t pos) override;
+    size_t bytes() const override;
+    std::shared_ptr<ColumnBase> clone() const override;
+    std::shared_ptr<ColumnBase> share() const override;
     void clear() override;
     void add(size_t data) override;
     size_t &get(size_t pos) override;
-    std::vector<size_t> &get_data() override;
+    void set(size_t pos, size_t value) override;
+    std::pmr::vector<size_t> &get_data() override;
+    /// @brief Compresses the column, if it will take less memory.
+    void pack();
+    /// @brief Decompresses the column back into a vector.
+    void unpack();
+    bool is_packed() const;
+    /// @brief Value at pos, without unpacking the column.
+    size_t value(size_t pos) const;
+    /// @brief Returns pointer to 'count' values starting from 'first'.
+    ///        Points either into the column, or into 'scratch' when values
+    ///        had to be decoded. 'scratch' should fit 'count' values.
+    const size_t *read(size_t first, size_t count, size_t *scratch) const;
+    /// @brief Evaluates predicate on 'count' values starting from 'first',
+    ///        which should be a multiple of TDB_PACK_GROUP.
+    /// @see compare_uints()
+    void compare(size_t first, size_t count, ToiletCompare op, size_t a,
+                 size_t b, uint64_t *out) const;
+    /// @brief Calls f(values, count, first) for consecutive blocks of values
+    ///        in [first, end). Packed values are decoded block by block.
+    template <typename F>
+    void for_each_block(size_t first, size_t end, F &&f) const
+    {
+        if (!this->packed) {
+            if (first < end) {
+                f(this->data.data() + first, end - first, first);
+            }
+            return;
+        }
+
+        size_t scratch[TDB_BLOCK_SIZE];
+
+        while (first < end) {
+            size_t count = std::min<size_t>(TDB_BLOCK_SIZE, end - first);
+            f(this->read(first, count, scratch), count, first);
+            first += count;
+        }
+    }
 };
 
-class ColumnStr : public Column<std::string>
+class ColumnStr final : public Column<std::string>
 {
-    std::vector<std::string> *data;
+    SharedValues<std::string> data;
     std::string name;
     int type;
 
 public:
-    ColumnStr(std::string name, int type);
-    ~ColumnStr() override;
+    ColumnStr(std::string name, int type,
+              std::pmr::memory_resource *resource = std::pmr::get_default_resource());
     const int &get_type() const override;
     const std::string &get_name() const override;
     size_t size() const override;
     void erase(size_t pos) override;
+    size_t bytes() const override;
+    std::shared_ptr<ColumnBase> clone() const override;
+    std::shared_ptr<ColumnBase> share() const override;
     void clear() override;
     void add(std::string data) override;
     std::string &get(size_t pos) override;
-    std::vector<std::string> &get_data() override;
+    std::pmr::vector<std::string> &get_data() override;
+    const SharedValues<std::string> &get_data() const;
+    const std::string &value(size_t pos) const;
+    /// @brief Calls f(values, count, first) for consecutive blocks of values
+    ///        in [first, end).
+    template <typename F>
+    void for_each_block(size_t first, size_t end, F &&f) const
+    {
+        if (first < end) {
+            f(this->data.data() + first, end - first, first);
+        }
+    }
 };
 
+/**
+ * @brief Calls f with column casted to its concrete type, so type is
+ *        resolved once per column instead of once per value.
+ *        f should accept ColumnInt, ColumnUint and ColumnStr.
+ */
+template <typename F>
+decltype(auto) visit_column(ColumnBase &column, F &&f)
+{
+    switch (TDB_TYPE(column.get_type())) {
+        case TT_INT:
+            return f(static_cast<ColumnInt &>(column));
+        case TT_UINT:
+            return f(static_cast<ColumnUint &>(column));
+        default:
+            return f(static_cast<ColumnStr &>(column));
+    }
+}
+
+template <typename F>
+decltype(auto) visit_column(const ColumnBase &column, F &&f)
+{
+    switch (TDB_TYPE(column.get_type())) {
+        case TT_INT:
+            return f(static_cast<const ColumnInt &>(column));
+        case TT_UINT:
+            return f(static_cast<const ColumnUint &>(column));
+        default:
+            return f(static_cast<const ColumnStr &>(column));
+    }
+}
+
 } // namespace toiletdb
 
 #endif // TOILET_TYPES_H_
@@ -0,0 +1,177 @@
+// Checks of library behaviour at edges that are easy to get wrong.
+// Run with 'make test'. Tables are written to the temporary directory.
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "toiletdb.hpp"
+
+using namespace toiletdb;
+
+static int checks   = 0;
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        ++checks;                                                               \
+        if (!(condition)) {                                                     \
+            ++failures;                                                         \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                         #condition);                                           \
+        }                                                                       \
+    } while (0)
+
+static std::string utf8(uint32_t c)
+{
+    std::string out;
+
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    }
+    else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | c >> 6);
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xE0 | c >> 12);
+        out += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+
+    return out;
+}
+
+static bool folds_to(uint32_t c, uint32_t folded)
+{
+    return fold_case(utf8(c)) == utf8(folded);
+}
+
+// Writes a table file with 'rows' after the header, and returns its path.
+static std::string write_table(const std::string &name, const std::string &rows)
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / name;
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file << "tdb1\n|const id uint ID|str Name|uint Number|\n" << rows;
+
+    return path.string();
+}
+
+static void test_fold_case()
+{
+    // Greek capitals with dialytika, past the end of the basic alphabet.
+    CHECK(folds_to(0x3AA, 0x3CA));
+    CHECK(folds_to(0x3AB, 0x3CB));
+    // Latin Extended-B.
+    CHECK(folds_to(0x218, 0x219));
+    CHECK(folds_to(0x21A, 0x21B));
+    CHECK(folds_to(0x1C4, 0x1C6));
+    CHECK(folds_to(0x1C5, 0x1C6));
+    CHECK(folds_to(0x1C6, 0x1C6));
+    CHECK(folds_to(0x1CD, 0x1CE));
+    // Greek symbol variants.
+    CHECK(folds_to(0x3D0, 0x3B2));
+    CHECK(folds_to(0x3D1, 0x3B8));
+    CHECK(folds_to(0x3F5, 0x3B5));
+    // Archaic Greek.
+    CHECK(folds_to(0x370, 0x371));
+    CHECK(folds_to(0x3FD, 0x37B));
+    CHECK(folds_to(0x37F, 0x3F3));
+    // Status S only, full folding would give "ss".
+    CHECK(folds_to(0x1E9E, 0xDF));
+    // Dotted capital I has no simple folding.
+    CHECK(folds_to(0x130, 0x130));
+    CHECK(fold_case("Ș\xFFT") == "ș\xFFt");
+}
+
+static void test_merge_aggregates()
+{
+    // As shards of a table would report them, each fitting on its own.
+    Aggregate<int> a = {2, LLONG_MAX - 10, false, 1, INT_MAX, (LLONG_MAX - 10) / 2.0};
+    Aggregate<int> b = {2, LLONG_MAX - 20, false, 2, INT_MAX, (LLONG_MAX - 20) / 2.0};
+
+    Aggregate<int> both = merge_aggregates(a, b);
+
+    CHECK(both.overflow);
+    CHECK(both.count == 4);
+    CHECK(both.min == 1);
+    // Not taken from the sum, which wrapped around.
+    CHECK(both.avg > LLONG_MAX / 4.0);
+
+    b.sum = -20;
+    CHECK(!merge_aggregates(a, b).overflow);
+    CHECK(merge_aggregates(a, b).sum == LLONG_MAX - 30);
+
+    Aggregate<size_t> c = {1, SIZE_MAX, false, SIZE_MAX, SIZE_MAX, double(SIZE_MAX)};
+
+    CHECK(merge_aggregates(c, c).overflow);
+    CHECK(!merge_aggregates(c, Aggregate<size_t>{0, 0, false, 0, 0, 0}).overflow);
+}
+
+static void test_row_builder_discard()
+{
+    InMemoryTable table(write_table("tdb_tests_builder.tdb", "|1|Ann|5|\n|2|Bob|7|\n"));
+
+    table.set_search_cache(1 << 20);
+    table.search("Name", "A", TS_PREFIX);
+
+    {
+        RowBuilder row(table);
+        row.add("Cid");
+    }
+
+    RowBuilder row(table);
+
+    CHECK(row.add("Dan").add(std::string("Eve")).finish() != 0);
+    CHECK(table.get_row_count() == 2);
+    CHECK(table.get_flush_stats().pending == 0);
+
+    // Nothing changed, so cached result is still good.
+    CHECK(table.search("Name", "A", TS_PREFIX).size() == 1);
+    CHECK(table.get_search_cache_stats().hits == 1);
+}
+
+static void test_unsafe_rows_and_snapshots()
+{
+    InMemoryTable table(write_table("tdb_tests_unsafe.tdb", "|1|Ann|5|\n|2|Bob|7|\n"));
+
+    table.compact();
+
+    std::shared_ptr<const InMemoryTable> before = table.snapshot();
+    std::vector<void *> row                     = table.unsafe_get_mut_row(0);
+    std::shared_ptr<const InMemoryTable> after  = table.snapshot();
+
+    *static_cast<std::string *>(row[1]) = "Zed";
+    *static_cast<size_t *>(row[2])      = 9;
+
+    CHECK(table.get_row_view(0).get<std::string_view>(1) == "Zed");
+    CHECK(table.get_row_view(0).get<size_t>(2) == 9);
+
+    // Snapshots keep values rows had when they were made.
+    CHECK(before->get_row_view(0).get<std::string_view>(1) == "Ann");
+    CHECK(before->get_row_view(0).get<size_t>(2) == 5);
+    CHECK(after->get_row_view(0).get<std::string_view>(1) == "Ann");
+    CHECK(after->get_row_view(0).get<size_t>(2) == 5);
+
+    // And new ones see writes made since.
+    CHECK(table.snapshot()->get_row_view(0).get<std::string_view>(1) == "Zed");
+}
+
+int main()
+{
+    test_fold_case();
+    test_merge_aggregates();
+    test_row_builder_discard();
+    test_unsafe_rows_and_snapshots();
+
+    std::printf("%d checks, %d failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}